@@ -217,14 +217,15 @@ PUBLIC void cs_hash_table_remove(CSOUND* csound,
 
     while (item != NULL) {
         if (strcmp(key, item->key) == 0) {
+            /* unlink the item, keeping the rest of the bucket */
             if (previous == NULL) {
-                hashTable->buckets[index] = NULL;
-                csound->Free(csound, item);
-                return;
+                hashTable->buckets[index] = item->next;
             } else {
                 previous->next = item->next;
-                csound->Free(csound, item);
             }
+            csound->Free(csound, item->key);
+            csound->Free(csound, item);
+            return;
         }
         previous = item;
         item = item->next;
@@ -0,0 +1,1080 @@
+/*
+    csound_orc_cache.c:
+
+    Copyright (C) 2026
+    The Csound Developers
+
+    This file is part of Csound.
+
+    The Csound Library is free software; you can redistribute it
+    and/or modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    Csound is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Csound; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+    02111-1307 USA
+*/
+
+#include <ctype.h>
+#include "csoundCore.h"
+#include "csound_orc.h"
+#include "csound_orc_semantics.h"
+
+extern const char* SYNTHESIZED_ARG;
+
+/* Compiled instrument cache.
+
+   Before the preprocessed orchestra is parsed, it is split into
+   instrument bodies (the lines between instr and endin).  Each body is
+   looked up by a hash of its text and of everything else its compiled
+   form depends on: the UDO signatures declared in the same text, the
+   expression options and the size of MYFLT.  The body of an instrument
+   found in the cache is blanked out, so the parser only sees its
+   header, and after verification and optimisation the empty body is
+   replaced by the cached statement list and local variables.  Other
+   instrument bodies are stored after they have been compiled.
+
+   Entries are kept serialised, with opcodes and types by name, so they
+   survive csoundReset() (which rebuilds the opcode table) and can also
+   be written to and read from a directory (-+orc_cache_dir=DIR) shared
+   between runs.  Line numbers are stored relative to the instr line, so
+   an instrument moved in the file is still found.
+
+   A cached body cannot declare global variables as the parser goes, so
+   the globals it writes first are declared before verification, and
+   the ones it only reads must exist once the rest of the orchestra has
+   been verified.  The body was compiled against the type of each of
+   these globals, which is stored with it: if a global already known
+   has another type, the whole text is parsed without the cache, and if
+   one declared by the rest of the orchestra turns out to have another
+   type, that body alone is compiled from its text after all.  The
+   cache is not used with --num-threads, whose dependency analysis
+   needs every statement to go through the parser. */
+
+#define ORC_CACHE_VERSION   1
+#define ORC_CACHE_MAGIC     0x434F5243  /* also tells the byte order */
+#define ORC_CACHE_MAX       1024        /* instruments kept in memory */
+#define ORC_CACHE_BUCKETS   256
+
+typedef struct orc_cache_entry {
+    uint64_t        hash;
+    char            *text;          /* normalised instrument body */
+    size_t          textLen;
+    unsigned char   *data;          /* serialised statements and variables */
+    size_t          size;
+    uint64_t        lastUsed;
+    struct orc_cache_entry *next;
+} ORC_CACHE_ENTRY;
+
+typedef struct {
+    ORC_CACHE_ENTRY *bucket[ORC_CACHE_BUCKETS];
+    int             count;
+    uint64_t        clock;
+} ORC_CACHE;
+
+typedef struct {
+    size_t          head, tail;     /* instr line to after the endin line */
+    size_t          start, end;     /* body: after the instr line to endin */
+    int             cacheable;
+    uint64_t        hash;
+    char            *text;
+    size_t          textLen;
+    ORC_CACHE_ENTRY *entry;         /* NULL if not cached */
+    TREE            *instr;         /* INSTR_TOKEN node of the parsed tree */
+    TREE            *body;          /* read back from the entry */
+    CS_VAR_POOL     *pool;
+    CS_VARIABLE     *declared;      /* globals the body declares */
+    CS_VARIABLE     *reads;         /* globals it only reads */
+} ORC_CACHE_BLOCK;
+
+struct orc_cache_plan {
+    ORC_CACHE_BLOCK *blocks;
+    int             count, hits;
+    char            *stub;          /* text with cached bodies blanked */
+    char            *text;          /* the text itself, if there are hits */
+    size_t          len;
+};
+
+static ORC_CACHE_ENTRY *orc_cache_find(CSOUND *, ORC_CACHE_BLOCK *);
+
+/* growing output buffer and bounded input buffer */
+typedef struct {
+    unsigned char   *data;
+    size_t          size, cap;
+    int             error;
+} OBUF;
+
+typedef struct {
+    const unsigned char *p, *end;
+    int             error;
+} IBUF;
+
+static uint64_t fnv1a(uint64_t h, const void *p, size_t n)
+{
+    const unsigned char *s = (const unsigned char *) p;
+    while (n--) {
+      h ^= *s++;
+      h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+#define FNV_BASIS   0xcbf29ce484222325ULL
+
+static void put_bytes(OBUF *b, const void *p, size_t n)
+{
+    if (b->error)
+      return;
+    if (b->size + n > b->cap) {
+      size_t cap = (b->cap ? 2 * b->cap : 4096);
+      unsigned char *data;
+      while (cap < b->size + n)
+        cap *= 2;
+      if ((data = realloc(b->data, cap)) == NULL) {
+        b->error = 1;
+        return;
+      }
+      b->data = data;
+      b->cap = cap;
+    }
+    memcpy(b->data + b->size, p, n);
+    b->size += n;
+}
+
+static void put_i32(OBUF *b, int32_t v)  { put_bytes(b, &v, sizeof(v)); }
+static void put_u64(OBUF *b, uint64_t v) { put_bytes(b, &v, sizeof(v)); }
+static void put_f64(OBUF *b, double v)   { put_bytes(b, &v, sizeof(v)); }
+
+static void put_str(OBUF *b, const char *s)
+{
+    if (s == NULL) {
+      put_i32(b, -1);
+      return;
+    }
+    put_i32(b, (int32_t) strlen(s));
+    put_bytes(b, s, strlen(s));
+}
+
+static void get_bytes(IBUF *b, void *p, size_t n)
+{
+    if (b->error || (size_t) (b->end - b->p) < n) {
+      b->error = 1;
+      memset(p, 0, n);
+      return;
+    }
+    memcpy(p, b->p, n);
+    b->p += n;
+}
+
+static int32_t get_i32(IBUF *b)
+{
+    int32_t v;
+    get_bytes(b, &v, sizeof(v));
+    return v;
+}
+
+static uint64_t get_u64(IBUF *b)
+{
+    uint64_t v;
+    get_bytes(b, &v, sizeof(v));
+    return v;
+}
+
+static double get_f64(IBUF *b)
+{
+    double v;
+    get_bytes(b, &v, sizeof(v));
+    return v;
+}
+
+/* returns a csound->Malloc'ed copy, or NULL */
+static char *get_str(CSOUND *csound, IBUF *b)
+{
+    int32_t n = get_i32(b);
+    char    *s;
+
+    if (n < 0 || b->error)
+      return NULL;
+    if ((size_t) (b->end - b->p) < (size_t) n) {
+      b->error = 1;
+      return NULL;
+    }
+    s = csound->Malloc(csound, n + 1);
+    memcpy(s, b->p, n);
+    s[n] = '\0';
+    b->p += n;
+    return s;
+}
+
+static int same_str(const char *a, const char *b)
+{
+    return (a == NULL ? b == NULL : (b != NULL && !strcmp(a, b)));
+}
+
+/* ---------------------------------------------------------------------
+   splitting the preprocessed text                                       */
+
+static int is_word(const char *p, const char *end, const char *w)
+{
+    size_t n = strlen(w);
+    return ((size_t) (end - p) >= n && !strncmp(p, w, n) &&
+            (p + n == end || !(isalnum((unsigned char) p[n]) || p[n] == '_')));
+}
+
+/* blanks out lines, keeping the newlines and directives so that line
+   numbers still match */
+static void blank_lines(char *s, char *e)
+{
+    for (; s < e; s++) {
+      char *t = s;
+      while (t < e && (*t == ' ' || *t == '\t'))
+        t++;
+      if (!strncmp(t, "#line", 5) || !strncmp(t, "#source", 7)) {
+        while (s < e && *s != '\n')
+          s++;
+        continue;
+      }
+      for (; s < e && *s != '\n'; s++)
+        *s = ' ';
+    }
+}
+
+static void append_text(CSOUND *csound, ORC_CACHE_BLOCK *blk,
+                        const char *s, size_t n, size_t *cap)
+{
+    if (blk->textLen + n + 1 > *cap) {
+      *cap = 2 * (blk->textLen + n + 1);
+      blk->text = csound->ReAlloc(csound, blk->text, *cap);
+    }
+    memcpy(blk->text + blk->textLen, s, n);
+    blk->textLen += n;
+    blk->text[blk->textLen] = '\0';
+}
+
+ORC_CACHE_PLAN *csound_orc_cache_plan(CSOUND *csound,
+                                      const char *text, size_t len)
+{
+    ORC_CACHE_PLAN  *plan;
+    ORC_CACHE_BLOCK *blk = NULL;
+    const char      *p = text, *end = text + len;
+    enum { IN_TOP, IN_INSTR, IN_UDO } state = IN_TOP;
+    int             xstr = 0, line = 0, headerLine = 0, alloc = 0, i;
+    size_t          cap = 0;
+    uint64_t        salt = FNV_BASIS;
+    int32_t         opts[3];
+
+    if (!csound->orc_cache || csound->oparms->numThreads > 1 ||
+        text == NULL)
+      return NULL;
+
+    plan = csound->Calloc(csound, sizeof(ORC_CACHE_PLAN));
+    while (p < end && *p != '\0') {
+      const char *eol = p, *q = p;
+      int         instring = 0;
+
+      /* find the end of the line, following strings */
+      while (eol < end && *eol != '\0' && (*eol != '\n' || xstr)) {
+        if (xstr) {
+          if (eol[0] == '}' && eol + 1 < end && eol[1] == '}')
+            xstr = 0, eol++;
+        }
+        else if (instring) {
+          if (*eol == '\\' && eol + 1 < end) eol++;
+          else if (*eol == '"') instring = 0;
+        }
+        else if (*eol == '"') instring = 1;
+        else if (eol[0] == '{' && eol + 1 < end && eol[1] == '{')
+          xstr = 1, eol++;
+        if (*eol == '\n') line++;
+        eol++;
+      }
+      size_t      n;
+
+      while (q < eol && (*q == ' ' || *q == '\t'))
+        q++;
+      n = (eol - p) + (eol < end && *eol == '\n');
+
+      /* #line directives are kept relative to the instr line */
+      if (is_word(q, eol, "#line")) {
+        int l = atoi(q + 5);
+        if (state == IN_INSTR) {
+          char buf[32];
+          snprintf(buf, 32, "#line %+d\n", l - headerLine);
+          append_text(csound, blk, buf, strlen(buf), &cap);
+        }
+        line = l - 1;
+      }
+      else if (state == IN_TOP && is_word(q, eol, "instr")) {
+        const char *last = eol;
+        if (plan->count == alloc) {
+          alloc = (alloc ? 2 * alloc : 16);
+          plan->blocks = csound->ReAlloc(csound, plan->blocks,
+                                         alloc * sizeof(ORC_CACHE_BLOCK));
+        }
+        blk = &plan->blocks[plan->count++];
+        memset(blk, 0, sizeof(ORC_CACHE_BLOCK));
+        blk->head = p - text;
+        blk->start = (eol - text) + 1;
+        /* a header continued on the next line is not split off */
+        while (last > q && (last[-1] == ' ' || last[-1] == '\t'))
+          last--;
+        blk->cacheable = (last[-1] != '\\');
+        headerLine = line;
+        cap = 0;
+        state = IN_INSTR;
+      }
+      else if (state == IN_TOP && is_word(q, eol, "opcode")) {
+        salt = fnv1a(salt, q, eol - q);
+        state = IN_UDO;
+      }
+      else if (state == IN_INSTR && is_word(q, eol, "endin")) {
+        blk->end = p - text;
+        blk->tail = blk->end + n;
+        state = IN_TOP;
+      }
+      else if (state == IN_UDO && is_word(q, eol, "endop"))
+        state = IN_TOP;
+      else if (is_word(q, eol, "instr") || is_word(q, eol, "opcode") ||
+               is_word(q, eol, "endin") || is_word(q, eol, "endop")) {
+        state = IN_INSTR;                  /* unbalanced: give up */
+        break;
+      }
+      else if (state == IN_INSTR)
+        append_text(csound, blk, p, n, &cap);
+
+      line++;
+      p = eol + 1;
+    }
+    if (state != IN_TOP || xstr || plan->count == 0) {
+      csound_orc_cache_free(csound, plan);
+      return NULL;
+    }
+
+    opts[0] = ORC_CACHE_VERSION;
+    opts[1] = (int32_t) sizeof(MYFLT);
+    opts[2] = csound->expr_opt;
+    salt = fnv1a(salt, opts, sizeof(opts));
+    for (i = 0; i < plan->count; i++) {
+      blk = &plan->blocks[i];
+      if (!blk->cacheable || blk->text == NULL)
+        continue;
+      blk->hash = fnv1a(salt, blk->text, blk->textLen);
+      if ((blk->entry = orc_cache_find(csound, blk)) != NULL)
+        plan->hits++;
+    }
+    if (plan->hits) {
+      plan->stub = csound->Malloc(csound, len);
+      memcpy(plan->stub, text, len);
+      for (i = 0; i < plan->count; i++) {
+        blk = &plan->blocks[i];
+        if (blk->entry != NULL)
+          blank_lines(plan->stub + blk->start, plan->stub + blk->end);
+      }
+      plan->text = csound->Malloc(csound, len);
+      memcpy(plan->text, text, len);
+      plan->len = len;
+    }
+    return plan;
+}
+
+char *csound_orc_cache_stub(ORC_CACHE_PLAN *plan)
+{
+    return (plan != NULL ? plan->stub : NULL);
+}
+
+/* ---------------------------------------------------------------------
+   in memory and on disk                                                 */
+
+static ORC_CACHE *get_cache(CSOUND *csound)
+{
+    if (csound->orcCache == NULL)
+      csound->orcCache = calloc(1, sizeof(ORC_CACHE));
+    return (ORC_CACHE *) csound->orcCache;
+}
+
+static const char *cache_dir(CSOUND *csound)
+{
+    const char *dir = csoundQueryGlobalVariable(csound, "_ORC_CACHE_DIR");
+    return (dir != NULL && *dir != '\0' ? dir : NULL);
+}
+
+static void free_entry(ORC_CACHE_ENTRY *e)
+{
+    free(e->text);
+    free(e->data);
+    free(e);
+}
+
+static ORC_CACHE_ENTRY *lookup_entry(ORC_CACHE *c, ORC_CACHE_BLOCK *blk)
+{
+    ORC_CACHE_ENTRY *e;
+
+    for (e = c->bucket[blk->hash % ORC_CACHE_BUCKETS]; e != NULL; e = e->next)
+      if (e->hash == blk->hash && e->textLen == blk->textLen &&
+          !memcmp(e->text, blk->text, blk->textLen))
+        return e;
+    return NULL;
+}
+
+static void insert_entry(ORC_CACHE *c, ORC_CACHE_ENTRY *e)
+{
+    ORC_CACHE_ENTRY **pp;
+    int     i;
+
+    if (c->count >= ORC_CACHE_MAX) {       /* drop the least recently used */
+      ORC_CACHE_ENTRY **oldest = NULL;
+      for (i = 0; i < ORC_CACHE_BUCKETS; i++)
+        for (pp = &c->bucket[i]; *pp != NULL; pp = &(*pp)->next)
+          if (oldest == NULL || (*pp)->lastUsed < (*oldest)->lastUsed)
+            oldest = pp;
+      if (oldest != NULL) {
+        ORC_CACHE_ENTRY *old = *oldest;
+        *oldest = old->next;
+        free_entry(old);
+        c->count--;
+      }
+    }
+    e->lastUsed = ++c->clock;
+    e->next = c->bucket[e->hash % ORC_CACHE_BUCKETS];
+    c->bucket[e->hash % ORC_CACHE_BUCKETS] = e;
+    c->count++;
+}
+
+typedef struct {
+    int32_t     magic, version, myfltSize, csoundVersion;
+    uint64_t    hash, textLen, size;
+} ORC_CACHE_HEADER;
+
+static void cache_path(char *buf, size_t n, const char *dir, uint64_t hash)
+{
+    snprintf(buf, n, "%s%c%016llx.csorc", dir, DIRSEP,
+             (unsigned long long) hash);
+}
+
+static ORC_CACHE_ENTRY *read_entry(CSOUND *csound, const char *dir,
+                                   ORC_CACHE_BLOCK *blk)
+{
+    char    path[1024];
+    FILE    *f;
+    ORC_CACHE_HEADER h;
+    ORC_CACHE_ENTRY *e = NULL;
+
+    cache_path(path, 1024, dir, blk->hash);
+    if ((f = fopen(path, "rb")) == NULL)
+      return NULL;
+    if (fread(&h, sizeof(h), 1, f) == 1 && h.magic == ORC_CACHE_MAGIC &&
+        h.version == ORC_CACHE_VERSION && h.myfltSize == sizeof(MYFLT) &&
+        h.csoundVersion == csoundGetVersion() && h.hash == blk->hash &&
+        h.textLen == blk->textLen && h.size < ((uint64_t) 1 << 31) &&
+        (e = calloc(1, sizeof(ORC_CACHE_ENTRY))) != NULL) {
+      e->hash = h.hash;
+      e->textLen = h.textLen;
+      e->size = h.size;
+      e->text = malloc(e->textLen + 1);
+      e->data = malloc(e->size);
+      if (e->text == NULL || e->data == NULL ||
+          fread(e->text, 1, e->textLen, f) != e->textLen ||
+          fread(e->data, 1, e->size, f) != e->size ||
+          memcmp(e->text, blk->text, blk->textLen)) {
+        free_entry(e);
+        e = NULL;
+      }
+      else
+        e->text[e->textLen] = '\0';
+    }
+    fclose(f);
+    return e;
+}
+
+/* written under a temporary name and renamed, so that other processes
+   sharing the directory never see a partial file */
+static void write_entry(CSOUND *csound, const char *dir, ORC_CACHE_ENTRY *e)
+{
+    char    path[1024], tmp[1100];
+    FILE    *f;
+    ORC_CACHE_HEADER h;
+    int     ok;
+
+    cache_path(path, 1024, dir, e->hash);
+    snprintf(tmp, 1100, "%s.%08x", path,
+             (unsigned int) csoundGetRandomSeedFromTime());
+    if ((f = fopen(tmp, "wb")) == NULL) {
+      csound->Warning(csound, Str("cannot write orchestra cache file %s"),
+                      tmp);
+      return;
+    }
+    memset(&h, 0, sizeof(h));
+    h.magic = ORC_CACHE_MAGIC;
+    h.version = ORC_CACHE_VERSION;
+    h.myfltSize = sizeof(MYFLT);
+    h.csoundVersion = csoundGetVersion();
+    h.hash = e->hash;
+    h.textLen = e->textLen;
+    h.size = e->size;
+    ok = (fwrite(&h, sizeof(h), 1, f) == 1 &&
+          fwrite(e->text, 1, e->textLen, f) == e->textLen &&
+          fwrite(e->data, 1, e->size, f) == e->size);
+    ok = (fclose(f) == 0 && ok);
+    if (!ok || rename(tmp, path) != 0)
+      remove(tmp);
+}
+
+static ORC_CACHE_ENTRY *orc_cache_find(CSOUND *csound, ORC_CACHE_BLOCK *blk)
+{
+    ORC_CACHE       *c = get_cache(csound);
+    ORC_CACHE_ENTRY *e;
+    const char      *dir;
+
+    if (c == NULL)
+      return NULL;
+    if ((e = lookup_entry(c, blk)) != NULL)
+      e->lastUsed = ++c->clock;
+    else if ((dir = cache_dir(csound)) != NULL &&
+             (e = read_entry(csound, dir, blk)) != NULL)
+      insert_entry(c, e);
+    return e;
+}
+
+/* ---------------------------------------------------------------------
+   serialisation                                                         */
+
+static OENTRY *find_entry(CSOUND *csound, char *opname,
+                          char *outypes, char *intypes)
+{
+    char      *shortName = get_opcode_short_name(csound, opname);
+    CONS_CELL *head = cs_hash_table_get(csound, csound->opcodes, shortName);
+    OENTRY    *ep = NULL;
+
+    for (; head != NULL; head = head->next) {
+      OENTRY *e = (OENTRY *) head->value;
+      if (!strcmp(e->opname, opname) && same_str(e->outypes, outypes) &&
+          same_str(e->intypes, intypes)) {
+        ep = e;
+        break;
+      }
+    }
+    if (shortName != opname)
+      csound->Free(csound, shortName);
+    return ep;
+}
+
+static void put_variable(OBUF *b, CS_VARIABLE *var)
+{
+    put_str(b, var->varName);
+    put_str(b, var->varType->varTypeName);
+    put_i32(b, var->dimensions);
+    put_str(b, var->subType != NULL ? var->subType->varTypeName : NULL);
+}
+
+static CS_VARIABLE *get_variable(CSOUND *csound, IBUF *b)
+{
+    char    *name = get_str(csound, b), *typeName = get_str(csound, b);
+    int     dimensions = get_i32(b);
+    char    *subName = get_str(csound, b);
+    CS_TYPE *type = NULL;
+    CS_VARIABLE *var = NULL;
+    ARRAY_VAR_INIT varInit;
+    void    *typeArg = NULL;
+
+    if (!b->error && name != NULL && typeName != NULL)
+      type = csoundGetTypeWithVarTypeName(csound->typePool, typeName);
+    if (type != NULL && subName != NULL) {
+      varInit.dimensions = dimensions;
+      varInit.type = csoundGetTypeWithVarTypeName(csound->typePool, subName);
+      typeArg = &varInit;
+      if (varInit.type == NULL)
+        type = NULL;
+    }
+    if (type != NULL)
+      var = csoundCreateVariable(csound, csound->typePool, type,
+                                 name, typeArg);
+    if (var == NULL)
+      b->error = 1;
+    if (name != NULL) csound->Free(csound, name);
+    if (typeName != NULL) csound->Free(csound, typeName);
+    if (subName != NULL) csound->Free(csound, subName);
+    return var;
+}
+
+static void free_variable(CSOUND *csound, CS_VARIABLE *var)
+{
+    csound->Free(csound, var->varName);
+    csound->Free(csound, var);
+}
+
+static int same_type(CS_VARIABLE *a, CS_VARIABLE *b)
+{
+    return (!strcmp(a->varType->varTypeName, b->varType->varTypeName) &&
+            a->dimensions == b->dimensions &&
+            (a->subType == NULL ? b->subType == NULL :
+             (b->subType != NULL &&
+              !strcmp(a->subType->varTypeName, b->subType->varTypeName))));
+}
+
+/* the global of that name as the orchestra now has it, or NULL */
+static CS_VARIABLE *live_global(CSOUND *csound, TYPE_TABLE *typeTable,
+                                const char *name)
+{
+    CS_VARIABLE *var = csoundFindVariableWithName(csound,
+                                                  typeTable->globalPool, name);
+    if (var == NULL)
+      var = csoundFindVariableWithName(csound, csound->engineState.varPool,
+                                       name);
+    return var;
+}
+
+/* returns 0 if any of the globals in the list is known with another type */
+static int globals_match(CSOUND *csound, TYPE_TABLE *typeTable,
+                         CS_VARIABLE *list)
+{
+    CS_VARIABLE *var, *live;
+
+    for (var = list; var != NULL; var = var->next)
+      if ((live = live_global(csound, typeTable, var->varName)) != NULL &&
+          !same_type(var, live))
+        return 0;
+    return 1;
+}
+
+/* Statements keep their OENTRY in markup, and arguments may be marked
+   as optional ones filled in by the compiler; anything else cannot be
+   stored. */
+static int put_tree(OBUF *b, TREE *t, int statement,
+                    int line0, uint64_t locn0)
+{
+    for (; t != NULL; t = t->next) {
+      int32_t kind = 0;
+
+      if (t->markup == (void *) &SYNTHESIZED_ARG)
+        kind = 2;
+      else if (t->markup != NULL) {
+        if (!statement || t->type == LABEL_TOKEN)
+          return 0;
+        kind = 1;
+      }
+      put_i32(b, 1);
+      put_i32(b, t->type);
+      put_i32(b, t->rate);
+      put_i32(b, t->len);
+      put_i32(b, t->line - line0);
+      put_i32(b, t->locn != locn0);
+      if (t->locn != locn0)
+        put_u64(b, t->locn);
+      put_i32(b, t->value != NULL);
+      if (t->value != NULL) {
+        put_i32(b, t->value->type);
+        put_str(b, t->value->lexeme);
+        put_i32(b, t->value->value);
+        put_f64(b, t->value->fvalue);
+        put_str(b, t->value->optype);
+      }
+      put_i32(b, kind);
+      if (kind == 1) {
+        OENTRY *ep = (OENTRY *) t->markup;
+        put_str(b, ep->opname);
+        put_str(b, ep->outypes);
+        put_str(b, ep->intypes);
+      }
+      if (!put_tree(b, t->left, 0, line0, locn0) ||
+          !put_tree(b, t->right, 0, line0, locn0))
+        return 0;
+    }
+    put_i32(b, 0);
+    return 1;
+}
+
+static TREE *get_tree(CSOUND *csound, IBUF *b, int line0, uint64_t locn0)
+{
+    TREE    *first = NULL, *last = NULL, *t;
+
+    while (!b->error && get_i32(b) == 1) {
+      t = (TREE *) csound->Calloc(csound, sizeof(TREE));
+      if (first == NULL) first = t;
+      else last->next = t;
+      last = t;
+      t->type = get_i32(b);
+      t->rate = get_i32(b);
+      t->len = get_i32(b);
+      t->line = line0 + get_i32(b);
+      t->locn = (get_i32(b) ? get_u64(b) : locn0);
+      if (get_i32(b)) {
+        t->value = (ORCTOKEN *) csound->Calloc(csound, sizeof(ORCTOKEN));
+        t->value->type = get_i32(b);
+        t->value->lexeme = get_str(csound, b);
+        t->value->value = get_i32(b);
+        t->value->fvalue = get_f64(b);
+        t->value->optype = get_str(csound, b);
+      }
+      switch (get_i32(b)) {
+      case 0:
+        break;
+      case 1: {
+        char *opname = get_str(csound, b);
+        char *outypes = get_str(csound, b), *intypes = get_str(csound, b);
+        if (opname != NULL)
+          t->markup = find_entry(csound, opname, outypes, intypes);
+        if (t->markup == NULL)
+          b->error = 1;           /* opcode no longer available */
+        if (opname != NULL) csound->Free(csound, opname);
+        if (outypes != NULL) csound->Free(csound, outypes);
+        if (intypes != NULL) csound->Free(csound, intypes);
+        break;
+      }
+      case 2:
+        t->markup = (void *) &SYNTHESIZED_ARG;
+        break;
+      default:
+        b->error = 1;
+      }
+      t->left = get_tree(csound, b, line0, locn0);
+      t->right = get_tree(csound, b, line0, locn0);
+    }
+    return first;
+}
+
+typedef struct {
+    char    *name;
+    int     declared;           /* first use writes it */
+} GLOBAL_USE;
+
+typedef struct {
+    GLOBAL_USE  *use;
+    int         count, alloc;
+} GLOBAL_USES;
+
+static void note_globals(CSOUND *csound, GLOBAL_USES *g, TREE *t, int writing)
+{
+    int     i;
+
+    for (; t != NULL; t = t->next) {
+      if ((t->type == T_IDENT || t->type == T_ARRAY_IDENT) &&
+          t->value != NULL && t->value->lexeme != NULL &&
+          t->value->lexeme[0] == 'g') {
+        for (i = 0; i < g->count && strcmp(g->use[i].name, t->value->lexeme);
+             i++)
+          ;
+        if (i == g->count) {
+          if (g->count == g->alloc) {
+            g->alloc = (g->alloc ? 2 * g->alloc : 16);
+            g->use = csound->ReAlloc(csound, g->use,
+                                     g->alloc * sizeof(GLOBAL_USE));
+          }
+          g->use[i].name = t->value->lexeme;
+          g->use[i].declared = writing;
+          g->count++;
+        }
+      }
+      /* indices of an array element written are read */
+      note_globals(csound, g, t->left, 0);
+      note_globals(csound, g, t->right, 0);
+    }
+}
+
+static void store_block(CSOUND *csound, ORC_CACHE_BLOCK *blk,
+                        TYPE_TABLE *typeTable)
+{
+    ORC_CACHE       *c = get_cache(csound);
+    ORC_CACHE_ENTRY *e;
+    CS_VAR_POOL     *pool = (CS_VAR_POOL *) blk->instr->markup;
+    CS_VARIABLE     *var;
+    GLOBAL_USES     g;
+    OBUF            b;
+    TREE            *s;
+    const char      *dir;
+    int             i, n, ok = 1;
+
+    if (c == NULL || pool == NULL || lookup_entry(c, blk) != NULL)
+      return;
+    memset(&g, 0, sizeof(GLOBAL_USES));
+    memset(&b, 0, sizeof(OBUF));
+    for (s = blk->instr->right; s != NULL; s = s->next) {
+      if (s->type == LABEL_TOKEN)
+        continue;
+      note_globals(csound, &g, s->right, 0);
+      note_globals(csound, &g, s->left, 1);
+    }
+
+    for (n = 0, var = pool->head; var != NULL; var = var->next)
+      n++;
+    put_i32(&b, n);
+    put_i32(&b, pool->synthArgCount);
+    for (var = pool->head; var != NULL; var = var->next)
+      put_variable(&b, var);
+    put_i32(&b, g.count);
+    for (i = 0; i < g.count && ok; i++) {
+      var = csoundFindVariableWithName(csound, typeTable->globalPool,
+                                       g.use[i].name);
+      if (var == NULL)
+        var = csoundFindVariableWithName(csound, csound->engineState.varPool,
+                                         g.use[i].name);
+      if ((ok = (var != NULL))) {
+        put_i32(&b, g.use[i].declared);
+        put_variable(&b, var);
+      }
+    }
+    if (ok)
+      ok = put_tree(&b, blk->instr->right, 1,
+                    blk->instr->line, blk->instr->locn);
+    if (g.use != NULL)
+      csound->Free(csound, g.use);
+
+    if (!ok || b.error || (e = calloc(1, sizeof(ORC_CACHE_ENTRY))) == NULL) {
+      free(b.data);
+      return;
+    }
+    e->hash = blk->hash;
+    e->textLen = blk->textLen;
+    e->text = malloc(blk->textLen + 1);
+    if (e->text == NULL) {
+      free(b.data);
+      free(e);
+      return;
+    }
+    memcpy(e->text, blk->text, blk->textLen + 1);
+    e->data = b.data;
+    e->size = b.size;
+    insert_entry(c, e);
+    if ((dir = cache_dir(csound)) != NULL)
+      write_entry(csound, dir, e);
+}
+
+/* reads the statements and variables of a cached body; the globals it
+   declares are kept aside until every cached body has been read */
+static int read_block(CSOUND *csound, ORC_CACHE_BLOCK *blk)
+{
+    IBUF        b;
+    CS_VARIABLE *var;
+    int         i, n, synth;
+
+    b.p = blk->entry->data;
+    b.end = b.p + blk->entry->size;
+    b.error = 0;
+    blk->pool = csoundCreateVarPool(csound);
+    n = get_i32(&b);
+    synth = get_i32(&b);
+    for (i = 0; i < n && !b.error; i++)
+      if ((var = get_variable(csound, &b)) != NULL)
+        csoundAddVariable(csound, blk->pool, var);
+    blk->pool->synthArgCount = synth;
+
+    n = get_i32(&b);
+    if (b.error || n < 0 || (size_t) n > blk->entry->size)
+      return 0;
+    for (i = 0; i < n && !b.error; i++) {
+      int declared = get_i32(&b);
+      if ((var = get_variable(csound, &b)) == NULL)
+        break;
+      if (declared) {
+        var->next = blk->declared;
+        blk->declared = var;
+      }
+      else {
+        var->next = blk->reads;
+        blk->reads = var;
+      }
+    }
+    blk->body = get_tree(csound, &b, blk->instr->line, blk->instr->locn);
+    return (!b.error && b.p == b.end);
+}
+
+/* ---------------------------------------------------------------------
+   around verification                                                   */
+
+/* Called on the parsed tree before verification: matches the instr
+   nodes to the split text, reads the cached bodies back and declares
+   the globals they introduce.  Returns 0 if the tree does not match,
+   in which case the text has to be parsed without the cache. */
+int csound_orc_cache_prepare(CSOUND *csound, ORC_CACHE_PLAN *plan,
+                             TREE *root, TYPE_TABLE *typeTable)
+{
+    ORC_CACHE_BLOCK *blk;
+    CS_VARIABLE     *var;
+    TREE            *t;
+    int             i = 0;
+
+    for (t = root; t != NULL; t = t->next)
+      if (t->type == INSTR_TOKEN) {
+        if (i == plan->count ||
+            (plan->blocks[i].entry != NULL && t->right != NULL))
+          return 0;
+        plan->blocks[i++].instr = t;
+      }
+    if (i != plan->count)
+      return 0;
+    for (i = 0; i < plan->count; i++)
+      if (plan->blocks[i].entry != NULL &&
+          !read_block(csound, &plan->blocks[i]))
+        return 0;
+
+    /* nothing is declared until every body has been checked, as the
+       text may still have to be parsed without the cache */
+    for (i = 0; i < plan->count; i++) {
+      blk = &plan->blocks[i];
+      if (!globals_match(csound, typeTable, blk->reads) ||
+          !globals_match(csound, typeTable, blk->declared))
+        return 0;
+      for (var = blk->declared; var != NULL; var = var->next) {
+        int j;
+        for (j = 0; j < i; j++) {
+          CS_VARIABLE *v;
+          for (v = plan->blocks[j].declared; v != NULL; v = v->next)
+            if (!strcmp(v->varName, var->varName) && !same_type(v, var))
+              return 0;
+        }
+      }
+    }
+    for (i = 0; i < plan->count; i++) {
+      blk = &plan->blocks[i];
+      while ((var = blk->declared) != NULL) {
+        blk->declared = var->next;
+        var->next = NULL;
+        if (csoundFindVariableWithName(csound, typeTable->globalPool,
+                                       var->varName) == NULL)
+          csoundAddVariable(csound, typeTable->globalPool, var);
+        else
+          free_variable(csound, var);
+      }
+    }
+    return 1;
+}
+
+extern TREE* verify_tree(CSOUND *, TREE *, TYPE_TABLE *);
+extern TREE* csound_orc_optimize(CSOUND *, TREE *, TYPE_TABLE *);
+
+/* Compiles the body of a cached instrument from its text after all: the
+   text is parsed with everything but the instrument blanked out, and
+   verified against the globals of the orchestra as it is now. */
+static int recompile_block(CSOUND *csound, ORC_CACHE_PLAN *plan,
+                           ORC_CACHE_BLOCK *blk, TYPE_TABLE *typeTable)
+{
+    char    *text = csound->Malloc(csound, plan->len);
+    TREE    *tree = NULL, *t;
+    int     ok = 0;
+
+    memcpy(text, plan->text, plan->len);
+    blank_lines(text, text + blk->head);
+    blank_lines(text + blk->tail, text + plan->len);
+    if (parse_orc_text(csound, text, plan->len, &tree) == 0) {
+      for (t = tree; t != NULL && t->type != INSTR_TOKEN; t = t->next)
+        ;
+      if (t != NULL && t->next == NULL &&
+          verify_tree(csound, t, typeTable) != NULL && !csound->synterrcnt) {
+        csound_orc_optimize(csound, t, typeTable);
+        csoundFreeVarPool(csound, (CS_VAR_POOL *) blk->instr->markup);
+        blk->instr->markup = t->markup;
+        blk->instr->right = t->right;
+        t->markup = NULL;
+        t->right = NULL;
+        ok = 1;
+      }
+    }
+    csoundDeleteTree(csound, tree);
+    csound->Free(csound, text);
+    return ok;
+}
+
+/* Called after verification and optimisation: puts the cached bodies
+   in place of the empty ones and stores the others. */
+int csound_orc_cache_finish(CSOUND *csound, ORC_CACHE_PLAN *plan,
+                            TREE *root, TYPE_TABLE *typeTable)
+{
+    ORC_CACHE_BLOCK *blk;
+    CS_VARIABLE     *var, *live;
+    int             i, err = 0, stale;
+
+    (void) root;
+    for (i = 0; i < plan->count; i++) {
+      blk = &plan->blocks[i];
+      if (blk->instr == NULL)
+        continue;
+      if (blk->entry != NULL) {
+        stale = 0;
+        for (var = blk->reads; var != NULL; var = var->next)
+          if ((live = live_global(csound, typeTable, var->varName)) == NULL) {
+            synterr(csound, Str("Variable '%s' used before defined\n"),
+                    var->varName);
+            err++;
+          }
+          else if (!same_type(var, live))
+            stale = 1;
+        if (stale) {
+          /* compiled against a global that now has another type */
+          plan->hits--;
+          if (!recompile_block(csound, plan, blk, typeTable))
+            err++;
+          continue;
+        }
+        csoundFreeVarPool(csound, (CS_VAR_POOL *) blk->instr->markup);
+        blk->instr->markup = blk->pool;
+        blk->instr->right = blk->body;
+        blk->pool = NULL;
+        blk->body = NULL;
+      }
+      else if (blk->cacheable && blk->text != NULL)
+        store_block(csound, blk, typeTable);
+    }
+    if (csound->oparms->msglevel & TIMEMSG)
+      csound->Message(csound,
+                      Str("orchestra cache: %d of %d instruments reused\n"),
+                      plan->hits, plan->count);
+    return (err ? CSOUND_ERROR : CSOUND_SUCCESS);
+}
+
+void csound_orc_cache_free(CSOUND *csound, ORC_CACHE_PLAN *plan)
+{
+    ORC_CACHE_BLOCK *blk;
+    CS_VARIABLE     *var;
+    int             i;
+
+    if (plan == NULL)
+      return;
+    for (i = 0; i < plan->count; i++) {
+      blk = &plan->blocks[i];
+      if (blk->text != NULL)
+        csound->Free(csound, blk->text);
+      if (blk->body != NULL)
+        csoundDeleteTree(csound, blk->body);
+      if (blk->pool != NULL)
+        csoundFreeVarPool(csound, blk->pool);
+      while ((var = blk->declared) != NULL) {
+        blk->declared = var->next;
+        free_variable(csound, var);
+      }
+      while ((var = blk->reads) != NULL) {
+        blk->reads = var->next;
+        free_variable(csound, var);
+      }
+    }
+    if (plan->blocks != NULL)
+      csound->Free(csound, plan->blocks);
+    if (plan->stub != NULL)
+      csound->Free(csound, plan->stub);
+    if (plan->text != NULL)
+      csound->Free(csound, plan->text);
+    csound->Free(csound, plan);
+}
+
+/* the cache outlives csoundReset(), so it is only freed here */
+void csound_orc_cache_destroy(CSOUND *csound)
+{
+    ORC_CACHE       *c = (ORC_CACHE *) csound->orcCache;
+    ORC_CACHE_ENTRY *e;
+    int             i;
+
+    if (c == NULL)
+      return;
+    for (i = 0; i < ORC_CACHE_BUCKETS; i++)
+      while ((e = c->bucket[i]) != NULL) {
+        c->bucket[i] = e->next;
+        free_entry(e);
+      }
+    free(c);
+    csound->orcCache = NULL;
+}
@@ -36,6 +36,7 @@
 //#include "typetabl.h"
 #include "csound_standard_types.h"
 #include "csound_orc_semantics.h"
+#include "envvar.h"
 
 static const char* INSTR_NAME_FIRST = "::^inm_first^::";
 static  ARG* createArg(CSOUND *csound, INSTRTXT* ip,
@@ -751,6 +752,140 @@ int tree_contains_fn_p(CSOUND *csound, TREE* t)
     return 0;
 }
 
+/* returns the number N of a synthetic audio variable #aN, or -1 */
+static int synth_asig_number(CS_VAR_POOL *pool, const char *s)
+{
+    const char *t;
+    int n;
+
+    if (s[0] != '#' || s[1] != 'a' || s[2] == '\0')
+      return -1;
+    for (t = s + 2; *t != '\0'; t++)
+      if (!isdigit((unsigned char) *t))
+        return -1;
+    n = atoi(s + 2);
+    return (n < pool->synthArgCount ? n : -1);
+}
+
+static int64_t var_pool_bytes(CS_VAR_POOL *pool)
+{
+    CS_VARIABLE *var;
+    int64_t     bytes = 0;
+
+    for (var = pool->head; var != NULL; var = var->next)
+      bytes += CS_VAR_TYPE_OFFSET + var->memBlockSize;
+    return bytes;
+}
+
+/**
+ * Audio temporaries created by expression expansion (#a0, #a1, ...) are
+ * only live from the statement that writes them to the last one that
+ * reads them.  Temporaries whose live ranges do not overlap are given
+ * the same variable, so that an instrument only needs as many audio
+ * buffers for them as are live at the same time.  A range containing a
+ * label, or a temporary read before it is written, is left alone, as
+ * control could then enter the range without passing the write.
+ */
+static void coalesce_temporaries(CSOUND *csound, INSTRTXT *ip,
+                                 ENGINE_STATE *engineState,
+                                 const char *name)
+{
+    CS_VAR_POOL *pool = ip->varPool;
+    OPTXT   *op;
+    OENTRY  *label = find_opcode(csound, "$label");
+    int     nsynth = pool->synthArgCount, nops, ntemps = 0, nslots = 0;
+    int     *first, *last, *labels, *rep, *order, *slot_end, *slot_rep;
+    int     i, j, k, n, pos;
+    int64_t before;
+
+    if (nsynth == 0)
+      return;
+    for (nops = 0, op = ip->nxtop; op != NULL; op = op->nxtop)
+      nops++;
+    first = csound->Malloc(csound, 5 * nsynth * sizeof(int));
+    last = first + nsynth;
+    rep = last + nsynth;
+    order = rep + nsynth;
+    slot_end = order + nsynth;
+    labels = csound->Calloc(csound, (nops + 1) * sizeof(int));
+    slot_rep = csound->Malloc(csound, nsynth * sizeof(int));
+    for (i = 0; i < nsynth; i++) {
+      first[i] = last[i] = -1;
+      rep[i] = i;
+    }
+
+    /* live ranges as [first write, last read] in statement order;
+       labels[pos] counts the labels up to statement pos */
+    for (pos = 0, op = ip->nxtop; op != NULL; op = op->nxtop, pos++) {
+      TEXT *tp = &op->t;
+      labels[pos + 1] = labels[pos] + (tp->oentry == label);
+      if (tp->oentry == label)
+        continue;
+      for (i = 0; tp->outlist != NULL && i < tp->outlist->count; i++)
+        if ((n = synth_asig_number(pool, tp->outlist->arg[i])) >= 0) {
+          if (first[n] < 0) first[n] = pos;
+          last[n] = pos;
+        }
+      for (i = 0; tp->inlist != NULL && i < tp->inlist->count; i++)
+        if ((n = synth_asig_number(pool, tp->inlist->arg[i])) >= 0) {
+          if (first[n] < 0) first[n] = nops;    /* read before written */
+          last[n] = pos;
+        }
+    }
+    for (i = 0; i < nsynth; i++) {
+      if (first[i] < 0 || first[i] >= nops || last[i] < first[i] ||
+          labels[last[i] + 1] != labels[first[i] + 1])
+        continue;
+      /* insertion sort by start of range */
+      for (j = ntemps++; j > 0 && first[order[j - 1]] > first[i]; j--)
+        order[j] = order[j - 1];
+      order[j] = i;
+    }
+
+    /* linear scan: reuse the first buffer whose range has ended */
+    for (k = 0; k < ntemps; k++) {
+      i = order[k];
+      for (j = 0; j < nslots && slot_end[j] >= first[i]; j++)
+        ;
+      if (j == nslots)
+        slot_rep[nslots++] = i;
+      slot_end[j] = last[i];
+      rep[i] = slot_rep[j];
+    }
+
+    if (nslots < ntemps) {
+      char        buf[16];
+      CS_VARIABLE *var, *next;
+
+      before = var_pool_bytes(pool);
+      for (op = ip->nxtop; op != NULL; op = op->nxtop) {
+        ARGLST *lists[2] = { op->t.outlist, op->t.inlist };
+        for (k = 0; k < 2; k++)
+          for (i = 0; lists[k] != NULL && i < lists[k]->count; i++)
+            if ((n = synth_asig_number(pool, lists[k]->arg[i])) >= 0 &&
+                rep[n] != n) {
+              snprintf(buf, 16, "#a%d", rep[n]);
+              lists[k]->arg[i] = strsav_string(csound, engineState, buf);
+            }
+      }
+      for (var = pool->head; var != NULL; var = next) {
+        next = var->next;
+        n = synth_asig_number(pool, var->varName);
+        if (n >= 0 && rep[n] != n && var->varType == &CS_VAR_TYPE_A)
+          csoundRemoveVariable(csound, pool, var->varName);
+      }
+      if (csound->oparms->msglevel & TIMEMSG)
+        csound->Message(csound,
+                        Str("%s: %d audio temporaries in %d buffers, "
+                            "local variables %ld -> %ld bytes\n"),
+                        name, ntemps, nslots, (long) before,
+                        (long) var_pool_bytes(pool));
+    }
+    csound->Free(csound, slot_rep);
+    csound->Free(csound, labels);
+    csound->Free(csound, first);
+}
+
 /**
  * Create an Instrument (INSTRTXT) from the AST node given. Called from
  * csound_orc_compile.
@@ -841,6 +976,17 @@ INSTRTXT *create_instrument(CSOUND *csound, TREE *root,
       current = current->next;
     }
     close_instrument(csound, engineState, ip);
+    if (csound->expr_opt) {
+      char name[64];
+      if (root->left->type == INTEGER_TOKEN)
+        snprintf(name, 64, "instr %ld", (long) root->left->value->value);
+      else if (root->left->value != NULL)
+        snprintf(name, 64, "%s %s",
+                 root->type == UDO_TOKEN ? "opcode" : "instr",
+                 root->left->value->lexeme);
+      else strcpy(name, "instr");
+      coalesce_temporaries(csound, ip, engineState, name);
+    }
     return ip;
 }
 
@@ -1358,6 +1504,7 @@ int engineState_merge(CSOUND *csound, ENGINE_STATE *engineState)
         }
       }
     }
+    csound->instr0 = engineState->instrtxtp[0];
     (&(current_state->instxtanchor))->nxtinstxt = csound->instr0;
     /* now free old instr 0 */
     free_instrtxt(csound, old_instr0);
@@ -1405,7 +1552,8 @@ static char *node2string(int type)
    2) instrument 0 is treated as a global i-time instrument, header constants
       are ignored.
    3) Creates other instruments
-   4) Calls engineState_merge() and engineState_free()
+   4) Leaves the new engineState in *built, to be merged by commit_state()
+      or, for asynchronous compilation, at the next k-cycle.
 
   VL 20-12-12
 
@@ -1413,12 +1561,10 @@ static char *node2string(int type)
  *
  *
  */
-PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
+static int compile_tree(CSOUND *csound, TREE *root, ENGINE_STATE **built)
 {
     INSTRTXT    *instrtxt = NULL;
-    INSTRTXT    *ip = NULL;
-    INSTRTXT    *prvinstxt;
-    OPTXT       *bp;
+    INSTRTXT    *prvinstxt, *instr0;
     char        *opname;
     TREE * current = root;
     ENGINE_STATE *engineState;
@@ -1451,13 +1597,14 @@ PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
       (INSTRTXT **) csound->Calloc(csound, (1 + engineState->maxinsno) *
                                     sizeof(INSTRTXT*));
        /* VL: allowing global code to be evaluated in
-          subsequent compilations */
-       csound->instr0 = create_global_instrument(csound, current, engineState,
+          subsequent compilations; csound->instr0 is only replaced
+          when the new state is merged */
+       instr0 = create_global_instrument(csound, current, engineState,
                                          typeTable->instr0LocalPool);
 
-        insert_instrtxt(csound, csound->instr0, 0, engineState,1);
+        insert_instrtxt(csound, instr0, 0, engineState,1);
 
-       prvinstxt = prvinstxt->nxtinstxt = csound->instr0;
+       prvinstxt = prvinstxt->nxtinstxt = instr0;
       //engineState->maxinsno = 1;
     }
 
@@ -1639,10 +1786,29 @@ PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
     /* now add the instruments with names, assigning them fake instr numbers */
     named_instr_assign_numbers(csound,engineState);
 
+    *built = engineState;
+    if (engineState != &csound->engineState)
+      free_typetable(csound, typeTable);
+    return CSOUND_SUCCESS;
+}
+
+/**
+ * Makes a compiled ENGINE_STATE live.  The state of the first compilation
+ * is the engine state itself and is finished in place; any later one is
+ * merged into it, freed, and its global code is run.
+ * The compile lock is taken after the API lock, as on the performance
+ * thread, so that a merge never runs while another orchestra is parsed.
+ */
+static void commit_state(CSOUND *csound, ENGINE_STATE *engineState)
+{
+    INSTRTXT    *ip = NULL;
+    OPTXT       *bp;
+
     /* lock to ensure thread-safety */
     csoundLockMutex(csound->API_lock);
     if (csound->init_pass_threadlock)
       csoundLockMutex(csound->init_pass_threadlock);
+    csoundLockMutex(csound->compile_lock);
     if (engineState != &csound->engineState) {
       OPDS *ids = csound->ids;
       /* any compilation other than the first one */
@@ -1653,7 +1819,6 @@ PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
       /* run global i-time code */
       init0(csound);
       csound->ids = ids;
-      free_typetable(csound, typeTable);
     }
     else {
       /* first compilation */
@@ -1699,11 +1864,81 @@ PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
       var = csoundFindVariableWithName(csound, engineState->varPool, "0dbfs");
       var->memBlock->value = csound->e0dbfs;
     }
+    csoundUnlockMutex(csound->compile_lock);
     if (csound->init_pass_threadlock)
       csoundUnlockMutex(csound->init_pass_threadlock);
     /* notify API lock  */
     csoundUnlockMutex(csound->API_lock);
-    return CSOUND_SUCCESS;
+}
+
+/* Lock-free LIFO used to hand orchestras to the compile thread and
+   compiled states to the performance thread: any thread may push, and
+   the consumer takes the whole list with a single exchange. */
+static void list_push(CSOUND *csound, void **head, void **nxt, void *item)
+{
+#ifdef HAVE_ATOMIC_BUILTIN
+    void    *old;
+    IGN(csound);
+    do {
+      old = *head;
+      *nxt = old;
+    } while (!__sync_bool_compare_and_swap(head, old, item));
+#else
+    csoundSpinLock(&csound->pending_lock);
+    *nxt = *head;
+    *head = item;
+    csoundSpinUnLock(&csound->pending_lock);
+#endif
+}
+
+static void *list_take(CSOUND *csound, void **head)
+{
+    void    *list;
+#ifdef HAVE_ATOMIC_BUILTIN
+    IGN(csound);
+    list = __sync_lock_test_and_set(head, NULL);
+#else
+    csoundSpinLock(&csound->pending_lock);
+    list = *head;
+    *head = NULL;
+    csoundSpinUnLock(&csound->pending_lock);
+#endif
+    return list;
+}
+
+/* Makes a compiled state live: at once, or, for asynchronous compilation,
+   by handing it to the performance thread.  The first compilation is
+   always committed at once, as there is no performance yet. */
+static void make_live(CSOUND *csound, ENGINE_STATE *engineState, int async)
+{
+    if (async && engineState != &csound->engineState)
+      list_push(csound, &csound->pending_states,
+                (void **) &engineState->nxtstate, engineState);
+    else
+      commit_state(csound, engineState);
+}
+
+static int compile_tree_locked(CSOUND *csound, TREE *root, int async)
+{
+    ENGINE_STATE  *built = NULL;
+    int           retVal;
+
+    csoundLockMutex(csound->compile_lock);
+    retVal = compile_tree(csound, root, &built);
+    csoundUnlockMutex(csound->compile_lock);
+    if (LIKELY(retVal == CSOUND_SUCCESS))
+      make_live(csound, built, async);
+    return retVal;
+}
+
+PUBLIC int csoundCompileTree(CSOUND *csound, TREE *root)
+{
+    return compile_tree_locked(csound, root, 0);
+}
+
+PUBLIC int csoundCompileTreeAsync(CSOUND *csound, TREE *root)
+{
+    return compile_tree_locked(csound, root, 1);
 }
 
 /**
@@ -1729,6 +1964,81 @@ void sanitize(CSOUND *csound) {}
 extern void sanitize(CSOUND *csound);
 #endif
 
+/* Parses and compiles an orchestra.  Parsing and building the new state
+   hold the compile lock only, so that the performance thread carries on
+   meanwhile; the state is then committed or handed over by make_live(). */
+static int compile_orc(CSOUND *csound, const char *str, int async)
+{
+    ENGINE_STATE  *built = NULL;
+    TREE          *root;
+    int           retVal;
+
+    csoundLockMutex(csound->compile_lock);
+    root = csoundParseOrc(csound, str);
+    if (UNLIKELY(root == NULL)) {
+      csoundUnlockMutex(csound->compile_lock);
+      return CSOUND_ERROR;
+    }
+    retVal = compile_tree(csound, root, &built);
+    // Sanitise semantic sets here
+    sanitize(csound);
+    csoundDeleteTree(csound, root);
+    csoundUnlockMutex(csound->compile_lock);
+    if (LIKELY(retVal == CSOUND_SUCCESS))
+      make_live(csound, built, async);
+    return retVal;
+}
+
+typedef struct orc_queue {
+    char              *orc;
+    struct orc_queue  *nxt;
+} ORC_QUEUE;
+
+/* polling interval (ms) where thread locks cannot be used for wakeup */
+#define COMPILE_POLL 10
+
+/* An orchestra is verified against the live engine state, so one that
+   uses an instrument or global defined by an orchestra queued before it
+   can only be compiled once that one has been merged: wait for the
+   performance thread to take the states already compiled. */
+static void wait_for_merge(CSOUND *csound)
+{
+    while (*((void * volatile *) &csound->pending_states) != NULL &&
+           !csound->compile_stop)
+      csoundSleep(1);
+}
+
+/* csoundCompileOrcAsync() worker: compiles queued orchestras in order */
+static uintptr_t compile_thread(void *data)
+{
+    CSOUND      *csound = (CSOUND *) data;
+    ORC_QUEUE   *q, *nxt, *fifo;
+
+    while (!csound->compile_stop) {
+#if CS_THREADLOCK_WAKEUP
+      csoundWaitThreadLockNoTimeout(csound->compile_wakeup);
+#else
+      csoundSleep(COMPILE_POLL);
+#endif
+      fifo = NULL;
+      q = (ORC_QUEUE *) list_take(csound, &csound->compile_queue);
+      for ( ; q != NULL; q = nxt) {
+        nxt = q->nxt;
+        q->nxt = fifo;
+        fifo = q;
+      }
+      for (q = fifo; q != NULL; q = nxt) {
+        nxt = q->nxt;
+        wait_for_merge(csound);
+        if (!csound->compile_stop)
+          compile_orc(csound, q->orc, 1);
+        free(q->orc);
+        free(q);
+      }
+    }
+    return (uintptr_t) 0;
+}
+
 /**
     Parse and compile an orchestra given on an string (OPTIONAL)
     if str is NULL the string is taken from the internal corfile
@@ -1737,24 +2047,106 @@ extern void sanitize(CSOUND *csound);
 */
 PUBLIC int csoundCompileOrc(CSOUND *csound, const char *str)
 {
-    int retVal=1;
-    TREE *root = csoundParseOrc(csound, str);
-    if (LIKELY(root != NULL)) {
-     retVal = csoundCompileTree(csound, root);
-     // Sanitise semantic sets here
-     sanitize(csound);
-     csoundDeleteTree(csound, root);
-    }
-    else {
-      // csoundDeleteTree(csound, root);
-     return  CSOUND_ERROR;
-    }
+    int retVal = compile_orc(csound, str, 0);
 
-    if (UNLIKELY(csound->oparms->odebug))
+    if (UNLIKELY(csound->oparms->odebug) && retVal == CSOUND_SUCCESS)
       debugPrintCsound(csound);
     return retVal;
 }
 
+PUBLIC int csoundCompileOrcAsync(CSOUND *csound, const char *str)
+{
+    ORC_QUEUE   *q;
+
+    /* nothing is performing yet, or the orchestra is in the corfile */
+    if (csound->instr0 == NULL || str == NULL)
+      return csoundCompileOrc(csound, str);
+    if (UNLIKELY(csound->compile_thread == NULL)) {
+      csoundLockMutex(csound->compile_lock);
+      if (csound->compile_thread == NULL) {
+        csound->compile_stop = 0;
+        csound->compile_wakeup = csoundCreateThreadLock();
+        csound->compile_thread = csoundCreateThread(compile_thread,
+                                                    (void *) csound);
+        if (UNLIKELY(csound->compile_thread == NULL)) {
+          csoundDestroyThreadLock(csound->compile_wakeup);
+          csound->compile_wakeup = NULL;
+        }
+      }
+      csoundUnlockMutex(csound->compile_lock);
+      if (UNLIKELY(csound->compile_thread == NULL))
+        return csoundCompileOrc(csound, str);
+    }
+    q = (ORC_QUEUE *) malloc(sizeof(ORC_QUEUE));
+    if (UNLIKELY(q == NULL || (q->orc = strdup(str)) == NULL)) {
+      free(q);
+      return CSOUND_MEMORY;
+    }
+    list_push(csound, &csound->compile_queue, (void **) &q->nxt, q);
+    csoundNotifyThreadLock(csound->compile_wakeup);
+    return CSOUND_SUCCESS;
+}
+
+void async_compile_stop(CSOUND *csound)
+{
+    ORC_QUEUE   *q, *nxt;
+
+    if (csound->compile_thread != NULL) {
+      csound->compile_stop = 1;
+      csoundNotifyThreadLock(csound->compile_wakeup);
+      csoundJoinThread(csound->compile_thread);
+      csoundDestroyThreadLock(csound->compile_wakeup);
+      csound->compile_thread = NULL;
+      csound->compile_wakeup = NULL;
+    }
+    q = (ORC_QUEUE *) list_take(csound, &csound->compile_queue);
+    for ( ; q != NULL; q = nxt) {
+      nxt = q->nxt;
+      free(q->orc);
+      free(q);
+    }
+    /* states never merged are in memory released by memRESET() */
+    csound->pending_states = NULL;
+}
+
+/**
+ * Called by the performance thread at the start of a k-cycle: merges the
+ * states compiled off the performance thread, in the order they were
+ * compiled, and runs their global code.  If an orchestra is being parsed
+ * at that moment the merge is left for a later k-cycle, so that the
+ * performance thread never waits for the parser.
+ */
+void merge_pending_states(CSOUND *csound)
+{
+    ENGINE_STATE  *list, *nxt, *state = NULL;
+    OPDS          *ids;
+
+    csoundLockMutex(csound->API_lock);
+    if (csound->init_pass_threadlock)
+      csoundLockMutex(csound->init_pass_threadlock);
+    if (csoundLockMutexNoWait(csound->compile_lock) == 0) {
+      /* one exchange takes every state posted so far */
+      list = (ENGINE_STATE *) list_take(csound, &csound->pending_states);
+      for ( ; list != NULL; list = nxt) {
+        nxt = list->nxtstate;
+        list->nxtstate = state;
+        state = list;
+      }
+      ids = csound->ids;
+      for ( ; state != NULL; state = nxt) {
+        nxt = state->nxtstate;
+        engineState_merge(csound, state);
+        engineState_free(csound, state);
+        init0(csound);
+      }
+      csound->ids = ids;
+      csoundUnlockMutex(csound->compile_lock);
+    }
+    if (csound->init_pass_threadlock)
+      csoundUnlockMutex(csound->init_pass_threadlock);
+    csoundUnlockMutex(csound->API_lock);
+}
+
 
 /* prep an instr template for efficient allocs  */
 /* repl arg refs by offset ndx to lcl/gbl space */
@@ -28,6 +28,7 @@
 #include "csound_orc_expressions.h"
 #include "csound_type_system.h"
 #include "csound_orc_semantics.h"
+#include "aops.h"
 
 extern char argtyp2(char *);
 extern void print_tree(CSOUND *, char *, TREE *);
@@ -46,6 +47,7 @@ extern void add_array_arg(CSOUND* csound, char* varName, int dimensions,
 extern char* get_array_sub_type(CSOUND* csound, char*);
 
 extern char* convert_external_to_internal(CSOUND* csound, char* arg);
+extern int exprfuse_opcode(const char *);
 
 
 TREE* create_boolean_expression(CSOUND*, TREE*, int, int, TYPE_TABLE*);
@@ -375,6 +377,159 @@ char* create_out_arg_for_expression(CSOUND* csound, char* op, TREE* left,
                           typeTable->localPool->synthArgCount++, typeTable);
 }
 
+/* Expression fusion: an audio-rate expression made only of the
+   arithmetic operators and the functions known to ##expr (see
+   OOps/aops.c) is compiled to one ##expr call instead of one opcode
+   per operator.  Any other subexpression is lowered as usual and its
+   result becomes an argument of the fused opcode.                      */
+
+typedef struct {
+    TREE    *anchor;            /* lowered subexpressions */
+    TREE    *args;              /* arguments after the program string */
+    int     nargs;
+    char    *prog;
+    size_t  len;
+} EXPR_FUSION;
+
+static int is_fusable_node(TREE *node)
+{
+    switch (node->type) {
+    case '+':
+    case '-':
+    case '*':
+    case '/':
+    case '%':
+      return (node->left != NULL && node->right != NULL);
+    case S_UMINUS:
+      return (node->right != NULL);
+    case T_FUNCTION:
+      return (node->value->optype == NULL &&
+              node->right != NULL && node->right->next == NULL &&
+              exprfuse_opcode(node->value->lexeme) >= 0);
+    }
+    return 0;
+}
+
+/* Counts operators and leaves of the fusable part of the tree; returns
+   0 if a leaf is not a numeric a-, k- or i-rate value. */
+static int count_fusable(CSOUND *csound, TREE *node, int *nops, int *nleaves,
+                         TYPE_TABLE *typeTable)
+{
+    char    *type;
+    int     ok;
+
+    if (is_fusable_node(node)) {
+      (*nops)++;
+      if (node->left != NULL &&
+          !count_fusable(csound, node->left, nops, nleaves, typeTable))
+        return 0;
+      return count_fusable(csound, node->right, nops, nleaves, typeTable);
+    }
+    (*nleaves)++;
+    type = get_arg_type2(csound, node, typeTable);
+    ok = (type != NULL && type[1] == '\0' && strchr("akicpr", *type) != NULL);
+    if (type != NULL) csound->Free(csound, type);
+    return ok;
+}
+
+static void fusion_append(EXPR_FUSION *f, const char *tok)
+{
+    size_t  n = strlen(tok);
+    if (f->len) f->prog[f->len++] = ' ';
+    memcpy(f->prog + f->len, tok, n + 1);
+    f->len += n;
+}
+
+static void fuse_tree(CSOUND *csound, EXPR_FUSION *f, TREE *node,
+                      int line, int locn, TYPE_TABLE *typeTable)
+{
+    TREE    *arg, *t;
+    char    tok[16], *type;
+    int     i;
+
+    if (is_fusable_node(node)) {
+      if (node->left != NULL)
+        fuse_tree(csound, f, node->left, line, locn, typeTable);
+      fuse_tree(csound, f, node->right, line, locn, typeTable);
+      switch (node->type) {
+      case S_UMINUS:   fusion_append(f, "neg"); break;
+      case T_FUNCTION: fusion_append(f, node->value->lexeme); break;
+      default:
+        tok[0] = (char) node->type; tok[1] = '\0';
+        fusion_append(f, tok);
+      }
+      return;
+    }
+    if (is_expression_node(node)) {
+      t = create_expression(csound, node, line, locn, typeTable);
+      f->anchor = appendToTree(csound, f->anchor, t);
+      arg = create_ans_token(csound, tree_tail(t)->left->value->lexeme);
+      i = f->nargs;
+    }
+    else {
+      /* the same variable or constant is passed only once */
+      for (i = 0, t = f->args; t != NULL; i++, t = t->next)
+        if (t->type == node->type && t->value != NULL && node->value != NULL &&
+            !strcmp(t->value->lexeme, node->value->lexeme))
+          break;
+      arg = node;
+      arg->next = NULL;
+    }
+    type = get_arg_type2(csound, arg, typeTable);
+    snprintf(tok, 16, "$%c%d",
+             *type == 'a' ? 'a' : *type == 'k' ? 'k' : 'i', i);
+    csound->Free(csound, type);
+    fusion_append(f, tok);
+    if (i == f->nargs) {
+      f->args = appendToTree(csound, f->args, arg);
+      f->nargs++;
+    }
+}
+
+static TREE *create_fused_expression(CSOUND *csound, TREE *root,
+                                     int line, int locn,
+                                     TYPE_TABLE *typeTable)
+{
+    EXPR_FUSION f;
+    TREE    *opTree, *prog;
+    char    *type, *outarg;
+    int     nops = 0, nleaves = 0, ok;
+
+    if (!csound->expr_opt || !is_fusable_node(root))
+      return NULL;
+    type = get_arg_type2(csound, root, typeTable);
+    ok = (type != NULL && *type == 'a');
+    if (type != NULL) csound->Free(csound, type);
+    if (!ok ||
+        !count_fusable(csound, root, &nops, &nleaves, typeTable) ||
+        nops < 2 || nleaves > EXPR_MAXARGS)
+      return NULL;
+
+    memset(&f, 0, sizeof(EXPR_FUSION));
+    /* longest tokens are "$a31" and "sininv" */
+    f.prog = csound->Calloc(csound, 8 * (nops + nleaves) + 3);
+    f.prog[0] = '"';
+    f.prog++;
+    fuse_tree(csound, &f, root, line, locn, typeTable);
+    f.prog[f.len++] = '"';
+    f.prog--;
+
+    prog = create_empty_token(csound);
+    prog->type = STRING_TOKEN;
+    prog->value = make_token(csound, f.prog);
+    csound->Free(csound, f.prog);
+    prog->next = f.args;
+
+    outarg = create_out_arg(csound, "a",
+                            typeTable->localPool->synthArgCount++, typeTable);
+    opTree = create_opcode_token(csound, "##expr");
+    opTree->left = create_ans_token(csound, outarg);
+    opTree->right = prog;
+    opTree->line = line;
+    opTree->locn = locn;
+    return appendToTree(csound, f.anchor, opTree);
+}
+
 /**
  * Create a chain of Opcode (OPTXT) text from the AST node given. Called from
  * create_opcode when an expression node has been found as an argument
@@ -390,6 +545,9 @@ TREE * create_expression(CSOUND *csound, TREE *root, int line, int locn,
 
     if (root->type=='?') return create_cond_expression(csound, root, line,
                                                        locn, typeTable);
+    if ((anchor = create_fused_expression(csound, root, line, locn,
+                                          typeTable)) != NULL)
+      return anchor;
     memset(op, 0, 80);
     current = root->left;
     newArgList = NULL;
@@ -24,212 +24,634 @@
 
 #include "csoundCore.h"
 #include "csound_orc.h"
+#include "csound_orc_semantics.h"
 
-static TREE * create_fun_token(CSOUND *csound, TREE *right, char *fname)
-{
-    TREE *ans;
-    ans = (TREE*)csound->Malloc(csound, sizeof(TREE));
-    if (UNLIKELY(ans == NULL)) exit(1);
-    ans->type = T_FUNCTION;
-    ans->value = make_token(csound, fname);
-    ans->value->type = T_FUNCTION;
-    ans->left = NULL;
-    ans->right = right;
-    ans->next = NULL;
-    ans->len = 0;
-    ans->markup = NULL;
-    ans->rate = -1;
+extern char* get_arg_string_from_tree(CSOUND*, TREE*, TYPE_TABLE*);
+extern void add_arg(CSOUND*, char*, TYPE_TABLE*);
+extern CONS_CELL* get_label_list(CSOUND*, TREE*);
+
+/* The optimiser runs on the typed statement lists left by verify_tree(),
+   in which every expression has been lowered to one opcode call per
+   operator writing a synthetic variable (#i0, #k1, ...).  Each synthetic
+   variable is written once, so its reads can be rewritten freely.
+
+   Within a block (a run of statements entered only at its first
+   statement and left only after its last, i.e. delimited by labels and
+   jumps) it
+     - replaces i(ivar), i(pN) and i(const) by their argument,
+     - folds i-time operators and functions of constants, calling the
+       opcode's own init routine so the result is exactly the run time one,
+     - shares the result of a pure operator or function applied twice to
+       the same arguments.
+   In instruments and UDOs without i-time jumps or reinit, a k-rate pure
+   operator or function of i-rate values only is also moved to the init
+   pass.  A rewrite is only kept if every statement reading the result
+   still resolves to the same opcode entry.                            */
+
+/* operators and functions without side effects or state */
+static const char *pure_opcodes[] = {
+    "##add", "##sub", "##mul", "##div", "##mod", "##pow",
+    "##and", "##or", "##xor", "##shl", "##shr", "##not", "##expr",
+    ":cond", ">", ">=", "<", "<=", "==", "!=", "&&", "||",
+    "int", "frac", "round", "floor", "ceil", "abs", "exp", "log",
+    "log10", "log2", "sqrt", "sin", "cos", "tan", "sininv", "cosinv",
+    "taninv", "taninv2", "sinh", "cosh", "tanh", "ampdb", "dbamp",
+    "cpsoct", "octpch", "cpspch", "pchoct", "octcps", "powoftwo",
+    "logbtwo", "octave", "semitone", "cent", "db", NULL
+};
+
+typedef struct {
+    TREE        **stmt;         /* statements, NULL once removed */
+    int         *block;         /* last statement of the enclosing block */
+    int         n;
+    CS_HASH_TABLE *lastuse;     /* synthetic variable -> last reader */
+    CS_HASH_TABLE *lastwrite;   /* variable -> last writer */
+    TYPE_TABLE  *typeTable;
+    int         ncopy, nfold, nhoist, ncse;
+} OPT_BODY;
+
+/* layout shared by the EVAL, AOP and POW argument structures */
+typedef struct {
+    OPDS    h;
+    MYFLT   *arg[4];
+} FOLD_ARGS;
+
+static int opcode_is(OENTRY *ep, const char *name)
+{
+    size_t len = strcspn(ep->opname, ".");
+    return (strlen(name) == len && strncmp(ep->opname, name, len) == 0);
+}
+
+static int is_pure(OENTRY *ep)
+{
+    const char **p;
+
+    if (ep == NULL || ep->useropinfo != NULL)
+      return 0;
+    for (p = pure_opcodes; *p != NULL; p++)
+      if (opcode_is(ep, *p))
+        return 1;
+    return 0;
+}
+
+/* opcodes other than the pure ones and assignments may write to
+   variables passed as inputs (vincr, clear, trigseq, ...) */
+static int writes_inputs(OENTRY *ep)
+{
+    return (ep == NULL ||
+            (!is_pure(ep) && !opcode_is(ep, "=") && !opcode_is(ep, "init")));
+}
+
+static int is_jump(OENTRY *ep)
+{
+    return ((ep->intypes != NULL && strchr(ep->intypes, 'l') != NULL) ||
+            opcode_is(ep, "rireturn"));
+}
+
+static OENTRY *statement_entry(TREE *t)
+{
+    switch (t->type) {
+    case T_OPCODE:
+    case T_OPCODE0:
+    case GOTO_TOKEN:
+    case IGOTO_TOKEN:
+    case KGOTO_TOKEN:
+    case '=':
+      return (OENTRY *) t->markup;
+    }
+    return NULL;
+}
+
+static int is_synthetic(TREE *t)
+{
+    return (t->type == T_IDENT && t->value->lexeme[0] == '#');
+}
+
+static int is_leaf(TREE *t)
+{
+    return (t->left == NULL && t->right == NULL && t->value != NULL);
+}
+
+/* the single synthetic output of a statement, or NULL */
+static TREE *synthetic_output(TREE *t)
+{
+    if (t->left == NULL || t->left->next != NULL || !is_synthetic(t->left))
+      return NULL;
+    return t->left;
+}
+
+static int get_index(CSOUND *csound, CS_HASH_TABLE *table, char *name)
+{
+    int *p = cs_hash_table_get(csound, table, name);
+    return (p != NULL ? *p : -1);
+}
+
+static void set_index(CSOUND *csound, CS_HASH_TABLE *table, char *name, int n)
+{
+    int *p = cs_hash_table_get(csound, table, name);
+    if (p == NULL) {
+      p = csound->Malloc(csound, sizeof(int));
+      cs_hash_table_put(csound, table, name, p);
+    }
+    *p = n;
+}
+
+static int writes_var(TREE *t, const char *name)
+{
+    OENTRY  *ep = statement_entry(t);
+    TREE    *arg;
+
+    for (arg = t->left; arg != NULL; arg = arg->next)
+      if (arg->value != NULL && !strcmp(arg->value->lexeme, name))
+        return 1;
+    if (!writes_inputs(ep))
+      return 0;
+    /* p3 is also changed by xtratim and the release opcodes */
+    if (!strcmp(name, "p3"))
+      return 1;
+    for (arg = t->right; arg != NULL; arg = arg->next)
+      if (arg->type == T_IDENT && !strcmp(arg->value->lexeme, name))
+        return 1;
+    return 0;
+}
+
+static int written_between(OPT_BODY *b, const char *name, int from, int to)
+{
+    int     i;
+
+    for (i = from; i <= to; i++)
+      if (b->stmt[i] != NULL && writes_var(b->stmt[i], name))
+        return 1;
+    return 0;
+}
+
+static OENTRY *resolve_statement(CSOUND *csound, TREE *t,
+                                 TYPE_TABLE *typeTable)
+{
+    char    *out = get_arg_string_from_tree(csound, t->left, typeTable);
+    char    *in = get_arg_string_from_tree(csound, t->right, typeTable);
+    OENTRY  *ep;
+
+    ep = find_opcode_new(csound, t->value->lexeme,
+                         t->value->optype != NULL ? t->value->optype : out,
+                         in);
+    if (out != NULL) csound->Free(csound, out);
+    if (in != NULL) csound->Free(csound, in);
+    return ep;
+}
+
+static ORCTOKEN *copy_token(CSOUND *csound, ORCTOKEN *tok)
+{
+    ORCTOKEN *ans = make_token(csound, tok->lexeme);
+    ans->type = tok->type;
+    ans->value = tok->value;
+    ans->fvalue = tok->fvalue;
     return ans;
 }
 
-static TREE * optimize_ifun(CSOUND *csound, TREE *root)
+/* Replaces the reads of 'name' in statements from..to by 'by'; the
+   change is undone and 0 returned if a statement would then resolve to
+   another opcode entry. */
+static int replace_uses(CSOUND *csound, OPT_BODY *b, char *name, TREE *by,
+                        int from, int to)
 {
-    /* print_tree(csound, "optimize_ifun: before", root); */
-    switch(root->right->type) {
-        case INTEGER_TOKEN:
-        case NUMBER_TOKEN:       /* i(num)    -> num      */
-            // FIXME - reinstate optimization after implementing get_type(varname)
-            //    case T_IDENT_I:          /* i(ivar)   -> ivar     */
-            //    case T_IDENT_GI:         /* i(givar)  -> givar    */
-            //    case T_IDENT_P:          /* i(pN)     -> pN       */
-            root = root->right;
-            break;
-            //    case T_IDENT_K:          /* i(kvar)   -> i(kvar)  */
-            //    case T_IDENT_GK:         /* i(gkvar)  -> i(gkvar) */
-            //      break;
-        case T_FUNCTION:         /* i(fn(x))  -> fn(i(x)) */
-        {
-            TREE *funTree = root->right;
-            funTree->right = create_fun_token(csound, funTree->right, "i");
-            root = funTree;
+    TREE    *arg, **args;
+    ORCTOKEN **old;
+    int     *oldtype, *changed, i, k, n = 0, nchanged = 0, ok = 1;
+
+    for (i = from; i <= to; i++)
+      if (b->stmt[i] != NULL)
+        for (arg = b->stmt[i]->right; arg != NULL; arg = arg->next)
+          n += (arg->type == T_IDENT && !strcmp(arg->value->lexeme, name));
+    if (n == 0)
+      return 1;
+    args = csound->Malloc(csound, n * sizeof(TREE *));
+    old = csound->Malloc(csound, n * sizeof(ORCTOKEN *));
+    oldtype = csound->Malloc(csound, n * sizeof(int));
+    changed = csound->Malloc(csound, n * sizeof(int));
+    for (i = from, k = 0; i <= to; i++) {
+      if (b->stmt[i] == NULL)
+        continue;
+      for (arg = b->stmt[i]->right; arg != NULL; arg = arg->next)
+        if (arg->type == T_IDENT && !strcmp(arg->value->lexeme, name)) {
+          if (nchanged == 0 || changed[nchanged - 1] != i)
+            changed[nchanged++] = i;
+          args[k] = arg;
+          old[k] = arg->value;
+          oldtype[k++] = arg->type;
+          arg->type = by->type;
+          arg->value = copy_token(csound, by->value);
         }
+    }
+    for (i = 0; i < nchanged && ok; i++) {
+      TREE *t = b->stmt[changed[i]];
+      ok = (resolve_statement(csound, t, b->typeTable) == t->markup);
+    }
+    for (k = 0; k < n; k++) {
+      if (ok) {
+        csound->Free(csound, old[k]->lexeme);
+        csound->Free(csound, old[k]);
+      }
+      else {
+        csound->Free(csound, args[k]->value->lexeme);
+        csound->Free(csound, args[k]->value);
+        args[k]->value = old[k];
+        args[k]->type = oldtype[k];
+      }
+    }
+    if (ok && is_synthetic(by) &&
+        get_index(csound, b->lastuse, by->value->lexeme) < to)
+      set_index(csound, b->lastuse, by->value->lexeme, to);
+    csound->Free(csound, changed);
+    csound->Free(csound, oldtype);
+    csound->Free(csound, old);
+    csound->Free(csound, args);
+    return ok;
+}
+
+static void remove_statement(CSOUND *csound, OPT_BODY *b, int i)
+{
+    csoundRemoveVariable(csound, b->typeTable->localPool,
+                         b->stmt[i]->left->value->lexeme);
+    b->stmt[i] = NULL;
+}
+
+/* range of the reads of the output of statement i inside its block,
+   0 if it is also read after the block or not read at all */
+static int block_uses(CSOUND *csound, OPT_BODY *b, int i, int *last)
+{
+    *last = get_index(csound, b->lastuse, b->stmt[i]->left->value->lexeme);
+    return (*last > i && *last <= b->block[i]);
+}
+
+/* i(ivar) -> ivar, i(pN) -> pN, i(const) -> const */
+static void copy_pass(CSOUND *csound, OPT_BODY *b)
+{
+    int     i, last;
+
+    for (i = 0; i < b->n; i++) {
+      TREE    *t = b->stmt[i], *arg;
+      OENTRY  *ep;
+
+      if (t == NULL || (ep = statement_entry(t)) == NULL ||
+          strcmp(ep->opname, "i.i") != 0 || synthetic_output(t) == NULL)
+        continue;
+      arg = t->right;
+      if (arg == NULL || arg->next != NULL || !is_leaf(arg) ||
+          !block_uses(csound, b, i, &last))
+        continue;
+      if (arg->type == T_IDENT &&
+          (arg->value->lexeme[0] == 'g' ||
+           written_between(b, arg->value->lexeme, i + 1, last - 1)))
+        continue;
+      if (arg->type != T_IDENT && arg->type != INTEGER_TOKEN &&
+          arg->type != NUMBER_TOKEN)
+        continue;
+      if (replace_uses(csound, b, t->left->value->lexeme, arg, i + 1, last)) {
+        remove_statement(csound, b, i);
+        b->ncopy++;
+      }
+    }
+}
+
+static int fold_value(TREE *arg, MYFLT *val)
+{
+    if (arg->type != INTEGER_TOKEN && arg->type != NUMBER_TOKEN &&
+        !(arg->type == T_IDENT && arg->value->lexeme[0] != '\0' &&
+          strchr("0123456789.-+", arg->value->lexeme[0]) != NULL &&
+          strcmp(arg->value->lexeme, "0dbfs") != 0))
+      return 0;
+    /* the same conversion as the constant pool */
+    *val = (MYFLT) cs_strtod(arg->value->lexeme, NULL);
+    return 1;
+}
+
+/* evaluates i-time operators and functions of constants */
+static void fold_pass(CSOUND *csound, OPT_BODY *b)
+{
+    int     i, k, last;
+
+    for (i = 0; i < b->n; i++) {
+      TREE    *t = b->stmt[i], *arg, by;
+      OENTRY  *ep;
+      FOLD_ARGS f;
+      MYFLT   in[3], res = FL(0.0);
+      char    buf[32];
+
+      if (t == NULL || (ep = statement_entry(t)) == NULL || !is_pure(ep) ||
+          ep->thread != 1 || ep->iopadr == NULL ||
+          strcmp(ep->outypes, "i") != 0 || synthetic_output(t) == NULL ||
+          !block_uses(csound, b, i, &last))
+        continue;
+      memset(&f, 0, sizeof(FOLD_ARGS));
+      f.arg[0] = &res;
+      for (k = 0, arg = t->right; arg != NULL && k < 3; arg = arg->next, k++) {
+        if (!fold_value(arg, &in[k]))
+          break;
+        f.arg[k + 1] = &in[k];
+      }
+      if (arg != NULL || k == 0)
+        continue;
+      /* leave run time errors and warnings to run time */
+      if ((opcode_is(ep, "##div") || opcode_is(ep, "##mod")) &&
+          in[1] == FL(0.0))
+        continue;
+      if (opcode_is(ep, "##pow") && in[0] == FL(0.0) && in[1] == FL(0.0))
+        continue;
+      if (ep->iopadr(csound, &f) != OK || isnan(res) || isinf(res))
+        continue;
+#ifdef USE_DOUBLE
+      snprintf(buf, 32, "%.17g", res);
+#else
+      snprintf(buf, 32, "%.9g", res);
+#endif
+      memset(&by, 0, sizeof(TREE));
+      by.type = NUMBER_TOKEN;
+      by.value = make_num(csound, buf);
+      if (replace_uses(csound, b, t->left->value->lexeme, &by, i + 1, last)) {
+        remove_statement(csound, b, i);
+        b->nfold++;
+      }
+      csound->Free(csound, by.value->lexeme);
+      csound->Free(csound, by.value);
+    }
+}
+
+static int is_init_value(CSOUND *csound, OPT_BODY *b, TREE *arg, int i)
+{
+    char    *type;
+    int     ok;
+
+    if (arg->type == INTEGER_TOKEN || arg->type == NUMBER_TOKEN)
+      return 1;
+    if (arg->type != T_IDENT || arg->value->lexeme[0] == 'g' ||
+        !strcmp(arg->value->lexeme, "p3") ||
+        get_index(csound, b->lastwrite, arg->value->lexeme) >= i)
+      return 0;
+    type = get_arg_type2(csound, arg, b->typeTable);
+    ok = (type != NULL && type[0] != '\0' && type[1] == '\0' &&
+          strchr("cip", type[0]) != NULL);
+    if (type != NULL) csound->Free(csound, type);
+    return ok;
+}
+
+/* k-rate pure operations of i-rate values -> i-rate */
+static void hoist_pass(CSOUND *csound, OPT_BODY *b)
+{
+    int     i, j, last;
+
+    for (i = 0; i < b->n; i++) {
+      OENTRY  *ep = b->stmt[i] != NULL ? statement_entry(b->stmt[i]) : NULL;
+      if (ep != NULL &&
+          ((is_jump(ep) && ep->iopadr != NULL) || opcode_is(ep, "reinit") ||
+           opcode_is(ep, "rigoto") || opcode_is(ep, "rireturn")))
+        return;
+    }
+
+    for (i = 0; i < b->n; i++) {
+      TREE    *t = b->stmt[i], *out, *arg, by;
+      OENTRY  *ep, *iep;
+      char    *name, *in, iname[16];
+
+      if (t == NULL || (ep = statement_entry(t)) == NULL || !is_pure(ep) ||
+          strcmp(ep->outypes, "k") != 0 || (out = synthetic_output(t)) == NULL ||
+          out->value->lexeme[1] != 'k')
+        continue;
+      last = get_index(csound, b->lastuse, out->value->lexeme);
+      if (last <= i)
+        continue;
+      for (arg = t->right; arg != NULL; arg = arg->next)
+        if (!is_init_value(csound, b, arg, i))
+          break;
+      if (arg != NULL)
+        continue;
+      /* the readers must not look at the value in the init pass, where
+         it would now be set rather than 0 */
+      for (j = i + 1; j <= last; j++) {
+        OENTRY *rep;
+        if (b->stmt[j] == NULL ||
+            (rep = statement_entry(b->stmt[j])) == NULL || rep->iopadr == NULL)
+          continue;
+        for (arg = b->stmt[j]->right; arg != NULL; arg = arg->next)
+          if (arg->type == T_IDENT &&
+              !strcmp(arg->value->lexeme, out->value->lexeme))
             break;
-        default:                 /* i(A op B) -> i(A) op i(B) */
-            if(root->right->left != NULL)
-                root->right->left = create_fun_token(csound,
-                                                     root->right->left, "i");
-            if(root->right->right != NULL)
-                root->right->right = create_fun_token(csound,
-                                                      root->right->right, "i");
-            root->right->next = root->next;
-            root = root->right;
-            break;
+        if (arg != NULL)
+          break;
+      }
+      if (j <= last)
+        continue;
+
+      name = out->value->lexeme;
+      snprintf(iname, 16, "#i%s", name + 2);
+      in = get_arg_string_from_tree(csound, t->right, b->typeTable);
+      iep = find_opcode_new(csound, t->value->lexeme, "i", in);
+      if (in != NULL) csound->Free(csound, in);
+      if (iep == NULL || iep->thread != 1 || iep->iopadr == NULL)
+        continue;
+      add_arg(csound, iname, b->typeTable);
+      memset(&by, 0, sizeof(TREE));
+      by.type = T_IDENT;
+      by.value = make_token(csound, iname);
+      by.value->type = T_IDENT;
+      if (replace_uses(csound, b, name, &by, i + 1, last)) {
+        csoundRemoveVariable(csound, b->typeTable->localPool, name);
+        csound->Free(csound, out->value->lexeme);
+        csound->Free(csound, out->value);
+        out->value = by.value;
+        t->markup = iep;
+        t->value->optype = NULL;
+        set_index(csound, b->lastwrite, iname, i);
+        b->nhoist++;
+      }
+      else {
+        csoundRemoveVariable(csound, b->typeTable->localPool, iname);
+        csound->Free(csound, by.value->lexeme);
+        csound->Free(csound, by.value);
+      }
     }
-    /* print_tree(csound, "optimize_ifun: after", root); */
-    return root;
 }
 
-/** Verifies and optimise; constant fold and opcodes and args are correct*/
-static TREE * verify_tree1(CSOUND *csound, TREE *root)
-{
-    TREE *ans, *last;
-    double lval, rval;
-    //csound->Message(csound, "Verifying AST (NEED TO IMPLEMENT)\n");
-    //print_tree(csound, "Verify", root);
-    if (root->right && root->right->type != T_INSTLIST) {
-        if (root->type == T_OPCODE || root->type == T_OPCODE0) {
-            last = root->right;
-            while (last->next) {
-                /* we optimize the i() functions in the opcode */
-                if (last->next->type == T_FUNCTION &&
-                    (strcmp(last->next->value->lexeme, "i") == 0)) {
-                    TREE *temp = optimize_ifun(csound, last->next);
-                    temp->next = last->next->next;
-                    last->next = temp;
-                }
-                last = last->next;
-            }
-        }
-        if (root->right->type == T_FUNCTION &&
-            (strcmp(root->right->value->lexeme, "i") == 0)) {  /* i() function */
-            root->right = optimize_ifun(csound, root->right);
-        }
-        last = root->right;
-        while (last->next) {
-            last->next = verify_tree1(csound, last->next);
-            last = last->next;
-        }
-        root->right = verify_tree1(csound, root->right);
-        if (root->left) {
-            if (root->left->type == T_FUNCTION &&
-                (strcmp(root->left->value->lexeme, "i") == 0)) {  /* i() function */
-                root->left = optimize_ifun(csound, root->left);
-            }
-            root->left= verify_tree1(csound, root->left);
-            if ((root->left->type  == INTEGER_TOKEN ||
-                 root->left->type  == NUMBER_TOKEN) &&
-                (root->right->type == INTEGER_TOKEN ||
-                 root->right->type == NUMBER_TOKEN)) {
-                    //print_tree(csound, "numerical case\n", root);
-                    lval = (root->left->type == INTEGER_TOKEN ?
-                            (double)root->left->value->value :
-                            root->left->value->fvalue);
-                    rval = (root->right->type == INTEGER_TOKEN ?
-                            (double)root->right->value->value :
-                            root->right->value->fvalue);
-                    ans = root->left;
-                    /* **** Something wrong here --
-                       subtraction confuses memory **** */
-                    switch (root->type) {
-                        case '+':
-                            ans->type = ans->value->type = NUMBER_TOKEN;
-                            ans->value->fvalue = lval+rval;
-                            ans->value->lexeme =
-                              (char*)csound->
-                              ReAlloc(csound, ans->value->lexeme, 24);
-                            CS_SPRINTF(ans->value->lexeme, "%f", ans->value->fvalue);
-                            ans->next = root->next;
-                            //Memory leak!!
-                            //csound->Free(csound, root); mfree(csound root->right);
-                            return ans;
-                        case '-':
-                            ans->type = ans->value->type = NUMBER_TOKEN;
-                            ans->value->fvalue = lval-rval;
-                            ans->value->lexeme =
-                              (char*)csound->
-                              ReAlloc(csound, ans->value->lexeme, 24);
-                            CS_SPRINTF(ans->value->lexeme, "%f", ans->value->fvalue);
-                            ans->next = root->next;
-                            //Memory leak!!
-                            //csound->Free(csound, root); mfree(csound, root->right);
-                            return ans;
-                        case '*':
-                            ans->type = ans->value->type = NUMBER_TOKEN;
-                            ans->value->fvalue = lval*rval;
-                            ans->value->lexeme =
-                            (char*)csound->ReAlloc(csound, ans->value->lexeme, 24);
-                            CS_SPRINTF(ans->value->lexeme, "%f", ans->value->fvalue);
-                            ans->next = root->next;
-                            //Memory leak!!
-                            //csound->Free(csound, root); mfree(csound, root->right);
-                            return ans;
-                        case '/':
-                            ans->type = ans->value->type = NUMBER_TOKEN;
-                            ans->value->fvalue = lval/rval;
-                            ans->value->lexeme =
-                            (char*)csound->ReAlloc(csound, ans->value->lexeme, 24);
-                            CS_SPRINTF(ans->value->lexeme, "%f", ans->value->fvalue);
-                            ans->next = root->next;
-                            //Memory leak!!
-                            //csound->Free(csound, root); mfree(csound, root->right);
-                            return ans;
-                            /* case S_NEQ: */
-                            /*   break; */
-                            /* case S_AND: */
-                            /*   break; */
-                            /* case S_OR: */
-                            /*   break; */
-                            /* case S_LT: */
-                            /*   break; */
-                            /* case S_LE: */
-                            /*   break; */
-                            /* case S_EQ: */
-                            /*   break; */
-                            /* case S_GT: */
-                            /*   break; */
-                            /* case S_GE: */
-                            /*   break; */
-                        default: break;
-                    }
-                }
+static int same_args(TREE *a, TREE *b)
+{
+    for ( ; a != NULL && b != NULL; a = a->next, b = b->next)
+      if (a->type != b->type || strcmp(a->value->lexeme, b->value->lexeme))
+        return 0;
+    return (a == NULL && b == NULL);
+}
+
+static int shareable(TREE *t, OENTRY *ep)
+{
+    TREE    *arg;
+
+    if (!is_pure(ep) || synthetic_output(t) == NULL)
+      return 0;
+    for (arg = t->right; arg != NULL; arg = arg->next)
+      if (!is_leaf(arg) ||
+          (arg->type == T_IDENT && arg->value->lexeme[0] == 'g'))
+        return 0;               /* globals may change under us */
+    return 1;
+}
+
+/* reuses the result of an identical pure operation earlier in the block */
+static void cse_pass(CSOUND *csound, OPT_BODY *b)
+{
+    int     *avail = csound->Malloc(csound, b->n * sizeof(int));
+    int     navail = 0, i, j, k, last;
+
+    for (i = 0; i < b->n; i++) {
+      TREE    *t = b->stmt[i], *arg;
+      OENTRY  *ep;
+
+      if (i > 0 && b->block[i - 1] == i - 1)
+        navail = 0;             /* new block */
+      if (t == NULL)
+        continue;
+      ep = statement_entry(t);
+      if (ep != NULL && shareable(t, ep)) {
+        for (j = 0; j < navail; j++) {
+          TREE *u = b->stmt[avail[j]];
+          if (u->markup == ep &&
+              u->left->value->lexeme[1] == t->left->value->lexeme[1] &&
+              same_args(u->right, t->right))
+            break;
         }
-        else if (root->right->type == INTEGER_TOKEN ||
-                 root->right->type == NUMBER_TOKEN) {
-            switch (root->type) {
-                case S_UMINUS:
-                    /*print_tree(csound, "root", root);*/
-                    ans = root->right;
-                    ans->value->fvalue =
-                    -(ans->type==INTEGER_TOKEN ? (double)ans->value->value
-                      : ans->value->fvalue);
-                    ans->value->lexeme =
-                    (char*)csound->ReAlloc(csound, ans->value->lexeme, 24);
-                    CS_SPRINTF(ans->value->lexeme, "%f", ans->value->fvalue);
-                    ans->type = ans->value->type = NUMBER_TOKEN;
-                    //print_tree(csound, "ans", ans);
-                    ans->next = root->next;
-                    return ans;
-                default:
-                    break;
-            }
+        if (j < navail) {
+          if (block_uses(csound, b, i, &last) &&
+              replace_uses(csound, b, t->left->value->lexeme,
+                           b->stmt[avail[j]]->left, i + 1, last)) {
+            remove_statement(csound, b, i);
+            b->ncse++;
+          }
+          continue;
         }
+        avail[navail++] = i;
+        continue;
+      }
+      /* drop what this statement may invalidate */
+      for (j = k = 0; j < navail; j++) {
+        for (arg = b->stmt[avail[j]]->right; arg != NULL; arg = arg->next)
+          if (arg->type == T_IDENT && writes_var(t, arg->value->lexeme))
+            break;
+        if (arg == NULL)
+          avail[k++] = avail[j];
+      }
+      navail = k;
     }
-    return root;
+    csound->Free(csound, avail);
+}
+
+static TREE *optimize_body(CSOUND *csound, TREE *root, TYPE_TABLE *typeTable,
+                           int perf, const char *name)
+{
+    OPT_BODY b;
+    TREE    *t, *arg, *head = NULL, *last = NULL;
+    CONS_CELL *parentLabelList = typeTable->labelList;
+    int     i, start;
+
+    memset(&b, 0, sizeof(OPT_BODY));
+    for (t = root; t != NULL; t = t->next)
+      b.n++;
+    if (b.n == 0)
+      return root;
+    b.typeTable = typeTable;
+    b.stmt = csound->Malloc(csound, b.n * sizeof(TREE *));
+    b.block = csound->Malloc(csound, b.n * sizeof(int));
+    b.lastuse = cs_hash_table_create(csound);
+    b.lastwrite = cs_hash_table_create(csound);
+    typeTable->labelList = get_label_list(csound, root);
+
+    for (i = 0, t = root; t != NULL; t = t->next, i++)
+      b.stmt[i] = t;
+    /* blocks start at labels and end after jumps */
+    for (i = start = 0; i < b.n; i++) {
+      OENTRY *ep = statement_entry(b.stmt[i]);
+      if (b.stmt[i]->type == LABEL_TOKEN && i > start) {
+        for ( ; start < i; start++)
+          b.block[start] = i - 1;
+      }
+      if ((ep == NULL && b.stmt[i]->type != LABEL_TOKEN) ||
+          (ep != NULL && is_jump(ep))) {
+        for ( ; start <= i; start++)
+          b.block[start] = i;
+      }
+    }
+    for ( ; start < b.n; start++)
+      b.block[start] = b.n - 1;
+    for (i = 0; i < b.n; i++) {
+      t = b.stmt[i];
+      if (statement_entry(t) == NULL)
+        continue;
+      for (arg = t->right; arg != NULL; arg = arg->next)
+        if (is_synthetic(arg))
+          set_index(csound, b.lastuse, arg->value->lexeme, i);
+      for (arg = t->left; arg != NULL; arg = arg->next)
+        if (arg->value != NULL)
+          set_index(csound, b.lastwrite, arg->value->lexeme, i);
+      if (writes_inputs(statement_entry(t))) {
+        set_index(csound, b.lastwrite, "p3", i);
+        for (arg = t->right; arg != NULL; arg = arg->next)
+          if (arg->type == T_IDENT && !is_synthetic(arg))
+            set_index(csound, b.lastwrite, arg->value->lexeme, i);
+      }
+    }
+
+    copy_pass(csound, &b);
+    if (perf)
+      hoist_pass(csound, &b);
+    fold_pass(csound, &b);
+    cse_pass(csound, &b);
+
+    for (i = 0; i < b.n; i++) {
+      if (b.stmt[i] == NULL)
+        continue;
+      if (last == NULL) head = b.stmt[i];
+      else last->next = b.stmt[i];
+      last = b.stmt[i];
+    }
+    if (last != NULL)
+      last->next = NULL;
+
+    if ((csound->oparms->msglevel & TIMEMSG) &&
+        (b.ncopy | b.nfold | b.nhoist | b.ncse))
+      csound->Message(csound,
+                      Str("%s: %d i() removed, %d constants folded, "
+                          "%d expressions moved to init, "
+                          "%d common subexpressions shared\n"),
+                      name, b.ncopy, b.nfold, b.nhoist, b.ncse);
+
+    cs_cons_free_complete(csound, typeTable->labelList);
+    typeTable->labelList = parentLabelList;
+    cs_hash_table_mfree_complete(csound, b.lastwrite);
+    cs_hash_table_mfree_complete(csound, b.lastuse);
+    csound->Free(csound, b.block);
+    csound->Free(csound, b.stmt);
+    return head;
 }
 
 /* Optimizes tree (expressions, etc.) */
-TREE * csound_orc_optimize(CSOUND *csound, TREE *root)
-{
-    TREE *original=root, *last = NULL;
-    while (root) {
-        TREE *xx = verify_tree1(csound, root);
-        if (xx != root) {
-            xx->next = root->next;
-            if (last) last->next = xx;
-            else original = xx;
-        }
-        last = root;
-        root = root->next;
+TREE * csound_orc_optimize(CSOUND *csound, TREE *root, TYPE_TABLE *typeTable)
+{
+    TREE    *current;
+    char    name[64];
+
+    if (!csound->expr_opt)
+      return root;
+
+    typeTable->localPool = typeTable->instr0LocalPool;
+    root = optimize_body(csound, root, typeTable, 0, "instr 0");
+    for (current = root; current != NULL; current = current->next) {
+      if ((current->type != INSTR_TOKEN && current->type != UDO_TOKEN) ||
+          current->right == NULL)
+        continue;
+      snprintf(name, 64, "%s %s",
+               current->type == UDO_TOKEN ? "opcode" : "instr",
+               current->left != NULL && current->left->value != NULL ?
+               current->left->value->lexeme : "");
+      typeTable->localPool = (CS_VAR_POOL *) current->markup;
+      current->right = optimize_body(csound, current->right, typeTable,
+                                     1, name);
     }
-    return original;
+    typeTable->localPool = typeTable->instr0LocalPool;
+    return root;
 }
@@ -230,6 +230,29 @@ int csoundAddVariable(CSOUND* csound, CS_VAR_POOL* pool, CS_VARIABLE* var) {
   } else return -1;
 }
 
+int csoundRemoveVariable(CSOUND* csound, CS_VAR_POOL* pool, const char* name)
+{
+    CS_VARIABLE* current = pool->head;
+    CS_VARIABLE* previous = NULL;
+
+    while (current != NULL && strcmp(current->varName, name) != 0) {
+      previous = current;
+      current = current->next;
+    }
+    if (current == NULL) return -1;
+
+    if (previous == NULL) pool->head = current->next;
+    else previous->next = current->next;
+    if (pool->tail == current) pool->tail = previous;
+    cs_hash_table_remove(csound, pool->table, current->varName);
+    /* memBlockIndex of the others is set again by recalculateVarPoolMemory */
+    pool->poolSize -= current->memBlockSize;
+    pool->varCount -= 1;
+    csound->Free(csound, current->varName);
+    csound->Free(csound, current);
+    return 0;
+}
+
 void recalculateVarPoolMemory(void* csound, CS_VAR_POOL* pool)
 {
     CS_VARIABLE* current = pool->head;
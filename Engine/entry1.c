@@ -219,6 +219,7 @@ OENTRY opcodlst_1[] = {
   { "##mul.aa",  S(AOP),0,    4,      "a",    "aa",   NULL,   NULL,   mulaa   },
   { "##div.aa",  S(AOP),0,    4,      "a",    "aa",   NULL,   NULL,   divaa   },
   { "##mod.aa",  S(AOP),0,    4,      "a",    "aa",   NULL,   NULL,   modaa   },
+  { "##expr",   S(EXPRFUSE),0, 5,     "a",    "S*",   exprfuse_init, NULL, exprfuse },
   { "divz",   0xfffc                                                      },
   { "divz.ii", S(DIVZ),0,   1,      "i",    "iii",  divzkk, NULL,   NULL    },
   { "divz.kk", S(DIVZ),0,   2,      "k",    "kkk",  NULL,   divzkk, NULL    },
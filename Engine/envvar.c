@@ -67,6 +67,8 @@ typedef struct CSFILE_ {
     int    pos;
     MYFLT *buf;
     int    bufsize;
+    int    direct;      /* write-behind, see csoundFileSetDirect() */
+    off_t  synced;      /* end of the range last pushed out to disk */
     char            fullName[1];
 } CSFILE;
 
@@ -1125,6 +1127,8 @@ void *csoundFileOpenWithType(CSOUND *csound, void *fd, int type,
     p->async_flag = 0;
     p->buf = NULL;
     p->bufsize = 0;
+    p->direct = 0;
+    p->synced = (off_t) 0;
     return (void*) p;
 
  err_return:
@@ -1205,6 +1209,11 @@ void *csoundCreateFileHandle(CSOUND *csound,
     csound->open_files = (void*) p;
     /* return with opaque file handle */
     p->cb = NULL;
+    p->async_flag = 0;
+    p->buf = NULL;
+    p->bufsize = 0;
+    p->direct = 0;
+    p->synced = (off_t) 0;
     return (void*) p;
 }
 
@@ -1227,6 +1236,13 @@ int csoundFileClose(CSOUND *csound, void *fd)
     int     retval = -1;
    if(p->async_flag == ASYNC_GLOBAL) {
      csound->WaitThreadLockNoTimeout(csound->file_io_threadlock);
+     /* write out whatever the I/O thread has not consumed yet */
+     if (p->type == CSFILE_SND_W && p->sf != NULL && p->buf != NULL) {
+       int items;
+       while ((items = csound->ReadCircularBuffer(csound, p->cb, p->buf,
+                                                  p->bufsize)) > 0)
+         sf_write_MYFLT(p->sf, p->buf, items);
+     }
      /* close file */
     switch (p->type) {
       case CSFILE_FD_R:
@@ -1256,6 +1272,8 @@ int csoundFileClose(CSOUND *csound, void *fd)
     p->bufsize = 0;
     csound->DestroyCircularBuffer(csound, p->cb);
     csound->NotifyThreadLock(csound->file_io_threadlock);
+    /* let the I/O thread notice, and exit if this was the last file */
+    csoundFileIOWakeup(csound);
    } else {
    /* close file */
     switch (p->type) {
@@ -1300,6 +1318,10 @@ void close_all_files(CSOUND *csound)
 #endif
         if (csound->file_io_threadlock != NULL)
          csound->DestroyThreadLock(csound->file_io_threadlock);
+        if (csound->file_io_wakeup != NULL)
+         csound->DestroyThreadLock(csound->file_io_wakeup);
+        csound->file_io_threadlock = NULL;
+        csound->file_io_wakeup = NULL;
     }
 }
 
@@ -1351,6 +1373,8 @@ void *csoundFileOpenWithType_Async(CSOUND *csound, void *fd, int type,
       csound->file_io_start = 1;
       csound->file_io_threadlock = csound->CreateThreadLock();
       csound->NotifyThreadLock(csound->file_io_threadlock);
+      if (csound->file_io_wakeup == NULL)
+        csound->file_io_wakeup = csound->CreateThreadLock();
       pthread_create(&csound->file_io_thread,NULL, file_iothread, (void *) csound);
     }
     csound->WaitThreadLockNoTimeout(csound->file_io_threadlock);
@@ -1368,6 +1392,8 @@ void *csoundFileOpenWithType_Async(CSOUND *csound, void *fd, int type,
       csoundFileClose(csound, (void *) p);
       return NULL;
     }
+    /* have input files pre-filled straight away */
+    csoundFileIOWakeup(csound);
     return (void *) p;
 #else
     return NULL;
@@ -1378,8 +1404,14 @@ unsigned int csoundReadAsync(CSOUND *csound, void *handle,
                              MYFLT *buf, int items)
 {
     CSFILE *p = handle;
-    if(p != NULL &&  p->cb != NULL)
-    return csound->ReadCircularBuffer(csound, p->cb, buf, items);
+    unsigned int n;
+    if(p != NULL &&  p->cb != NULL) {
+      n = csound->ReadCircularBuffer(csound, p->cb, buf, items);
+      /* refill once less than half of the buffer is left */
+      if (csoundCircularBufferAvailable(p->cb, 0) < 2*p->bufsize)
+        csoundFileIOWakeup(csound);
+      return n;
+    }
     else return 0;
 }
 
@@ -1387,8 +1419,14 @@ unsigned int csoundWriteAsync(CSOUND *csound, void *handle,
                               MYFLT *buf, int items)
 {
     CSFILE *p = handle;
-    if(p != NULL &&  p->cb != NULL)
-    return csound->WriteCircularBuffer(csound, p->cb, buf, items);
+    unsigned int n;
+    if(p != NULL &&  p->cb != NULL) {
+      n = csound->WriteCircularBuffer(csound, p->cb, buf, items);
+      /* flush as soon as a full block is waiting */
+      if (csoundCircularBufferAvailable(p->cb, 0) >= p->bufsize)
+        csoundFileIOWakeup(csound);
+      return n;
+    }
     else return 0;
 }
 
@@ -1412,9 +1450,91 @@ int csoundFSeekAsync(CSOUND *csound, void *handle, int pos, int whence){
       break;
     }
     csound->NotifyThreadLock(csound->file_io_threadlock);
+    csoundFileIOWakeup(csound);
     return ret;
 }
 
+void csoundFileIOWakeup(CSOUND *csound)
+{
+#if CS_THREADLOCK_WAKEUP
+    if (csound->file_io_wakeup != NULL)
+      csoundNotifyThreadLock(csound->file_io_wakeup);
+#else
+    IGN(csound);
+#endif
+}
+
+void csoundFileAdviseSequential(CSOUND *csound, void *fd)
+{
+    IGN(csound);
+#if defined(POSIX_FADV_SEQUENTIAL) && !defined(WIN32)
+    if (fd != NULL && ((CSFILE*) fd)->fd >= 0)
+      (void) posix_fadvise(((CSFILE*) fd)->fd, (off_t) 0, (off_t) 0,
+                           POSIX_FADV_SEQUENTIAL);
+#else
+    IGN(fd);
+#endif
+}
+
+void csoundFileReadAhead(CSOUND *csound, void *fd, size_t nbytes)
+{
+    IGN(csound);
+#if defined(POSIX_FADV_WILLNEED) && !defined(WIN32)
+    if (fd != NULL && ((CSFILE*) fd)->fd >= 0 && nbytes > 0) {
+      off_t pos = lseek(((CSFILE*) fd)->fd, (off_t) 0, SEEK_CUR);
+      if (pos >= (off_t) 0)
+        (void) posix_fadvise(((CSFILE*) fd)->fd, pos, (off_t) nbytes,
+                             POSIX_FADV_WILLNEED);
+    }
+#else
+    IGN(fd); IGN(nbytes);
+#endif
+}
+
+void csoundFileSetDirect(CSOUND *csound, void *fd, int direct)
+{
+    IGN(csound);
+    if (fd != NULL)
+      ((CSFILE*) fd)->direct = (direct != 0);
+}
+
+/* Write-behind for files marked with csoundFileSetDirect(): start
+   writeback of what the I/O thread has just written, then wait for the
+   previous range (which has had a whole batch worth of time) and drop it
+   from the page cache. Long recordings then neither fill the cache nor
+   stall in one large writeback burst. */
+static void file_write_behind(CSFILE *p)
+{
+#if !defined(WIN32) && \
+    (defined(SYNC_FILE_RANGE_WRITE) || defined(POSIX_FADV_DONTNEED))
+    off_t pos;
+    if (p->fd < 0)
+      return;
+    pos = lseek(p->fd, (off_t) 0, SEEK_CUR);
+    if (pos <= p->synced)
+      return;
+#  ifdef SYNC_FILE_RANGE_WRITE
+    (void) sync_file_range(p->fd, p->synced, pos - p->synced,
+                           SYNC_FILE_RANGE_WRITE);
+    if (p->synced > (off_t) 0)
+      (void) sync_file_range(p->fd, (off_t) 0, p->synced,
+                             SYNC_FILE_RANGE_WAIT_BEFORE |
+                             SYNC_FILE_RANGE_WRITE |
+                             SYNC_FILE_RANGE_WAIT_AFTER);
+#  endif
+#  ifdef POSIX_FADV_DONTNEED
+    /* only clean pages are dropped, so this never loses data */
+    if (p->synced > (off_t) 0)
+      (void) posix_fadvise(p->fd, (off_t) 0, p->synced, POSIX_FADV_DONTNEED);
+#  endif
+    p->synced = pos;
+#else
+    IGN(p);
+#endif
+}
+
+/* longest time (ms) the I/O thread sleeps without being woken up */
+#define FILE_IO_TIMEOUT 100
 
 static int read_files(CSOUND *csound){
   CSFILE *current = (CSFILE *) csound->open_files;
@@ -1432,20 +1552,27 @@ static int read_files(CSOUND *csound){
       case CSFILE_STD:
         break;
       case CSFILE_SND_R:
-       if(n == 0) {
-           n = sf_read_MYFLT(current->sf, buf, items);
-           m = 0;
-        }
-        l = csound->WriteCircularBuffer(csound,current->cb,&buf[m],n);
-        m += l;
-        n -= l;
+        /* top up the buffer until it is full or the file ends */
+        do {
+          if(n == 0) {
+            n = sf_read_MYFLT(current->sf, buf, items);
+            m = 0;
+            if (n <= 0) { n = 0; break; }
+          }
+          l = csound->WriteCircularBuffer(csound,current->cb,&buf[m],n);
+          m += l;
+          n -= l;
+        } while (n == 0);
         current->items = n;
         current->pos = m;
         break;
       case CSFILE_SND_W:
-        items = csound->ReadCircularBuffer(csound, current->cb, buf, items);
-        if(items == 0) { csoundSleep(10); break;}
-        sf_write_MYFLT(current->sf, buf, items);
+        /* write out everything queued so far */
+        while ((l = csound->ReadCircularBuffer(csound, current->cb,
+                                               buf, items)) > 0)
+          sf_write_MYFLT(current->sf, buf, l);
+        if (current->direct)
+          file_write_behind(current);
         break;
     }
     }
@@ -1460,11 +1587,18 @@ static int read_files(CSOUND *csound){
 void *file_iothread(void *p){
   int res = 1;
   CSOUND *csound = p;
+#if !CS_THREADLOCK_WAKEUP
   int wakeup = (int) (1000*csound->ksmps/csound->esr);
-  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
   if(wakeup == 0) wakeup = 1;
+#endif
+  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
   while(res){
+#if CS_THREADLOCK_WAKEUP
+    /* sleep until a file needs servicing; the timeout is a safety net */
+    csoundWaitThreadLock(csound->file_io_wakeup, FILE_IO_TIMEOUT);
+#else
     csoundSleep(wakeup);
+#endif
     csound->WaitThreadLockNoTimeout(csound->file_io_threadlock);
     res = read_files(csound);
     csound->NotifyThreadLock(csound->file_io_threadlock);
@@ -485,8 +485,13 @@ int MIDIinsert(CSOUND *csound, int insno, MCHNBLK *chn, MEVENT *mep)
     ip->offbet       = -1.0;
     ip->offtim       = -1.0;              /* set indef duration */
     ip->opcod_iobufs = NULL;              /* IV - Sep 8 2002:            */
+    /* timestamped MIDI input starts the note within the k-period */
+    ip->ksmps_offset = csound->midiGlobals->midiOffset;
+    csound->midiGlobals->midiOffset = 0;
+    ip->ksmps_no_end = ip->no_end = 0;
     ip->p1.value     = (MYFLT) insno;     /* set these required p-fields */
-    ip->p2.value     = (MYFLT) (csound->icurTime/csound->esr - csound->timeOffs);
+    ip->p2.value     = (MYFLT) ((csound->icurTime + ip->ksmps_offset)/csound->esr
+                                - csound->timeOffs);
     ip->p3.value     = FL(-1.0);
     ip->ksmps = csound->ksmps;
     ip->ekr = csound->ekr;
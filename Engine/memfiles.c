@@ -31,6 +31,15 @@
 #include "namedins.h"
 #include <sndfile.h>
 #include <string.h>
+#include <stddef.h>
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H) && !defined(WIN32)
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  define SNDMEMFILE_MMAP 1
+#endif
 
 static int Load_Het_File_(CSOUND *csound, const char *filnam,
                           char **allocp, int32 *len)
@@ -551,6 +560,224 @@ int PVOCEX_LoadFile(CSOUND *csound, const char *fname, PVOCEX_MEMFILE *p)
 
  /* ------------------------------------------------------------------------ */
 
+/* SNDMEMFILE keeps its sample data inline, as plugins expect, so the
+   mapping of a memory mapped file is recorded in front of it; a mapped
+   file has this structure placed directly before the mapped samples */
+
+typedef struct {
+    void        *mapBase;       /* start of the mapping, NULL: heap copy */
+    size_t      mapSize;        /* length of the mapping in bytes        */
+    SNDMEMFILE  f;
+} SNDMEMFILE_PRIV;
+
+#define SNDMEM_PRIV(p) \
+    ((SNDMEMFILE_PRIV*) ((char*) (p) - offsetof(SNDMEMFILE_PRIV, f)))
+
+#ifdef SNDMEMFILE_MMAP
+
+static inline uint32_t sndmem_le32(const unsigned char *b)
+{
+    return ((uint32_t) b[0] | ((uint32_t) b[1] << 8)
+            | ((uint32_t) b[2] << 16) | ((uint32_t) b[3] << 24));
+}
+
+static inline uint32_t sndmem_be32(const unsigned char *b)
+{
+    return ((uint32_t) b[3] | ((uint32_t) b[2] << 8)
+            | ((uint32_t) b[1] << 16) | ((uint32_t) b[0] << 24));
+}
+
+static int sndmem_host_is_big_endian(void)
+{
+    union { int32_t i; char c[4]; } u;
+    u.i = 1;
+    return (u.c[0] == 0);
+}
+
+/**
+ * Find the byte offset of the sample data in an uncompressed WAV or AIFF
+ * file by walking its chunk list, and its byte order (1: big endian).
+ * Returns the offset, or -1 if the file has no usable data chunk.
+ */
+
+static off_t sndmem_find_data(int fd, int fileType, off_t fileSize,
+                              int *bigEndian)
+{
+    unsigned char b[16];
+    off_t   pos = (off_t) 12;
+    int     wav = (fileType == TYP_WAV || fileType == TYP_WAVEX);
+
+    if (pread(fd, b, 12, (off_t) 0) != 12)
+      return (off_t) -1;
+    if (wav) {
+      if (memcmp(b, "RIFF", 4) != 0 || memcmp(b + 8, "WAVE", 4) != 0)
+        return (off_t) -1;          /* RIFX, RF64 etc. are not mapped */
+      *bigEndian = 0;
+    }
+    else {
+      if (memcmp(b, "FORM", 4) != 0 ||
+          (memcmp(b + 8, "AIFF", 4) != 0 && memcmp(b + 8, "AIFC", 4) != 0))
+        return (off_t) -1;
+      *bigEndian = 1;
+    }
+    while (pos + 8 <= fileSize) {
+      uint32_t  len;
+      if (pread(fd, b, 16, pos) < 8)
+        return (off_t) -1;
+      len = (wav ? sndmem_le32(b + 4) : sndmem_be32(b + 4));
+      if (wav && memcmp(b, "data", 4) == 0)
+        return pos + 8;
+      if (!wav && memcmp(b, "SSND", 4) == 0)
+        return pos + 16 + (off_t) sndmem_be32(b + 8);
+      if (!wav && memcmp(b, "COMM", 4) == 0 && len >= 22) {
+        /* AIFC compression type: only big endian 'fl32' is mapped */
+        unsigned char c[4];
+        if (pread(fd, c, 4, pos + 8 + 18) != 4 ||
+            (memcmp(c, "fl32", 4) != 0 && memcmp(c, "FL32", 4) != 0))
+          return (off_t) -1;
+      }
+      pos += (off_t) 8 + (off_t) len + (off_t) (len & 1U);
+    }
+    return (off_t) -1;
+}
+
+/**
+ * Try to map the sample data of the file described by 'hdr' directly from
+ * the file system instead of decoding it into memory. This is only
+ * possible for 32 bit float WAV, AIFF and raw files in the host byte
+ * order; the pages are then shared through the OS page cache, and only
+ * faulted in when accessed. The file is mapped privately behind an
+ * anonymous page, so that a copy of 'hdr' can be stored right in front of
+ * the samples; only the page it shares with the file, if any, is copied.
+ * Returns the new SNDMEMFILE, or NULL if the file cannot be mapped.
+ */
+
+static SNDMEMFILE *sndmem_map_file(CSOUND *csound, const SNDMEMFILE *hdr,
+                                   SF_INFO *sfinfo)
+{
+    SNDMEMFILE_PRIV *pp;
+    struct stat st;
+    off_t   dataOffs, mapOffs;
+    size_t  dataBytes, hdrBytes, preSize, mapSize;
+    long    pageSize;
+    int     fd, bigEndian = sndmem_host_is_big_endian();
+    void    *base;
+
+    if (!csound->mmap_sndfiles || hdr->sampleFormat != AE_FLOAT)
+      return NULL;
+    if (hdr->fileType != TYP_WAV && hdr->fileType != TYP_WAVEX &&
+        hdr->fileType != TYP_AIFF && hdr->fileType != TYP_RAW)
+      return NULL;
+    fd = open(hdr->fullName, O_RDONLY);
+    if (fd < 0)
+      return NULL;
+    if (fstat(fd, &st) != 0)
+      goto err_return;
+    if (hdr->fileType == TYP_RAW) {
+      int endian = sfinfo->format & SF_FORMAT_ENDMASK;
+      dataOffs = (off_t) 0;
+      if (endian == SF_ENDIAN_LITTLE)
+        bigEndian = 0;
+      else if (endian == SF_ENDIAN_BIG)
+        bigEndian = 1;
+    }
+    else
+      dataOffs = sndmem_find_data(fd, hdr->fileType, st.st_size, &bigEndian);
+    dataBytes = hdr->nFrames * (size_t) hdr->nChannels * sizeof(float);
+    hdrBytes = offsetof(SNDMEMFILE_PRIV, f) + offsetof(SNDMEMFILE, data);
+    /* the structure in front of the samples must be suitably aligned */
+    if (dataOffs < (off_t) 0 ||
+        ((dataOffs - (off_t) hdrBytes) & (off_t) (sizeof(double) - 1)) != 0 ||
+        bigEndian != sndmem_host_is_big_endian() ||
+        dataOffs + (off_t) dataBytes > st.st_size || dataBytes == 0)
+      goto err_return;
+    pageSize = sysconf(_SC_PAGESIZE);
+    if (pageSize <= 0)
+      pageSize = 4096;
+    mapOffs = dataOffs & ~((off_t) pageSize - 1);
+    preSize = (hdrBytes + (size_t) pageSize - 1) & ~((size_t) pageSize - 1);
+    mapSize = preSize + (size_t) (dataOffs - mapOffs) + dataBytes;
+    base = mmap(NULL, mapSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, (off_t) 0);
+    if (base == MAP_FAILED)
+      goto err_return;
+    if (mmap((char*) base + preSize, mapSize - preSize, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, mapOffs) == MAP_FAILED) {
+      munmap(base, mapSize);
+      goto err_return;
+    }
+    close(fd);                  /* the mapping stays valid */
+    pp = (SNDMEMFILE_PRIV*) ((char*) base + preSize
+                             + (size_t) (dataOffs - mapOffs) - hdrBytes);
+    pp->mapBase = base;
+    pp->mapSize = mapSize;
+    memcpy(&(pp->f), hdr, offsetof(SNDMEMFILE, data));
+    return &(pp->f);
+
+ err_return:
+    close(fd);
+    return NULL;
+}
+
+#endif  /* SNDMEMFILE_MMAP */
+
+/**
+ * Hint that sample frames startFrame to startFrame + nFrames - 1 of a
+ * sound file loaded with csoundLoadSoundFile() will be read soon, so that
+ * the OS can start paging them in. Does nothing if the file is not mapped.
+ */
+
+void csoundPrefetchSoundFile(CSOUND *csound, SNDMEMFILE *p,
+                             size_t startFrame, size_t nFrames)
+{
+#ifdef SNDMEMFILE_MMAP
+    uintptr_t start, end, pageMask;
+
+    (void) csound;
+    if (p == NULL || SNDMEM_PRIV(p)->mapBase == NULL ||
+        startFrame >= p->nFrames)
+      return;
+    if (nFrames > p->nFrames - startFrame)
+      nFrames = p->nFrames - startFrame;
+    pageMask = (uintptr_t) sysconf(_SC_PAGESIZE) - 1;
+    start = (uintptr_t) (p->data + startFrame * (size_t) p->nChannels);
+    end = (uintptr_t) (p->data + (startFrame + nFrames) * (size_t) p->nChannels);
+    start &= ~pageMask;
+    if (start < (uintptr_t) SNDMEM_PRIV(p)->mapBase)
+      start = (uintptr_t) SNDMEM_PRIV(p)->mapBase;
+    if (end > start)
+      madvise((void*) start, (size_t) (end - start), MADV_WILLNEED);
+#else
+    (void) csound; (void) p; (void) startFrame; (void) nFrames;
+#endif
+}
+
+/**
+ * Unmap all memory mapped sound files; called on reset, the heap copies
+ * are released with the rest of the memory pool.
+ */
+
+void rlssndmemfiles(CSOUND *csound)
+{
+#ifdef SNDMEMFILE_MMAP
+    CONS_CELL *values, *cell;
+
+    if (csound->sndmemfiles == NULL)
+      return;
+    values = cs_hash_table_values(csound, csound->sndmemfiles);
+    for (cell = values; cell != NULL; cell = cell->next) {
+      SNDMEMFILE_PRIV *pp = SNDMEM_PRIV(cell->value);
+      /* the structure itself goes with the mapping */
+      if (pp->mapBase != NULL)
+        munmap(pp->mapBase, pp->mapSize);
+    }
+    cs_cons_free(csound, values);
+#endif
+    csound->sndmemfiles = NULL;
+}
+
+ /* ------------------------------------------------------------------------ */
+
 /**
  * Load an entire sound file into memory.
  * 'fileName' is the file name (searched in the current directory first,
@@ -571,7 +798,8 @@ SNDMEMFILE *csoundLoadSoundFile(CSOUND *csound, const char *fileName, void *sfi)
     SF_INFO       *sfinfo = sfi;
     SNDFILE       *sf;
     void          *fd;
-    SNDMEMFILE    *p = NULL;
+    SNDMEMFILE    *p = NULL, hdr;
+    SNDMEMFILE_PRIV *pp;
     SF_INFO       tmp;
 
 
@@ -610,10 +838,9 @@ SNDMEMFILE *csoundLoadSoundFile(CSOUND *csound, const char *fileName, void *sfi)
                        fileName);
       return NULL;
     }
-    p = (SNDMEMFILE*)
-            csound->Malloc(csound, sizeof(SNDMEMFILE)
-                           + (size_t)  sfinfo->frames * sizeof(float));
     /* set parameters */
+    memset(&hdr, 0, sizeof(SNDMEMFILE));
+    p = &hdr;
     p->name = (char*) csound->Malloc(csound, strlen(fileName) + 1);
     strcpy(p->name, fileName);
     p->fullName = (char*) csound->Malloc(csound,
@@ -651,17 +878,37 @@ SNDMEMFILE *csoundLoadSoundFile(CSOUND *csound, const char *fileName, void *sfi)
         p->scaleFac = pow(10.0, (double) lpd.gain * 0.05);
       }
     }
+#ifdef SNDMEMFILE_MMAP
+    if ((p = sndmem_map_file(csound, &hdr, sfinfo)) != NULL) {
+      csound->FileClose(csound, fd);
+      csound->Message(csound, Str("File '%s' (sr = %d Hz, %d channel(s), %lu "
+                                  "sample frames) mapped into memory\n"),
+                              p->fullName, (int) sfinfo->samplerate,
+                              (int) sfinfo->channels,
+                              (uint32) sfinfo->frames);
+      cs_hash_table_put(csound, csound->sndmemfiles, (char*)fileName, p);
+      return p;
+    }
+#endif
+    pp = (SNDMEMFILE_PRIV*)
+            csound->Malloc(csound, sizeof(SNDMEMFILE_PRIV)
+                           + (size_t) hdr.nFrames * (size_t) hdr.nChannels
+                             * sizeof(float));
+    pp->mapBase = NULL;
+    pp->mapSize = 0;
+    memcpy(&(pp->f), &hdr, offsetof(SNDMEMFILE, data));
+    p = &(pp->f);
     if ((size_t) sf_readf_float(sf, &(p->data[0]), (sf_count_t) p->nFrames)
         != p->nFrames) {
       csound->FileClose(csound, fd);
       csound->Free(csound, p->name);
       csound->Free(csound, p->fullName);
-      csound->Free(csound, p);
+      csound->Free(csound, pp);
       csound->ErrorMsg(csound, Str("csoundLoadSoundFile(): error reading '%s'"),
                                fileName);
       return NULL;
     }
-    p->data[p->nFrames] = 0.0f;
+    p->data[p->nFrames * (size_t) p->nChannels] = 0.0f;
     csound->FileClose(csound, fd);
     csound->Message(csound, Str("File '%s' (sr = %d Hz, %d channel(s), %lu "
                                 "sample frames) loaded into memory\n"),
@@ -46,9 +46,11 @@ extern  void    beatexpire(CSOUND *, double), timexpire(CSOUND *, double);
 extern  void    sfopenin(CSOUND *), sfopenout(CSOUND*), sfnopenout(CSOUND*);
 extern  void    iotranset(CSOUND *), sfclosein(CSOUND*), sfcloseout(CSOUND*);
 extern  void    MidiClose(CSOUND *);
+extern  void    csoundMIDIFileSeek(CSOUND *, unsigned long);
 extern  void    RTclose(CSOUND *);
 extern  void    remote_Cleanup(CSOUND *);
 extern  char    **csoundGetSearchPathFromEnv(CSOUND *, const char *);
+extern  void    merge_pending_states(CSOUND *);
 /* extern  void    initialize_instrument0(CSOUND *); */
 
 typedef struct evt_cb_func {
@@ -785,6 +787,10 @@ static int process_score_event(CSOUND *csound, EVTBLK *evt, int rtEvt)
         kCnt = (int64_t) ((double) csound->ekr * (double) evt->p[3] + 0.5);
         if (kCnt > csound->advanceCnt) {
           csound->advanceCnt = kCnt;
+          /* MIDI file: continue where the skip ends */
+          if (csound->oparms->FMidiin)
+            csoundMIDIFileSeek(csound, (unsigned long)
+                               (csound->global_kcounter + kCnt));
           csound->Message(csound,
                           Str("time advanced %5.3f beats by score request\n"),
                         evt->p3orig);
@@ -906,6 +912,10 @@ int sensevents(CSOUND *csound)
         return 0; /* don't process events if we're in debug mode and stopped */
     }
 
+    /* bring in orchestras compiled off the performance thread */
+    if (UNLIKELY(csound->pending_states != NULL))
+      merge_pending_states(csound);
+
     if (UNLIKELY(csound->MTrkend && O->termifend)) {   /* end of MIDI file:  */
       deactivate_all_notes(csound);
       csound->Message(csound, Str("terminating.\n"));
@@ -63,7 +63,7 @@ extern void init_symbtab(CSOUND*);
 extern void print_tree(CSOUND *, char *, TREE *);
 extern TREE* verify_tree(CSOUND *, TREE *, TYPE_TABLE*);
 extern TREE *csound_orc_expand_expressions(CSOUND *, TREE *);
-extern TREE* csound_orc_optimize(CSOUND *, TREE *);
+extern TREE* csound_orc_optimize(CSOUND *, TREE *, TYPE_TABLE *);
 extern void csp_orc_analyze_tree(CSOUND* csound, TREE* root);
 
 
@@ -125,10 +125,49 @@ void add_include_udo_dir(CORFIL *xx)
 #endif
 }
 
+/* Runs the parser on preprocessed text, returning 0 on success */
+int parse_orc_text(CSOUND *csound, const char *text, size_t len,
+                   TREE **astTree)
+{
+    PARSE_PARM  pp;
+    int err;
+
+    memset(&pp, '\0', sizeof(PARSE_PARM));
+    init_symbtab(csound);
+
+    csound_orcdebug = csound->oparms->odebug;
+    csound_orclex_init(&pp.yyscanner);
+
+    csound_orcset_extra(&pp, pp.yyscanner);
+    csound_orc_scan_buffer(text, len, pp.yyscanner);
+
+    err = csound_orcparse(&pp, pp.yyscanner, csound, astTree);
+    csound_orclex_destroy(pp.yyscanner);
+
+    if (csound->synterrcnt) err = 3;
+    if (LIKELY(err == 0)) {
+      if(csound->oparms->odebug) csound->Message(csound,
+                                                 Str("Parsing successful!\n"));
+    }
+    else {
+      if (err == 1){
+        csound->Message(csound, Str("Parsing failed due to invalid input!\n"));
+      }
+      else if (err == 2){
+        csound->Message(csound,
+                        Str("Parsing failed due to memory exhaustion!\n"));
+      }
+      else if (err == 3){
+        csound->Message(csound, Str("Parsing failed due to %d syntax error%s!\n"),
+                        csound->synterrcnt, csound->synterrcnt==1?"":"s");
+      }
+    }
+    return err;
+}
+
 TREE *csoundParseOrc(CSOUND *csound, const char *str)
 {
     int err;
-    OPARMS *O = csound->oparms;
     csound->parserNamedInstrFlag = 2;
     {
       PRE_PARM    qq;
@@ -194,46 +233,19 @@ TREE *csoundParseOrc(CSOUND *csound, const char *str)
          by make leaf */
       TREE* astTree = NULL;// = (TREE *)csound->Calloc(csound, sizeof(TREE));
       TREE* newRoot;
-      PARSE_PARM  pp;
       TYPE_TABLE* typeTable = NULL;
-
-      /* Parse */
-      memset(&pp, '\0', sizeof(PARSE_PARM));
-      init_symbtab(csound);
-
-      csound_orcdebug = O->odebug;
-      csound_orclex_init(&pp.yyscanner);
-
-
-      csound_orcset_extra(&pp, pp.yyscanner);
-      csound_orc_scan_buffer(corfile_body(csound->expanded_orc),
-                             corfile_tell(csound->expanded_orc), pp.yyscanner);
-
-      //csound_orcset_lineno(csound->orcLineOffset, pp.yyscanner);
-      //printf("%p \n", astTree);
-      err = csound_orcparse(&pp, pp.yyscanner, csound, &astTree);
-      //printf("%p \n", astTree);
-      // print_tree(csound, "AST - AFTER csound_orcparse()\n", astTree);
-      //csp_orc_sa_cleanup(csound);
-      corfile_rm(&csound->expanded_orc);
-
-      if (csound->synterrcnt) err = 3;
-      if (LIKELY(err == 0)) {
-        if(csound->oparms->odebug) csound->Message(csound,
-                                                   Str("Parsing successful!\n"));
-      }
-      else {
-        if (err == 1){
-          csound->Message(csound, Str("Parsing failed due to invalid input!\n"));
-        }
-        else if (err == 2){
-          csound->Message(csound,
-                          Str("Parsing failed due to memory exhaustion!\n"));
-        }
-        else if (err == 3){
-          csound->Message(csound, Str("Parsing failed due to %d syntax error%s!\n"),
-                          csound->synterrcnt, csound->synterrcnt==1?"":"s");
-        }
+      ORC_CACHE_PLAN* plan;
+      char *stub;
+
+      /* Parse, leaving out the bodies of instruments compiled before */
+      plan = csound_orc_cache_plan(csound, corfile_body(csound->expanded_orc),
+                                   corfile_tell(csound->expanded_orc));
+      stub = csound_orc_cache_stub(plan);
+      err = parse_orc_text(csound,
+                           stub ? stub : corfile_body(csound->expanded_orc),
+                           corfile_tell(csound->expanded_orc), &astTree);
+      if (err) {
+        corfile_rm(&csound->expanded_orc);
         goto ending;
       }
        if (UNLIKELY(PARSER_DEBUG)) {
@@ -250,6 +262,20 @@ TREE *csoundParseOrc(CSOUND *csound, const char *str)
       typeTable->localPool = typeTable->instr0LocalPool;
       typeTable->labelList = NULL;
 
+      if (plan != NULL &&
+          !csound_orc_cache_prepare(csound, plan, astTree, typeTable)) {
+        /* the text did not split as expected: parse all of it */
+        csoundDeleteTree(csound, astTree);
+        astTree = NULL;
+        csound_orc_cache_free(csound, plan);
+        plan = NULL;
+        err = parse_orc_text(csound, corfile_body(csound->expanded_orc),
+                             corfile_tell(csound->expanded_orc), &astTree);
+      }
+      corfile_rm(&csound->expanded_orc);
+      if (err)
+        goto ending;
+
       /**** THIS NEXT LINE IS WRONG AS err IS int WHILE FN RETURNS TREE* ****/
       astTree = verify_tree(csound, astTree, typeTable);
 //      csound->Free(csound, typeTable->instr0LocalPool);
@@ -281,8 +307,8 @@ TREE *csoundParseOrc(CSOUND *csound, const char *str)
         }
 
     ending:
-      csound_orclex_destroy(pp.yyscanner);
       if (err) {
+        csound_orc_cache_free(csound, plan);
         csound->ErrorMsg(csound, Str("Stopping on parser failure"));
         csoundDeleteTree(csound, astTree);
         if (typeTable != NULL) {
@@ -298,7 +324,18 @@ TREE *csoundParseOrc(CSOUND *csound, const char *str)
         return NULL;
       }
 
-      astTree = csound_orc_optimize(csound, astTree);
+      astTree = csound_orc_optimize(csound, astTree, typeTable);
+      if (plan != NULL) {
+        err = csound_orc_cache_finish(csound, plan, astTree, typeTable);
+        csound_orc_cache_free(csound, plan);
+        plan = NULL;
+        if (err) {
+          csound->Message(csound,
+                          Str("Parsing failed due to %d semantic error%s!\n"),
+                          csound->synterrcnt, csound->synterrcnt==1?"":"s");
+          goto ending;
+        }
+      }
 
       // small hack: use an extra node as head of tree list to hold the
       // typeTable, to be used during compilation
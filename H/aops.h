@@ -93,6 +93,39 @@ typedef struct {
     MYFLT   *r, *a;
 } EVAL;
 
+/* fused arithmetic expressions (##expr), generated by the compiler */
+#define EXPR_MAXARGS (32)       /* leaves in one fused expression */
+#define EXPR_CHUNK   (32)       /* samples evaluated per pass */
+
+enum {
+    EXPR_ADD, EXPR_SUB, EXPR_MUL, EXPR_DIV, EXPR_MOD,  /* binary */
+    EXPR_NEG, EXPR_ABS, EXPR_EXP, EXPR_LOG, EXPR_SQRT,
+    EXPR_SIN, EXPR_COS, EXPR_TAN, EXPR_ASIN, EXPR_ACOS, EXPR_ATAN,
+    EXPR_SINH, EXPR_COSH, EXPR_TANH, EXPR_LOG10, EXPR_LOG2,
+    EXPR_INT, EXPR_FRAC, EXPR_ROUND, EXPR_FLOOR, EXPR_CEIL
+};
+
+enum { EXPR_SCALAR, EXPR_SIGNAL, EXPR_TEMP };
+
+typedef struct {
+    int     op;
+    int     akind, bkind;       /* EXPR_SCALAR, EXPR_SIGNAL or EXPR_TEMP */
+    MYFLT   *a, *b;             /* scalar value or input signal */
+    int     ta, tb;             /* scratch rows of EXPR_TEMP operands */
+    int     tr;                 /* scratch row of result, -1 for output */
+    MYFLT   *r;                 /* result of a scalar instruction */
+} EXPRINS;
+
+typedef struct {
+    OPDS    h;
+    MYFLT   *r;
+    STRINGDAT *prog;
+    MYFLT   *args[EXPR_MAXARGS];
+    int     ninit, nk, na;      /* instructions run at i-, k- and a-rate */
+    EXPRINS *ins;
+    AUXCH   auxch;
+} EXPRFUSE;
+
 typedef struct {
     OPDS    h;
     MYFLT   *ar;
@@ -43,4 +43,16 @@ ORCTOKEN *make_token(CSOUND *csound, char *s);
 extern int ksmps, nchnls; */
 
 void query_deprecated_opcode(CSOUND *, ORCTOKEN *);
+
+/* compiled instrument cache (csound_orc_cache.c) */
+typedef struct orc_cache_plan ORC_CACHE_PLAN;
+ORC_CACHE_PLAN *csound_orc_cache_plan(CSOUND *, const char *, size_t);
+char *csound_orc_cache_stub(ORC_CACHE_PLAN *);
+int csound_orc_cache_prepare(CSOUND *, ORC_CACHE_PLAN *, TREE *, TYPE_TABLE *);
+int csound_orc_cache_finish(CSOUND *, ORC_CACHE_PLAN *, TREE *, TYPE_TABLE *);
+void csound_orc_cache_free(CSOUND *, ORC_CACHE_PLAN *);
+void csound_orc_cache_destroy(CSOUND *);
+
+/* new_orc_parser.c */
+int parse_orc_text(CSOUND *, const char *, size_t, TREE **);
 #endif
@@ -72,6 +72,9 @@ typedef struct {
   MYFLT aOut_bufsize;
   void *cb;
   int  async;
+  void *io;                     /* shared streaming service (async mode) */
+  int  lowWater;                /* buffered samples below which to refill */
+  int  frameBytes;              /* size of a sample frame in the file */
 } DISKIN2;
 
 typedef struct {
@@ -114,6 +117,9 @@ typedef struct {
   MYFLT aOut_bufsize;
   void *cb;
   int  async;
+  void *io;                     /* shared streaming service (async mode) */
+  int  lowWater;                /* buffered samples below which to refill */
+  int  frameBytes;              /* size of a sample frame in the file */
 } DISKIN2_ARRAY;
 
 int diskin2_init(CSOUND *csound, DISKIN2 *p);
@@ -103,6 +103,7 @@ int     acos1(CSOUND *, void *), atan1(CSOUND *, void *);
 int     sinh1(CSOUND *, void *), cosh1(CSOUND *, void *);
 int     tanh1(CSOUND *, void *), log101(CSOUND *, void *), log21(CSOUND *, void *);
 int     atan21(CSOUND *, void *), atan2aa(CSOUND *, void *);
+int     exprfuse_init(CSOUND *, void *), exprfuse(CSOUND *, void *);
 int     absa(CSOUND *, void *), expa(CSOUND *, void *);
 int     loga(CSOUND *, void *), sqrta(CSOUND *, void *);
 int     sina(CSOUND *, void *), cosa(CSOUND *, void *);
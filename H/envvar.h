@@ -30,6 +30,15 @@
 
 #ifdef __cplusplus
 extern "C" {
+#endif
+
+  /* Thread locks can be used to wake another thread on platforms where */
+  /* they are implemented as binary semaphores; elsewhere they are plain */
+  /* mutexes and I/O threads have to poll.                               */
+#if !defined(ANDROID) && (defined(__HAIKU__) || defined(WIN32))
+#  define CS_THREADLOCK_WAKEUP  0
+#else
+#  define CS_THREADLOCK_WAKEUP  1
 #endif
 
   /**
@@ -241,6 +250,32 @@ extern "C" {
 
   int csoundFSeekAsync(CSOUND *csound, void *handle, int pos, int whence);
 
+  /**
+   * Hint that a file opened with csoundFileOpenWithType() will be read
+   * sequentially from now on, so the OS can use a larger read-ahead window.
+   */
+  void csoundFileAdviseSequential(CSOUND *csound, void *fd);
+
+  /**
+   * Ask the OS to start reading the next 'nbytes' bytes of a file opened
+   * with csoundFileOpenWithType() into the page cache, from the current
+   * file position, without waiting for the data.
+   */
+  void csoundFileReadAhead(CSOUND *csound, void *fd, size_t nbytes);
+
+  /**
+   * Have the asynchronous file I/O thread write a sound file opened with
+   * csoundFileOpenWithType_Async() behind: data is pushed out to disk as
+   * it is written and then dropped from the page cache.
+   */
+  void csoundFileSetDirect(CSOUND *csound, void *fd, int direct);
+
+  /**
+   * Wake up the asynchronous file I/O thread, e.g. when a stream buffer
+   * has dropped below its low-water mark.
+   */
+  void csoundFileIOWakeup(CSOUND *csound);
+
 
 #ifdef __cplusplus
 }
@@ -32,9 +32,14 @@ extern "C" {
 
 int csoundMIDIFileOpen(CSOUND *csound, const char *name);
 
-/* read MIDI file event data at performace time */
+/* get the next MIDI file event due at the current k-period; returns 1 */
+/* and fills in *mep if there is one, 0 otherwise                      */
 
-int csoundMIDIFileRead(CSOUND *csound, unsigned char *buf, int nBytes);
+int csoundMIDIFileEvent(CSOUND *csound, MEVENT *mep);
+
+/* position the MIDI file at a k-period, chasing controller state */
+
+void csoundMIDIFileSeek(CSOUND *csound, unsigned long kcnt);
 
 /* destroy MIDI file event list */
 
@@ -85,6 +85,8 @@ int     insert_score_event(CSOUND *, EVTBLK *, double);
 MEMFIL  *ldmemfile2withCB(CSOUND *csound, const char *filnam, int csFileType,
                          int (*callback)(CSOUND*, MEMFIL*));
 void    rlsmemfiles(CSOUND *);
+void    rlssndmemfiles(CSOUND *);
+int     csoundCircularBufferAvailable(void *cb, int forWrite);
 int     delete_memfile(CSOUND *, const char *);
 char    *csoundTmpFileName(CSOUND *, const char *);
 void    *SAsndgetset(CSOUND *, char *, void *, MYFLT *, MYFLT *, MYFLT *, int);
@@ -93,6 +95,8 @@ void    *sndgetset(CSOUND *, void *);
 void    dbfs_init(CSOUND *, MYFLT dbfs);
 int     csoundLoadExternals(CSOUND *);
 SNDMEMFILE  *csoundLoadSoundFile(CSOUND *, const char *name, void *sfinfo);
+void    csoundPrefetchSoundFile(CSOUND *, SNDMEMFILE *,
+                                size_t startFrame, size_t nFrames);
 int     PVOCEX_LoadFile(CSOUND *, const char *fname, PVOCEX_MEMFILE *p);
 void    print_opcodedir_warning(CSOUND *);
 int     check_rtaudio_name(char *fName, char **devName, int isOutput);
@@ -62,6 +62,26 @@ static int checkspace(circular_buffer *p, int writeCheck){
     }
 }
 
+/* Number of items that can be read (forWrite == 0) or written (forWrite
+   != 0) without blocking; used by the streaming I/O threads to decide when
+   a buffer needs servicing. */
+int csoundCircularBufferAvailable(void *p, int forWrite)
+{
+    if (p == NULL) return 0;
+    return checkspace((circular_buffer *) p, forWrite);
+}
+
+/* copy items from/to the ring in at most two contiguous segments */
+static inline void cb_copy_out(circular_buffer *p, void *out, int rp, int n)
+{
+    int elemsize = p->elemsize, first = p->numelem - rp;
+    if (first > n) first = n;
+    memcpy(out, &(p->buffer[elemsize * rp]), (size_t) (first * elemsize));
+    if (n > first)
+      memcpy((char *) out + (first * elemsize), p->buffer,
+             (size_t) ((n - first) * elemsize));
+}
+
 int csoundReadCircularBuffer(CSOUND *csound, void *p, void *out, int items)
 {
     IGN(csound);
@@ -69,20 +89,14 @@ int csoundReadCircularBuffer(CSOUND *csound, void *p, void *out, int items)
     {
       int remaining;
       int itemsread, numelem = ((circular_buffer *)p)->numelem;
-      int elemsize = ((circular_buffer *)p)->elemsize;
-      int i=0, rp = ((circular_buffer *)p)->rp;
-      char *buffer = ((circular_buffer *)p)->buffer;
+      int rp = ((circular_buffer *)p)->rp;
       if ((remaining = checkspace(p, 0)) == 0) {
         return 0;
       }
       itemsread = items > remaining ? remaining : items;
-      for (i=0; i < itemsread; i++){
-        memcpy((char *) out + (i * elemsize),
-               &(buffer[elemsize * rp++]),  elemsize);
-        if (rp == numelem) {
-          rp = 0;
-        }
-      }
+      cb_copy_out((circular_buffer *) p, out, rp, itemsread);
+      rp += itemsread;
+      if (rp >= numelem) rp -= numelem;
 #ifdef HAVE_ATOMIC_BUILTIN
       __sync_lock_test_and_set(&((circular_buffer *)p)->rp,rp);
 #else
@@ -97,21 +111,12 @@ int csoundPeekCircularBuffer(CSOUND *csound, void *p, void *out, int items)
     IGN(csound);
     if (p == NULL) return 0;
     int remaining;
-    int itemsread, numelem = ((circular_buffer *)p)->numelem;
-    int elemsize = ((circular_buffer *)p)->elemsize;
-    int i=0, rp = ((circular_buffer *)p)->rp;
-    char *buffer = ((circular_buffer *)p)->buffer;
+    int itemsread, rp = ((circular_buffer *)p)->rp;
     if ((remaining = checkspace(p, 0)) == 0) {
         return 0;
     }
     itemsread = items > remaining ? remaining : items;
-    for(i=0; i < itemsread; i++){
-        memcpy((char *) out + (i * elemsize),
-               &(buffer[elemsize * rp++]),  elemsize);
-        if (rp == numelem) {
-            rp = 0;
-        }
-    }
+    cb_copy_out((circular_buffer *) p, out, rp, itemsread);
     return itemsread;
 }
 
@@ -146,17 +151,20 @@ int csoundWriteCircularBuffer(CSOUND *csound, void *p, const void *in, int items
     int remaining;
     int itemswrite, numelem = ((circular_buffer *)p)->numelem;
     int elemsize = ((circular_buffer *)p)->elemsize;
-    int i=0, wp = ((circular_buffer *)p)->wp;
+    int first, wp = ((circular_buffer *)p)->wp;
     char *buffer = ((circular_buffer *)p)->buffer;
     if ((remaining = checkspace(p, 1)) == 0) {
         return 0;
     }
     itemswrite = items > remaining ? remaining : items;
-    for(i=0; i < itemswrite; i++){
-        memcpy(&(buffer[elemsize * wp++]),
-                ((char *) in) + (i * elemsize),  elemsize);
-        if(wp == numelem) wp = 0;
-    }
+    first = numelem - wp;
+    if (first > itemswrite) first = itemswrite;
+    memcpy(&(buffer[elemsize * wp]), in, (size_t) (first * elemsize));
+    if (itemswrite > first)
+      memcpy(buffer, ((const char *) in) + (first * elemsize),
+             (size_t) ((itemswrite - first) * elemsize));
+    wp += itemswrite;
+    if (wp >= numelem) wp -= numelem;
 #ifdef HAVE_ATOMIC_BUILTIN
       __sync_lock_test_and_set(&((circular_buffer *)p)->wp,wp);
 #else
@@ -59,59 +59,121 @@ static inline void alloc_globals(CSOUND *csound)
    audtran to flush when this happens.
 */
 
-static void spoutsf(CSOUND *csound)
+/* Level metering for spoutsf: the per-channel peak and out-of-range
+   count of a run of interleaved samples are first gathered a whole
+   frame at a time into STA(chnpeak) and STA(chnover), so that the
+   inner loop runs across the channels without any branches.  Only for
+   the (rare) channels whose peak has grown is the run searched again
+   for the position; maxamp, maxpos and rngcnt end up exactly as if the
+   samples had been checked one by one.                                 */
+
+static inline void meter_frame(MYFLT *pk, uint32 *over, const MYFLT *x,
+                               uint32_t cnt, MYFLT e0dbfs)
 {
-    uint32_t   chn = 0;
-    int     n;
-    int spoutrem = csound->nspout;
-    MYFLT   *sp = csound->spout;
-    MYFLT   absamp = FL(0.0);
-    uint32  nframes = csound->libsndStatics.nframes;
- nchk:
-    /* if nspout remaining > buf rem, prepare to send in parts */
-    if ((n = spoutrem) > (int) csound->libsndStatics.outbufrem) {
-      n = (int) csound->libsndStatics.outbufrem;
+    uint32_t c;
+
+    for (c = 0; c < cnt; c++) {
+      MYFLT a = FABS(x[c]);
+      pk[c] = (a > pk[c] ? a : pk[c]);
+      over[c] += (a > e0dbfs);
     }
-    spoutrem -= n;
-    csound->libsndStatics.outbufrem -= n;
-    do {
-      absamp = *sp++;
-      if (csound->libsndStatics.osfopen) {
-        *csound->libsndStatics.outbufp++ = (absamp * csound->dbfs_to_float);
-      }
-      if (absamp < FL(0.0)) {
-        absamp = -absamp;
-      }
-      if (absamp > csound->maxamp[chn]) {   /*  maxamp this seg  */
-        csound->maxamp[chn] = absamp;
-        csound->maxpos[chn] = nframes;
+}
+
+static void spout_meter(CSOUND *csound, const MYFLT *sp, int n,
+                        uint32_t *chnp, uint32 *nframesp, int rngchk)
+{
+    uint32_t  nchnls = (uint32_t) csound->nchnls, chn = *chnp;
+    uint32_t  c, i, head, nfr, rem, len = (uint32_t) n;
+    uint32    nframes = *nframesp;
+    MYFLT     e0dbfs = csound->e0dbfs;
+    MYFLT     *pk = STA(chnpeak);
+    uint32    *over = STA(chnover);
+    const MYFLT *p;
+
+    if (UNLIKELY(pk == NULL)) {
+      pk = STA(chnpeak) = (MYFLT*) csound->Malloc(csound,
+                                                  nchnls * sizeof(MYFLT));
+      over = STA(chnover) = (uint32*) csound->Malloc(csound,
+                                                     nchnls * sizeof(uint32));
+    }
+    memset(pk, 0, nchnls * sizeof(MYFLT));
+    memset(over, 0, nchnls * sizeof(uint32));
+    /* finish a frame left incomplete by the previous run */
+    head = (chn ? nchnls - chn : 0);
+    if (head > len)
+      head = len;
+    meter_frame(pk + chn, over + chn, sp, head, e0dbfs);
+    p = sp + head;
+    nfr = (len - head) / nchnls;
+    rem = (len - head) - nfr * nchnls;
+    if (nchnls == 1) {
+      MYFLT   m = FL(0.0);
+      uint32  o = 0;
+      for (i = 0; i < nfr; i++) {
+        MYFLT a = FABS(p[i]);
+        m = (a > m ? a : m);
+        o += (a > e0dbfs);
       }
-      if (absamp > csound->e0dbfs) {        /* out of range?     */
-        csound->rngcnt[chn]++;              /*  report it        */
+      pk[0] = m; over[0] = o;
+    }
+    else {
+      for (i = 0; i < nfr; i++, p += nchnls)
+        meter_frame(pk, over, p, nchnls, e0dbfs);
+      meter_frame(pk, over, p, rem, e0dbfs);
+    }
+    for (c = 0; c < nchnls; c++) {
+      if (rngchk && over[c]) {                  /* out of range?     */
+        csound->rngcnt[c] += (int32) over[c];   /*  report it        */
         csound->rngflg = 1;
       }
-      if (csound->multichan) {
-        if (++chn >= csound->nchnls) {
-            chn = 0;
-            nframes++;
-        }
-      } else {
-        nframes++;
+      if (pk[c] > csound->maxamp[c]) {          /*  maxamp this seg  */
+        /* the first sample of this channel that reached the new peak */
+        for (i = (c + nchnls - chn) % nchnls; i < len; i += nchnls)
+          if (FABS(sp[i]) == pk[c])
+            break;
+        csound->maxamp[c] = pk[c];
+        csound->maxpos[c] = nframes + (chn + i) / nchnls;
       }
-    } while (--n);
-    if (!csound->libsndStatics.outbufrem) {
-      if (csound->libsndStatics.osfopen) {
+    }
+    *chnp = (chn + len) % nchnls;
+    *nframesp = nframes + (chn + len) / nchnls;
+}
+
+static void spoutsf(CSOUND *csound)
+{
+    uint32_t  chn = 0;
+    int       i, n;
+    int       spoutrem = csound->nspout;
+    MYFLT     *sp = csound->spout;
+    MYFLT     scale = csound->dbfs_to_float;
+    uint32    nframes = STA(nframes);
+ nchk:
+    /* if nspout remaining > buf rem, prepare to send in parts */
+    if ((n = spoutrem) > (int) STA(outbufrem)) {
+      n = (int) STA(outbufrem);
+    }
+    spoutrem -= n;
+    STA(outbufrem) -= n;
+    if (STA(osfopen)) {
+      MYFLT *outp = STA(outbufp);
+      for (i = 0; i < n; i++)
+        outp[i] = sp[i] * scale;
+      STA(outbufp) = outp + n;
+    }
+    spout_meter(csound, sp, n, &chn, &nframes, 1);
+    sp += n;
+    if (!STA(outbufrem)) {
+      if (STA(osfopen)) {
         csound->nrecs++;
-        csound->audtran(csound, csound->libsndStatics.outbuf,
-                        csound->libsndStatics.outbufsiz); /* Flush buffer */
-        csound->libsndStatics.outbufp = (MYFLT*) csound->libsndStatics.outbuf;
+        csound->audtran(csound, STA(outbuf), STA(outbufsiz)); /* Flush buffer */
+        STA(outbufp) = (MYFLT*) STA(outbuf);
       }
-      csound->libsndStatics.outbufrem = csound->oparms_.outbufsamps;
+      STA(outbufrem) = csound->oparms_.outbufsamps;
       if (spoutrem) {
         goto nchk;
       }
     }
-    csound->libsndStatics.nframes = nframes;
+    STA(nframes) = nframes;
 }
 
 /* special version of spoutsf for "raw" floating point files */
@@ -121,56 +183,109 @@ static void spoutsf_noscale(CSOUND *csound)
     uint32_t chn = 0;
     int      n, spoutrem = csound->nspout;
     MYFLT    *sp = csound->spout;
-    MYFLT    absamp = FL(0.0);
-    uint32   nframes = csound->libsndStatics.nframes;
+    uint32   nframes = STA(nframes);
 
  nchk:
     /* if nspout remaining > buf rem, prepare to send in parts */
-    if ((n = spoutrem) > (int) csound->libsndStatics.outbufrem)
-      n = (int)csound->libsndStatics.outbufrem;
+    if ((n = spoutrem) > (int) STA(outbufrem))
+      n = (int) STA(outbufrem);
     spoutrem -= n;
-    csound->libsndStatics.outbufrem -= n;
-    do {
-      absamp = *sp++;
-      if (csound->libsndStatics.osfopen)
-        *csound->libsndStatics.outbufp++ = absamp;
-      if (absamp < FL(0.0))
-        absamp = -absamp;
-      if (absamp > csound->maxamp[chn]) {   /*  maxamp this seg  */
-        csound->maxamp[chn] = absamp;
-        csound->maxpos[chn] = nframes;
-      }
-      if (++chn >= csound->nchnls)
-        chn = 0, nframes++;
-    } while (--n);
+    STA(outbufrem) -= n;
+    if (STA(osfopen)) {
+      memcpy(STA(outbufp), sp, n * sizeof(MYFLT));
+      STA(outbufp) += n;
+    }
+    spout_meter(csound, sp, n, &chn, &nframes, 0);
+    sp += n;
 
-    if (!csound->libsndStatics.outbufrem) {
-      if (csound->libsndStatics.osfopen) {
+    if (!STA(outbufrem)) {
+      if (STA(osfopen)) {
         csound->nrecs++;
-        csound->audtran(csound, csound->libsndStatics.outbuf,
-                        csound->libsndStatics.outbufsiz); /* Flush buffer */
-        csound->libsndStatics.outbufp = (MYFLT*) csound->libsndStatics.outbuf;
+        csound->audtran(csound, STA(outbuf), STA(outbufsiz)); /* Flush buffer */
+        STA(outbufp) = (MYFLT*) STA(outbuf);
       }
-      csound->libsndStatics.outbufrem = csound->oparms_.outbufsamps;
+      STA(outbufrem) = csound->oparms_.outbufsamps;
       if (spoutrem) goto nchk;
     }
-    csound->libsndStatics.nframes = nframes;
+    STA(nframes) = nframes;
+}
+
+/* Dither noise for 8 and 16 bit output.  The generator is the 16 bit
+   LCG  x' = (15625 x + 1) & 0xFFFF;  the triangular (TPDF) variant sums
+   two consecutive values, the rectangular one uses a single value per
+   sample.  Blocks of DITHER_LANES samples are done at once: step k of
+   the sequence is  A(k) x + C(k),  so with the A and C of the first
+   2 * DITHER_LANES steps every lane computes its own value straight
+   from the block's seed, and the output is the same as that of the
+   serial generator.                                                    */
+
+#define DITHER_LANES  8
+
+static void dither_block(CSOUND *csound, MYFLT *buf, int m, int tpdf,
+                         MYFLT scale)
+{
+    uint32_t  a[2 * DITHER_LANES], c[2 * DITHER_LANES];
+    uint32_t  ak = 1, ck = 0, x = (uint32_t) STA(dither) & 0xFFFF;
+    int       i, j, nk = (tpdf ? 2 : 1) * DITHER_LANES;
+
+    for (i = 0; i < nk; i++) {
+      ak = (ak * 15625) & 0xFFFF;
+      ck = (ck * 15625 + 1) & 0xFFFF;
+      a[i] = ak; c[i] = ck;
+    }
+    for (i = 0; i + DITHER_LANES <= m; i += DITHER_LANES) {
+      MYFLT r[DITHER_LANES];
+      if (tpdf) {
+        for (j = 0; j < DITHER_LANES; j++) {
+          uint32_t tmp = (a[2*j] * x + c[2*j]) & 0xFFFF;
+          uint32_t rnd = (a[2*j+1] * x + c[2*j+1]) & 0xFFFF;
+          r[j] = (MYFLT) ((int32) ((rnd + tmp) >> 1) - 0x8000);
+        }
+      }
+      else {
+        for (j = 0; j < DITHER_LANES; j++)
+          r[j] = (MYFLT) ((int32) ((a[j] * x + c[j]) & 0xFFFF) - 0x8000);
+      }
+      for (j = 0; j < DITHER_LANES; j++)
+        buf[i + j] += r[j] / ((MYFLT) 0x10000) / scale;
+      x = (a[nk - 1] * x + c[nk - 1]) & 0xFFFF;
+    }
+    for ( ; i < m; i++) {
+      int32 rnd = (int32) (x = (x * 15625 + 1) & 0xFFFF);
+      if (tpdf) {
+        int32 tmp = rnd;
+        rnd = (int32) (x = (x * 15625 + 1) & 0xFFFF);
+        rnd = (rnd + tmp) >> 1;     /* triangular distribution */
+      }
+      buf[i] += (MYFLT) (rnd - 0x8000) / ((MYFLT) 0x10000) / scale;
+    }
+    STA(dither) = (int) x;
 }
 
 /* diskfile write option for audtran's */
 /*      assigned during sfopenout()    */
 
-static void writesf(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+enum { SFW_PLAIN = 0, SFW_TPDF_16, SFW_TPDF_8, SFW_RECT_16, SFW_RECT_8 };
+
+/* dither and write one buffer; returns the number of bytes written */
+
+static int sfwrite_block(CSOUND *csound, MYFLT *buf, int nbytes, int kind)
 {
     OPARMS  *O = csound->oparms;
-    int     n;
+    int     n, nret;
+    int     m = nbytes / (int) sizeof(MYFLT);
 
     if (UNLIKELY(STA(outfile) == NULL))
-      return;
-    n = (int) sf_write_MYFLT(STA(outfile), (MYFLT*) outbuf,
-                             nbytes / sizeof(MYFLT)) * (int) sizeof(MYFLT);
-    if (UNLIKELY(n < nbytes))
-      sndwrterr(csound, n, nbytes);
+      return nbytes;
+    switch (kind) {
+      case SFW_TPDF_16: dither_block(csound, buf, m, 1, (MYFLT) 0x7fff); break;
+      case SFW_TPDF_8:  dither_block(csound, buf, m, 1, (MYFLT) 0x7f);   break;
+      case SFW_RECT_16: dither_block(csound, buf, m, 0, (MYFLT) 0x7fff); break;
+      case SFW_RECT_8:  dither_block(csound, buf, m, 0, (MYFLT) 0x7f);   break;
+    }
+    nret = (int) sf_write_MYFLT(STA(outfile), buf, m) * (int) sizeof(MYFLT);
+    if (UNLIKELY(nret < nbytes))
+      return nret;
     if (UNLIKELY(O->rewrt_hdr))
       rewriteheader((void *)STA(outfile));
     switch (O->heartbeat) {
@@ -197,210 +312,209 @@ static void writesf(CSOUND *csound, const MYFLT *outbuf, int nbytes)
         csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
         break;
     }
+    return nret;
 }
 
-static void writesf_dither_16(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+static inline void writesf_(CSOUND *csound, const MYFLT *outbuf, int nbytes,
+                            int kind)
 {
-    OPARMS  *O = csound->oparms;
-    int     n;
-    int m = nbytes / sizeof(MYFLT);
-    MYFLT *buf = (MYFLT*) outbuf;
-
-    if (UNLIKELY(STA(outfile) == NULL))
-      return;
+    int     n = sfwrite_block(csound, (MYFLT*) outbuf, nbytes, kind);
 
-    for (n=0; n<m; n++) {
-      int   tmp = ((STA(dither) * 15625) + 1) & 0xFFFF;
-      int   rnd = ((tmp * 15625) + 1) & 0xFFFF;
-      MYFLT result;
-      STA(dither) = rnd;
-      rnd = (rnd+tmp)>>1;           /* triangular distribution */
-      result = (MYFLT) (rnd - 0x8000)  / ((MYFLT) 0x10000);
-      result /= ((MYFLT) 0x7fff);
-      buf[n] += result;
-    }
-    n = (int) sf_write_MYFLT(STA(outfile), (MYFLT*) outbuf,
-                             nbytes / sizeof(MYFLT)) * (int) sizeof(MYFLT);
     if (UNLIKELY(n < nbytes))
       sndwrterr(csound, n, nbytes);
-    if (UNLIKELY(O->rewrt_hdr))
-      rewriteheader(STA(outfile));
-    switch (O->heartbeat) {
-      case 1:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME,
-                                 "%c\010", "|/-\\"[csound->nrecs & 3]);
-        break;
-      case 2:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, ".");
-        break;
-      case 3:
-        {
-          char    s[512];
-          CS_SPRINTF(s, "%ld(%.3f)%n", (long) csound->nrecs,
-                  csound->icurTime/csound->esr, &n);
-          if (n > 0) {
-            memset(&(s[n]), '\b', n);
-            s[n + n] = '\0';
-            csound->MessageS(csound, CSOUNDMSG_REALTIME, s);
-          }
-        }
-        break;
-      case 4:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
-        break;
-    }
 }
 
-static void writesf_dither_8(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+static void writesf(CSOUND *csound, const MYFLT *outbuf, int nbytes)
 {
-    OPARMS  *O = csound->oparms;
-    int     n;
-    int m = nbytes / sizeof(MYFLT);
-    MYFLT *buf = (MYFLT*) outbuf;
+    writesf_(csound, outbuf, nbytes, SFW_PLAIN);
+}
 
-    if (UNLIKELY(STA(outfile) == NULL))
-      return;
+static void writesf_dither_16(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+{
+    writesf_(csound, outbuf, nbytes, SFW_TPDF_16);
+}
 
-    for (n=0; n<m; n++) {
-      int   tmp = ((STA(dither) * 15625) + 1) & 0xFFFF;
-      int   rnd = ((tmp * 15625) + 1) & 0xFFFF;
-      MYFLT result;
-      STA(dither) = rnd;
-      rnd = (rnd+tmp)>>1;           /* triangular distribution */
-      result = (MYFLT) (rnd - 0x8000)  / ((MYFLT) 0x10000);
-      result /= ((MYFLT) 0x7f);
-      buf[n] += result;
-    }
-    n = (int) sf_write_MYFLT(STA(outfile), (MYFLT*) outbuf,
-                             nbytes / sizeof(MYFLT)) * (int) sizeof(MYFLT);
-    if (UNLIKELY(n < nbytes))
-      sndwrterr(csound, n, nbytes);
-    if (UNLIKELY(O->rewrt_hdr))
-      rewriteheader(STA(outfile));
-    switch (O->heartbeat) {
-      case 1:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME,
-                                 "%c\010", "|/-\\"[csound->nrecs & 3]);
-        break;
-      case 2:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, ".");
-        break;
-      case 3:
-        {
-          char    s[512];
-          CS_SPRINTF(s, "%ld(%.3f)%n", (long) csound->nrecs,
-                  csound->icurTime/csound->esr, &n);
-          if (n > 0) {
-            memset(&(s[n]), '\b', n);
-            s[n + n] = '\0';
-            csound->MessageS(csound, CSOUNDMSG_REALTIME, s);
-          }
-        }
-        break;
-      case 4:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
-        break;
-    }
+static void writesf_dither_8(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+{
+    writesf_(csound, outbuf, nbytes, SFW_TPDF_8);
 }
 
 static void writesf_dither_u16(CSOUND *csound, const MYFLT *outbuf, int nbytes)
 {
-    OPARMS  *O = csound->oparms;
-    int     n;
-    int m = nbytes / sizeof(MYFLT);
-    MYFLT *buf = (MYFLT*) outbuf;
+    writesf_(csound, outbuf, nbytes, SFW_RECT_16);
+}
 
-    if (UNLIKELY(STA(outfile) == NULL))
-      return;
+static void writesf_dither_u8(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+{
+    writesf_(csound, outbuf, nbytes, SFW_RECT_8);
+}
 
-    for (n=0; n<m; n++) {
-        int   rnd = ((STA(dither) * 15625) + 1) & 0xFFFF;
-        MYFLT result;
-        STA(dither) = rnd;
-        result = (MYFLT) (rnd - 0x8000)  / ((MYFLT) 0x10000);
-        result /= ((MYFLT) 0x7fff);
-        buf[n] += result;
-    }
-    n = (int) sf_write_MYFLT(STA(outfile), (MYFLT*) outbuf,
-                             nbytes / sizeof(MYFLT)) * (int) sizeof(MYFLT);
-    if (UNLIKELY(n < nbytes))
-      sndwrterr(csound, n, nbytes);
-    if (UNLIKELY(O->rewrt_hdr))
-      rewriteheader(STA(outfile));
-    switch (O->heartbeat) {
-      case 1:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME,
-                                 "%c\010", "|/-\\"[csound->nrecs & 3]);
-        break;
-      case 2:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, ".");
-        break;
-      case 3:
-        {
-          char    s[512];
-          CS_SPRINTF(s, "%ld(%.3f)%n", (long) csound->nrecs,
-                  csound->icurTime/csound->esr, &n);
-          if (n > 0) {
-            memset(&(s[n]), '\b', n);
-            s[n + n] = '\0';
-            csound->MessageS(csound, CSOUNDMSG_REALTIME, s);
-          }
-        }
-        break;
-      case 4:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
-        break;
-    }
+static void (*const sfwriters[])(CSOUND *, const MYFLT *, int) = {
+    writesf, writesf_dither_16, writesf_dither_8,
+    writesf_dither_u16, writesf_dither_u8
+};
+
+/* Background writer (-+async_sndout=1): instead of writing the output
+   buffer from the performance thread, audtran queues it to a thread
+   that does the dithering, sf_write() and header updates, and spoutsf
+   carries on filling the next one of SNDOUT_NBUFS buffers.  The
+   performance thread only blocks when all of them are waiting to be
+   written.                                                             */
+
+#define SNDOUT_NBUFS    4
+/* longest time (ms) either side sleeps without being woken up */
+#define SNDOUT_TIMEOUT  100
+
+typedef struct {
+    void    *thread;
+    void    *mutex;                 /* protects the fields below        */
+    void    *queued;                /* wakes the writer                 */
+    void    *released;              /* wakes a waiting spoutsf          */
+    MYFLT   *bufs[SNDOUT_NBUFS];
+    int     nbytes[SNDOUT_NBUFS];
+    int     head, tail, count;      /* bufs[head] is being filled       */
+    int     kind;                   /* SFW_ writer chosen by sfopenout  */
+    int     stop;
+    int     err_ret, err_put;       /* short write seen by the thread   */
+} SNDOUT_WRITER;
+
+static inline void sndout_wait(CSOUND *csound, void *lock)
+{
+#if CS_THREADLOCK_WAKEUP
+    csound->WaitThreadLock(lock, SNDOUT_TIMEOUT);
+#else
+    IGN(lock);
+    csound->Sleep(1);
+#endif
 }
 
-static void writesf_dither_u8(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+static uintptr_t sndout_thread(void *userData)
 {
-    OPARMS  *O = csound->oparms;
-    int     n;
-    int m = nbytes / sizeof(MYFLT);
-    MYFLT *buf = (MYFLT*) outbuf;
+    CSOUND        *csound = (CSOUND*) userData;
+    SNDOUT_WRITER *w = (SNDOUT_WRITER*) STA(writer);
+
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    for (;;) {
+      MYFLT *buf;
+      int   n, nbytes;
+      csound->LockMutex(w->mutex);
+      if (w->count == 0) {
+        int stop = w->stop;
+        csound->UnlockMutex(w->mutex);
+        if (stop)
+          break;
+        sndout_wait(csound, w->queued);
+        continue;
+      }
+      buf = w->bufs[w->tail];
+      nbytes = w->nbytes[w->tail];
+      csound->UnlockMutex(w->mutex);
+      n = sfwrite_block(csound, buf, nbytes, w->kind);
+      csound->LockMutex(w->mutex);
+      if (UNLIKELY(n < nbytes)) {
+        /* give up; the error is reported by the performance thread */
+        w->err_ret = n; w->err_put = nbytes;
+        w->count = 0; w->tail = w->head;
+        w->stop = 1;
+      }
+      else {
+        w->tail = (w->tail + 1) % SNDOUT_NBUFS;
+        w->count--;
+      }
+      csound->UnlockMutex(w->mutex);
+      csound->NotifyThreadLock(w->released);
+    }
+    return 0;
+}
 
-    if (UNLIKELY(STA(outfile) == NULL))
+static void writesf_async(CSOUND *csound, const MYFLT *outbuf, int nbytes)
+{
+    SNDOUT_WRITER *w = (SNDOUT_WRITER*) STA(writer);
+
+    (void) outbuf;                          /* == w->bufs[w->head] */
+    csound->LockMutex(w->mutex);
+    if (UNLIKELY(w->err_put)) {
+      int nret = w->err_ret, nput = w->err_put;
+      w->err_put = 0;
+      csound->UnlockMutex(w->mutex);
+      sndwrterr(csound, nret, nput);
       return;
+    }
+    w->nbytes[w->head] = nbytes;
+    w->head = (w->head + 1) % SNDOUT_NBUFS;
+    w->count++;
+    while (w->count == SNDOUT_NBUFS) {      /* writer is behind: wait */
+      csound->UnlockMutex(w->mutex);
+      csound->NotifyThreadLock(w->queued);
+      sndout_wait(csound, w->released);
+      csound->LockMutex(w->mutex);
+    }
+    STA(outbuf) = w->bufs[w->head];
+    csound->UnlockMutex(w->mutex);
+    csound->NotifyThreadLock(w->queued);
+}
 
-    for (n=0; n<m; n++) {
-      int   rnd = ((STA(dither) * 15625) + 1) & 0xFFFF;
-      MYFLT result;
-      STA(dither) = rnd;
-      result = (MYFLT) (rnd - 0x8000)  / ((MYFLT) 0x10000);
-      result /= ((MYFLT) 0x7f);
-      buf[n] += result;
+static void sndout_start(CSOUND *csound, int kind)
+{
+    SNDOUT_WRITER *w;
+    int           i;
+
+    w = (SNDOUT_WRITER*) csound->Calloc(csound, sizeof(SNDOUT_WRITER));
+    w->bufs[0] = STA(outbuf);
+    for (i = 1; i < SNDOUT_NBUFS; i++)
+      w->bufs[i] = (MYFLT*) csound->Malloc(csound, STA(outbufsiz));
+    w->kind = kind;
+    w->mutex = csound->Create_Mutex(0);
+    w->queued = csound->CreateThreadLock();
+    w->released = csound->CreateThreadLock();
+    STA(writer) = (void*) w;
+    if (UNLIKELY(w->mutex == NULL || w->queued == NULL ||
+                 w->released == NULL ||
+                 (w->thread = csound->CreateThread(sndout_thread,
+                                                   (void*) csound)) == NULL)) {
+      csound->Warning(csound, Str("could not start sound file writer thread,"
+                                  " writing synchronously"));
+      if (w->mutex != NULL)
+        csound->DestroyMutex(w->mutex);
+      if (w->queued != NULL)
+        csound->DestroyThreadLock(w->queued);
+      if (w->released != NULL)
+        csound->DestroyThreadLock(w->released);
+      STA(writer) = NULL;
+      return;
     }
-    n = (int) sf_write_MYFLT(STA(outfile), (MYFLT*) outbuf,
-                             nbytes / sizeof(MYFLT)) * (int) sizeof(MYFLT);
-    if (UNLIKELY(n < nbytes))
-      sndwrterr(csound, n, nbytes);
-    if (UNLIKELY(O->rewrt_hdr))
-      rewriteheader(STA(outfile));
-    switch (O->heartbeat) {
-      case 1:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME,
-                                 "%c\010", "|/-\\"[csound->nrecs & 3]);
-        break;
-      case 2:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, ".");
-        break;
-      case 3:
-        {
-          char    s[512];
-          CS_SPRINTF(s, "%ld(%.3f)%n", (long) csound->nrecs,
-                  csound->icurTime/csound->esr, &n);
-          if (n > 0) {
-            memset(&(s[n]), '\b', n);
-            s[n + n] = '\0';
-            csound->MessageS(csound, CSOUNDMSG_REALTIME, s);
-          }
-        }
-        break;
-      case 4:
-        csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
-        break;
+    csound->audtran = writesf_async;
+}
+
+/* write out everything still queued, and stop the writer thread */
+
+static void sndout_stop(CSOUND *csound)
+{
+    SNDOUT_WRITER *w = (SNDOUT_WRITER*) STA(writer);
+    int           i;
+
+    if (w == NULL)
+      return;
+    csound->LockMutex(w->mutex);
+    w->stop = 1;
+    csound->UnlockMutex(w->mutex);
+    csound->NotifyThreadLock(w->queued);
+    csound->JoinThread(w->thread);
+    STA(writer) = NULL;
+    csound->DestroyMutex(w->mutex);
+    csound->DestroyThreadLock(w->queued);
+    csound->DestroyThreadLock(w->released);
+    csound->audtran = sfwriters[w->kind];
+    STA(outbuf) = STA(outbufp) = w->bufs[0];
+    for (i = 1; i < SNDOUT_NBUFS; i++)
+      csound->Free(csound, w->bufs[i]);
+    if (UNLIKELY(w->err_put)) {
+      int nret = w->err_ret, nput = w->err_put;
+      csound->Free(csound, w);
+      sndwrterr(csound, nret, nput);
     }
+    else
+      csound->Free(csound, w);
 }
 
 static int readsf(CSOUND *csound, MYFLT *inbuf, int inbufsize)
@@ -597,6 +711,7 @@ void sfopenout(CSOUND *csound)                  /* init for sound out       */
     char    *s, *fName, *fullName;
     SF_INFO sfinfo;
     int     osfd = 1;   /* stdout */
+    int     writer = SFW_PLAIN;
 
     alloc_globals(csound);
     if (O->outfilename == NULL) {
@@ -722,21 +837,20 @@ void sfopenout(CSOUND *csound)                  /* init for sound out       */
         STA(outfile) = NULL;
         if (csound->dither_output && csound->oparms->outformat!=AE_FLOAT &&
             csound->oparms->outformat!=AE_DOUBLE) {
-          if (csound->oparms->outformat==AE_SHORT)
+          if (csound->oparms->outformat==AE_SHORT) {
             if (csound->dither_output==1)
-              csound->audtran = writesf_dither_16;
+              writer = SFW_TPDF_16;
             else
-              csound->audtran = writesf_dither_u16;
-          else if (csound->oparms->outformat==AE_CHAR)
+              writer = SFW_RECT_16;
+          }
+          else if (csound->oparms->outformat==AE_CHAR) {
             if (csound->dither_output==1)
-              csound->audtran = writesf_dither_8;
+              writer = SFW_TPDF_8;
             else
-              csound->audtran = writesf_dither_u8;
-          else
-            csound->audtran = writesf;
+              writer = SFW_RECT_8;
+          }
         }
-        else
-          csound->audtran = writesf;
+        csound->audtran = sfwriters[writer];
         goto outset;
       }
     }
@@ -819,14 +933,11 @@ void sfopenout(CSOUND *csound)                  /* init for sound out       */
     if (csound->dither_output && csound->oparms->outformat!=AE_FLOAT &&
         csound->oparms->outformat!=AE_DOUBLE) {
       if (csound->oparms->outformat==AE_SHORT)
-        csound->audtran = writesf_dither_16;
+        writer = SFW_TPDF_16;
       else if (csound->oparms->outformat==AE_CHAR)
-        csound->audtran = writesf_dither_8;
-      else
-        csound->audtran = writesf;
+        writer = SFW_TPDF_8;
     }
-    else
-      csound->audtran = writesf;
+    csound->audtran = sfwriters[writer];
     /* Write any tags. */
     if ((s = csound->SF_id_title) != NULL && *s != '\0')
       sf_set_string(STA(outfile), SF_STR_TITLE, s);
@@ -858,6 +969,8 @@ void sfopenout(CSOUND *csound)                  /* init for sound out       */
     /* calc outbuf size & alloc bufspace */
     STA(outbufsiz) = O->outbufsamps * sizeof(MYFLT);
     STA(outbufp)   = STA(outbuf) = csound->Malloc(csound, STA(outbufsiz));
+    if (csound->async_sndout && STA(outfile) != NULL && STA(pipdevout) != 2)
+      sndout_start(csound, writer);
     if (STA(pipdevout) == 2)
       csound->Message(csound,
                       Str("writing %d sample blks of %d-bit floats to %s \n"),
@@ -912,6 +1025,7 @@ void sfcloseout(CSOUND *csound)
       csound->nrecs++;
       csound->audtran(csound, STA(outbuf), nb);
     }
+    sndout_stop(csound);
     if (STA(pipdevout) == 2 && (!STA(isfopen) || STA(pipdevin) != 2)) {
       /* close only if not open for input too */
       csound->rtclose_callback(csound);
@@ -50,6 +50,18 @@ typedef struct midiEvent_s {
     unsigned char   d2;                 /* data byte 2 (0x00-0x7F)          */
 } midiEvent_t;
 
+/* controller state of all channels at some point of the file, used to
+   chase controllers when seeking; 0xFF (0xFFFF for pitch bend) = not set */
+
+#define CHASE_STEP  (512)               /* events between snapshots        */
+
+typedef struct chaseState_s {
+    unsigned char   ctl[MAXCHAN][128];  /* control change values           */
+    unsigned char   prog[MAXCHAN];      /* program change                  */
+    unsigned char   press[MAXCHAN];     /* channel pressure                */
+    unsigned short  bend[MAXCHAN];      /* pitch bend (14 bit)             */
+} chaseState_t;
+
 typedef struct midiFile_s {
     /* static file data, not changed at performance */
     double          timeCode;           /* > 0: ticks per beat              */
@@ -63,6 +75,8 @@ typedef struct midiFile_s {
     int             maxTempo;           /* tempo change array size          */
     midiEvent_t     *eventList;         /* array of MIDI events             */
     tempoEvent_t    *tempoList;         /* array of tempo changes           */
+    chaseState_t    *chaseList;         /* controller state before every    */
+                                        /*   CHASE_STEP-th event            */
     /* performance time state variables */
     double          currentTempo;       /* current tempo in BPM             */
     int             eventListIndex;     /* index of next MIDI event in list */
@@ -461,6 +475,48 @@ static CS_NOINLINE void tempoEvent_sort(tempoEvent_t *p, tempoEvent_t *tmp,
     memcpy(p, tmp, cnt * sizeof(tempoEvent_t));
 }
 
+/* update controller state with a MIDI event */
+
+static void chase_event(chaseState_t *cs, const midiEvent_t *ev)
+{
+    int chn = ev->st & 0x0F;
+
+    switch (ev->st & 0xF0) {
+      case 0xB0:
+        cs->ctl[chn][ev->d1 & 0x7F] = ev->d2;
+        break;
+      case 0xC0:
+        cs->prog[chn] = ev->d1;
+        break;
+      case 0xD0:
+        cs->press[chn] = ev->d1;
+        break;
+      case 0xE0:
+        cs->bend[chn] = (unsigned short) ((ev->d2 << 7) | ev->d1);
+        break;
+    }
+}
+
+/* record controller snapshots for seeking */
+
+static void makeChaseList(CSOUND *csound)
+{
+    chaseState_t  cs;
+    int           i;
+
+    MF(chaseList) = (chaseState_t*)
+      csound->Malloc(csound, sizeof(chaseState_t)
+                             * (size_t) (MF(nEvents) / CHASE_STEP + 1));
+    memset(&cs, 0xFF, sizeof(chaseState_t));
+    for (i = 0; i < MF(nEvents); i++) {
+      if (i % CHASE_STEP == 0)
+        MF(chaseList)[i / CHASE_STEP] = cs;
+      chase_event(&cs, &(MF(eventList)[i]));
+    }
+    if (i % CHASE_STEP == 0)
+      MF(chaseList)[i / CHASE_STEP] = cs;
+}
+
 /* sort event lists by time and convert tick times to Csound k-periods */
 
 static void sortEventLists(CSOUND *csound)
@@ -657,6 +713,7 @@ int csoundMIDIFileOpen(CSOUND *csound, const char *name)
     MF(nTempo) = 0; MF(maxTempo) = 0;
     MF(eventList) = (midiEvent_t*) NULL;
     MF(tempoList) = (tempoEvent_t*) NULL;
+    MF(chaseList) = (chaseState_t*) NULL;
     MF(currentTempo) = default_tempo;
     MF(eventListIndex) = 0;
     MF(tempoListIndex) = 0;
@@ -687,6 +744,7 @@ int csoundMIDIFileOpen(CSOUND *csound, const char *name)
       csound->FileClose(csound, fd);
     /* prepare event and tempo list for reading */
     sortEventLists(csound);
+    makeChaseList(csound);
     /* successfully read MIDI file */
     csound->Message(csound, Str("done.\n"));
     return 0;
@@ -699,12 +757,14 @@ int csoundMIDIFileOpen(CSOUND *csound, const char *name)
     return -1;
 }
 
-/* read MIDI file event data at performace time */
+/* get the next MIDI file event due at the current k-period; returns 1 */
+/* and fills in *mep if there is one, 0 otherwise                      */
 
-int csoundMIDIFileRead(CSOUND *csound, unsigned char *buf, int nBytes)
+int csoundMIDIFileEvent(CSOUND *csound, MEVENT *mep)
 {
     midiFile_t  *mf;
-    int         i, j, n, nRead;
+    midiEvent_t *ev;
+    int         i, j;
 
     mf = (midiFile_t*) MIDIFILE;
     if (mf == NULL)
@@ -728,36 +788,102 @@ int csoundMIDIFileRead(CSOUND *csound, unsigned char *buf, int nBytes)
       }
       return 0;
     }
-    /* otherwise read any events with time less than or equal to */
-    /* current orchestra time */
+    /* apply tempo changes up to the current orchestra time */
     while (j < mf->nTempo &&
            (unsigned long) csound->global_kcounter >= mf->tempoList[j].kcnt) {
-      /* tempo change */
       mf->currentTempo = mf->tempoList[j++].tempoVal;
     }
     mf->tempoListIndex = j;
-    nRead = 0;
-    while (i < mf->nEvents &&
-           (unsigned long) csound->global_kcounter >= mf->eventList[i].kcnt) {
-      n = msgDataBytes((int) mf->eventList[i].st) + 1;
-      if (n < 1) {
-        i++; continue;        /* unknown or system event: skip */
+    /* and return the next event with time less than or equal to it */
+    for ( ; i < mf->nEvents &&
+            (unsigned long) csound->global_kcounter >= mf->eventList[i].kcnt;
+          i++) {
+      ev = &(mf->eventList[i]);
+      if (ev->st < 0xF0) {              /* channel message */
+        mep->type = ev->st & 0xF0;
+        mep->chan = ev->st & 0x0F;
       }
-      nBytes -= n;
-      if (nBytes < 0) {
-        csound->Message(csound, Str(" *** buffer overflow while reading "
-                                    "MIDI file events\n"));
-        break;      /* return with whatever has been read so far */
+      else if (ev->st >= 0xF1 && ev->st <= 0xF3) {
+        mep->type = 0xF0;               /* system common: code in chan */
+        mep->chan = ev->st & 0x07;
       }
-      nRead += n;
-      *buf++ = mf->eventList[i].st;
-      if (n > 1) *buf++ = mf->eventList[i].d1;
-      if (n > 2) *buf++ = mf->eventList[i].d2;
-      i++;
+      else continue;                    /* unknown or system event: skip */
+      mep->dat1 = ev->d1;
+      mep->dat2 = (msgDataBytes((int) ev->st) < 2 ? 0 : ev->d2);
+      mf->eventListIndex = i + 1;
+      return 1;
     }
     mf->eventListIndex = i;
-    /* return the number of bytes read */
-    return nRead;
+    return 0;
+}
+
+/* midirecv.c, resets MIDI controllers on a channel and handles */
+/* channel messages                                             */
+extern  void    midi_ctl_reset(CSOUND *csound, int16 chan);
+extern  void    m_chanmsg(CSOUND *csound, MEVENT *mep);
+
+/* position the MIDI file at k-period kcnt: events before it are not */
+/* played, but the controller, program, pressure and pitch bend      */
+/* state they leave behind is sent to the channels                   */
+
+void csoundMIDIFileSeek(CSOUND *csound, unsigned long kcnt)
+{
+    midiFile_t    *mf = (midiFile_t*) MIDIFILE;
+    chaseState_t  cs;
+    MEVENT        mev;
+    int           lo, hi, mid, chn, i;
+
+    if (mf == NULL)
+      return;
+    /* first event and tempo change at or after kcnt */
+    lo = 0; hi = mf->nEvents;
+    while (lo < hi) {
+      mid = (lo + hi) >> 1;
+      if (mf->eventList[mid].kcnt < kcnt) lo = mid + 1;
+      else hi = mid;
+    }
+    mf->eventListIndex = lo;
+    lo = 0; hi = mf->nTempo;
+    while (lo < hi) {
+      mid = (lo + hi) >> 1;
+      if (mf->tempoList[mid].kcnt < kcnt) lo = mid + 1;
+      else hi = mid;
+    }
+    mf->tempoListIndex = lo;
+    mf->currentTempo = (lo > 0 ? mf->tempoList[lo - 1].tempoVal
+                                 : default_tempo);
+    csound->MTrkend = 0;
+    /* controller state from the nearest snapshot */
+    i = mf->eventListIndex;
+    cs = mf->chaseList[i / CHASE_STEP];
+    for (lo = i - (i % CHASE_STEP); lo < i; lo++)
+      chase_event(&cs, &(mf->eventList[lo]));
+    for (chn = 0; chn < MAXCHAN; chn++) {
+      midi_ctl_reset(csound, (int16) chn);
+      mev.chan = chn;
+      /* plain controllers only: not data entry, (N)RPN selection or */
+      /* channel mode messages, which only make sense in sequence    */
+      for (i = 0; i < 120; i++) {
+        if (cs.ctl[chn][i] == 0xFF || i == 6 || i == 38 ||
+            (i >= 96 && i <= 101))
+          continue;
+        mev.type = 0xB0; mev.dat1 = i; mev.dat2 = cs.ctl[chn][i];
+        m_chanmsg(csound, &mev);
+      }
+      if (cs.prog[chn] != 0xFF) {
+        mev.type = 0xC0; mev.dat1 = cs.prog[chn]; mev.dat2 = 0;
+        m_chanmsg(csound, &mev);
+      }
+      if (cs.press[chn] != 0xFF) {
+        mev.type = 0xD0; mev.dat1 = cs.press[chn]; mev.dat2 = 0;
+        m_chanmsg(csound, &mev);
+      }
+      if (cs.bend[chn] != 0xFFFF) {
+        mev.type = 0xE0;
+        mev.dat1 = cs.bend[chn] & 0x7F; mev.dat2 = cs.bend[chn] >> 7;
+        m_chanmsg(csound, &mev);
+      }
+    }
 }
 
 /* destroy MIDI file event list */
@@ -769,9 +895,6 @@ int csoundMIDIFileClose(CSOUND *csound)
     return 0;
 }
 
-/* midirecv.c, resets MIDI controllers on a channel */
-extern  void    midi_ctl_reset(CSOUND *csound, int16 chan);
-
 /* called by csoundRewindScore() to reset performance to time zero */
 
 void midifile_rewind_score(CSOUND *csound)
@@ -43,6 +43,17 @@
       as a note on status without the data bytes) should not be
       returned.
 
+    int (*MidiReadTimedCallback)(CSOUND *csound, void *userData,
+                                 unsigned char *buf, int nbytes,
+                                 int64_t *times);
+
+      Same as MidiReadCallback, but also stores the time of each byte
+      in 'times', in sample frames since the start of performance (as
+      returned by csoundGetCurrentTimeSamples()). Note on events start
+      at their sample offset within the k-period; bytes timed later
+      than the current k-period are not processed until it is reached.
+      If set, it is used instead of MidiReadCallback.
+
     int (*MidiInCloseCallback)(CSOUND *csound, void *userData);
 
       Close MIDI input device associated with 'userData'.
@@ -84,6 +95,10 @@
     void csoundSetExternalMidiReadCallback(CSOUND *csound,
                     int (*func)(CSOUND *, void *, unsigned char *, int));
 
+    void csoundSetExternalMidiReadTimedCallback(CSOUND *csound,
+                    int (*func)(CSOUND *, void *, unsigned char *, int,
+                                int64_t *));
+
     void csoundSetExternalMidiInCloseCallback(CSOUND *csound,
                     int (*func)(CSOUND *, void *));
 
@@ -130,7 +145,7 @@ void MidiOpen(CSOUND *csound)
     if (O->Midiin) {
       if (p->MidiInOpenCallback == NULL)
         csound->Die(csound, Str(" *** no callback for opening MIDI input"));
-      if (p->MidiReadCallback == NULL)
+      if (p->MidiReadCallback == NULL && p->MidiReadTimedCallback == NULL)
         csound->Die(csound, Str(" *** no callback for reading MIDI data"));
       err = p->MidiInOpenCallback(csound, &(p->midiInUserData), O->Midiname);
       if (err != 0) {
@@ -471,6 +486,28 @@ static void midNotesOff(CSOUND *csound)
     } while (++chan < MAXCHAN);
 }
 
+/* enter a complete message into the buffer used by 'midiin' and handle */
+/* control and system common messages; returns 2 if MIDI on/off         */
+
+static int midi_event(CSOUND *csound, MEVENT *mep, int datreq)
+{
+    MGLOBAL *p = csound->midiGlobals;
+
+    if (mep->type != SYSTEM_TYPE) {
+      unsigned char *pMessage =
+                    &(p->MIDIINbuffer2[p->MIDIINbufIndex++].bData[0]);
+      p->MIDIINbufIndex &= MIDIINBUFMSK;
+      *pMessage++ = mep->type | mep->chan;
+      *pMessage++ = (unsigned char) mep->dat1;
+      *pMessage = (datreq < 2 ? (unsigned char) 0 : mep->dat2);
+    }
+    if (mep->type > NOTEON_TYPE) {      /* if control or syscom */
+      m_chanmsg(csound, mep);           /*   handle from here   */
+      return 0;
+    }
+    return 2;                           /* else it's note_on/off */
+}
+
 /* sense a MIDI event, collect the data & dispatch */
 /* called from sensevents(), returns 2 if MIDI on/off */
 
@@ -478,31 +515,46 @@ int sensMidi(CSOUND *csound)
 {
     MGLOBAL *p = csound->midiGlobals;
     MEVENT  *mep = p->Midevtblk;
+    MEVENT  *dev = &(p->runevt);        /* keeps running status */
     OPARMS  *O = csound->oparms;
-    int     n;
+    int     n, i;
     int16   c, type;
 
+    /* MIDI file events are parsed when the file is loaded */
+    while (O->FMidiin && csoundMIDIFileEvent(csound, mep)) {
+      if (midi_event(csound, mep, 2) == 2) {
+        p->midiOffset = 0;
+        return 2;
+      }
+    }
+
  nxtchr:
     if (p->bufp >= p->endatp) {
+      if (!O->Midiin || csound->advanceCnt)
+        return 0;
       p->bufp = &(p->mbuf[0]);
       p->endatp = p->bufp;
-      if (O->Midiin && !csound->advanceCnt) {   /* read MIDI device */
+      /* read MIDI device */
+      if (p->MidiReadTimedCallback != NULL)
+        n = p->MidiReadTimedCallback(csound, p->midiInUserData, p->bufp,
+                                     MBUFSIZ, p->mstamp);
+      else {
         n = p->MidiReadCallback(csound, p->midiInUserData, p->bufp, MBUFSIZ);
-        if (n < 0)
-          csoundErrorMsg(csound, Str(" *** error reading MIDI device: %d (%s)"),
-                                 n, csoundExternalMidiErrorString(csound, n));
-        else
-          p->endatp += (int) n;
-      }
-      if (O->FMidiin) {                         /* read MIDI file */
-        n = csoundMIDIFileRead(csound, p->endatp,
-                               MBUFSIZ - (int) (p->endatp - p->bufp));
-        if (n > 0)
-          p->endatp += (int) n;
+        for (i = 0; i < n; i++)                 /* untimed: now */
+          p->mstamp[i] = csound->icurTime;
       }
+      if (n < 0)
+        csoundErrorMsg(csound, Str(" *** error reading MIDI device: %d (%s)"),
+                               n, csoundExternalMidiErrorString(csound, n));
+      else
+        p->endatp += (int) n;
       if (p->endatp <= p->bufp)
         return 0;               /* no events were received */
     }
+    /* leave input timed after this k-period for a later one */
+    if (UNLIKELY(p->mstamp[p->bufp - p->mbuf] >=
+                 csound->icurTime + csound->ksmps))
+      return 0;
 
     if ((c = *(p->bufp++)) & 0x80) {    /* STATUS byte:         */
       type = c & 0xF0;
@@ -542,8 +594,8 @@ int sensMidi(CSOUND *csound)
             goto nxtchr;
           }
         }
-        mep->type = type;               /* begin sys_com event  */
-        mep->chan = lo3;                /* holding code in chan */
+        dev->type = type;               /* begin sys_com event  */
+        dev->chan = lo3;                /* holding code in chan */
         p->datcnt = 0;
         goto nxtchr;
       }
@@ -551,8 +603,8 @@ int sensMidi(CSOUND *csound)
         int16 chan;
         p->sexp = 0;                    /* also implies sys_exclus end */
         chan = c & 0xF;
-        mep->type = type;               /* & begin new event    */
-        mep->chan = chan;
+        dev->type = type;               /* & begin new event    */
+        dev->chan = chan;
         p->datreq = datbyts[(type>>4) & 0x7];
         p->datcnt = 0;
         goto nxtchr;
@@ -562,24 +614,18 @@ int sensMidi(CSOUND *csound)
       goto nxtchr;
     }
     if (p->datcnt == 0)
-      mep->dat1 = c;                    /* else normal data     */
-    else mep->dat2 = c;
+      dev->dat1 = c;                    /* else normal data     */
+    else dev->dat2 = c;
     if (++p->datcnt < p->datreq)        /* if msg incomplete    */
       goto nxtchr;                      /*   get next char      */
-    /* Enter the input event into a buffer used by 'midiin'. */
-    if (mep->type != SYSTEM_TYPE) {
-      unsigned char *pMessage =
-                    &(p->MIDIINbuffer2[p->MIDIINbufIndex++].bData[0]);
-      p->MIDIINbufIndex &= MIDIINBUFMSK;
-      *pMessage++ = mep->type | mep->chan;
-      *pMessage++ = (unsigned char) mep->dat1;
-      *pMessage = (p->datreq < 2 ? (unsigned char) 0 : mep->dat2);
-    }
     p->datcnt = 0;                      /* else allow a repeat  */
     /* NB:  this allows repeat in syscom 1,2,3 too */
-    if (mep->type > NOTEON_TYPE) {      /* if control or syscom */
-      m_chanmsg(csound, mep);           /*   handle from here   */
+    *mep = *dev;
+    if (midi_event(csound, mep, p->datreq) != 2)
       goto nxtchr;                      /*   & go look for more */
+    {                                   /* sample offset for MIDIinsert */
+      int64_t t = p->mstamp[p->bufp - p->mbuf - 1] - csound->icurTime;
+      p->midiOffset = (t > 0 ? (uint32_t) t : 0);
     }
     return 2;                           /* else it's note_on/off */
 }
@@ -842,6 +842,288 @@ int atan2aa(CSOUND *csound, AOP *p)
     return OK;
 }
 
+/* Fused expressions: the compiler replaces an audio-rate expression tree
+   such as  a1*k2 + a3*0.5  by a single ##expr call.  The first argument
+   is the tree in postfix form, where $a0, $k1, $i2 ... name the remaining
+   arguments by rate and position, and the other tokens are operators or
+   function names.  Init splits the tree into instructions run once at
+   init, once per k-cycle and per sample; the audio part is run over the
+   block EXPR_CHUNK samples at a time so that the intermediate results
+   stay in a small scratch area instead of in full ksmps variables.  The
+   arithmetic is that of the individual opcodes above.                  */
+
+static const char *expr_opnames[] = {
+    "+", "-", "*", "/", "%",
+    "neg", "abs", "exp", "log", "sqrt",
+    "sin", "cos", "tan", "sininv", "cosinv", "taninv",
+    "sinh", "cosh", "tanh", "log10", "log2",
+    "int", "frac", "round", "floor", "ceil", NULL
+};
+
+/* returns the EXPR_ code of a function that ##expr evaluates, or -1 */
+int exprfuse_opcode(const char *name)
+{
+    int     i;
+    for (i = EXPR_NEG + 1; expr_opnames[i] != NULL; i++)
+      if (strcmp(name, expr_opnames[i]) == 0)
+        return i;
+    return -1;
+}
+
+static inline MYFLT expr_apply(CSOUND *csound, int op, MYFLT x, MYFLT y)
+{
+    MYFLT   intpart;
+    switch (op) {
+    case EXPR_ADD:   return x + y;
+    case EXPR_SUB:   return x - y;
+    case EXPR_MUL:   return x * y;
+    case EXPR_DIV:
+      if (UNLIKELY(y==FL(0.0)))
+        csound->Warning(csound, Str("Division by zero"));
+      return x / y;
+    case EXPR_MOD:   return MOD(x, y);
+    case EXPR_NEG:   return -x;
+    case EXPR_ABS:   return FABS(x);
+    case EXPR_EXP:   return EXP(x);
+    case EXPR_LOG:   return LOG(x);
+    case EXPR_SQRT:  return SQRT(x);
+    case EXPR_SIN:   return SIN(x);
+    case EXPR_COS:   return COS(x);
+    case EXPR_TAN:   return TAN(x);
+    case EXPR_ASIN:  return ASIN(x);
+    case EXPR_ACOS:  return ACOS(x);
+    case EXPR_ATAN:  return ATAN(x);
+    case EXPR_SINH:  return SINH(x);
+    case EXPR_COSH:  return COSH(x);
+    case EXPR_TANH:  return TANH(x);
+    case EXPR_LOG10: return LOG10(x);
+    case EXPR_LOG2:  return LOG2(x);
+    case EXPR_INT:   MODF(x, &intpart); return intpart;
+    case EXPR_FRAC:  return MODF(x, &intpart);
+    case EXPR_ROUND: return (MYFLT) MYFLT2LRND(x);
+    case EXPR_FLOOR: return (MYFLT) MYFLOOR(x);
+    case EXPR_CEIL:  return (MYFLT) MYCEIL(x);
+    }
+    return FL(0.0);
+}
+
+#define EXPR_BINARY(OP)                                         \
+    if (a != NULL && b != NULL)                                 \
+      for (n = 0; n < len; n++) r[n] = a[n] OP b[n];            \
+    else if (a != NULL)                                         \
+      for (n = 0; n < len; n++) r[n] = a[n] OP y;               \
+    else                                                        \
+      for (n = 0; n < len; n++) r[n] = x OP b[n];               \
+    break;
+
+#define EXPR_UNARY(EXPR)                                        \
+    for (n = 0; n < len; n++) r[n] = EXPR;                      \
+    break;
+
+/* one audio instruction over len samples starting at n0 */
+static void expr_vector(const EXPRINS *ins, MYFLT *out, MYFLT *tmp,
+                        uint32_t n0, uint32_t len)
+{
+    MYFLT    *r, *a = NULL, *b = NULL, x = FL(0.0), y = FL(0.0), intpart;
+    uint32_t n;
+
+    r = (ins->tr < 0 ? out + n0 : tmp + ins->tr * EXPR_CHUNK);
+    switch (ins->akind) {
+    case EXPR_SCALAR: x = *ins->a; break;
+    case EXPR_SIGNAL: a = ins->a + n0; break;
+    default:          a = tmp + ins->ta * EXPR_CHUNK;
+    }
+    if (ins->op <= EXPR_MOD) {
+      switch (ins->bkind) {
+      case EXPR_SCALAR: y = *ins->b; break;
+      case EXPR_SIGNAL: b = ins->b + n0; break;
+      default:          b = tmp + ins->tb * EXPR_CHUNK;
+      }
+    }
+    switch (ins->op) {
+    case EXPR_ADD:   EXPR_BINARY(+)
+    case EXPR_SUB:   EXPR_BINARY(-)
+    case EXPR_MUL:   EXPR_BINARY(*)
+    case EXPR_DIV:   EXPR_BINARY(/)
+    case EXPR_MOD:
+      if (a != NULL && b != NULL)
+        for (n = 0; n < len; n++) r[n] = MOD(a[n], b[n]);
+      else if (a != NULL)
+        for (n = 0; n < len; n++) r[n] = MOD(a[n], y);
+      else
+        for (n = 0; n < len; n++) r[n] = MOD(x, b[n]);
+      break;
+    case EXPR_NEG:   EXPR_UNARY(-a[n])
+    case EXPR_ABS:   EXPR_UNARY(FABS(a[n]))
+    case EXPR_EXP:   EXPR_UNARY(EXP(a[n]))
+    case EXPR_LOG:   EXPR_UNARY(LOG(a[n]))
+    case EXPR_SQRT:  EXPR_UNARY(SQRT(a[n]))
+    case EXPR_SIN:   EXPR_UNARY(SIN(a[n]))
+    case EXPR_COS:   EXPR_UNARY(COS(a[n]))
+    case EXPR_TAN:   EXPR_UNARY(TAN(a[n]))
+    case EXPR_ASIN:  EXPR_UNARY(ASIN(a[n]))
+    case EXPR_ACOS:  EXPR_UNARY(ACOS(a[n]))
+    case EXPR_ATAN:  EXPR_UNARY(ATAN(a[n]))
+    case EXPR_SINH:  EXPR_UNARY(SINH(a[n]))
+    case EXPR_COSH:  EXPR_UNARY(COSH(a[n]))
+    case EXPR_TANH:  EXPR_UNARY(TANH(a[n]))
+    case EXPR_LOG10: EXPR_UNARY(LOG10(a[n]))
+    case EXPR_LOG2:  EXPR_UNARY(LOG2(a[n]))
+    case EXPR_INT:
+      for (n = 0; n < len; n++) {
+        MODF(a[n], &intpart);
+        r[n] = intpart;
+      }
+      break;
+    case EXPR_FRAC:  EXPR_UNARY(MODF(a[n], &intpart))
+    case EXPR_ROUND: EXPR_UNARY((MYFLT) MYFLT2LRND(a[n]))
+    case EXPR_FLOOR: EXPR_UNARY((MYFLT) MYFLOOR(a[n]))
+    case EXPR_CEIL:  EXPR_UNARY((MYFLT) MYCEIL(a[n]))
+    }
+}
+
+typedef struct {
+    int     rate;               /* 0: i, 1: k, 2: a */
+    int     kind;
+    MYFLT   *p;
+    int     t;
+} EXPRVAL;
+
+/* Translates the postfix program into p->ins, or with ins == NULL only
+   counts the instructions of each rate.  Returns OK or NOTOK.         */
+static int expr_translate(CSOUND *csound, EXPRFUSE *p, EXPRINS *ins,
+                          MYFLT *val, int *count)
+{
+    EXPRVAL  stack[2*EXPR_MAXARGS];
+    EXPRINS  *list[3], tmp;
+    char     tok[16];
+    const char *s = p->prog->data;
+    int      i, j, n, sp = 0, ntemp, nval = 0;
+    int      nargs = (int) p->INOCOUNT - 1;
+
+    list[0] = ins;
+    list[1] = ins + count[0];
+    list[2] = ins + count[0] + count[1];
+    count[0] = count[1] = count[2] = 0;
+    while (*s != '\0') {
+      while (*s == ' ') s++;
+      if (*s == '\0') break;
+      for (n = 0; s[n] != ' ' && s[n] != '\0'; n++)
+        if (n < 15) tok[n] = s[n];
+      tok[n < 15 ? n : 15] = '\0';
+      s += n;
+      if (tok[0] == '$') {                       /* leaf */
+        if (UNLIKELY(sp >= 2*EXPR_MAXARGS)) return NOTOK;
+        j = atoi(tok + 2);
+        if (UNLIKELY(j < 0 || j >= nargs)) return NOTOK;
+        stack[sp].rate = (tok[1] == 'a' ? 2 : tok[1] == 'k' ? 1 : 0);
+        stack[sp].kind = (tok[1] == 'a' ? EXPR_SIGNAL : EXPR_SCALAR);
+        stack[sp].p = p->args[j];
+        stack[sp].t = -1;
+        sp++;
+        continue;
+      }
+      for (i = 0; expr_opnames[i] != NULL; i++)
+        if (strcmp(tok, expr_opnames[i]) == 0) break;
+      n = (i <= EXPR_MOD ? 2 : 1);
+      if (UNLIKELY(expr_opnames[i] == NULL || sp < n)) return NOTOK;
+      sp -= n;
+      memset(&tmp, 0, sizeof(EXPRINS));
+      tmp.op = i;
+      tmp.akind = stack[sp].kind;
+      tmp.a = stack[sp].p;
+      tmp.ta = stack[sp].t;
+      tmp.tb = -1;
+      tmp.tr = -1;
+      j = stack[sp].rate;
+      if (n == 2) {
+        tmp.bkind = stack[sp+1].kind;
+        tmp.b = stack[sp+1].p;
+        tmp.tb = stack[sp+1].t;
+        if (stack[sp+1].rate > j) j = stack[sp+1].rate;
+      }
+      stack[sp].rate = j;
+      if (j < 2) {                               /* scalar result */
+        stack[sp].kind = EXPR_SCALAR;
+        stack[sp].p = tmp.r = (val != NULL ? &val[nval] : NULL);
+        stack[sp].t = -1;
+        nval++;
+      }
+      else {                /* temporaries are used as a stack */
+        for (ntemp = 0, i = 0; i < sp; i++)
+          if (stack[i].kind == EXPR_TEMP) ntemp++;
+        if (UNLIKELY(ntemp >= EXPR_MAXARGS)) return NOTOK;
+        stack[sp].kind = EXPR_TEMP;
+        stack[sp].p = NULL;
+        stack[sp].t = tmp.tr = ntemp;
+      }
+      if (ins != NULL) list[j][count[j]] = tmp;
+      count[j]++;
+      sp++;
+    }
+    /* the last audio instruction is the root, and writes the output */
+    if (UNLIKELY(sp != 1 || stack[0].kind != EXPR_TEMP)) return NOTOK;
+    if (ins != NULL) list[2][count[2] - 1].tr = -1;
+    return OK;
+}
+
+int exprfuse_init(CSOUND *csound, EXPRFUSE *p)
+{
+    int      count[3] = { 0, 0, 0 }, i;
+    size_t   size;
+    MYFLT    *val;
+
+    if (UNLIKELY(expr_translate(csound, p, NULL, NULL, count) != OK))
+      return csound->InitError(csound, Str("##expr: invalid program '%s'"),
+                               p->prog->data);
+    size = (count[0] + count[1] + count[2]) * sizeof(EXPRINS)
+           + (count[0] + count[1]) * sizeof(MYFLT);
+    if (p->auxch.auxp == NULL || p->auxch.size < size)
+      csound->AuxAlloc(csound, size, &p->auxch);
+    p->ins = (EXPRINS*) p->auxch.auxp;
+    val = (MYFLT*) (p->ins + count[0] + count[1] + count[2]);
+    expr_translate(csound, p, p->ins, val, count);
+    p->ninit = count[0];
+    p->nk = count[1];
+    p->na = count[2];
+    for (i = 0; i < p->ninit; i++) {
+      EXPRINS *ins = &p->ins[i];
+      *ins->r = expr_apply(csound, ins->op, *ins->a,
+                           ins->b != NULL ? *ins->b : FL(0.0));
+    }
+    return OK;
+}
+
+int exprfuse(CSOUND *csound, EXPRFUSE *p)
+{
+    MYFLT    tmp[EXPR_MAXARGS * EXPR_CHUNK];
+    MYFLT    *r = p->r;
+    EXPRINS  *kins = p->ins + p->ninit, *ains = kins + p->nk;
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t n, len, nsmps = CS_KSMPS;
+    int      i;
+
+    for (i = 0; i < p->nk; i++)
+      *kins[i].r = expr_apply(csound, kins[i].op, *kins[i].a,
+                              kins[i].b != NULL ? *kins[i].b : FL(0.0));
+    for (i = 0; i < p->na; i++)         /* as divak does */
+      if (ains[i].op == EXPR_DIV && ains[i].bkind == EXPR_SCALAR &&
+          UNLIKELY(*ains[i].b == FL(0.0)))
+        csound->Warning(csound, Str("Division by zero"));
+    if (UNLIKELY(offset)) memset(r, '\0', offset*sizeof(MYFLT));
+    if (UNLIKELY(early)) {
+      nsmps -= early;
+      memset(&r[nsmps], '\0', early*sizeof(MYFLT));
+    }
+    for (n = offset; n < nsmps; n += len) {
+      len = (nsmps - n < EXPR_CHUNK ? nsmps - n : EXPR_CHUNK);
+      for (i = 0; i < p->na; i++)
+        expr_vector(&ains[i], r, tmp, n, len);
+    }
+    return OK;
+}
+
 int dbamp(CSOUND *csound, EVAL *p)
 {
     IGN(csound);
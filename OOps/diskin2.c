@@ -28,10 +28,178 @@
 
 typedef struct DISKIN_INST_ {
   CSOUND *csound;
-  DISKIN2 *diskin;
+  void   *diskin;               /* DISKIN2, or DISKIN2_ARRAY if array is set */
+  int    array;
   struct DISKIN_INST_ *nxt;
 } DISKIN_INST;
 
+/* Streaming service shared by all asynchronous diskin2 instances: a single
+   I/O thread that sleeps until a stream signals that its buffer has dropped
+   below the low-water mark, then tops up every stream that has room.      */
+
+typedef struct DISKIN_IO_ {
+  DISKIN_INST   *streams;       /* chain of streams being serviced */
+  void          *lock;          /* protects the chain */
+  void          *wakeup;        /* thread lock used as a wakeup event */
+  pthread_t     thread;
+  volatile int  running;
+  volatile int  pending;        /* a wakeup was signalled and not yet seen */
+} DISKIN_IO;
+
+/* safety net: service all streams at least this often (ms) even if */
+/* no wakeup arrives                                                */
+#define DISKIN_IO_TIMEOUT       100
+
+int diskin_file_read(CSOUND *csound, DISKIN2 *p);
+int diskin_file_read_array(CSOUND *csound, DISKIN2_ARRAY *p);
+
+static void diskin_io_fill(CSOUND *csound, DISKIN_INST *s)
+{
+    if (s->array) {
+      DISKIN2_ARRAY *p = (DISKIN2_ARRAY *) s->diskin;
+      int     block = (int) p->aOut_bufsize * p->nChannels;
+      while (csoundCircularBufferAvailable(p->cb, 1) >= block)
+        if (diskin_file_read_array(csound, p) != OK)
+          break;
+    }
+    else {
+      DISKIN2 *p = (DISKIN2 *) s->diskin;
+      int     block = (int) p->aOut_bufsize * p->nChannels;
+      while (csoundCircularBufferAvailable(p->cb, 1) >= block)
+        if (diskin_file_read(csound, p) != OK)
+          break;
+    }
+}
+
+static void *diskin_io_thread(void *pp)
+{
+    DISKIN_IO   *io = (DISKIN_IO *) pp;
+    DISKIN_INST *current;
+#if !CS_THREADLOCK_WAKEUP
+    int wakeup = 0;
+#endif
+    _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
+    while (io->running) {
+#if CS_THREADLOCK_WAKEUP
+      csoundWaitThreadLock(io->wakeup, DISKIN_IO_TIMEOUT);
+#else
+      csoundSleep(wakeup > 0 ? wakeup : 1);
+#endif
+      io->pending = 0;
+      csoundLockMutex(io->lock);
+      for (current = io->streams; current != NULL && io->running;
+           current = current->nxt) {
+#if !CS_THREADLOCK_WAKEUP
+        wakeup = (int) (1000 * current->csound->ksmps / current->csound->esr);
+#endif
+        diskin_io_fill(current->csound, current);
+      }
+      csoundUnlockMutex(io->lock);
+    }
+    return NULL;
+}
+
+/* called from the performance thread when a stream is running low */
+
+static inline void diskin_io_wakeup(DISKIN_IO *io)
+{
+#if CS_THREADLOCK_WAKEUP
+    if (!io->pending) {
+      io->pending = 1;
+      csoundNotifyThreadLock(io->wakeup);
+    }
+#else
+    IGN(io);
+#endif
+}
+
+/* add a stream to the service, starting the I/O thread if needed */
+
+static int diskin_io_add(CSOUND *csound, void *p, void **iop, int array)
+{
+    DISKIN_IO   *io;
+    DISKIN_INST *inst;
+
+    io = (DISKIN_IO *) csound->QueryGlobalVariable(csound, "DISKIN_IO");
+    if (io == NULL) {
+      if (UNLIKELY(csound->CreateGlobalVariable(csound, "DISKIN_IO",
+                                                sizeof(DISKIN_IO)) != 0))
+        return NOTOK;
+      io = (DISKIN_IO *) csound->QueryGlobalVariable(csound, "DISKIN_IO");
+      io->lock = csound->Create_Mutex(0);
+      io->wakeup = csound->CreateThreadLock();
+    }
+    inst = (DISKIN_INST *) csound->Calloc(csound, sizeof(DISKIN_INST));
+    inst->csound = csound;
+    inst->diskin = p;
+    inst->array = array;
+    csound->LockMutex(io->lock);
+    inst->nxt = io->streams;
+    io->streams = inst;
+    csound->UnlockMutex(io->lock);
+    *iop = io;
+#ifndef __EMSCRIPTEN__
+    if (!io->running) {
+      io->running = 1;
+      pthread_create(&io->thread, NULL, diskin_io_thread, io);
+    }
+#endif
+    /* have the new stream pre-filled straight away */
+    diskin_io_wakeup(io);
+    return OK;
+}
+
+/* remove a stream; the I/O thread is stopped with the last one */
+
+static int diskin_io_remove(CSOUND *csound, void *p, void **iop)
+{
+    DISKIN_IO   *io = (DISKIN_IO *) *iop;
+    DISKIN_INST *current, *prv = NULL;
+
+    if (io == NULL)
+      return NOTOK;
+    csound->LockMutex(io->lock);
+    for (current = io->streams; current != NULL; current = current->nxt) {
+      if (current->diskin == p)
+        break;
+      prv = current;
+    }
+    if (current != NULL) {
+      if (prv == NULL) io->streams = current->nxt;
+      else prv->nxt = current->nxt;
+    }
+    csound->UnlockMutex(io->lock);
+    if (current != NULL)
+      csound->Free(csound, current);
+    *iop = NULL;
+    if (io->streams == NULL) {
+      io->running = 0;
+#ifndef __EMSCRIPTEN__
+      csound->NotifyThreadLock(io->wakeup);
+      pthread_join(io->thread, NULL);
+#endif
+      csound->DestroyThreadLock(io->wakeup);
+      csound->DestroyMutex(io->lock);
+      csound->DestroyGlobalVariable(csound, "DISKIN_IO");
+    }
+    return OK;
+}
+
+/* hint the OS to fetch the part of the file that will be read next; */
+/* faster playback consumes the file faster, so read further ahead   */
+
+static void diskin2_read_ahead(CSOUND *csound, void *fd, int bufSize,
+                               int frameBytes, int64_t pos_frac_inc)
+{
+    double  rate = (double) (pos_frac_inc < 0 ? -pos_frac_inc : pos_frac_inc)
+                   * (1.0 / (double) POS_FRAC_SCALE);
+    if (rate < 1.0)
+      rate = 1.0;
+    csoundFileReadAhead(csound, fd,
+                        (size_t) (2.0 * rate * (double) bufSize)
+                        * (size_t) frameBytes);
+}
+
 
 static CS_NOINLINE void diskin2_read_buffer(CSOUND *csound,
                                             DISKIN2 *p, int bufReadPos)
@@ -39,7 +207,6 @@ static CS_NOINLINE void diskin2_read_buffer(CSOUND *csound,
     MYFLT *tmp;
     int32 nsmps;
     int   i;
-    IGN(csound);
     /* swap buffer pointers */
     tmp = p->buf;
     p->buf = p->prvBuf;
@@ -72,6 +239,9 @@ static CS_NOINLINE void diskin2_read_buffer(CSOUND *csound,
         i = (int)sf_read_MYFLT(p->sf, p->buf, (sf_count_t) nsmps);
         if (UNLIKELY(i < 0))  /* error ? */
           i = 0;    /* clear entire buffer to zero */
+        else if (p->io != NULL)         /* streaming: prefetch what follows */
+          diskin2_read_ahead(csound, p->fdch.fd, p->bufSize,
+                             p->frameBytes, p->pos_frac_inc);
       }
     }
     /* fill rest of buffer with zero samples */
@@ -375,57 +545,30 @@ static int diskin2_init_(CSOUND *csound, DISKIN2 *p, int stringname)
 
     memset(p->buf, 0, n*sizeof(MYFLT));
 
+    p->io = NULL;
     // create circular buffer, on fail set mode to synchronous
     if(csound->realtime_audio_flag==1 && p->fforceSync==0 &&
        (p->cb = csound->CreateCircularBuffer(csound,
                                              p->bufSize*p->nChannels*2,
                                              sizeof(MYFLT))) != NULL){
-      DISKIN_INST **top, *current;
-      int *start;
-      // allocate buffer
-      n = CS_KSMPS*sizeof(MYFLT)*p->nChannels;
+      // allocate buffers: one k-period for the I/O thread to render
+      // into, and one for the performance thread to read back
+      n = 2*CS_KSMPS*sizeof(MYFLT)*p->nChannels;
       if (n != (int)p->auxData2.size)
         csound->AuxAlloc(csound, (int32) n, &(p->auxData2));
       p->aOut_buf = (MYFLT *) (p->auxData2.auxp);
       memset(p->aOut_buf, 0, n);
       p->aOut_bufsize = CS_KSMPS;
+      /* ask for a refill once half of the buffered audio has been used */
+      p->lowWater = p->bufSize*p->nChannels;
+      p->frameBytes = p->nChannels * csound->sfsampsize(sfinfo.format);
+      if (p->frameBytes <= 0)
+        p->frameBytes = p->nChannels * 4;
+      csoundFileAdviseSequential(csound, fd);
 
-#ifndef __EMSCRIPTEN__
-      if ((top=(DISKIN_INST **)csound->QueryGlobalVariable(csound,
-                                                       "DISKIN_INST")) == NULL){
-        csound->CreateGlobalVariable(csound, "DISKIN_INST", sizeof(DISKIN_INST *));
-        top = (DISKIN_INST **) csound->QueryGlobalVariable(csound, "DISKIN_INST");
-        *top = (DISKIN_INST *) csound->Calloc(csound, sizeof(DISKIN_INST));
-        csound->CreateGlobalVariable(csound, "DISKIN_PTHREAD", sizeof(pthread_t));
-        csound->CreateGlobalVariable(csound, "DISKIN_THREAD_START", sizeof(int));
-        current = *top;
-      }
-      else
-#endif
-      {
-        current = *top;
-        while(current->nxt != NULL) { /* find next empty slot in chain */
-          current = current->nxt;
-        }
-        current->nxt = (DISKIN_INST *) csound->Calloc(csound, sizeof(DISKIN_INST));
-        current = current->nxt;
-      }
-      current->csound = csound;
-      current->diskin = p;
-      current->nxt = NULL;
-
-#ifndef __EMSCRIPTEN__
-      if( *(start = csound->QueryGlobalVariable(csound,
-                                                "DISKIN_THREAD_START")) == 0) {
-        void *diskin_io_thread(void *p);
-        *start = 1;
-        pthread_create((pthread_t *)csound->QueryGlobalVariable(csound,
-                                                                "DISKIN_PTHREAD"),
-                       NULL, diskin_io_thread, *top);
-      }
-#endif
       csound->RegisterDeinitCallback(csound, p, diskin2_async_deinit);
       p->async = 1;
+      diskin_io_add(csound, p, &p->io, 0);
 
       /* print file information */
       if (UNLIKELY((csound->oparms_.msglevel & 7) == 7)) {
@@ -459,35 +602,9 @@ static int diskin2_init_(CSOUND *csound, DISKIN2 *p, int stringname)
 
 int diskin2_async_deinit(CSOUND *csound,  void *p){
 
-  DISKIN_INST **top, *current, *prv;
-
-  if ((top = (DISKIN_INST **)
-       csound->QueryGlobalVariable(csound, "DISKIN_INST")) == NULL) return NOTOK;
-   current = *top;
-   prv = NULL;
-   while(current->diskin != (DISKIN2 *)p) {
-        prv = current;
-        current = current->nxt;
-   }
-   if(prv == NULL) *top = current->nxt;
-   else prv->nxt = current->nxt;
-
-#ifndef __EMSCRIPTEN__
-   if(*top == NULL) {
-     int *start; pthread_t *pt;
-
-     start = (int *) csound->QueryGlobalVariable(csound,"DISKIN_THREAD_START");
-     *start = 0;
-     pt = (pthread_t *) csound->QueryGlobalVariable(csound,"DISKIN_PTHREAD");
-     //csound->Message(csound, "dealloc %p %d\n", start, *start);
-     pthread_join(*pt, NULL);
-     csound->DestroyGlobalVariable(csound, "DISKIN_PTHREAD");
-     csound->DestroyGlobalVariable(csound, "DISKIN_THREAD_START");
-     csound->DestroyGlobalVariable(csound, "DISKIN_INST");
-   }
-#endif
-   csound->Free(csound, current);
+   if (diskin_io_remove(csound, p, &((DISKIN2 *)p)->io) != OK) return NOTOK;
    csound->DestroyCircularBuffer(csound, ((DISKIN2 *)p)->cb);
+   ((DISKIN2 *)p)->cb = NULL;
 
    return OK;
 }
@@ -869,16 +986,8 @@ int diskin_file_read(CSOUND *csound, DISKIN2 *p)
           diskin2_file_pos_inc(p, &ndx);
         }
     }
-    {
-    /* write to circular buffer */
-    int lc, mc=0, nc=nsmps*p->nChannels;
-    int *start = csound->QueryGlobalVariable(csound,"DISKIN_THREAD_START");
-    do{
-      lc = csound->WriteCircularBuffer(csound, p->cb, &aOut[mc], nc);
-      nc -= lc;
-      mc += lc;
-    } while(nc && *start);
-    }
+    /* write to circular buffer; the I/O thread has checked for space */
+    csound->WriteCircularBuffer(csound, p->cb, aOut, nsmps*p->nChannels);
     return OK;
  file_error:
     csound->ErrorMsg(csound, Str("diskin2: file descriptor closed or invalid\n"));
@@ -891,10 +1000,10 @@ int diskin2_perf_asynchronous(CSOUND *csound, DISKIN2 *p)
     uint32_t offset = p->h.insdshead->ksmps_offset;
     uint32_t early  = p->h.insdshead->ksmps_no_end;
     uint32_t nn, nsmps = CS_KSMPS;
-    MYFLT samp;
-    int chn;
+    int chn, n;
     void *cb = p->cb;
     int chans = p->nChannels;
+    MYFLT *buf = p->aOut_buf + CS_KSMPS*chans;
 
     if(offset || early) {
    for (chn = 0; chn < chans; chn++)
@@ -908,38 +1017,22 @@ int diskin2_perf_asynchronous(CSOUND *csound, DISKIN2 *p)
       return csound->PerfError(csound, p->h.insdshead,
                                Str("diskin2: not initialised"));
     }
-    for (nn = offset; nn < nsmps; nn++){
-
+    if (UNLIKELY(offset >= nsmps)) return OK;
+    /* read the whole block at once, zero filling on underrun */
+    n = csound->ReadCircularBuffer(csound, cb, buf, (nsmps - offset)*chans);
+    if (UNLIKELY(n < (int) (nsmps - offset)*chans))
+      memset(&buf[n], 0, ((nsmps - offset)*chans - n)*sizeof(MYFLT));
     for (chn = 0; chn < chans; chn++) {
-      //int i =0;
-      //do {
-      // i =
-       csound->ReadCircularBuffer(csound, cb, &samp, 1);
-        //} while(i==0);
-        p->aOut[chn][nn] = csound->e0dbfs*samp;
-      }
+      MYFLT *out = p->aOut[chn], *in = &buf[chn];
+      for (nn = offset; nn < nsmps; nn++, in += chans)
+        out[nn] = csound->e0dbfs * *in;
     }
+    if (csoundCircularBufferAvailable(cb, 0) < p->lowWater)
+      diskin_io_wakeup((DISKIN_IO *) p->io);
     return OK;
 }
 
 
-void *diskin_io_thread(void *p){
-  DISKIN_INST *current = (DISKIN_INST *) p;
-  int wakeup = 1000*current->csound->ksmps/current->csound->esr;
-  int *start =
-    current->csound->QueryGlobalVariable(current->csound,"DISKIN_THREAD_START");
-  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
-  while(*start){
-    current = (DISKIN_INST *) p;
-    csoundSleep(wakeup > 0 ? wakeup : 1);
-    while(current != NULL){
-      diskin_file_read(current->csound, current->diskin);
-      current = current->nxt;
-  }
-  }
-  return NULL;
-}
-
 
 int diskin2_perf(CSOUND *csound, DISKIN2 *p) {
   if(!p->async) return diskin2_perf_synchronous(csound, p);
@@ -1338,7 +1431,6 @@ static CS_NOINLINE void diskin2_read_buffer_array(CSOUND *csound,
     MYFLT *tmp;
     int32 nsmps;
     int   i;
-    IGN(csound);
     /* swap buffer pointers */
     tmp = p->buf;
     p->buf = p->prvBuf;
@@ -1371,6 +1463,9 @@ static CS_NOINLINE void diskin2_read_buffer_array(CSOUND *csound,
         i = (int)sf_read_MYFLT(p->sf, p->buf, (sf_count_t) nsmps);
         if (UNLIKELY(i < 0))  /* error ? */
           i = 0;    /* clear entire buffer to zero */
+        else if (p->io != NULL)         /* streaming: prefetch what follows */
+          diskin2_read_ahead(csound, p->fdch.fd, p->bufSize,
+                             p->frameBytes, p->pos_frac_inc);
       }
     }
     /* fill rest of buffer with zero samples */
@@ -1485,38 +1580,10 @@ static inline void diskin2_get_sample_array(CSOUND *csound,
 
 int diskin2_async_deinit_array(CSOUND *csound,  void *p){
 
-  DISKIN_INST **top, *current, *prv;
-
-  if ((top = (DISKIN_INST **)
-       csound->QueryGlobalVariable(csound, "DISKIN_INST_ARRAY")) == NULL)
-    return NOTOK;
-   current = *top;
-   prv = NULL;
-   while(current->diskin != (DISKIN2 *)p) {
-        prv = current;
-        current = current->nxt;
-   }
-   if(prv == NULL) *top = current->nxt;
-   else prv->nxt = current->nxt;
-
-#ifndef __EMSCRIPTEN__
-   if(*top == NULL) {
-     int *start; pthread_t *pt;
-
-     start = (int *) csound->QueryGlobalVariable(csound,
-                                                 "DISKIN_THREAD_START_ARRAY");
-     *start = 0;
-     pt = (pthread_t *) csound->QueryGlobalVariable(csound,"DISKIN_PTHREAD_ARRAY");
-     //csound->Message(csound, "dealloc %p %d\n", start, *start);
-     pthread_join(*pt, NULL);
-     csound->DestroyGlobalVariable(csound, "DISKIN_PTHREAD_ARRAY");
-     csound->DestroyGlobalVariable(csound, "DISKIN_THREAD_START_ARRAY");
-     csound->DestroyGlobalVariable(csound, "DISKIN_INST_ARRAY");
-   }
-#endif
-
-   csound->Free(csound, current);
+   if (diskin_io_remove(csound, p, &((DISKIN2_ARRAY *)p)->io) != OK)
+     return NOTOK;
    csound->DestroyCircularBuffer(csound, ((DISKIN2_ARRAY *)p)->cb);
+   ((DISKIN2_ARRAY *)p)->cb = NULL;
 
    return OK;
 }
@@ -1696,40 +1763,14 @@ int diskin_file_read_array(CSOUND *csound, DISKIN2_ARRAY *p)
           diskin2_file_pos_inc_array(p, &ndx);
         }
     }
-    {
-    /* write to circular buffer */
-    int lc, mc=0, nc=nsmps*p->nChannels;
-    int *start = csound->QueryGlobalVariable(csound,"DISKIN_THREAD_START");
-    do{
-      lc = csound->WriteCircularBuffer(csound, p->cb, &aOut[mc], nc);
-      nc -= lc;
-      mc += lc;
-    } while(nc && *start);
-    }
+    /* write to circular buffer; the I/O thread has checked for space */
+    csound->WriteCircularBuffer(csound, p->cb, aOut, nsmps*p->nChannels);
     return OK;
  file_error:
     csound->ErrorMsg(csound, Str("diskin2: file descriptor closed or invalid\n"));
    return NOTOK;
 }
 
-void *diskin_io_thread_array(void *p){
-  DISKIN_INST *current = (DISKIN_INST *) p;
-  int wakeup = 1000*current->csound->ksmps/current->csound->esr;
-  int *start =
-    current->csound->QueryGlobalVariable(current->csound,
-                                         "DISKIN_THREAD_START_ARRAY");
-  _MM_SET_DENORMALS_ZERO_MODE(_MM_DENORMALS_ZERO_ON);
-  while(*start){
-    current = (DISKIN_INST *) p;
-    csoundSleep(wakeup > 0 ? wakeup : 1);
-    while(current != NULL){
-      diskin_file_read_array(current->csound, (DISKIN2_ARRAY *)current->diskin);
-      current = current->nxt;
-  }
-  }
-  return NULL;
-}
-
 
 static int diskin2_init_array(CSOUND *csound, DISKIN2_ARRAY *p, int stringname)
 {
@@ -1858,64 +1899,31 @@ static int diskin2_init_array(CSOUND *csound, DISKIN2_ARRAY *p, int stringname)
 
     memset(p->buf, 0, n*sizeof(MYFLT));
 
+    p->io = NULL;
     // create circular buffer, on fail set mode to synchronous
     if(csound->realtime_audio_flag==1 && p->fforceSync==0 &&
        (p->cb = csound->CreateCircularBuffer(csound,
                                              p->bufSize*p->nChannels*2,
                                              sizeof(MYFLT))) != NULL){
-      DISKIN_INST **top, *current;
-      int *start;
-      // allocate buffer
-      n = CS_KSMPS*sizeof(MYFLT)*p->nChannels;
+      // allocate buffers: one k-period for the I/O thread to render
+      // into, and one for the performance thread to read back
+      n = 2*CS_KSMPS*sizeof(MYFLT)*p->nChannels;
       if (n != (int)p->auxData2.size)
         csound->AuxAlloc(csound, (int32) n, &(p->auxData2));
       p->aOut_buf = (MYFLT *) (p->auxData2.auxp);
       memset(p->aOut_buf, 0, n);
       p->aOut_bufsize = CS_KSMPS;
+      /* ask for a refill once half of the buffered audio has been used */
+      p->lowWater = p->bufSize*p->nChannels;
+      p->frameBytes = p->nChannels * csound->sfsampsize(sfinfo.format);
+      if (p->frameBytes <= 0)
+        p->frameBytes = p->nChannels * 4;
+      csoundFileAdviseSequential(csound, fd);
 
-#ifndef __EMSCRIPTEN__
-      if ((top=(DISKIN_INST **)
-           csound->QueryGlobalVariable(csound,
-                                       "DISKIN_INST_ARRAY")) == NULL){
-        csound->CreateGlobalVariable(csound,
-                                     "DISKIN_INST_ARRAY", sizeof(DISKIN_INST *));
-        top = (DISKIN_INST **) csound->QueryGlobalVariable(csound,
-                                                           "DISKIN_INST_ARRAY");
-        *top = (DISKIN_INST *) csound->Calloc(csound, sizeof(DISKIN_INST));
-        csound->CreateGlobalVariable(csound,
-                                     "DISKIN_PTHREAD_ARRAY", sizeof(pthread_t));
-        csound->CreateGlobalVariable(csound,
-                                     "DISKIN_THREAD_START_ARRAY", sizeof(int));
-        current = *top;
-      }
-      else
-#endif
-      {
-        current = *top;
-        while(current->nxt != NULL) { /* find next empty slot in chain */
-          current = current->nxt;
-        }
-        current->nxt = (DISKIN_INST *) csound->Calloc(csound, sizeof(DISKIN_INST));
-        current = current->nxt;
-      }
-      current->csound = csound;
-      current->diskin =  (DISKIN2 *) p;
-      current->nxt = NULL;
-
-#ifndef __EMSCRIPTEN__
-      if (*(start =
-            csound->QueryGlobalVariable(csound,
-                                        "DISKIN_THREAD_START_ARRAY")) == 0) {
-        void *diskin_io_thread(void *p);
-        *start = 1;
-        pthread_create((pthread_t *)csound->QueryGlobalVariable(csound,
-                                                       "DISKIN_PTHREAD_ARRAY"),
-                       NULL, diskin_io_thread_array, *top);
-      }
-#endif
       csound->RegisterDeinitCallback(csound, (DISKIN2 *) p,
                                      diskin2_async_deinit_array);
       p->async = 1;
+      diskin_io_add(csound, p, &p->io, 1);
 
       /* print file information */
       if (UNLIKELY((csound->oparms_.msglevel & 7) == 7)) {
@@ -2142,11 +2150,11 @@ int diskin2_perf_asynchronous_array(CSOUND *csound, DISKIN2_ARRAY *p)
     uint32_t offset = p->h.insdshead->ksmps_offset;
     uint32_t early  = p->h.insdshead->ksmps_no_end;
     uint32_t nn, nsmps = CS_KSMPS, ksmps = CS_KSMPS;
-    MYFLT samp;
-    int chn;
+    int chn, n;
     void *cb = p->cb;
     int chans = p->nChannels;
     MYFLT *aOut = (MYFLT *) p->aOut->data;
+    MYFLT *buf = p->aOut_buf + CS_KSMPS*chans;
 
     if(offset || early) {
    for (chn = 0; chn < chans; chn++)
@@ -2160,17 +2168,18 @@ int diskin2_perf_asynchronous_array(CSOUND *csound, DISKIN2_ARRAY *p)
       return csound->PerfError(csound, p->h.insdshead,
                                Str("diskin2: not initialised"));
     }
-    for (nn = offset; nn < nsmps; nn++){
-
+    if (UNLIKELY(offset >= nsmps)) return OK;
+    /* read the whole block at once, zero filling on underrun */
+    n = csound->ReadCircularBuffer(csound, cb, buf, (nsmps - offset)*chans);
+    if (UNLIKELY(n < (int) (nsmps - offset)*chans))
+      memset(&buf[n], 0, ((nsmps - offset)*chans - n)*sizeof(MYFLT));
     for (chn = 0; chn < chans; chn++) {
-      //int i =0;
-      //do {
-      // i =
-       csound->ReadCircularBuffer(csound, cb, &samp, 1);
-        //} while(i==0);
-        aOut[chn*ksmps+nn] = csound->e0dbfs*samp;
-      }
+      MYFLT *out = &aOut[chn*ksmps], *in = &buf[chn];
+      for (nn = offset; nn < nsmps; nn++, in += chans)
+        out[nn] = csound->e0dbfs * *in;
     }
+    if (csoundCircularBufferAvailable(cb, 0) < p->lowWater)
+      diskin_io_wakeup((DISKIN_IO *) p->io);
     return OK;
 }
 
@@ -1072,6 +1072,268 @@ abformdec_a(CSOUND * csound, AMBIDA * p) {
 
 /* ------------------------------------------------------------------------- */
 
+/* Higher order ambisonics, for any order up to HOA_MAXORDER.
+
+   aamb[] hoaenc asrc[], kazim[], kelev[]
+   aspk[] hoadec aamb[], iazim[], ielev[] [, imode]
+
+   hoaenc encodes all sources of asrc[] into one ambisonic bus; the order
+   follows from the size of the output array, which has to hold
+   (order + 1)^2 channels. Channels are in ACN order with SN3D
+   normalisation (AmbiX), angles are in degrees as for bformenc1. The
+   spherical harmonics of a source are only recalculated when it moves,
+   and gains are then ramped over the control period. The encoding itself
+   is a sources x channels matrix applied to the whole block.
+
+   hoadec decodes the bus to loudspeakers at the given directions, using a
+   decoding matrix that is calculated once at init time: a sampling
+   decoder (imode = 0), or the same with max-rE order weights (imode =
+   1). */
+
+#define HOA_MAXORDER  (15)
+
+typedef struct {
+    OPDS      h;
+    ARRAYDAT  *tabout;
+    ARRAYDAT  *tabin, *kangles, *kelevations;
+    int       order, nchnls, nsrc;
+    AUXCH     coefs;            /* nsrc x nchnls gains, then previous ones */
+    AUXCH     pos;              /* angle and elevation of each source      */
+} HOAENC;
+
+typedef struct {
+    OPDS      h;
+    ARRAYDAT  *tabout;
+    ARRAYDAT  *tabin, *iangles, *ielevations;
+    MYFLT     *imode;
+    int       nchnls, nspk;
+    AUXCH     matrix;           /* nspk x nchnls decoding gains            */
+} HOADEC;
+
+/* order of an ambisonic bus with nchnls channels, or -1 if not valid */
+
+static int hoa_order(int nchnls)
+{
+    int order = 0;
+
+    while ((order + 1) * (order + 1) < nchnls)
+      order++;
+    if ((order + 1) * (order + 1) != nchnls || order > HOA_MAXORDER)
+      return -1;
+    return order;
+}
+
+/* Real spherical harmonics up to the given order for a direction in
+   radians, in ACN order, SN3D normalised and without the Condon-Shortley
+   phase. The associated Legendre functions are found with the usual
+   recurrences. */
+
+static void hoa_harmonics(int order, double angle, double elevation,
+                          MYFLT *coefficients)
+{
+    double legendre[HOA_MAXORDER + 1][HOA_MAXORDER + 1];
+    double s = sin(elevation), c = cos(elevation), pmm = 1.0;
+    int n, m;
+
+    for (m = 0; m <= order; m++) {
+      if (m > 0)
+        pmm *= (double) (2 * m - 1) * c;
+      legendre[m][m] = pmm;
+      if (m < order)
+        legendre[m + 1][m] = s * (double) (2 * m + 1) * pmm;
+      for (n = m + 2; n <= order; n++)
+        legendre[n][m] = ((double) (2 * n - 1) * s * legendre[n - 1][m]
+                          - (double) (n + m - 1) * legendre[n - 2][m])
+                         / (double) (n - m);
+    }
+    for (n = 0; n <= order; n++) {
+      coefficients[n * n + n] = (MYFLT) legendre[n][0];
+      for (m = 1; m <= n; m++) {
+        /* sqrt(2 (n - m)! / (n + m)!) */
+        double norm = 2.0;
+        int k;
+        for (k = n - m + 1; k <= n + m; k++)
+          norm /= (double) k;
+        norm = sqrt(norm) * legendre[n][m];
+        coefficients[n * n + n + m] = (MYFLT) (norm * cos(m * angle));
+        coefficients[n * n + n - m] = (MYFLT) (norm * sin(m * angle));
+      }
+    }
+}
+
+static int ihoaenc(CSOUND * csound, HOAENC * p)
+{
+    MYFLT *pos;
+    int i;
+
+    if (UNLIKELY(p->tabout->data == NULL || p->tabout->dimensions != 1 ||
+                 p->tabin->data == NULL || p->kangles->data == NULL ||
+                 p->kelevations->data == NULL))
+      return csound->InitError(csound, Str("hoaenc: array not initialised"));
+    if (UNLIKELY((p->order = hoa_order(p->tabout->sizes[0])) < 0))
+      return csound->InitError(csound,
+                               Str("hoaenc: output array size %d is not "
+                                   "(order + 1)^2 with order <= %d"),
+                               p->tabout->sizes[0], HOA_MAXORDER);
+    p->nchnls = p->tabout->sizes[0];
+    p->nsrc = p->tabin->sizes[0];
+    if (UNLIKELY(p->kangles->sizes[0] < p->nsrc ||
+                 p->kelevations->sizes[0] < p->nsrc))
+      return csound->InitError(csound, Str("hoaenc: position arrays smaller "
+                                           "than source array"));
+    csound->AuxAlloc(csound, 2 * p->nsrc * p->nchnls * sizeof(MYFLT),
+                     &p->coefs);
+    csound->AuxAlloc(csound, 2 * p->nsrc * sizeof(MYFLT), &p->pos);
+    /* calculate initial gains, so that the first period is not ramped */
+    pos = (MYFLT*) p->pos.auxp;
+    for (i = 0; i < p->nsrc; i++) {
+      pos[2 * i] = p->kangles->data[i];
+      pos[2 * i + 1] = p->kelevations->data[i];
+      hoa_harmonics(p->order, (double) pos[2 * i] * (PI / 180.0),
+                    (double) pos[2 * i + 1] * (PI / 180.0),
+                    (MYFLT*) p->coefs.auxp + i * p->nchnls);
+    }
+    return OK;
+}
+
+static int ahoaenc(CSOUND * csound, HOAENC * p)
+{
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t ksmps = CS_KSMPS, sampleCount = ksmps - early, sampleIndex;
+    int nchnls = p->nchnls, nsrc = p->nsrc, s, ch;
+    MYFLT *coefs = (MYFLT*) p->coefs.auxp;
+    MYFLT *prev = coefs + nsrc * nchnls;
+    MYFLT *pos = (MYFLT*) p->pos.auxp;
+    MYFLT *tabin = p->tabin->data, *tabout = p->tabout->data;
+    MYFLT rcount;
+
+    memset(tabout, '\0', nchnls * ksmps * sizeof(MYFLT));
+    if (UNLIKELY(offset >= sampleCount))
+      return OK;
+    rcount = FL(1.0) / (MYFLT) (sampleCount - offset);
+    for (s = 0; s < nsrc; s++) {
+      MYFLT *in = &tabin[s * ksmps];
+      MYFLT *gains = &coefs[s * nchnls], *prevgains = &prev[s * nchnls];
+      MYFLT angle = p->kangles->data[s], elevation = p->kelevations->data[s];
+      int moved = (angle != pos[2 * s] || elevation != pos[2 * s + 1]);
+
+      if (moved) {
+        /* new harmonics, ramped from the old ones over this period */
+        memcpy(prevgains, gains, nchnls * sizeof(MYFLT));
+        hoa_harmonics(p->order, (double) angle * (PI / 180.0),
+                      (double) elevation * (PI / 180.0), gains);
+        pos[2 * s] = angle;
+        pos[2 * s + 1] = elevation;
+      }
+      for (ch = 0; ch < nchnls; ch++) {
+        MYFLT *out = &tabout[ch * ksmps];
+        MYFLT gain = gains[ch];
+
+        if (moved) {
+          MYFLT g = prevgains[ch], dg = (gain - g) * rcount;
+          for (sampleIndex = offset; sampleIndex < sampleCount; sampleIndex++) {
+            g += dg;
+            out[sampleIndex] += g * in[sampleIndex];
+          }
+        }
+        else if (gain != FL(0.0)) {
+          for (sampleIndex = offset; sampleIndex < sampleCount; sampleIndex++)
+            out[sampleIndex] += gain * in[sampleIndex];
+        }
+      }
+    }
+    return OK;
+}
+
+/* Legendre polynomial of degree n at x */
+
+static double hoa_legendre(int n, double x)
+{
+    double p0 = 1.0, p1 = x;
+    int k;
+
+    if (n == 0)
+      return 1.0;
+    for (k = 2; k <= n; k++) {
+      double p2 = ((double) (2 * k - 1) * x * p1 - (double) (k - 1) * p0)
+                  / (double) k;
+      p0 = p1;
+      p1 = p2;
+    }
+    return p1;
+}
+
+static int ihoadec(CSOUND * csound, HOADEC * p)
+{
+    MYFLT *matrix, weights[HOA_MAXORDER + 1];
+    int order, nspk, nchnls, spk, n, ch;
+
+    if (UNLIKELY(p->tabout->data == NULL || p->tabout->dimensions != 1 ||
+                 p->tabin->data == NULL || p->iangles->data == NULL ||
+                 p->ielevations->data == NULL))
+      return csound->InitError(csound, Str("hoadec: array not initialised"));
+    nchnls = p->tabin->sizes[0];
+    if (UNLIKELY((order = hoa_order(nchnls)) < 0))
+      return csound->InitError(csound,
+                               Str("hoadec: input array size %d is not "
+                                   "(order + 1)^2 with order <= %d"),
+                               nchnls, HOA_MAXORDER);
+    nspk = p->tabout->sizes[0];
+    if (UNLIKELY(p->iangles->sizes[0] < nspk ||
+                 p->ielevations->sizes[0] < nspk))
+      return csound->InitError(csound, Str("hoadec: speaker direction arrays "
+                                           "smaller than output array"));
+    p->nchnls = nchnls;
+    p->nspk = nspk;
+    /* order weights: (2n + 1) / nspk undoes the SN3D normalisation for a
+       sampling decoder, max-rE additionally tapers the higher orders */
+    for (n = 0; n <= order; n++) {
+      weights[n] = (MYFLT) (2 * n + 1) / (MYFLT) nspk;
+      if (*p->imode == FL(1.0))
+        weights[n] *= (MYFLT) hoa_legendre(n, cos((137.9 * PI / 180.0)
+                                                  / ((double) order + 1.51)));
+    }
+    csound->AuxAlloc(csound, nspk * nchnls * sizeof(MYFLT), &p->matrix);
+    matrix = (MYFLT*) p->matrix.auxp;
+    for (spk = 0; spk < nspk; spk++) {
+      MYFLT *row = &matrix[spk * nchnls];
+      hoa_harmonics(order, (double) p->iangles->data[spk] * (PI / 180.0),
+                    (double) p->ielevations->data[spk] * (PI / 180.0), row);
+      for (n = 0; n <= order; n++)
+        for (ch = n * n; ch < (n + 1) * (n + 1); ch++)
+          row[ch] *= weights[n];
+    }
+    return OK;
+}
+
+static int ahoadec(CSOUND * csound, HOADEC * p)
+{
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t ksmps = CS_KSMPS, sampleCount = ksmps - early, sampleIndex;
+    int nchnls = p->nchnls, nspk = p->nspk, spk, ch;
+    MYFLT *matrix = (MYFLT*) p->matrix.auxp;
+    MYFLT *tabin = p->tabin->data, *tabout = p->tabout->data;
+
+    memset(tabout, '\0', nspk * ksmps * sizeof(MYFLT));
+    for (spk = 0; spk < nspk; spk++) {
+      MYFLT *out = &tabout[spk * ksmps];
+      const MYFLT *row = &matrix[spk * nchnls];
+      for (ch = 0; ch < nchnls; ch++) {
+        const MYFLT *in = &tabin[ch * ksmps];
+        MYFLT gain = row[ch];
+        if (gain == FL(0.0))
+          continue;
+        for (sampleIndex = offset; sampleIndex < sampleCount; sampleIndex++)
+          out[sampleIndex] += gain * in[sampleIndex];
+      }
+    }
+    return OK;
+}
+
+/* ------------------------------------------------------------------------- */
+
 #define S(x) sizeof(x)
 
 static OENTRY ambicode1_localops[] = {
@@ -1083,6 +1345,10 @@ static OENTRY ambicode1_localops[] = {
     (SUBR)ibformdec, NULL, (SUBR)abformdec },
   { "bformdec1.A", S(AMBIDA), 0, 5, "a[]", "ia[]",
     (SUBR)ibformdec_a, NULL, (SUBR)abformdec_a },
+  { "hoaenc", S(HOAENC), 0, 5, "a[]", "a[]k[]k[]",
+    (SUBR)ihoaenc, NULL, (SUBR)ahoaenc },
+  { "hoadec", S(HOADEC), 0, 5, "a[]", "a[]i[]i[]o",
+    (SUBR)ihoadec, NULL, (SUBR)ahoadec },
 };
 
 LINKAGE_BUILTIN(ambicode1_localops)
@@ -30,6 +30,7 @@
 #include <sndfile.h>
 #include "fout.h"
 #include "soundio.h"
+#include "envvar.h"
 #include <ctype.h>
 
 /* remove a file reference, optionally closing the file */
@@ -55,6 +56,12 @@ static CS_NOINLINE int fout_deinit_callback(CSOUND *csound, void *p_)
           pp->do_scale = 0;
           pp->refCount = 0U;
 
+          if (UNLIKELY(pp->dropped))
+            csound->Warning(csound, Str("fout: %u samples could not be "
+                                        "written to '%s' in time"),
+                            pp->dropped, csound->GetFileName(pp->fd));
+          pp->async = 0;
+          pp->dropped = 0U;
           if (pp->fd != NULL) {
             if ((csound->oparms->msglevel & 7) == 7)
               csound->Message(csound, Str("Closing file '%s'...\n"),
@@ -69,13 +76,44 @@ static CS_NOINLINE int fout_deinit_callback(CSOUND *csound, void *p_)
     return OK;
 }
 
+/* Write a block of interleaved samples. Files served by the file I/O
+   thread never block a real-time caller: what does not fit in the file's
+   ring buffer is dropped, counted, and reported once here and in total
+   when the file is closed. Rendering offline there is no deadline to
+   miss, so wait for the I/O thread instead of losing samples. */
+
+static void fout_write(CSOUND *csound, FOUT_FILE *p, MYFLT *buf, int n)
+{
+    struct fileinTag  *pp;
+    unsigned int      m;
+
+    if (p->async != 1) {
+      sf_write_MYFLT(p->sf, buf, n);
+      return;
+    }
+    m = csound->WriteAsync(csound, p->fd, buf, n);
+    while (m < (unsigned int) n && !csound->realtime_audio_flag) {
+      csoundFileIOWakeup(csound);
+      csound->Sleep(1);
+      m += csound->WriteAsync(csound, p->fd, buf + m, n - (int) m);
+    }
+    if (LIKELY(m >= (unsigned int) n))
+      return;
+    pp = &(((STDOPCOD_GLOBALS*) csound->stdOp_Env)->file_opened[p->idx - 1]);
+    if (pp->dropped == 0U)
+      csound->Warning(csound, Str("fout: '%s': write buffer overrun, the disk "
+                                  "is not keeping up"),
+                      csound->GetFileName(p->fd));
+    pp->dropped += (uint32) n - m;
+}
+
 static CS_NOINLINE int fout_open_file(CSOUND *csound, FOUT_FILE *p, void *fp,
                                       int fileType, MYFLT *iFile, int isString,
                                       void *fileParams, int forceSync)
 {
     STDOPCOD_GLOBALS  *pp = (STDOPCOD_GLOBALS*) csound->stdOp_Env;
     char              *name;
-    int               idx, csFileType, need_deinit = 0;
+    int               idx, csFileType, need_deinit = 0, opened = 0;
 
     if (p != (FOUT_FILE*) NULL) p->async = 0;
     if (fp != NULL) {
@@ -179,35 +217,38 @@ static CS_NOINLINE int fout_open_file(CSOUND *csound, FOUT_FILE *p, void *fp,
       void    *fd;
       //int     buf_reqd;
       int     do_scale = 0;
+      /* sound files go through the file I/O thread when running in real
+         time, or always when asked to (writes only) */
+      int     async = (forceSync != 1 &&
+                       (csound->realtime_audio_flag != 0 ||
+                        (fileType == CSFILE_SND_W &&
+                         (csound->fout_async || csound->fout_direct))));
 
       if (fileType == CSFILE_SND_W) {
         do_scale = ((SF_INFO*) fileParams)->format;
         csFileType = csound->sftype2csfiletype(do_scale);
-        if(csound->realtime_audio_flag == 0 || forceSync == 1) {
+        if (!async) {
           fd = csound->FileOpen2(csound, &sf, fileType, name, fileParams,
                                 "SFDIR", csFileType, 0);
-          p->async = 0;
         }
         else {
-        p->fd = fd = csound->FileOpenAsync(csound, &sf, fileType, name, fileParams,
-                                           "SFDIR;SSDIR", CSFTYPE_UNKNOWN_AUDIO,
-                                           p->bufsize,  0);
-        p->async = 1;
+          fd = csound->FileOpenAsync(csound, &sf, fileType, name, fileParams,
+                                     "SFDIR", csFileType, p->bufsize, 0);
+          if (fd != NULL && csound->fout_direct)
+            csoundFileSetDirect(csound, fd, 1);
         }
         p->nchnls = ((SF_INFO*) fileParams)->channels;
       }
       else {
-         if(csound->realtime_audio_flag == 0 || forceSync == 1) {
-        fd = csound->FileOpen2(csound, &sf, fileType, name, fileParams,
-                               "SFDIR;SSDIR", CSFTYPE_UNKNOWN_AUDIO, 0);
-        p->async = 0;
-
-         } else {
-        p->fd = fd = csound->FileOpenAsync(csound, &sf, fileType, name, fileParams,
-                                           "SFDIR;SSDIR", CSFTYPE_UNKNOWN_AUDIO,
-                                           p->bufsize,  0);
-        p->async = 1;
-         }
+        if (!async) {
+          fd = csound->FileOpen2(csound, &sf, fileType, name, fileParams,
+                                 "SFDIR;SSDIR", CSFTYPE_UNKNOWN_AUDIO, 0);
+        }
+        else {
+          fd = csound->FileOpenAsync(csound, &sf, fileType, name, fileParams,
+                                     "SFDIR;SSDIR", CSFTYPE_UNKNOWN_AUDIO,
+                                     p->bufsize, 0);
+        }
         p->nchnls = ((SF_INFO*) fileParams)->channels;
         do_scale = ((SF_INFO*) fileParams)->format;
       }
@@ -238,9 +279,11 @@ static CS_NOINLINE int fout_open_file(CSOUND *csound, FOUT_FILE *p, void *fp,
       pp->file_opened[idx].file = sf;
       pp->file_opened[idx].fd = fd;
       pp->file_opened[idx].do_scale = do_scale;
+      pp->file_opened[idx].async = async;
     }
     /* store file information */
     pp->file_opened[idx].name = name;
+    opened = 1;
 
  returnHandle:
     /* return 'idx' as file handle */
@@ -258,6 +301,14 @@ static CS_NOINLINE int fout_open_file(CSOUND *csound, FOUT_FILE *p, void *fp,
       else {
         p->sf = pp->file_opened[idx].file;
         p->f = (FILE*) NULL;
+        /* all writers to a file share its handle, so that they go through
+           the same ring buffer when it is served by the I/O thread; a
+           reader reusing an open file keeps its own position and reads
+           synchronously */
+        if (opened || fileType == CSFILE_SND_W) {
+          p->fd = pp->file_opened[idx].fd;
+          p->async = pp->file_opened[idx].async;
+        }
       }
       p->idx = idx + 1;
       pp->file_opened[idx].refCount++;
@@ -296,14 +347,7 @@ static int outfile(CSOUND *csound, OUTFILE *p)
       p->buf_pos = k;
       if (p->buf_pos >= p->guard_pos) {
 
-        //#ifndef USE_DOUBLE
-        //sf_write_float(p->f.sf, buf, p->buf_pos);
-        //#else
-        //sf_write_double(p->f.sf, buf, p->buf_pos);
-        //#endif
-        if(p->f.async==1)
-        csound->WriteAsync(csound, p->f.fd, buf, p->buf_pos);
-        else sf_write_MYFLT(p->f.sf, buf, p->buf_pos);
+        fout_write(csound, &(p->f), buf, p->buf_pos);
         p->buf_pos = 0;
        }
 
@@ -338,15 +382,7 @@ static int outfile_array(CSOUND *csound, OUTFILEA *p)
       p->buf_pos = k;
       if (p->buf_pos >= p->guard_pos) {
 
-        //#ifndef USE_DOUBLE
-        //sf_write_float(p->f.sf, buf, p->buf_pos);
-        //#else
-        //sf_write_double(p->f.sf, buf, p->buf_pos);
-        //#endif
-        if (p->f.async==1)
-          csound->WriteAsync(csound, p->f.fd, buf, p->buf_pos);
-        else
-          sf_write_MYFLT(p->f.sf, buf, p->buf_pos);
+        fout_write(csound, &(p->f), buf, p->buf_pos);
         p->buf_pos = 0;
        }
 
@@ -390,15 +426,7 @@ static int fout_flush_callback(CSOUND *csound, void *p_)
     OUTFILE            *p = (OUTFILE*) p_;
 
     if (p->f.sf != NULL && p->buf_pos > 0) {
-      //#ifndef USE_DOUBLE
-      //sf_write_float(p->f.sf, (float*) p->buf.auxp, p->buf_pos);
-      //#else
-      //sf_write_double(p->f.sf, (double*) p->buf.auxp, p->buf_pos);
-      //#endif
-      if(p->f.async == 1)
-        csound->WriteAsync(csound, p->f.fd, (MYFLT *) p->buf.auxp, p->buf_pos);
-      else
-        sf_write_MYFLT(p->f.sf, (MYFLT *) p->buf.auxp, p->buf_pos);
+      fout_write(csound, &(p->f), (MYFLT *) p->buf.auxp, p->buf_pos);
     }
     return OK;
 }
@@ -408,15 +436,7 @@ static int fouta_flush_callback(CSOUND *csound, void *p_)
     OUTFILEA           *p = (OUTFILEA*) p_;
 
     if (p->f.sf != NULL && p->buf_pos > 0) {
-      //#ifndef USE_DOUBLE
-      //sf_write_float(p->f.sf, (float*) p->buf.auxp, p->buf_pos);
-      //#else
-      //sf_write_double(p->f.sf, (double*) p->buf.auxp, p->buf_pos);
-      //#endif
-      if (p->f.async == 1)
-        csound->WriteAsync(csound, p->f.fd, (MYFLT *) p->buf.auxp, p->buf_pos);
-      else
-        sf_write_MYFLT(p->f.sf, (MYFLT *) p->buf.auxp, p->buf_pos);
+      fout_write(csound, &(p->f), (MYFLT *) p->buf.auxp, p->buf_pos);
     }
     return OK;
 }
@@ -533,14 +553,7 @@ static int koutfile(CSOUND *csound, KOUTFILE *p)
       buf[k++] = p->argums[i][0] * p->scaleFac;
     p->buf_pos = k;
     if (p->buf_pos >= p->guard_pos) {
-        //#ifndef USE_DOUBLE
-        //sf_write_float(p->f.sf, buf, p->buf_pos);
-        //#else
-        //sf_write_double(p->f.sf, buf, p->buf_pos);
-        //#endif
-        if(p->f.async==1)
-        csound->WriteAsync(csound, p->f.fd, buf, p->buf_pos);
-        else sf_write_MYFLT(p->f.sf, buf, p->buf_pos);
+      fout_write(csound, &(p->f), buf, p->buf_pos);
       p->buf_pos = 0;
     }
     return OK;
@@ -56,18 +56,19 @@ static const double offsetRoom  = 0.7;
 
 static const double allPassFeedBack = 0.5;
 
-typedef struct {
-    int     nSamples;
-    int     bufPos;
-    double  filterState;
-    MYFLT   buf[1];
-} freeVerbComb;
+/* Comb and allpass filter states, stored per field rather than per filter, */
+/* with the left and right channel filters interleaved (index 2 * filter    */
+/* + channel), so that all filters of a stage can be stepped side by side.  */
 
 typedef struct {
-    int     nSamples;
-    int     bufPos;
-    MYFLT   buf[1];
-} freeVerbAllPass;
+    int     combPos[NR_COMB * 2];
+    int     combSize[NR_COMB * 2];
+    double  combState[NR_COMB * 2];
+    MYFLT   *combBuf[NR_COMB * 2];
+    int     allPassPos[NR_ALLPASS * 2];
+    int     allPassSize[NR_ALLPASS * 2];
+    MYFLT   *allPassBuf[NR_ALLPASS * 2];
+} freeVerbFilters;
 
 typedef struct {
     OPDS            h;
@@ -79,103 +80,177 @@ typedef struct {
     MYFLT           *kDampFactor;
     MYFLT           *iSampleRate;
     MYFLT           *iSkipInit;
-    freeVerbComb    *Comb[NR_COMB][2];
-    freeVerbAllPass *AllPass[NR_ALLPASS][2];
-    MYFLT           *tmpBuf;
+    freeVerbFilters filters;
     AUXCH           auxData;
     MYFLT           prvDampFactor;
     double          dampValue;
     double          srFact;
 } FREEVERB;
 
-static int calc_nsamples(FREEVERB *p, double delTime)
+/* freeverb for arrays of stereo busses, all with the same parameters */
+
+typedef struct {
+    OPDS            h;
+    ARRAYDAT        *aOutL;
+    ARRAYDAT        *aOutR;
+    ARRAYDAT        *aInL;
+    ARRAYDAT        *aInR;
+    MYFLT           *kRoomSize;
+    MYFLT           *kDampFactor;
+    MYFLT           *iSampleRate;
+    MYFLT           *iSkipInit;
+    int             nBusses;
+    AUXCH           filters;    /* freeVerbFilters for each bus */
+    AUXCH           auxData;
+    MYFLT           prvDampFactor;
+    double          dampValue;
+    double          srFact;
+} FREEVERB_A;
+
+static int calc_nsamples(MYFLT iSampleRate, double delTime)
 {
     double  sampleRate;
-    sampleRate = (double) *(p->iSampleRate);
+    sampleRate = (double) iSampleRate;
     if (sampleRate < MIN_SRATE)
       sampleRate = DEFAULT_SRATE;
     return (int) (delTime * sampleRate + 0.5);
 }
 
-static int comb_nbytes(FREEVERB *p, double delTime)
+/* buffer length of a filter, rounded up to keep the buffers 16 byte aligned */
+
+static int buf_nsamples(MYFLT iSampleRate, double delTime)
 {
-    int nbytes;
-    nbytes = (int) sizeof(freeVerbComb) - (int) sizeof(MYFLT);
-    nbytes += ((int) sizeof(MYFLT) * calc_nsamples(p, delTime));
-    return ((nbytes + 15) & (~15));
+    int align = 16 / (int) sizeof(MYFLT);
+    return ((calc_nsamples(iSampleRate, delTime) + align - 1) / align) * align;
 }
 
-static int allpass_nbytes(FREEVERB *p, double delTime)
+/* number of samples in all filter buffers of one reverb */
+
+static int filters_nsamples(MYFLT iSampleRate)
 {
-    int nbytes;
-    nbytes = (int) sizeof(freeVerbAllPass) - (int) sizeof(MYFLT);
-    nbytes += ((int) sizeof(MYFLT) * calc_nsamples(p, delTime));
-    return ((nbytes + 15) & (~15));
+    int i, nSamples = 0;
+
+    for (i = 0; i < (NR_COMB << 1); i++)
+      nSamples += buf_nsamples(iSampleRate, comb_delays[i >> 1][i & 1]);
+    for (i = 0; i < (NR_ALLPASS << 1); i++)
+      nSamples += buf_nsamples(iSampleRate, allpass_delays[i >> 1][i & 1]);
+    return nSamples;
 }
 
-static int freeverb_init(CSOUND *csound, FREEVERB *p)
+/* set up the filters of one reverb, using the buffer space at buf */
+
+static void init_filters(freeVerbFilters *fp, MYFLT *buf, MYFLT iSampleRate)
 {
-    int             i, j, k, nbytes;
-    freeVerbComb    *combp;
-    freeVerbAllPass *allpassp;
-    /* calculate the total number of bytes to allocate */
-    nbytes = 0;
-    for (i = 0; i < NR_COMB; i++) {
-      nbytes += comb_nbytes(p, comb_delays[i][0]);
-      nbytes += comb_nbytes(p, comb_delays[i][1]);
+    int i;
+
+    for (i = 0; i < (NR_COMB << 1); i++) {
+      fp->combBuf[i] = buf;
+      fp->combSize[i] = calc_nsamples(iSampleRate, comb_delays[i >> 1][i & 1]);
+      fp->combPos[i] = 0;
+      fp->combState[i] = 0.0;
+      memset(buf, 0, sizeof(MYFLT) * fp->combSize[i]);
+      buf += buf_nsamples(iSampleRate, comb_delays[i >> 1][i & 1]);
     }
-    for (i = 0; i < NR_ALLPASS; i++) {
-      nbytes += allpass_nbytes(p, allpass_delays[i][0]);
-      nbytes += allpass_nbytes(p, allpass_delays[i][1]);
+    for (i = 0; i < (NR_ALLPASS << 1); i++) {
+      fp->allPassBuf[i] = buf;
+      fp->allPassSize[i] = calc_nsamples(iSampleRate,
+                                         allpass_delays[i >> 1][i & 1]);
+      fp->allPassPos[i] = 0;
+      memset(buf, 0, sizeof(MYFLT) * fp->allPassSize[i]);
+      buf += buf_nsamples(iSampleRate, allpass_delays[i >> 1][i & 1]);
     }
-    nbytes += (int) sizeof(MYFLT) * (int) CS_KSMPS;
+}
+
+static double freeverb_sr_fact(MYFLT iSampleRate)
+{
+    if (iSampleRate >= MIN_SRATE)
+      return pow((DEFAULT_SRATE / iSampleRate), 0.8);
+    return 1.0;
+}
+
+static int freeverb_init(CSOUND *csound, FREEVERB *p)
+{
+    size_t  nbytes;
+
+    /* calculate the total number of bytes to allocate */
+    nbytes = sizeof(MYFLT) * (size_t) filters_nsamples(*(p->iSampleRate));
     /* allocate space if size has changed */
-    if (nbytes != (int) p->auxData.size)
-      csound->AuxAlloc(csound, (int32) nbytes, &(p->auxData));
+    if (nbytes != p->auxData.size)
+      csound->AuxAlloc(csound, nbytes, &(p->auxData));
     else if (*(p->iSkipInit) != FL(0.0))    /* skip initialisation */
       return OK;                            /*   if requested      */
     /* set up comb and allpass filters */
-    nbytes = 0;
-    for (i = 0; i < (NR_COMB << 1); i++) {
-      combp = (freeVerbComb*)((unsigned char*)p->auxData.auxp + (int) nbytes);
-      p->Comb[i >> 1][i & 1] = combp;
-      k = calc_nsamples(p, comb_delays[i >> 1][i & 1]);
-      combp->nSamples = k;
-      combp->bufPos = 0;
-      combp->filterState = 0.0;
-      for (j = 0; j < k; j++)
-        combp->buf[j] = FL(0.0);
-      nbytes += comb_nbytes(p, comb_delays[i >> 1][i & 1]);
-    }
-    for (i = 0; i < (NR_ALLPASS << 1); i++) {
-      allpassp = (freeVerbAllPass*) ((unsigned char*) p->auxData.auxp
-                                     + (int) nbytes);
-      p->AllPass[i >> 1][i & 1] = allpassp;
-      k = calc_nsamples(p, allpass_delays[i >> 1][i & 1]);
-      allpassp->nSamples = k;
-      allpassp->bufPos = 0;
-      for (j = 0; j < k; j++)
-        allpassp->buf[j] = FL(0.0);
-      nbytes += allpass_nbytes(p, allpass_delays[i >> 1][i & 1]);
-    }
-    p->tmpBuf = (MYFLT*) ((unsigned char*)p->auxData.auxp + (int)nbytes);
+    init_filters(&(p->filters), (MYFLT*) p->auxData.auxp, *(p->iSampleRate));
     p->prvDampFactor = -FL(1.0);
-    if (*(p->iSampleRate) >= MIN_SRATE)
-      p->srFact = pow((DEFAULT_SRATE / *(p->iSampleRate)), 0.8);
-    else
-      p->srFact = 1.0;
+    p->srFact = freeverb_sr_fact(*(p->iSampleRate));
     return OK;
 }
 
+/* damping of the comb filters for the damping factor */
+
+static double freeverb_damp(MYFLT kDampFactor, MYFLT iSampleRate,
+                            double srFact)
+{
+    double damp = (double) kDampFactor * scaleDamp;
+    /* hack to correct high frequency attenuation for sample rate */
+    if (iSampleRate >= MIN_SRATE)
+      damp = pow(damp, srFact);
+    return damp;
+}
+
+/* Run the filters of one reverb over nsmps samples. Per sample, the eight  */
+/* comb filters of both channels are stepped as sixteen lanes, followed by  */
+/* the allpass chains of both channels as two lanes.                        */
+
+static void freeverb_run(freeVerbFilters *fp, const MYFLT *inL,
+                         const MYFLT *inR, MYFLT *outL, MYFLT *outR,
+                         uint32_t nsmps, double feedback, double damp1)
+{
+    double    damp2 = 1.0 - damp1;
+    double    y[NR_COMB * 2];
+    uint32_t  n;
+    int       i;
+
+    for (n = 0; n < nsmps; n++) {
+      MYFLT   in[2], sum[2];
+
+      in[0] = inL[n];
+      in[1] = inR[n];
+      /* comb filters */
+      for (i = 0; i < (NR_COMB << 1); i++)
+        y[i] = (double) fp->combBuf[i][fp->combPos[i]];
+      for (i = 0; i < (NR_COMB << 1); i++)
+        fp->combState[i] = (fp->combState[i] * damp1) + (y[i] * damp2);
+      for (i = 0; i < (NR_COMB << 1); i++) {
+        fp->combBuf[i][fp->combPos[i]] =
+          (MYFLT) (fp->combState[i] * feedback + (double) in[i & 1]);
+        if (UNLIKELY(++(fp->combPos[i]) >= fp->combSize[i]))
+          fp->combPos[i] = 0;
+      }
+      sum[0] = sum[1] = FL(0.0);
+      for (i = 0; i < (NR_COMB << 1); i++)
+        sum[i & 1] += (MYFLT) y[i];
+      /* allpass filters */
+      for (i = 0; i < (NR_ALLPASS << 1); i++) {
+        MYFLT   *bp = &(fp->allPassBuf[i][fp->allPassPos[i]]);
+        double  x = (double) *bp - (double) sum[i & 1];
+        *bp *= (MYFLT) allPassFeedBack;
+        *bp += sum[i & 1];
+        if (UNLIKELY(++(fp->allPassPos[i]) >= fp->allPassSize[i]))
+          fp->allPassPos[i] = 0;
+        sum[i & 1] = (MYFLT) x;
+      }
+      outL[n] = sum[0] * (MYFLT) fixedGain;
+      outR[n] = sum[1] * (MYFLT) fixedGain;
+    }
+}
+
 static int freeverb_perf(CSOUND *csound, FREEVERB *p)
 {
-    double          feedback, damp1, damp2, x;
-    freeVerbComb    *combp;
-    freeVerbAllPass *allpassp;
-    int             i;
+    double          feedback;
     uint32_t offset = p->h.insdshead->ksmps_offset;
     uint32_t early  = p->h.insdshead->ksmps_no_end;
-    uint32_t n, nsmps = CS_KSMPS;
+    uint32_t nsmps = CS_KSMPS;
 
     /* check if opcode was correctly initialised */
     if (UNLIKELY(p->auxData.size <= 0L || p->auxData.auxp == NULL)) goto err1;
@@ -183,87 +258,96 @@ static int freeverb_perf(CSOUND *csound, FREEVERB *p)
     feedback = (double) *(p->kRoomSize) * scaleRoom + offsetRoom;
     if (*(p->kDampFactor) != p->prvDampFactor) {
       p->prvDampFactor = *(p->kDampFactor);
-      damp1 = (double) *(p->kDampFactor) * scaleDamp;
-      /* hack to correct high frequency attenuation for sample rate */
-      if (*(p->iSampleRate) >= MIN_SRATE)
-        damp1 = pow(damp1, p->srFact);
-      p->dampValue = damp1;
-    }
-    else
-      damp1 = p->dampValue;
-    damp2 = 1.0 - damp1;
-    /* comb filters (left channel) */
-    memset(p->tmpBuf,0, sizeof(MYFLT)*nsmps);
-    for (i = 0; i < NR_COMB; i++) {
-      combp = p->Comb[i][0];
-      for (n = 0; n < nsmps; n++) {
-        p->tmpBuf[n] += combp->buf[combp->bufPos];
-        x = (double) combp->buf[combp->bufPos];
-        combp->filterState = (combp->filterState * damp1) + (x * damp2);
-        x = combp->filterState * feedback + (double) p->aInL[n];
-        combp->buf[combp->bufPos] = (MYFLT) x;
-        if (UNLIKELY(++(combp->bufPos) >= combp->nSamples))
-          combp->bufPos = 0;
-      }
+      p->dampValue = freeverb_damp(*(p->kDampFactor), *(p->iSampleRate),
+                                   p->srFact);
     }
-    /* allpass filters (left channel) */
-    for (i = 0; i < NR_ALLPASS; i++) {
-      allpassp = p->AllPass[i][0];
-      for (n = 0; n < nsmps; n++) {
-        x = (double) allpassp->buf[allpassp->bufPos] - (double) p->tmpBuf[n];
-        allpassp->buf[allpassp->bufPos] *= (MYFLT) allPassFeedBack;
-        allpassp->buf[allpassp->bufPos] += p->tmpBuf[n];
-        if (UNLIKELY(++(allpassp->bufPos) >= allpassp->nSamples))
-          allpassp->bufPos = 0;
-        p->tmpBuf[n] = (MYFLT) x;
-      }
+    /* the filters run over the whole period */
+    freeverb_run(&(p->filters), p->aInL, p->aInR, p->aOutL, p->aOutR,
+                 nsmps, feedback, p->dampValue);
+    if (UNLIKELY(offset)) {
+      memset(p->aOutL, '\0', offset*sizeof(MYFLT));
+      memset(p->aOutR, '\0', offset*sizeof(MYFLT));
     }
-
-    /* write left channel output */
-    if (UNLIKELY(offset)) memset(p->aOutL, '\0', offset*sizeof(MYFLT));
     if (UNLIKELY(early)) {
       nsmps -= early;
       memset(&p->aOutL[nsmps], '\0', early*sizeof(MYFLT));
+      memset(&p->aOutR[nsmps], '\0', early*sizeof(MYFLT));
     }
-    for (n = offset; n < nsmps; n++)
-      p->aOutL[n] = p->tmpBuf[n] * (MYFLT) fixedGain;
-    /* comb filters (right channel) */
-    memset(p->tmpBuf, 0, sizeof(MYFLT)*nsmps);
-    /* for (n = 0; n < nsmps; n++) */
-    /*   p->tmpBuf[n] = FL(0.0); */
-    for (i = 0; i < NR_COMB; i++) {
-      combp = p->Comb[i][1];
-      for (n = 0; n < nsmps; n++) {
-        p->tmpBuf[n] += combp->buf[combp->bufPos];
-        x = (double) combp->buf[combp->bufPos];
-        combp->filterState = (combp->filterState * damp1) + (x * damp2);
-        x = combp->filterState * feedback + (double) p->aInR[n];
-        combp->buf[combp->bufPos] = (MYFLT) x;
-        if (UNLIKELY(++(combp->bufPos) >= combp->nSamples))
-          combp->bufPos = 0;
-      }
+
+    return OK;
+ err1:
+    return csound->PerfError(csound, p->h.insdshead,
+                             Str("freeverb: not initialised"));
+}
+
+static int freeverb_init_a(CSOUND *csound, FREEVERB_A *p)
+{
+    size_t  nbytes;
+    int     nSamples, i;
+
+    if (UNLIKELY(p->aInL->data == NULL || p->aInR->data == NULL ||
+                 p->aOutL->data == NULL || p->aOutR->data == NULL))
+      return csound->InitError(csound, Str("freeverb: array not initialised"));
+    p->nBusses = p->aInL->sizes[0];
+    if (UNLIKELY(p->aInR->sizes[0] != p->nBusses ||
+                 p->aOutL->sizes[0] < p->nBusses ||
+                 p->aOutR->sizes[0] < p->nBusses))
+      return csound->InitError(csound,
+                               Str("freeverb: array sizes do not match"));
+    nSamples = filters_nsamples(*(p->iSampleRate));
+    nbytes = sizeof(MYFLT) * (size_t) nSamples * (size_t) p->nBusses;
+    /* allocate space if size has changed */
+    if (nbytes != p->auxData.size ||
+        sizeof(freeVerbFilters) * (size_t) p->nBusses != p->filters.size) {
+      csound->AuxAlloc(csound, nbytes, &(p->auxData));
+      csound->AuxAlloc(csound, sizeof(freeVerbFilters) * (size_t) p->nBusses,
+                       &(p->filters));
     }
-    /* allpass filters (right channel) */
-    for (i = 0; i < NR_ALLPASS; i++) {
-      allpassp = p->AllPass[i][1];
-      for (n = 0; n < nsmps; n++) {
-        x = (double) allpassp->buf[allpassp->bufPos] - (double) p->tmpBuf[n];
-        allpassp->buf[allpassp->bufPos] *= (MYFLT) allPassFeedBack;
-        allpassp->buf[allpassp->bufPos] += p->tmpBuf[n];
-        if (UNLIKELY(++(allpassp->bufPos) >= allpassp->nSamples))
-          allpassp->bufPos = 0;
-        p->tmpBuf[n] = (MYFLT) x;
-      }
+    else if (*(p->iSkipInit) != FL(0.0))    /* skip initialisation */
+      return OK;                            /*   if requested      */
+    for (i = 0; i < p->nBusses; i++)
+      init_filters((freeVerbFilters*) p->filters.auxp + i,
+                   (MYFLT*) p->auxData.auxp + (size_t) i * nSamples,
+                   *(p->iSampleRate));
+    p->prvDampFactor = -FL(1.0);
+    p->srFact = freeverb_sr_fact(*(p->iSampleRate));
+    return OK;
+}
+
+static int freeverb_perf_a(CSOUND *csound, FREEVERB_A *p)
+{
+    double          feedback;
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t ksmps = CS_KSMPS, nsmps = ksmps - early;
+    int      i;
+
+    /* check if opcode was correctly initialised */
+    if (UNLIKELY(p->auxData.size <= 0L || p->auxData.auxp == NULL)) goto err1;
+    /* calculate reverb parameters */
+    feedback = (double) *(p->kRoomSize) * scaleRoom + offsetRoom;
+    if (*(p->kDampFactor) != p->prvDampFactor) {
+      p->prvDampFactor = *(p->kDampFactor);
+      p->dampValue = freeverb_damp(*(p->kDampFactor), *(p->iSampleRate),
+                                   p->srFact);
     }
-    nsmps = CS_KSMPS;
-    /* write right channel output */
-    if (UNLIKELY(offset)) memset(p->aOutR, '\0', offset*sizeof(MYFLT));
-    if (UNLIKELY(early)) {
-      nsmps -= early;
-      memset(&p->aOutR[nsmps], '\0', early*sizeof(MYFLT));
+    for (i = 0; i < p->nBusses; i++) {
+      MYFLT *aOutL = p->aOutL->data + (size_t) i * ksmps;
+      MYFLT *aOutR = p->aOutR->data + (size_t) i * ksmps;
+
+      freeverb_run((freeVerbFilters*) p->filters.auxp + i,
+                   p->aInL->data + (size_t) i * ksmps,
+                   p->aInR->data + (size_t) i * ksmps, aOutL, aOutR,
+                   ksmps, feedback, p->dampValue);
+      if (UNLIKELY(offset)) {
+        memset(aOutL, '\0', offset*sizeof(MYFLT));
+        memset(aOutR, '\0', offset*sizeof(MYFLT));
+      }
+      if (UNLIKELY(early)) {
+        memset(&aOutL[nsmps], '\0', early*sizeof(MYFLT));
+        memset(&aOutR[nsmps], '\0', early*sizeof(MYFLT));
+      }
     }
-    for (n = offset; n < nsmps; n++)
-      p->aOutR[n] = p->tmpBuf[n] * (MYFLT) fixedGain;
 
     return OK;
  err1:
@@ -273,12 +357,17 @@ static int freeverb_perf(CSOUND *csound, FREEVERB *p)
 
 /* module interface functions */
 
+#define S(x)    sizeof(x)
+
+static OENTRY localops[] = {
+  { "freeverb", S(FREEVERB), 0, 5, "aa", "aakkjo",
+    (SUBR) freeverb_init, (SUBR) NULL, (SUBR) freeverb_perf },
+  { "freeverb.A", S(FREEVERB_A), 0, 5, "a[]a[]", "a[]a[]kkjo",
+    (SUBR) freeverb_init_a, (SUBR) NULL, (SUBR) freeverb_perf_a }
+};
+
 int freeverb_init_(CSOUND *csound)
 {
-    return csound->AppendOpcode(csound, "freeverb",
-                                (int) sizeof(FREEVERB), 0, 5, "aa", "aakkjo",
-                                (int (*)(CSOUND*, void*)) freeverb_init,
-                                (int (*)(CSOUND*, void*)) NULL,
-                                (int (*)(CSOUND*, void*)) freeverb_perf);
+    return csound->AppendOpcodes(csound, &(localops[0]),
+                                 (int) (sizeof(localops) / sizeof(OENTRY)));
 }
-
@@ -2653,6 +2653,503 @@ static int hrtfmove2_process(CSOUND *csound, hrtfmove2 *p)
     return OK;
 }
 
+/* Csound hrtf multi source renderer: magnitude interpolation, woodworth
+   phase, all sources mixed in the frequency domain */
+
+/* aleft, aright hrtfmulti asrc[], kang[], kel[], ifilel, ifiler
+   [, ifade = 4, iradius = 8.8, isr = 44100] */
+/* ifade is the number of blocks over which the filter of a moving source
+   is interpolated, iradius is head radius, sr can also be 48000 and 96000 */
+
+/* Every source is convolved with its own (interpolated) hrtf, but the
+   products are accumulated in one spectrum per ear, so only two inverse
+   ffts are needed per block, however many sources there are. The hrtf
+   data are shared by all instances using the same files and sr. */
+
+#define HRTFSET_VAR "hrtfmulti::sets"
+
+/* hrtf data set shared by hrtfmulti instances */
+typedef struct hrtfset_ {
+    struct hrtfset_ *nxt;
+    char        filel[MAXNAME], filer[MAXNAME];
+    MYFLT       sr;
+    int         irlength;
+    /* offset of the first measurement of each elevation in the files */
+    int         elevoffset[14];
+    /* magnitude data of the left and right file */
+    float       *data[2];
+} HRTFSET;
+
+/* state of one source */
+typedef struct {
+    MYFLT       angle, elev;    /* position the filter was computed for */
+    int         fade;           /* blocks left in filter interpolation */
+} HRTFSRC;
+
+typedef struct
+{
+        OPDS  h;
+        /* outputs and inputs */
+        MYFLT *outsigl, *outsigr;
+        ARRAYDAT *in, *kangle, *kelev;
+        STRINGDAT *ifilel, *ifiler;
+        MYFLT *ofade, *oradius, *osr;
+
+        HRTFSET *set;
+        int nsrc, fade;
+        int irlength, irlengthpad, overlapsize;
+        MYFLT sr, sroverN, radius, scale;
+        const float *nonlin;
+
+        int counter;
+
+        /* per source state, input blocks, and filter spectra (left and
+           right, current and step per block) */
+        AUXCH src, insig, filt, step;
+        /* output, overlap and spectral accumulators */
+        AUXCH outl, outr, overlapl, overlapr, accl, accr;
+        /* scratch buffers for input fft and filter calculation */
+        AUXCH complexinsig, hrtfl, hrtfr;
+}
+hrtfmulti;
+
+/* find (or load) the data set for the given files and sr */
+static HRTFSET *hrtfset_get(CSOUND *csound, const char *filel,
+                            const char *filer, MYFLT sr, int irlength)
+{
+    HRTFSET **sets, *set;
+    MEMFIL *fpl, *fpr;
+    int i, npoints;
+
+    sets = (HRTFSET**) csound->QueryGlobalVariable(csound, HRTFSET_VAR);
+    if (sets == NULL) {
+      if (UNLIKELY(csound->CreateGlobalVariable(csound, HRTFSET_VAR,
+                                                sizeof(HRTFSET*)) != 0))
+        return NULL;
+      sets = (HRTFSET**) csound->QueryGlobalVariable(csound, HRTFSET_VAR);
+    }
+    for (set = *sets; set != NULL; set = set->nxt)
+      if (set->sr == sr && !strcmp(set->filel, filel) &&
+          !strcmp(set->filer, filer))
+        return set;
+
+    /* reading files, with byte swap */
+    fpl = csound->ldmemfile2withCB(csound, filel, CSFTYPE_FLOATS_BINARY,
+                                   swap4bytes);
+    if (UNLIKELY(fpl == NULL)) {
+      csound->InitError(csound, Str("Cannot load left data file %s"), filel);
+      return NULL;
+    }
+    fpr = csound->ldmemfile2withCB(csound, filer, CSFTYPE_FLOATS_BINARY,
+                                   swap4bytes);
+    if (UNLIKELY(fpr == NULL)) {
+      csound->InitError(csound, Str("Cannot load right data file %s"), filer);
+      return NULL;
+    }
+
+    set = (HRTFSET*) csound->Calloc(csound, sizeof(HRTFSET));
+    strncpy(set->filel, filel, MAXNAME-1);
+    strncpy(set->filer, filer, MAXNAME-1);
+    set->sr = sr;
+    set->irlength = irlength;
+    /* only half of each elevation (plus the centre) is stored, the other
+       side is read from the opposite ear */
+    npoints = 0;
+    for (i = 0; i < 14; i++) {
+      set->elevoffset[i] = npoints * irlength;
+      npoints += elevationarray[i] / 2 + 1;
+    }
+    if (UNLIKELY(fpl->length < (long) (npoints * irlength * sizeof(float)) ||
+                 fpr->length < (long) (npoints * irlength * sizeof(float)))) {
+      csound->InitError(csound, Str("hrtf data files are too short for "
+                                    "sr of %.0f"), sr);
+      csound->Free(csound, set);
+      return NULL;
+    }
+    set->data[0] = (float*) fpl->beginp;
+    set->data[1] = (float*) fpr->beginp;
+    set->nxt = *sets;
+    *sets = set;
+    return set;
+}
+
+/* measurement at the given indices, as left and right magnitude data */
+static inline void hrtfset_point(const HRTFSET *set, int elevindex,
+                                 int angleindex, const float **l,
+                                 const float **r)
+{
+    int n = elevationarray[elevindex];
+
+    if (angleindex > n / 2) {
+      /* switch l and r */
+      int skip = set->elevoffset[elevindex] + (n - angleindex) * set->irlength;
+      *l = set->data[1] + skip;
+      *r = set->data[0] + skip;
+    }
+    else {
+      int skip = set->elevoffset[elevindex] + angleindex * set->irlength;
+      *l = set->data[0] + skip;
+      *r = set->data[1] + skip;
+    }
+}
+
+/* calculate the padded filter spectra for a source position, as in
+   hrtfstat */
+static void hrtfmulti_filter(CSOUND *csound, hrtfmulti *p, MYFLT angle,
+                             MYFLT elev, MYFLT *hrtflpad, MYFLT *hrtfrpad)
+{
+    const float *lowl1, *lowr1, *lowl2, *lowr2;
+    const float *highl1, *highr1, *highl2, *highr2;
+    MYFLT *hrtfl = (MYFLT *)p->hrtfl.auxp;
+    MYFLT *hrtfr = (MYFLT *)p->hrtfr.auxp;
+    int irlength = p->irlength, irlengthpad = p->irlengthpad;
+    int i, shift;
+    MYFLT elevindexstore, angleindexlowstore, angleindexhighstore;
+    MYFLT elevindexhighper, angleindex2per, angleindex4per;
+    int elevindexlow, elevindexhigh, angleindex1, angleindex2,
+      angleindex3, angleindex4;
+    MYFLT magl, magr, magllow, magrlow, maglhigh, magrhigh, phasel, phaser;
+    MYFLT radianangle, radianelev, itdww, itd, freq;
+
+    if(elev > FL(90.0))
+      elev = FL(90.0);
+    if(elev < FL(-40.0))
+      elev = FL(-40.0);
+
+    while(angle < FL(0.0))
+      angle += FL(360.0);
+    while(angle >= FL(360.0))
+      angle -= FL(360.0);
+
+    /* two nearest elev indices */
+    elevindexstore = (elev - minelev) / elevincrement;
+    elevindexlow = (int)elevindexstore;
+    elevindexhigh = elevindexlow < 13 ? elevindexlow + 1 : elevindexlow;
+    elevindexhighper = elevindexstore - elevindexlow;
+
+    /* 4 closest indices, 2 low and 2 high */
+    angleindexlowstore = angle / (FL(360.0) / elevationarray[elevindexlow]);
+    angleindexhighstore = angle / (FL(360.0) / elevationarray[elevindexhigh]);
+    angleindex1 = (int)angleindexlowstore;
+    angleindex2 = (angleindex1 + 1) % elevationarray[elevindexlow];
+    angleindex3 = (int)angleindexhighstore;
+    angleindex4 = (angleindex3 + 1) % elevationarray[elevindexhigh];
+    angleindex2per = angleindexlowstore - angleindex1;
+    angleindex4per = angleindexhighstore - angleindex3;
+
+    hrtfset_point(p->set, elevindexlow, angleindex1, &lowl1, &lowr1);
+    hrtfset_point(p->set, elevindexlow, angleindex2, &lowl2, &lowr2);
+    hrtfset_point(p->set, elevindexhigh, angleindex3, &highl1, &highr1);
+    hrtfset_point(p->set, elevindexhigh, angleindex4, &highl2, &highr2);
+
+    /* woodworth itd */
+    if(angle > FL(180.0))
+      radianangle = (angle - FL(180.0)) * PI_F / FL(180.0);
+    else
+      radianangle = angle * PI_F / FL(180.0);
+    radianelev = elev * PI_F / FL(180.0);
+    if(radianangle > PI_F / FL(2.0))
+      radianangle = FL(PI) - radianangle;
+    itdww = (radianangle + SIN(radianangle)) * p->radius * COS(radianelev) / c;
+
+    /* 0 Hz and Nyq are real values */
+    for (i = 0; i < 2; i++) {
+      magllow = FABS(lowl1[i]) + (FABS(lowl2[i]) - FABS(lowl1[i])) *
+        angleindex2per;
+      maglhigh = FABS(highl1[i]) + (FABS(highl2[i]) - FABS(highl1[i])) *
+        angleindex4per;
+      hrtfl[i] = magllow + (maglhigh - magllow) * elevindexhighper;
+      magrlow = FABS(lowr1[i]) + (FABS(lowr2[i]) - FABS(lowr1[i])) *
+        angleindex2per;
+      magrhigh = FABS(highr1[i]) + (FABS(highr2[i]) - FABS(highr1[i])) *
+        angleindex4per;
+      hrtfr[i] = magrlow + (magrhigh - magrlow) * elevindexhighper;
+    }
+
+    /* magnitude interpolation, functional phase */
+    for(i = 2; i < irlength; i+=2)
+      {
+        magllow = lowl1[i] + (lowl2[i] - lowl1[i]) * angleindex2per;
+        maglhigh = highl1[i]+(highl2[i] - highl1[i]) * angleindex4per;
+        magrlow = lowr1[i] + (lowr2[i] - lowr1[i]) * angleindex2per;
+        magrhigh = highr1[i] + (highr2[i] - highr1[i]) * angleindex4per;
+        magl = magllow + (maglhigh - magllow) * elevindexhighper;
+        magr = magrlow + (magrhigh - magrlow) * elevindexhighper;
+
+        freq = (i / 2) * p->sroverN;
+        /* non linear itd...last value in array = 1.0 */
+        itd = (i / 2) < 6 ? itdww * p->nonlin[(i / 2) - 1] : itdww;
+
+        if(angle > FL(180.))
+          {
+            phasel = TWOPI_F * freq * (itd / 2);
+            phaser = TWOPI_F * freq * -(itd / 2);
+          }
+        else
+          {
+            phasel = TWOPI_F * freq * -(itd / 2);
+            phaser = TWOPI_F * freq * (itd / 2);
+          }
+
+        hrtfl[i] = magl * COS(phasel);
+        hrtfl[i+1] = magl * SIN(phasel);
+        hrtfr[i] = magr * COS(phaser);
+        hrtfr[i+1] = magr * SIN(phaser);
+      }
+
+    csound->InverseRealFFT(csound, hrtfl, irlength);
+    csound->InverseRealFFT(csound, hrtfr, irlength);
+
+    /* shift for causality, zero pad and back to freq domain */
+    shift = irlength / 2;
+    for(i = 0; i < irlength; i++)
+      {
+        hrtflpad[i] = hrtfl[shift];
+        hrtfrpad[i] = hrtfr[shift];
+        shift = (shift + 1) % irlength;
+      }
+    memset(hrtflpad + irlength, 0, (irlengthpad - irlength) * sizeof(MYFLT));
+    memset(hrtfrpad + irlength, 0, (irlengthpad - irlength) * sizeof(MYFLT));
+    csound->RealFFT(csound, hrtflpad, irlengthpad);
+    csound->RealFFT(csound, hrtfrpad, irlengthpad);
+}
+
+/* complex multiply accumulate of packed real fft spectra */
+static inline void hrtfmulti_mac(MYFLT *acc, const MYFLT *a, const MYFLT *b,
+                                 int n)
+{
+    int i;
+
+    acc[0] += a[0] * b[0];
+    acc[1] += a[1] * b[1];
+    for (i = 2; i < n; i += 2) {
+      acc[i] += (a[i] * b[i]) - (a[i + 1] * b[i + 1]);
+      acc[i + 1] += (a[i] * b[i + 1]) + (b[i] * a[i + 1]);
+    }
+}
+
+static int hrtfmulti_init(CSOUND *csound, hrtfmulti *p)
+{
+    char filel[MAXNAME], filer[MAXNAME];
+    int fade = (int)*p->ofade;
+    MYFLT r = *p->oradius;
+    MYFLT sr = *p->osr;
+    int nsrc, irlength, irlengthpad, overlapsize;
+    size_t pad;
+
+    if (UNLIKELY(p->in->data == NULL || p->in->dimensions != 1 ||
+                 p->kangle->data == NULL || p->kelev->data == NULL))
+      return csound->InitError(csound,
+                               Str("hrtfmulti: arrays not initialised"));
+    nsrc = p->in->sizes[0];
+    if (UNLIKELY(nsrc < 1 || p->kangle->sizes[0] < nsrc ||
+                 p->kelev->sizes[0] < nsrc))
+      return csound->InitError(csound,
+                               Str("hrtfmulti: position arrays smaller than "
+                                   "source array"));
+    p->nsrc = nsrc;
+
+    /* fade length: default 4, max 24, min 1 */
+    if(fade < 1 || fade > 24)
+      fade = 4;
+    p->fade = fade;
+
+    if(r <= 0 || r > 15)
+      r = FL(8.8);
+    p->radius = r;
+
+    /* sr, default 44100 */
+    if(sr != FL(44100.0) && sr != FL(48000.0) && sr != FL(96000.0))
+      sr = FL(44100.0);
+    p->sr = sr;
+
+    if (UNLIKELY(CS_ESR != sr))
+      csound->Message(csound,
+                      Str("\n\nWARNING!!:\nOrchestra SR not compatible with "
+                          "HRTF processing SR of: %.0f\n\n"), sr);
+
+    /* setup as per sr */
+    if(sr == 96000)
+      {
+        irlength = 256;
+        irlengthpad = 512;
+        p->nonlin = nonlinitd96k;
+      }
+    else
+      {
+        irlength = 128;
+        irlengthpad = 256;
+        p->nonlin = (sr == 48000 ? nonlinitd48k : nonlinitd);
+      }
+    overlapsize = (irlength - 1);
+    p->irlength = irlength;
+    p->irlengthpad = irlengthpad;
+    p->overlapsize = overlapsize;
+    p->sroverN = sr/irlength;
+    /* scaled by a factor related to sr, as in hrtfstat */
+    p->scale = FL(38000.0) / sr;
+
+    strncpy(filel, (char*) p->ifilel->data, MAXNAME-1); filel[MAXNAME-1]='\0';
+    strncpy(filer, (char*) p->ifiler->data, MAXNAME-1); filer[MAXNAME-1]='\0';
+    if (UNLIKELY((p->set = hrtfset_get(csound, filel, filer,
+                                       sr, irlength)) == NULL))
+      return NOTOK;
+
+    pad = irlengthpad * sizeof(MYFLT);
+    csound->AuxAlloc(csound, nsrc * sizeof(HRTFSRC), &p->src);
+    csound->AuxAlloc(csound, nsrc * irlength * sizeof(MYFLT), &p->insig);
+    csound->AuxAlloc(csound, nsrc * 2 * pad, &p->filt);
+    csound->AuxAlloc(csound, nsrc * 2 * pad, &p->step);
+    csound->AuxAlloc(csound, pad, &p->outl);
+    csound->AuxAlloc(csound, pad, &p->outr);
+    csound->AuxAlloc(csound, overlapsize * sizeof(MYFLT), &p->overlapl);
+    csound->AuxAlloc(csound, overlapsize * sizeof(MYFLT), &p->overlapr);
+    csound->AuxAlloc(csound, pad, &p->accl);
+    csound->AuxAlloc(csound, pad, &p->accr);
+    csound->AuxAlloc(csound, pad, &p->complexinsig);
+    csound->AuxAlloc(csound, irlength * sizeof(MYFLT), &p->hrtfl);
+    csound->AuxAlloc(csound, irlength * sizeof(MYFLT), &p->hrtfr);
+    {
+      HRTFSRC *src = (HRTFSRC *)p->src.auxp;
+      int i;
+      /* illegal positions to ensure first calculation */
+      for (i = 0; i < nsrc; i++) {
+        src[i].angle = FL(-1.0);
+        src[i].elev = FL(-41.0);
+        src[i].fade = -1;
+      }
+    }
+
+    p->counter = 0;
+
+    return OK;
+}
+
+/* process one block of irlength samples for all sources */
+static void hrtfmulti_block(CSOUND *csound, hrtfmulti *p)
+{
+    HRTFSRC *src = (HRTFSRC *)p->src.auxp;
+    MYFLT *insig = (MYFLT *)p->insig.auxp;
+    MYFLT *filt = (MYFLT *)p->filt.auxp;
+    MYFLT *step = (MYFLT *)p->step.auxp;
+    MYFLT *outl = (MYFLT *)p->outl.auxp;
+    MYFLT *outr = (MYFLT *)p->outr.auxp;
+    MYFLT *overlapl = (MYFLT *)p->overlapl.auxp;
+    MYFLT *overlapr = (MYFLT *)p->overlapr.auxp;
+    MYFLT *accl = (MYFLT *)p->accl.auxp;
+    MYFLT *accr = (MYFLT *)p->accr.auxp;
+    MYFLT *complexinsig = (MYFLT *)p->complexinsig.auxp;
+    MYFLT *angles = p->kangle->data, *elevs = p->kelev->data;
+    int irlength = p->irlength, irlengthpad = p->irlengthpad;
+    int overlapsize = p->overlapsize;
+    MYFLT scale = p->scale;
+    int s, i;
+
+    /* look after overlap add stuff */
+    memcpy(overlapl, outl + irlength, overlapsize * sizeof(MYFLT));
+    memcpy(overlapr, outr + irlength, overlapsize * sizeof(MYFLT));
+    memset(accl, 0, irlengthpad * sizeof(MYFLT));
+    memset(accr, 0, irlengthpad * sizeof(MYFLT));
+
+    for (s = 0; s < p->nsrc; s++) {
+      MYFLT *filtl = filt + 2 * s * irlengthpad, *filtr = filtl + irlengthpad;
+      MYFLT *stepl = step + 2 * s * irlengthpad, *stepr = stepl + irlengthpad;
+
+      /* new filter if the source has moved: the first one is used as is,
+         later ones are reached by interpolating over fade blocks */
+      if (angles[s] != src[s].angle || elevs[s] != src[s].elev) {
+        src[s].angle = angles[s];
+        src[s].elev = elevs[s];
+        if (src[s].fade < 0) {
+          hrtfmulti_filter(csound, p, angles[s], elevs[s], filtl, filtr);
+          src[s].fade = 0;
+        }
+        else {
+          MYFLT rfade = FL(1.0) / p->fade;
+          hrtfmulti_filter(csound, p, angles[s], elevs[s], stepl, stepr);
+          for (i = 0; i < 2 * irlengthpad; i++)
+            stepl[i] = (stepl[i] - filtl[i]) * rfade;
+          src[s].fade = p->fade;
+        }
+      }
+      if (src[s].fade > 0) {
+        for (i = 0; i < 2 * irlengthpad; i++)
+          filtl[i] += stepl[i];
+        src[s].fade--;
+      }
+
+      /* source block, zero padded, to freq domain */
+      memcpy(complexinsig, insig + s * irlength, irlength * sizeof(MYFLT));
+      memset(complexinsig + irlength, 0,
+             (irlengthpad - irlength) * sizeof(MYFLT));
+      csound->RealFFT(csound, complexinsig, irlengthpad);
+
+      /* accumulate convolution of all sources */
+      hrtfmulti_mac(accl, filtl, complexinsig, irlengthpad);
+      hrtfmulti_mac(accr, filtr, complexinsig, irlengthpad);
+    }
+
+    /* one inverse fft per ear */
+    csound->InverseRealFFT(csound, accl, irlengthpad);
+    csound->InverseRealFFT(csound, accr, irlengthpad);
+
+    for(i = 0; i < irlengthpad; i++)
+      {
+        outl[i] = accl[i] * scale;
+        outr[i] = accr[i] * scale;
+      }
+    for(i = 0; i < overlapsize; i++)
+      {
+        outl[i] += overlapl[i];
+        outr[i] += overlapr[i];
+      }
+}
+
+static int hrtfmulti_process(CSOUND *csound, hrtfmulti *p)
+{
+    MYFLT *in = p->in->data;
+    MYFLT *outsigl  = p->outsigl;
+    MYFLT *outsigr = p->outsigr;
+    MYFLT *insig = (MYFLT *)p->insig.auxp;
+    MYFLT *outl = (MYFLT *)p->outl.auxp;
+    MYFLT *outr = (MYFLT *)p->outr.auxp;
+    int counter = p->counter;
+    int irlength = p->irlength;
+    int s, nsrc = p->nsrc;
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t j, nsmps = CS_KSMPS;
+
+    if (UNLIKELY(offset)) {
+      memset(outsigl, '\0', offset*sizeof(MYFLT));
+      memset(outsigr, '\0', offset*sizeof(MYFLT));
+    }
+    if (UNLIKELY(early)) {
+      nsmps -= early;
+      memset(&outsigl[nsmps], '\0', early*sizeof(MYFLT));
+      memset(&outsigr[nsmps], '\0', early*sizeof(MYFLT));
+    }
+    for(j = offset; j < nsmps; j++)
+      {
+        /* ins and outs */
+        for (s = 0; s < nsrc; s++)
+          insig[s * irlength + counter] = in[s * CS_KSMPS + j];
+
+        outsigl[j] = outl[counter];
+        outsigr[j] = outr[counter];
+
+        if(++counter == irlength)
+          {
+            hrtfmulti_block(csound, p);
+            counter = 0;
+          }
+      }
+
+    p->counter = counter;
+
+    return OK;
+}
+
 /* see csound manual (extending csound) for details of below */
 static OENTRY hrtfopcodes_localops[] =
 {
@@ -2661,7 +3158,9 @@ static OENTRY hrtfopcodes_localops[] =
   { "hrtfstat", sizeof(hrtfstat),0, 5, "aa", "aiiSSoo",
     (SUBR)hrtfstat_init, NULL, (SUBR)hrtfstat_process },
   { "hrtfmove2",  sizeof(hrtfmove2),0, 5, "aa", "akkSSooo",
-    (SUBR)hrtfmove2_init, NULL, (SUBR)hrtfmove2_process }
+    (SUBR)hrtfmove2_init, NULL, (SUBR)hrtfmove2_process },
+  { "hrtfmulti",  sizeof(hrtfmulti),0, 5, "aa", "a[]k[]k[]SSooo",
+    (SUBR)hrtfmulti_init, NULL, (SUBR)hrtfmulti_process }
 };
 
 LINKAGE_BUILTIN(hrtfopcodes_localops)
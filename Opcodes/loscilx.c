@@ -127,6 +127,8 @@ static int sndload_opcode_init_S(CSOUND *csound, SNDLOAD_OPCODE *p)
 #define LOSCILX_MAXOUTS         (16)
 #define LOSCILX_MAX_INTERP_SIZE (256)
 #define LOSCILX_PHASE_SCALE     (4294967296.0)
+/* read-ahead window (in sample frames) hinted for memory mapped files */
+#define LOSCILX_PREFETCH_FRAMES (65536)
 
 typedef struct LOSCILX_OPCODE_ {
     OPDS    h;
@@ -140,6 +142,8 @@ typedef struct LOSCILX_OPCODE_ {
     int_least64_t   curLoopStart, curLoopEnd;
     MYFLT   prvKcps, frqScale, ampScale, warpFact, winFact;
     void    *dataPtr;
+    SNDMEMFILE  *sf;            /* sound file, if not using an ftable */
+    int32   prefetchPos;        /* start of last prefetched region */
     int32   nFrames;
     int     nChannels;
     int     winSize;
@@ -183,6 +187,7 @@ static int loscilx_opcode_init(CSOUND *csound, LOSCILX_OPCODE *p)
     double  frqScale = 1.0;
 
     p->dataPtr = NULL;
+    p->sf = NULL;
     nChannels = csound->GetOutputArgCnt(p);
     if (UNLIKELY(nChannels < 1 || nChannels > LOSCILX_MAXOUTS))
       return csound->InitError(csound,
@@ -228,6 +233,7 @@ static int loscilx_opcode_init(CSOUND *csound, LOSCILX_OPCODE *p)
         frqScale = sf->sampleRate / ((double) CS_ESR * sf->baseFreq);
       p->ampScale = (MYFLT) sf->scaleFac * csound->e0dbfs;
       p->nFrames = (int32) sf->nFrames;
+      p->sf = sf;               /* prefetching is a no-op if not mapped */
     }
     else {
       FUNC  *ftp;
@@ -324,10 +330,44 @@ static int loscilx_opcode_init(CSOUND *csound, LOSCILX_OPCODE *p)
       }
     }
     p->dataPtr = dataPtr;
+    if (p->sf != NULL) {
+      p->prefetchPos = loscilx_phase_int(p->curPos);
+      if (p->prefetchPos < 0L)
+        p->prefetchPos = 0L;
+      csound->PrefetchSoundFile(csound, p->sf, (size_t) p->prefetchPos,
+                                (size_t) LOSCILX_PREFETCH_FRAMES);
+    }
 
     return OK;
 }
 
+/* ask the OS to page in the part of a mapped sound file that is played */
+/* next, once the playback position has left the last hinted region     */
+
+static void loscilx_prefetch(CSOUND *csound, LOSCILX_OPCODE *p)
+{
+    int32   pos = loscilx_phase_int(p->curPos);
+
+    if (pos >= p->prefetchPos &&
+        pos < p->prefetchPos + (LOSCILX_PREFETCH_FRAMES >> 1))
+      return;
+    if ((p->curPosInc < (int_least64_t) 0) != (p->curLoopDir < 0))
+      pos -= (LOSCILX_PREFETCH_FRAMES >> 1);    /* playing backwards */
+    if (pos < 0L)
+      pos = 0L;
+    p->prefetchPos = pos;
+    csound->PrefetchSoundFile(csound, p->sf, (size_t) pos,
+                              (size_t) LOSCILX_PREFETCH_FRAMES);
+    if (p->curLoopMode) {
+      /* the loop start is needed next if the loop end is near */
+      int32 loopEnd = loscilx_phase_int(p->curLoopEnd);
+      if (loopEnd >= pos && loopEnd < pos + LOSCILX_PREFETCH_FRAMES)
+        csound->PrefetchSoundFile(csound, p->sf,
+                                  (size_t) loscilx_phase_int(p->curLoopStart),
+                                  (size_t) (LOSCILX_PREFETCH_FRAMES >> 1));
+    }
+}
+
 /* ------------- set up fast sine generator ------------- */
 /* Input args:                                            */
 /*   a: amplitude                                         */
@@ -686,6 +726,8 @@ static int loscilx_opcode_perf(CSOUND *csound, LOSCILX_OPCODE *p)
         p->curPos += p->curPosInc;
 
     }
+    if (p->sf != NULL)
+      loscilx_prefetch(csound, p);
 
     return OK;
  err1:
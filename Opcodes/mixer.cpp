@@ -1,5 +1,6 @@
 #include "OpcodeBase.hpp"
-#include <map>
+#include <algorithm>
+#include <cstring>
 #include <vector>
 #include "interlocks.h"
 
@@ -10,45 +11,85 @@
 //#define ENABLE_MIXER_KDEBUG
 
 /**
- * The mixer busses are laid out:
- * busses[csound][bus][channel][frame].
+ * The mixer state of one instance of Csound, created at the first init
+ * of a mixer opcode and stored in the global variable "Mixer::mixer".
+ * Busses and sends are numbered from 0 and stored densely, so that
+ * opcodes resolve their busses and sends to offsets once at init time,
+ * and performance never looks anything up.
  */
-static std::map<CSOUND *, std::map<size_t,
-                                   std::vector< std::vector<MYFLT> > > > busses;
-
-/**
- * The mixer send matrix is laid out:
- * matrix[csound][send][bus].
- */
-static std::map<CSOUND *, std::map<size_t, std::map<size_t, MYFLT> > > matrix;
+struct Mixer
+{
+  size_t channels;
+  size_t frames;
+  size_t bussCount;
+  size_t sendCount;
+  /**
+   * The mixer busses are laid out:
+   * busses[bus][channel][frame].
+   */
+  std::vector<MYFLT> busses;
+  /**
+   * The mixer send matrix is laid out:
+   * gains[send][bus], with bussCount gains per send.
+   */
+  std::vector<MYFLT> gains;
+  Mixer(CSOUND *csound) :
+    channels(csound->GetNchnls(csound)),
+    frames(csound->GetKsmps(csound)),
+    bussCount(0),
+    sendCount(0)
+  {
+  }
+  /**
+   * Grows the busses and the send matrix to hold the send and the bus,
+   * keeping existing gains. Only called at init time.
+   */
+  void create(size_t send, size_t buss)
+  {
+    size_t newSendCount = std::max(sendCount, send + 1);
+    size_t newBussCount = std::max(bussCount, buss + 1);
+    if (newBussCount != bussCount)
+      {
+        busses.resize(newBussCount * channels * frames);
+        std::vector<MYFLT> newGains(newSendCount * newBussCount);
+        for(size_t s = 0; s < sendCount; s++)
+          {
+            std::copy(&gains[s * bussCount], &gains[s * bussCount] + bussCount,
+                      &newGains[s * newBussCount]);
+          }
+        gains.swap(newGains);
+        bussCount = newBussCount;
+        sendCount = newSendCount;
+      }
+    else if (newSendCount != sendCount)
+      {
+        gains.resize(newSendCount * bussCount);
+        sendCount = newSendCount;
+      }
+  }
+  size_t offset(size_t buss, size_t channel) const
+  {
+    return (buss * channels + channel) * frames;
+  }
+  MYFLT &gain(size_t send, size_t buss)
+  {
+    return gains[send * bussCount + buss];
+  }
+};
 
-/**
- * Creates the buss if it does not already exist.
- */
-static void createBuss(CSOUND *csound, size_t buss)
+static Mixer *getMixer(CSOUND *csound)
 {
-#ifdef ENABLE_MIXER_IDEBUG
-  csound->Message(csound, "createBuss: csound %p buss %d...\n", csound, buss);
-#endif
-  if(busses[csound].find(buss) == busses[csound].end())
+  Mixer **mixer = (Mixer **) csound->QueryGlobalVariable(csound, "Mixer::mixer");
+  if (mixer == 0)
     {
-      size_t channels = csound->GetNchnls(csound);
-      size_t frames = csound->GetKsmps(csound);
-      busses[csound][buss].resize(channels);
-      for(size_t channel = 0; channel < channels; channel++)
-        {
-          busses[csound][buss][channel].resize(frames);
-        }
-#ifdef ENABLE_MIXER_IDEBUG
-      csound->Message(csound, "createBuss: created buss.\n");
-#endif
+      csound->CreateGlobalVariable(csound, "Mixer::mixer", sizeof(Mixer *));
+      mixer = (Mixer **) csound->QueryGlobalVariable(csound, "Mixer::mixer");
     }
-  else
+  if (*mixer == 0)
     {
-#ifdef ENABLE_MIXER_IDEBUG
-      csound->Message(csound, "createBuss: buss already exists.\n");
-#endif
+      *mixer = new Mixer(csound);
     }
+  return *mixer;
 }
 
 /**
@@ -64,6 +105,7 @@ struct MixerSetLevel : public OpcodeBase<MixerSetLevel>
   MYFLT *ibuss;
   MYFLT *kgain;
   // State.
+  Mixer *mixer;
   size_t send;
   size_t buss;
   int init(CSOUND *csound)
@@ -71,22 +113,23 @@ struct MixerSetLevel : public OpcodeBase<MixerSetLevel>
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerSetLevel::init...\n");
 #endif
+    mixer = getMixer(csound);
     send = static_cast<size_t>(*isend);
     buss = static_cast<size_t>(*ibuss);
-    createBuss(csound, buss);
-    matrix[csound][send][buss] = *kgain;
+    mixer->create(send, buss);
+    mixer->gain(send, buss) = *kgain;
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerSetLevel::init: csound %p send %d buss %d gain %f\n",
-         csound, send, buss, matrix[csound][send][buss]);
+         csound, send, buss, mixer->gain(send, buss));
 #endif
     return OK;
   }
   int kontrol(CSOUND *csound)
   {
-    matrix[csound][send][buss] = *kgain;
+    mixer->gain(send, buss) = *kgain;
 #ifdef ENABLE_MIXER_KDEBUG
     warn(csound, "MixerSetLevel::kontrol: csound %p send %d buss "
-         "%d gain %f\n", csound, send, buss, matrix[csound][send][buss]);
+         "%d gain %f\n", csound, send, buss, mixer->gain(send, buss));
 #endif
     return OK;
   }
@@ -95,12 +138,12 @@ struct MixerSetLevel : public OpcodeBase<MixerSetLevel>
 extern "C" {
   PUBLIC int csoundModuleDestroy(CSOUND *csound)
   {
-    if (busses.begin() != busses.end()) {
-      busses.clear();
-    }
-    if (matrix.begin() != matrix.end()) {
-      matrix.clear();
-    }
+    Mixer **mixer = (Mixer **) csound->QueryGlobalVariable(csound, "Mixer::mixer");
+    if (mixer != 0)
+      {
+        delete *mixer;
+        csound->DestroyGlobalVariable(csound, "Mixer::mixer");
+      }
     return 0;
   }
 }
@@ -118,6 +161,7 @@ struct MixerGetLevel : public OpcodeBase<MixerGetLevel>
   MYFLT *isend;
   MYFLT *ibuss;
   // State.
+  Mixer *mixer;
   size_t send;
   size_t buss;
   int init(CSOUND *csound)
@@ -125,9 +169,10 @@ struct MixerGetLevel : public OpcodeBase<MixerGetLevel>
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerGetLevel::init...\n");
 #endif
+    mixer = getMixer(csound);
     send = static_cast<size_t>(*isend);
     buss = static_cast<size_t>(*ibuss);
-    createBuss(csound, buss);
+    mixer->create(send, buss);
     return OK;
   }
   int noteoff(CSOUND *)
@@ -139,7 +184,7 @@ struct MixerGetLevel : public OpcodeBase<MixerGetLevel>
 #ifdef ENABLE_MIXER_KDEBUG
     warn(csound, "MixerGetLevel::kontrol...\n");
 #endif
-    *kgain = matrix[csound][send][buss];
+    *kgain = mixer->gain(send, buss);
     return OK;
   }
 };
@@ -158,26 +203,34 @@ struct MixerSend : public OpcodeBase<MixerSend>
   MYFLT *ibuss;
   MYFLT *ichannel;
   // State.
+  Mixer *mixer;
   size_t send;
   size_t buss;
   size_t channel;
   size_t frames;
-  MYFLT *busspointer;
+  size_t offset;
   int init(CSOUND *csound)
   {
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerSend::init...\n");
 #endif
+    mixer = getMixer(csound);
     send = static_cast<size_t>(*isend);
     buss = static_cast<size_t>(*ibuss);
-    createBuss(csound, buss);
     channel = static_cast<size_t>(*ichannel);
-    frames = opds.insdshead->ksmps;
-    busspointer = &busses[csound][buss][channel].front();
+    if (UNLIKELY(channel >= mixer->channels))
+      {
+        return csound->InitError(csound, Str("MixerSend: channel %d out of "
+                                             "range"), (int) channel);
+      }
+    mixer->create(send, buss);
+    frames = std::min(static_cast<size_t>(opds.insdshead->ksmps),
+                      mixer->frames);
+    offset = mixer->offset(buss, channel);
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerSend::init: instance %p send %d buss "
-         "%d channel %d frames %d busspointer %p\n",
-         csound, send, buss, channel, frames, busspointer);
+         "%d channel %d frames %d offset %d\n",
+         csound, send, buss, channel, frames, offset);
 #endif
     return OK;
   }
@@ -190,10 +243,29 @@ struct MixerSend : public OpcodeBase<MixerSend>
 #ifdef ENABLE_MIXER_KDEBUG
     warn(csound, "MixerSend::audio...\n");
 #endif
-    MYFLT gain = matrix[csound][send][buss];
-    for(size_t i = 0; i < frames; i++)
+    MYFLT gain = mixer->gain(send, buss);
+    MYFLT *__restrict busspointer = &mixer->busses[offset];
+    const MYFLT *__restrict input = ainput;
+    // Silent sends are common in large send matrices, and unity sends
+    // need no multiply; the loops have no dependencies between frames,
+    // so that the compiler can vectorise them.
+    if (gain == FL(0.0))
       {
-        busspointer[i] += (ainput[i] * gain);
+        return OK;
+      }
+    if (gain == FL(1.0))
+      {
+        for(size_t i = 0; i < frames; i++)
+          {
+            busspointer[i] += input[i];
+          }
+      }
+    else
+      {
+        for(size_t i = 0; i < frames; i++)
+          {
+            busspointer[i] += (input[i] * gain);
+          }
       }
 #ifdef ENABLE_MIXER_KDEBUG
     warn(csound, "MixerSend::audio: instance %d send %d buss "
@@ -218,24 +290,32 @@ struct MixerReceive : public OpcodeBase<MixerReceive>
   MYFLT *ibuss;
   MYFLT *ichannel;
   // State.
+  Mixer *mixer;
   size_t buss;
   size_t channel;
   size_t frames;
-  MYFLT *busspointer;
+  size_t offset;
   int init(CSOUND *csound)
   {
+    mixer = getMixer(csound);
     buss = static_cast<size_t>(*ibuss);
     channel = static_cast<size_t>(*ichannel);
-    frames = opds.insdshead->ksmps;
-    createBuss(csound, buss);
+    if (UNLIKELY(channel >= mixer->channels))
+      {
+        return csound->InitError(csound, Str("MixerReceive: channel %d out of "
+                                             "range"), (int) channel);
+      }
+    frames = std::min(static_cast<size_t>(opds.insdshead->ksmps),
+                      mixer->frames);
+    mixer->create(0, buss);
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerReceive::init...\n");
 #endif
-    busspointer = &busses[csound][buss][channel].front();
+    offset = mixer->offset(buss, channel);
 #ifdef ENABLE_MIXER_IDEBUG
     warn(csound, "MixerReceive::init csound %p buss %d channel "
-         "%d frames %d busspointer %p\n", csound, buss, channel,
-         frames, busspointer);
+         "%d frames %d offset %d\n", csound, buss, channel,
+         frames, offset);
 #endif
     return OK;
   }
@@ -248,12 +328,9 @@ struct MixerReceive : public OpcodeBase<MixerReceive>
 #ifdef ENABLE_MIXER_KDEBUG
     warn(csound, "MixerReceive::audio...\n");
 #endif
-    for(size_t i = 0; i < frames; i++)
-      {
-        aoutput[i] = busspointer[i];
-      }
+    std::memcpy(aoutput, &mixer->busses[offset], frames * sizeof(MYFLT));
 #ifdef ENABLE_MIXER_KDEBUG
-    warn(csound, "MixerReceive::audio aoutput %p busspointer %p\n",
+    warn(csound, "MixerReceive::audio aoutput %p buss %d\n",
          aoutput, buss);
 #endif
     return OK;
@@ -271,32 +348,27 @@ struct MixerClear : public OpcodeBase<MixerClear>
 {
   // No output.
   // No input.
-  // No state.
+  // State.
+  Mixer *mixer;
+  int init(CSOUND *csound)
+  {
+    mixer = getMixer(csound);
+    return OK;
+  }
   int audio(CSOUND *csound)
   {
 #ifdef ENABLE_MIXER_KDEBUG
-    warn(csound, "MixerClear::audio...\n")
+    warn(csound, "MixerClear::audio...\n");
 #endif
-      for(std::map<size_t,
-            std::vector< std::vector<MYFLT> > >::iterator
-            busi = busses[csound].begin(); busi != busses[csound].end(); ++busi)
-        {
-          for(std::vector< std::vector<MYFLT> >::iterator
-                channeli = busi->second.begin();
-              channeli != busi->second.end(); ++channeli)
-            {
-              for(std::vector<MYFLT>::iterator
-                    framei = (*channeli).begin();
-                  framei != (*channeli).end(); ++framei)
-                {
-                  *framei = 0;
-                }
-            }
-        }
+    if (!mixer->busses.empty())
+      {
+        std::memset(&mixer->busses[0], 0,
+                    mixer->busses.size() * sizeof(MYFLT));
+      }
 #ifdef ENABLE_MIXER_KDEBUG
-    warn(csound, "MixerClear::audio\n")
+    warn(csound, "MixerClear::audio\n");
 #endif
-      return OK;
+    return OK;
   }
 };
 
@@ -363,10 +435,10 @@ extern "C"
       (char*)"MixerClear",
       sizeof(MixerClear),
       0,
-      4,
+      5,
       (char*)"",
       (char*)"",
-      0,
+      (SUBR)&MixerClear::init_,
       0,
       (SUBR)&MixerClear::audio_
     },
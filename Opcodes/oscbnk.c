@@ -24,6 +24,14 @@
 #include "stdopcod.h"
 #include "oscbnk.h"
 #include <math.h>
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H) && !defined(WIN32)
+#  include <unistd.h>
+#  include <fcntl.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  define VCO2_CACHE_MMAP 1
+#endif
 
 static inline STDOPCOD_GLOBALS *get_oscbnk_globals(CSOUND *csound)
 {
@@ -1518,7 +1526,13 @@ static void vco2_delete_table_array(CSOUND *csound, int w)
     /* free number of partials list, */
     csound->Free(csound, pp->vco2_tables[w]->nparts);
 #endif
-    /* table data (only if not shared as standard Csound ftables), */
+    /* table data (only if not shared as standard Csound ftables, */
+    /* or mapped from the cache),                                  */
+#ifdef VCO2_CACHE_MMAP
+    if (pp->vco2_tables[w]->mapBase != NULL)
+      munmap(pp->vco2_tables[w]->mapBase, pp->vco2_tables[w]->mapSize);
+    else
+#endif
     for (j = 0; j < pp->vco2_tables[w]->ntabl; j++) {
       if (pp->vco2_tables[w]->base_ftnum < 1)
         csound->Free(csound, pp->vco2_tables[w]->tables[j].ftable);
@@ -1649,6 +1663,168 @@ static int vco2_table_size(int npart, VCO2_TABLE_PARAMS *tp)
     return n;
 }
 
+/* ---- on-disk cache of table arrays for built-in waveforms ---- */
+
+/* If the CS_VCO2_CACHE environment variable names a directory, generated */
+/* table arrays of the built-in waveforms are stored there, and are later */
+/* mapped read-only (and shared between instances) instead of being      */
+/* calculated again. A cache file consists of a header, followed by the   */
+/* data of all tables in the array, each one with its guard point.        */
+
+#ifdef VCO2_CACHE_MMAP
+
+#define VCO2_CACHE_MAGIC    0x32435643  /* "CVC2" */
+#define VCO2_CACHE_VERSION  1
+
+typedef struct {
+    uint32_t  magic, version;
+    uint32_t  floatsize;        /* sizeof(MYFLT)                             */
+    int32_t   waveform, min_size, max_size, ntabl;
+    uint32_t  reserved;
+    double    npart_mul;
+    uint64_t  nsamps;           /* total number of samples in all tables     */
+} VCO2_CACHE_HEADER;
+
+static int vco2_cache_unmap(CSOUND *csound, void *p)
+{
+    STDOPCOD_GLOBALS  *pp = get_oscbnk_globals(csound);
+    int               w;
+
+    (void) p;
+    for (w = 0; w < pp->vco2_nr_table_arrays; w++) {
+      VCO2_TABLE_ARRAY  *tables = pp->vco2_tables[w];
+      if (tables != NULL && tables->mapBase != NULL) {
+        munmap(tables->mapBase, tables->mapSize);
+        tables->mapBase = NULL;
+      }
+    }
+    pp->vco2_cache_reset = 0;
+    return OK;
+}
+
+/* get cache file name for the table parameters, returns non-zero if the */
+/* waveform cannot be cached, or caching is disabled                     */
+
+static int vco2_cache_path(CSOUND *csound, VCO2_TABLE_PARAMS *tp,
+                           char *path, size_t len)
+{
+    const char  *dir;
+    int         n;
+
+    if (tp->waveform < 0 || tp->waveform > 4)
+      return -1;
+    dir = csound->GetEnv(csound, "CS_VCO2_CACHE");
+    if (dir == NULL || dir[0] == '\0')
+      return -1;
+    n = snprintf(path, len, "%s/vco2_%d_%d_%d_%.6f_%d.tab", dir,
+                 tp->waveform, tp->min_size, tp->max_size, tp->npart_mul,
+                 (int) sizeof(MYFLT));
+    return (n < 0 || (size_t) n >= len);
+}
+
+static void vco2_cache_header(VCO2_CACHE_HEADER *h, VCO2_TABLE_PARAMS *tp,
+                              int ntabl, size_t nsamps)
+{
+    memset(h, 0, sizeof(VCO2_CACHE_HEADER));
+    h->magic = VCO2_CACHE_MAGIC;
+    h->version = VCO2_CACHE_VERSION;
+    h->floatsize = (uint32_t) sizeof(MYFLT);
+    h->waveform = tp->waveform;
+    h->min_size = tp->min_size;
+    h->max_size = tp->max_size;
+    h->ntabl = ntabl;
+    h->npart_mul = tp->npart_mul;
+    h->nsamps = (uint64_t) nsamps;
+}
+
+/* map the cached data of a table array, returns NULL if not found */
+
+static MYFLT *vco2_cache_map(CSOUND *csound, VCO2_TABLE_ARRAY *tables,
+                             VCO2_TABLE_PARAMS *tp, size_t nsamps)
+{
+    STDOPCOD_GLOBALS  *pp = get_oscbnk_globals(csound);
+    VCO2_CACHE_HEADER h;
+    char              path[1024];
+    struct stat       st;
+    size_t            size;
+    void              *base;
+    int               fd;
+
+    if (vco2_cache_path(csound, tp, path, sizeof(path)) != 0)
+      return NULL;
+    size = sizeof(VCO2_CACHE_HEADER) + nsamps * sizeof(MYFLT);
+    if ((fd = open(path, O_RDONLY)) < 0)
+      return NULL;
+    if (fstat(fd, &st) != 0 || st.st_size != (off_t) size) {
+      close(fd);
+      return NULL;
+    }
+    base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, (off_t) 0);
+    close(fd);                  /* the mapping stays valid */
+    if (base == MAP_FAILED)
+      return NULL;
+    vco2_cache_header(&h, tp, tables->ntabl, nsamps);
+    if (memcmp(base, &h, sizeof(VCO2_CACHE_HEADER)) != 0) {
+      munmap(base, size);       /* stale or foreign file */
+      return NULL;
+    }
+    if (!pp->vco2_cache_reset) {
+      csound->RegisterResetCallback(csound, NULL, vco2_cache_unmap);
+      pp->vco2_cache_reset = 1;
+    }
+    tables->mapBase = base;
+    tables->mapSize = size;
+    return (MYFLT*) ((char*) base + sizeof(VCO2_CACHE_HEADER));
+}
+
+/* store a newly calculated table array in the cache; the file is written */
+/* under a temporary name and then renamed, so that concurrently starting */
+/* instances never see a partial file                                     */
+
+static void vco2_cache_store(CSOUND *csound, VCO2_TABLE_ARRAY *tables,
+                             VCO2_TABLE_PARAMS *tp, size_t nsamps)
+{
+    VCO2_CACHE_HEADER h;
+    char              path[1024], tmp[1040];
+    int               fd, i, err;
+
+    if (vco2_cache_path(csound, tp, path, sizeof(path)) != 0)
+      return;
+    snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+    if ((fd = mkstemp(tmp)) < 0)
+      return;
+    vco2_cache_header(&h, tp, tables->ntabl, nsamps);
+    err = (write(fd, &h, sizeof(h)) != (ssize_t) sizeof(h));
+    for (i = 0; i < tables->ntabl && !err; i++) {
+      size_t  n = sizeof(MYFLT) * (size_t) (tables->tables[i].size + 1);
+      err = (write(fd, tables->tables[i].ftable, n) != (ssize_t) n);
+    }
+    if (close(fd) != 0)
+      err = 1;
+    if (err || rename(tmp, path) != 0) {
+      unlink(tmp);
+      csound->Warning(csound, Str("vco2: could not write table cache %s\n"),
+                      path);
+    }
+}
+
+#else
+
+static MYFLT *vco2_cache_map(CSOUND *csound, VCO2_TABLE_ARRAY *tables,
+                             VCO2_TABLE_PARAMS *tp, size_t nsamps)
+{
+    (void) csound; (void) tables; (void) tp; (void) nsamps;
+    return NULL;
+}
+
+static void vco2_cache_store(CSOUND *csound, VCO2_TABLE_ARRAY *tables,
+                             VCO2_TABLE_PARAMS *tp, size_t nsamps)
+{
+    (void) csound; (void) tables; (void) tp; (void) nsamps;
+}
+
+#endif  /* VCO2_CACHE_MMAP */
+
 /* Generate table array for the specified waveform (< 0: user defined).  */
 /* The tables can be accessed also as standard Csound ftables, starting  */
 /* from table number "base_ftable" if it is greater than zero.           */
@@ -1660,6 +1836,8 @@ static int vco2_tables_create(CSOUND *csound, int waveform, int base_ftable,
     STDOPCOD_GLOBALS  *pp = get_oscbnk_globals(csound);
     int               i, npart, ntables;
     double            npart_f;
+    size_t            nsamps;
+    MYFLT             *cached;
     VCO2_TABLE_ARRAY  *tables;
     VCO2_TABLE_PARAMS tp2;
 
@@ -1713,10 +1891,10 @@ static int vco2_tables_create(CSOUND *csound, int waveform, int base_ftable,
 #endif
     tables->tables =
         (VCO2_TABLE*) csound->Calloc(csound, sizeof(VCO2_TABLE) * ntables);
-    /* generate tables */
+    /* set up tables */
     tables->ntabl = ntables;            /* store number of tables */
     tables->base_ftnum = base_ftable;   /* and base ftable number */
-    npart_f = 0.0; i = 0;
+    npart_f = 0.0; i = 0; nsamps = 0;
     do {
       /* store number of partials, */
       npart = tables->tables[i].npart = (int) (npart_f + 0.5);
@@ -1725,26 +1903,48 @@ static int vco2_tables_create(CSOUND *csound, int waveform, int base_ftable,
 #endif
       /* table size, */
       tables->tables[i].size = vco2_table_size(npart, tp);
+      nsamps += (size_t) (tables->tables[i].size + 1);
       /* and other parameters */
       oscbnk_flen_setup((int32) tables->tables[i].size,
                         &(tables->tables[i].mask),
                         &(tables->tables[i].lobits),
                         &(tables->tables[i].pfrac));
+      /* next table */
+      vco2_next_npart(&npart_f, tp);
+    } while (++i < ntables);
+    /* look for the table data in the cache */
+    cached = vco2_cache_map(csound, tables, tp, nsamps);
+    /* generate tables */
+    for (i = 0; i < ntables; i++) {
+      size_t  n = (size_t) (tables->tables[i].size + 1);
       /* if base ftable was specified, generate empty table ... */
       if (base_ftable > 0) {
         csound->FTAlloc(csound, base_ftable, (int) tables->tables[i].size);
         csoundGetTable(csound, &(tables->tables[i].ftable), base_ftable);
         base_ftable++;                /* next table number */
+        if (cached != NULL)           /* ftables may be modified: copy */
+          memcpy(tables->tables[i].ftable, cached, sizeof(MYFLT) * n);
       }
+      else if (cached != NULL)  /* ... or use the read-only cache, ... */
+        tables->tables[i].ftable = cached;
       else    /* ... else allocate memory (cannot be accessed as a       */
         tables->tables[i].ftable =      /* standard Csound ftable) */
-          (MYFLT*) csound->Malloc(csound, sizeof(MYFLT)
-                                          * (tables->tables[i].size + 1));
+          (MYFLT*) csound->Malloc(csound, sizeof(MYFLT) * n);
       /* now calculate the table */
-      vco2_calculate_table(csound, &(tables->tables[i]), tp);
-      /* next table */
-      vco2_next_npart(&npart_f, tp);
-    } while (++i < ntables);
+      if (cached != NULL)
+        cached += n;
+      else
+        vco2_calculate_table(csound, &(tables->tables[i]), tp);
+    }
+    /* copied tables do not need the mapping any more */
+#ifdef VCO2_CACHE_MMAP
+    if (tables->mapBase != NULL && tables->base_ftnum > 0) {
+      munmap(tables->mapBase, tables->mapSize);
+      tables->mapBase = NULL;
+    }
+#endif
+    if (cached == NULL)
+      vco2_cache_store(csound, tables, tp, nsamps);
 #ifdef VCO2FT_USE_TABLE
     /* build table for number of harmonic partials -> table lookup */
     i = npart = 0;
@@ -223,6 +223,8 @@ struct VCO2_TABLE_ARRAY_ {
     MYFLT   *nparts;            /* number of partials list                   */
 #endif
     VCO2_TABLE  *tables;        /* array of table structures                 */
+    void    *mapBase;           /* table data mapped from the cache, if any  */
+    size_t  mapSize;
 };
 
 typedef struct {
@@ -39,55 +39,35 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
     if (index > (unsigned)(to) || index < (unsigned)(from)) \
         index = (unsigned)(from);
 
-/* here follows routines for maintaining a linked list of grains */
+/* here follows routines for maintaining the pool of grains */
 
-/* initialises a linked list of NODEs */
+/* initialises an empty grain pool in the memory at s->grains */
 static void init_pool(GRAINPOOL *s, unsigned max_grains)
 {
-    unsigned i;
-    NODE **p = &s->grainlist;
-    NODE *grainpool = (NODE *)s->mempool;
-
-    s->free_nodes = max_grains;
-    /* build list of grains in pool */
-    for (i = 0; i < max_grains; ++i) {
-        NODE *node;
-        *p = grainpool + i;
-        node = *p;
-        node->next = NULL;
-        p = &(node->next);
-    }
+    s->active = 0;
+    s->max_grains = max_grains;
 }
 
-/* returns pointer to new node */
-static NODE *get_grain(GRAINPOOL *s)
+/* returns pointer to the first free grain, which only becomes active
+ * when add_grain() is called, or NULL if the pool is full */
+static GRAIN *get_grain(GRAINPOOL *s)
 {
-    NODE *ret = s->grainlist;
-
-    if (s->grainlist)
-        s->grainlist = s->grainlist->next;
-    s->free_nodes--;
-    return ret;
+    return s->active < s->max_grains ? &s->grains[s->active] : NULL;
 }
 
-/* returns a NODE to the pool. function returns pointer to next node */
-static NODE *return_grain(GRAINPOOL *s, NODE *c)
+/* activates the grain returned by get_grain() */
+static void add_grain(GRAINPOOL *s)
 {
-    NODE *oldnext = c->next;
-
-    c->next = s->grainlist;
-    s->grainlist = c;
-    s->free_nodes++;
-    return oldnext;
+    s->active++;
 }
 
 /* return oldest grain to the pool, we use this when we're out of grains */
-static void kill_oldest_grain(GRAINPOOL *s, NODE *n)
+static void kill_oldest_grain(GRAINPOOL *s)
 {
-    while (n->next->next)
-        n = n->next;
-    return_grain(s, n->next);
-    n->next = NULL;
+    if (s->active == 0)
+        return;
+    memmove(s->grains, s->grains + 1, (s->active - 1)*sizeof(GRAIN));
+    s->active--;
 }
 
 static int setup_globals(CSOUND *csound, PARTIKKEL *p)
@@ -224,7 +204,6 @@ static int partikkel_init(CSOUND *csound, PARTIKKEL *p)
     if ((ret = setup_globals(csound, p)) != OK)
         return ret;
 
-    p->grainroot = NULL;
     /* set grainphase to 1.0 to make grain scheduler create a grain immediately
      * after starting opcode */
     p->grainphase = 1.0;
@@ -302,8 +281,9 @@ static int partikkel_init(CSOUND *csound, PARTIKKEL *p)
     p->synced = 0;
     p->graininc = 0.0;
 
-    /* allocate memory for the grain mix buffer */
-    size = CS_KSMPS*sizeof(MYFLT);
+    /* allocate memory for the grain mix buffer, followed by the envelope
+     * and fm modulation buffers used while rendering a grain */
+    size = 3*CS_KSMPS*sizeof(MYFLT);
     if (p->aux.auxp == NULL || p->aux.size < size)
         csound->AuxAlloc(csound, size, &p->aux);
     else
@@ -313,10 +293,10 @@ static int partikkel_init(CSOUND *csound, PARTIKKEL *p)
     if (UNLIKELY(*p->max_grains < FL(1.0)))
         return INITERROR("maximum number of grains needs to be non-zero "
                          "and positive");
-    size = ((unsigned)*p->max_grains)*sizeof(NODE);
+    size = ((unsigned)*p->max_grains)*sizeof(GRAIN);
     if (p->aux2.auxp == NULL || p->aux2.size < size)
         csound->AuxAlloc(csound, size, &p->aux2);
-    p->gpool.mempool = p->aux2.auxp;
+    p->gpool.grains = (GRAIN *)p->aux2.auxp;
     init_pool(&p->gpool, (unsigned)*p->max_grains);
 
     /* find out which of the xrate parameters are arate */
@@ -328,7 +308,7 @@ static int partikkel_init(CSOUND *csound, PARTIKKEL *p)
 
 /* n is sample number for which the grain is to be scheduled
  * offset is time offset for grain in seconds, passed separately for hints */
-static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
+static int schedule_grain(CSOUND *csound, PARTIKKEL *p, GRAIN *grain, int32 n,
                           double offset)
 {
     /* make a new grain */
@@ -337,7 +317,6 @@ static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
     int samples;
     double rcp_samples; /* 1/samples */
     double phase_corr;
-    GRAIN *grain = &node->grain;
     unsigned int i;
     unsigned int chan;
     MYFLT graingain;
@@ -386,7 +365,6 @@ static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
     if ((fabs(graingain) < FL(1e-8)) || (frand() > 1.0 - *p->randommask)) {
         /* grain is either masked out or has a zero amplitude, so we cancel it
          * and proceed with scheduling our next grain */
-        return_grain(&p->gpool, node);
         return OK;
     }
 
@@ -398,7 +376,6 @@ static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
     /* place a grain in between two channels according to channel mask value */
     chan = (unsigned)maskchannel;
     if (UNLIKELY(chan >= p->num_outputs)) {
-        return_grain(&p->gpool, node);
         return PERFERROR("channel mask specifies non-existing output channel");
     }
     /* use panning law table if specified */
@@ -421,7 +398,6 @@ static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
     samples = (int)((CS_ESR*(*p->duration)/1000.0) + 0.5);
     /* if grainlength is below one sample, we'll just cancel it */
     if (samples <= 0) {
-        return_grain(&p->gpool, node);
         return OK;
     }
     rcp_samples = 1.0/(double)samples;
@@ -535,9 +511,8 @@ static int schedule_grain(CSOUND *csound, PARTIKKEL *p, NODE *node, int32 n,
 
     grain->envinc = rcp_samples;
     grain->envphase = phase_corr*grain->envinc;
-    /* link new grain into the list */
-    node->next = p->grainroot;
-    p->grainroot = node;
+    /* activate the new grain */
+    add_grain(&p->gpool);
     return OK;
 }
 
@@ -547,7 +522,7 @@ static int schedule_grains(CSOUND *csound, PARTIKKEL *p)
     uint32_t koffset = p->h.insdshead->ksmps_offset;
     uint32_t early  = p->h.insdshead->ksmps_no_end;
     uint32_t n, nsmps = CS_KSMPS;
-    NODE *node;
+    GRAIN *grain;
     MYFLT **waveformparams = &p->waveform1;
     MYFLT grainfreq = fabs(*p->grainfreq);
 
@@ -621,19 +596,19 @@ static int schedule_grains(CSOUND *csound, PARTIKKEL *p)
                 offset = (offset - p->grainphase)/grainfreq;
 
             /* check if there are any grains left in the pool */
-            if (!p->gpool.free_nodes) {
+            if (p->gpool.active == p->gpool.max_grains) {
                 if (!p->out_of_voices_warning) {
                     WARNING("maximum number of grains reached");
                     p->out_of_voices_warning = 1; /* we only warn once */
                 }
-                kill_oldest_grain(&p->gpool, p->grainroot);
+                kill_oldest_grain(&p->gpool);
             }
             /* add a new grain */
-            node = get_grain(&p->gpool);
+            grain = get_grain(&p->gpool);
             /* check first, in case we'll change the above behaviour of
              * killing a grain */
-            if (node) {
-                int ret = schedule_grain(csound, p, node, n, offset);
+            if (grain) {
+                int ret = schedule_grain(csound, p, grain, n, offset);
 
                 if (ret != OK)
                     return ret;
@@ -657,67 +632,148 @@ static int schedule_grains(CSOUND *csound, PARTIKKEL *p)
 
 /* Main synthesis loops */
 /* NOTE: the main synthesis loop is duplicated for both wavetable and
- * trainlet synthesis for speed */
-static inline void render_wave(PARTIKKEL *p, GRAIN *grain, WAVEDATA *wav,
-                               MYFLT *buf, unsigned stop)
+ * trainlet synthesis for speed. The fm modulation is the same for every
+ * waveform of a grain, so it is computed once per grain into fmbuf */
+static inline void render_wave(GRAIN *grain, WAVEDATA *wav, MYFLT *buf,
+                               const MYFLT *fmbuf, unsigned stop)
 {
     unsigned n;
-    double fmenvphase = grain->envphase;
+    const MYFLT *ftable = wav->table->ftable;
+    const double tablen = (double)wav->table->flen;
+    const double sweepdecay = wav->sweepdecay, sweepoffset = wav->sweepoffset;
+    const MYFLT gain = wav->gain;
+    double phase = wav->phase, delta = wav->delta;
 
     /* wavetable synthesis */
     for (n = grain->start; n < stop; ++n) {
-        double tablen = (double)wav->table->flen;
         unsigned x0;
-        MYFLT frac, fmenv;
+        MYFLT frac;
 
         /* make sure phase accumulator stays within bounds */
-        while (UNLIKELY(wav->phase >= tablen))
-            wav->phase -= tablen;
-        while (UNLIKELY(wav->phase < 0.0))
-            wav->phase += tablen;
+        while (UNLIKELY(phase >= tablen))
+            phase -= tablen;
+        while (UNLIKELY(phase < 0.0))
+            phase += tablen;
 
         /* sample table lookup with linear interpolation */
-        x0 = (unsigned)wav->phase;
-        frac = (MYFLT)(wav->phase - x0);
-        buf[n] += lrp(wav->table->ftable[x0], wav->table->ftable[x0 + 1],
-                      frac)*wav->gain;
+        x0 = (unsigned)phase;
+        frac = (MYFLT)(phase - x0);
+        buf[n] += lrp(ftable[x0], ftable[x0 + 1], frac)*gain;
 
-        fmenv = grain->fmenvtab->ftable[(size_t)(fmenvphase*FMAXLEN)
-                                        >> grain->fmenvtab->lobits];
-        fmenvphase += grain->envinc;
-        wav->phase += wav->delta + wav->delta*p->fm[n]*grain->fmamp*fmenv;
+        phase += delta + delta*fmbuf[n];
         /* apply sweep */
-        wav->delta = wav->delta*wav->sweepdecay + wav->sweepoffset;
-     }
+        delta = delta*sweepdecay + sweepoffset;
+    }
+    wav->phase = phase;
+    wav->delta = delta;
 }
 
 static inline void render_trainlet(PARTIKKEL *p, GRAIN *grain, WAVEDATA *wav,
-                                   MYFLT *buf, unsigned stop)
+                                   MYFLT *buf, const MYFLT *fmbuf,
+                                   unsigned stop)
 {
     unsigned n;
-    double fmenvphase = grain->envphase;
+    const double sweepdecay = wav->sweepdecay, sweepoffset = wav->sweepoffset;
+    const MYFLT gain = wav->gain;
+    double phase = wav->phase, delta = wav->delta;
 
     /* trainlet synthesis */
     for (n = grain->start; n < stop; ++n) {
-        MYFLT fmenv;
-
-        while (UNLIKELY(wav->phase >= 1.0))
-            wav->phase -= 1.0;
-        while (UNLIKELY(wav->phase < 0.0))
-            wav->phase += 1.0;
+        while (UNLIKELY(phase >= 1.0))
+            phase -= 1.0;
+        while (UNLIKELY(phase < 0.0))
+            phase += 1.0;
 
         /* dsf/trainlet synthesis */
-        buf[n] += wav->gain*dsf(p->costab, grain, wav->phase, p->zscale,
-                                p->cosineshift);
+        buf[n] += gain*dsf(p->costab, grain, phase, p->zscale,
+                           p->cosineshift);
+
+        phase += delta + delta*fmbuf[n];
+        delta = delta*sweepdecay + sweepoffset;
+    }
+    wav->phase = phase;
+    wav->delta = delta;
+}
+
+/* fm modulation of a grain, scaled by its fm envelope */
+static inline void render_fm(PARTIKKEL *p, GRAIN *grain, MYFLT *fmbuf,
+                             unsigned stop)
+{
+    unsigned n;
+    const FUNC *fmenvtab = grain->fmenvtab;
+    const MYFLT fmamp = grain->fmamp;
+    double fmenvphase = grain->envphase;
+
+    if (fmamp == FL(0.0)) {
+        memset(fmbuf + grain->start, 0, (stop - grain->start)*sizeof(MYFLT));
+        return;
+    }
+    for (n = grain->start; n < stop; ++n) {
+        MYFLT fmenv = fmenvtab->ftable[(size_t)(fmenvphase*FMAXLEN)
+                                       >> fmenvtab->lobits];
 
-        fmenv = grain->fmenvtab->ftable[(size_t)(fmenvphase*FMAXLEN)
-                                        >> grain->fmenvtab->lobits];
         fmenvphase += grain->envinc;
-        wav->phase += wav->delta + wav->delta*p->fm[n]*grain->fmamp*fmenv;
-        wav->delta = wav->delta*wav->sweepdecay + wav->sweepoffset;
+        fmbuf[n] = p->fm[n]*fmamp*fmenv;
     }
 }
 
+/* envelope lookup helpers */
+#define ENVTAB(tab, phs) \
+    ((tab)->ftable[(size_t)((phs)*FMAXLEN) >> (tab)->lobits])
+#define ENV2(phs) \
+    (env2offset + env2amount*ENVTAB(env2tab, phs))
+
+/* compute the combined envelopes of a grain into envbuf. The envelope phase
+ * only moves forward, so the attack, sustain and decay segments are each
+ * rendered as one run with a fixed table instead of being chosen per sample */
+static inline void render_envelope(PARTIKKEL *p, GRAIN *grain, MYFLT *envbuf,
+                                   unsigned stop)
+{
+    unsigned n = grain->start;
+    const FUNC *atab = p->env_attack_tab, *dtab = p->env_decay_tab;
+    const FUNC *env2tab = p->env2_tab;
+    const double envinc = grain->envinc;
+    const double attacklen = grain->envattacklen;
+    const double decaystart = grain->envdecaystart;
+    const MYFLT env2amount = grain->env2amount;
+    const MYFLT env2offset = FL(1.0) - env2amount;
+    double envphase = grain->envphase;
+
+    /* attack */
+    for (; n < stop && envphase < attacklen; ++n) {
+        envbuf[n] = ENVTAB(atab, envphase/attacklen)*ENV2(envphase);
+        envphase += envinc;
+    }
+    /* for sustain, use last sample in attack table */
+    if (n < stop && envphase < decaystart) {
+        const MYFLT sustain = ENVTAB(atab, 1.0);
+
+        for (; n < stop && envphase < decaystart; ++n) {
+            envbuf[n] = sustain*ENV2(envphase);
+            envphase += envinc;
+        }
+    }
+    /* decay */
+    for (; n < stop && envphase < 1.0; ++n) {
+        envbuf[n] = ENVTAB(dtab, (envphase - decaystart)/(1.0 - decaystart))
+                    *ENV2(envphase);
+        envphase += envinc;
+    }
+    /* clamp envelope phase because of round-off errors */
+    if (n < stop) {
+        const MYFLT end = ENVTAB(decaystart < 1.0 ? dtab : atab, 1.0)
+                          *ENV2(1.0);
+
+        for (; n < stop; ++n)
+            envbuf[n] = end;
+        envphase = 1.0 + envinc;
+    }
+    grain->envphase = envphase;
+}
+
+#undef ENVTAB
+#undef ENV2
+
 /* do the actual waveform synthesis */
 static inline void render_grain(CSOUND *csound, PARTIKKEL *p, GRAIN *grain)
 {
@@ -727,10 +783,15 @@ static inline void render_grain(CSOUND *csound, PARTIKKEL *p, GRAIN *grain)
     MYFLT *out2 = *(&(p->output1) + grain->chan2);
     unsigned stop = grain->stop > CS_KSMPS
                     ? CS_KSMPS : grain->stop;
+    const unsigned start = grain->start;
+    const MYFLT gain1 = grain->gain1, gain2 = grain->gain2;
     MYFLT *buf = (MYFLT *)p->aux.auxp;
+    MYFLT *envbuf = buf + CS_KSMPS;
+    MYFLT *fmbuf = envbuf + CS_KSMPS;
 
-    if (grain->start >= CS_KSMPS)
+    if (start >= CS_KSMPS)
         return; /* grain starts at a later kperiod */
+    render_fm(p, grain, fmbuf, stop);
     for (i = 0; i < 5; ++i) {
         WAVEDATA *curwav = &grain->wav[i];
 
@@ -739,60 +800,33 @@ static inline void render_grain(CSOUND *csound, PARTIKKEL *p, GRAIN *grain)
             continue;
 
         if (i != WAV_TRAINLET)
-            render_wave(p, grain, curwav, buf, stop);
+            render_wave(grain, curwav, buf, fmbuf, stop);
         else
-            render_trainlet(p, grain, curwav, buf, stop);
+            render_trainlet(p, grain, curwav, buf, fmbuf, stop);
     }
 
     /* apply envelopes */
-    for (n = grain->start; n < stop; ++n) {
-        MYFLT env, env2, output;
-        double envphase;
-        FUNC *envtable;
-
-        /* apply envelopes */
-        if (grain->envphase < grain->envattacklen) {
-            envtable = p->env_attack_tab;
-            envphase = grain->envphase/grain->envattacklen;
-        } else if (grain->envphase < grain->envdecaystart) {
-            /* for sustain, use last sample in attack table */
-            envtable = p->env_attack_tab;
-            envphase = 1.0;
-        } else if (grain->envphase < 1.0) {
-            envtable = p->env_decay_tab;
-            envphase = (grain->envphase - grain->envdecaystart)/(1.0 -
-                       grain->envdecaystart);
-        } else {
-            /* clamp envelope phase because of round-off errors */
-            envtable = grain->envdecaystart < 1.0 ?
-                       p->env_decay_tab : p->env_attack_tab;
-            envphase = grain->envphase = 1.0;
-        }
-
-        /* fetch envelope values */
-        env = envtable->ftable[(size_t)(envphase*FMAXLEN)
-                                >> envtable->lobits];
-        env2 = p->env2_tab->ftable[(size_t)(grain->envphase*FMAXLEN)
-                                   >> p->env2_tab->lobits];
-        env2 = FL(1.0) - grain->env2amount + grain->env2amount*env2;
-        grain->envphase += grain->envinc;
-        /* generate grain output sample */
-        output = buf[n]*env*env2;
-        /* now distribute this grain to the output channels it's supposed to
-         * end up in, as decided by the channel mask */
-        out1[n] += output*grain->gain1;
-        out2[n] += output*grain->gain2;
-    }
+    render_envelope(p, grain, envbuf, stop);
+    for (n = start; n < stop; ++n)
+        buf[n] *= envbuf[n];
+    /* now distribute this grain to the output channels it's supposed to
+     * end up in, as decided by the channel mask */
+    if (gain1 != FL(0.0))
+        for (n = start; n < stop; ++n)
+            out1[n] += buf[n]*gain1;
+    if (gain2 != FL(0.0))
+        for (n = start; n < stop; ++n)
+            out2[n] += buf[n]*gain2;
     /* now clear the area we just worked in */
-    memset(buf + grain->start, 0, (stop - grain->start)*sizeof(MYFLT));
+    memset(buf + start, 0, (stop - start)*sizeof(MYFLT));
 }
 
 static int partikkel(CSOUND *csound, PARTIKKEL *p)
 {
     int ret;
-    unsigned int n;
-    NODE **nodeptr;
+    unsigned int n, i, j;
     MYFLT **outputs = &p->output1;
+    GRAIN *grains;
 
     if (UNLIKELY(p->aux.auxp == NULL || p->aux2.auxp == NULL))
         return PERFERROR("not initialised");
@@ -804,27 +838,28 @@ static int partikkel(CSOUND *csound, PARTIKKEL *p)
     for (n = 0; n < p->num_outputs; ++n)
         memset(outputs[n], 0, sizeof(MYFLT)*CS_KSMPS);
 
-    /* prepare to traverse grain list */
-    nodeptr = &p->grainroot;
-    while (*nodeptr) {
-        GRAIN *grain = &((*nodeptr)->grain);
+    /* render the active grains oldest first, moving the ones that live on
+     * down over the finished ones so the pool stays contiguous and ordered */
+    grains = p->gpool.grains;
+    for (i = 0, j = 0; i < p->gpool.active; ++i) {
+        GRAIN *grain = &grains[i];
 
         /* render current grain to outputs */
         render_grain(csound, p, grain);
         /* check if grain is finished */
-        if (grain->stop <= CS_KSMPS) {
-            /* grain is finished, deactivate it */
-            *nodeptr = return_grain(&p->gpool, *nodeptr);
-        } else {
-            /* extend grain lifetime with one k-period and find next grain */
-            if (CS_KSMPS > grain->start)
-                grain->start = 0; /* grain is active */
-            else
-                grain->start -= CS_KSMPS; /* grain is not yet active */
-            grain->stop -= CS_KSMPS;
-            nodeptr = &((*nodeptr)->next);
-        }
+        if (grain->stop <= CS_KSMPS)
+            continue; /* grain is finished, deactivate it */
+        /* extend grain lifetime with one k-period */
+        if (CS_KSMPS > grain->start)
+            grain->start = 0; /* grain is active */
+        else
+            grain->start -= CS_KSMPS; /* grain is not yet active */
+        grain->stop -= CS_KSMPS;
+        if (j != i)
+            grains[j] = *grain;
+        ++j;
     }
+    p->gpool.active = j;
     return OK;
 }
 
@@ -45,16 +45,12 @@ typedef struct {
 /* which of the wav[] entries above correspond to the trainlet generator */
 #define WAV_TRAINLET 4
 
-/* support structs for the grain pool routines */
-typedef struct NODE {
-    GRAIN grain;
-    struct NODE *next;
-} NODE;
-
+/* the grain pool is a contiguous array, holding the active grains first,
+ * oldest first, followed by the free ones */
 typedef struct {
-    NODE *grainlist;
-    char *mempool;
-    unsigned free_nodes;
+    GRAIN *grains;
+    unsigned active;
+    unsigned max_grains;
 } GRAINPOOL;
 
 struct PARTIKKEL;
@@ -122,7 +118,6 @@ typedef struct PARTIKKEL {
     PARTIKKEL_GLOBALS *globals;
     PARTIKKEL_GLOBALS_ENTRY *globals_entry;
     GRAINPOOL gpool;
-    NODE *grainroot;
     int out_of_voices_warning;
     unsigned num_outputs;
     int grainfreq_arate;
@@ -62,18 +62,20 @@ static const double reverbParams[8][4] = {
 static const double outputGain  = 0.35;
 static const double jpScale     = 0.25;
 
+/* State of the eight delay lines, stored per field rather than per line,  */
+/* so that all lines can be stepped side by side in loops over the lines.  */
+
 typedef struct {
-    int         writePos;
-    int         bufferSize;
-    int         readPos;
-    int         readPosFrac;
-    int         readPosFrac_inc;
-    int         dummy;
-    int         seedVal;
-    int         randLine_cnt;
-    double      filterState;
-    MYFLT       buf[1];
-} delayLine;
+    int         writePos[8];
+    int         bufferSize[8];
+    int         readPos[8];
+    int         readPosFrac[8];
+    int         readPosFrac_inc[8];
+    int         seedVal[8];
+    int         randLine_cnt[8];
+    double      filterState[8];
+    MYFLT       *buf[8];
+} delayLines;
 
 typedef struct {
     OPDS        h;
@@ -83,118 +85,153 @@ typedef struct {
     double      dampFact;
     MYFLT       prv_LPFreq;
     int         initDone;
-    delayLine   *delayLines[8];
+    delayLines  lines;
     AUXCH       auxData;
 } SC_REVERB;
 
-static int delay_line_max_samples(SC_REVERB *p, int n)
+/* reverbsc for arrays of stereo busses, all with the same parameters */
+
+typedef struct {
+    OPDS        h;
+    ARRAYDAT    *aoutL, *aoutR, *ainL, *ainR;
+    MYFLT       *kFeedBack, *kLPFreq;
+    MYFLT       *iSampleRate, *iPitchMod, *iSkipInit;
+    double      sampleRate;
+    double      dampFact;
+    MYFLT       prv_LPFreq;
+    int         initDone;
+    int         nBusses;
+    AUXCH       lines;          /* delayLines for each bus */
+    AUXCH       auxData;
+} SC_REVERB_A;
+
+static int delay_line_max_samples(double sampleRate, double pitchMod, int n)
 {
     double  maxDel;
 
     maxDel = reverbParams[n][0];
-    maxDel += (reverbParams[n][1] * (double) *(p->iPitchMod) * 1.125);
-    return (int) (maxDel * p->sampleRate + 16.5);
+    maxDel += (reverbParams[n][1] * pitchMod * 1.125);
+    return (int) (maxDel * sampleRate + 16.5);
 }
 
-static int delay_line_bytes_alloc(SC_REVERB *p, int n)
+/* number of samples in all delay lines of one reverb, each line rounded */
+/* up to keep the buffers 16 byte aligned                                */
+
+static int delay_lines_samples(double sampleRate, double pitchMod)
 {
-    int nBytes;
+    int n, nSamples = 0, align = 16 / (int) sizeof(MYFLT);
 
-    nBytes = (int) sizeof(delayLine) - (int) sizeof(MYFLT);
-    nBytes += (delay_line_max_samples(p, n) * (int) sizeof(MYFLT));
-    nBytes = (nBytes + 15) & (~15);
-    return nBytes;
+    for (n = 0; n < 8; n++)
+      nSamples += ((delay_line_max_samples(sampleRate, pitchMod, n)
+                    + align - 1) / align) * align;
+    return nSamples;
 }
 
-static void next_random_lineseg(SC_REVERB *p, delayLine *lp, int n)
+static void next_random_lineseg(delayLines *lp, int n,
+                                double sampleRate, double pitchMod)
 {
     double  prvDel, nxtDel, phs_incVal;
 
     /* update random seed */
-    if (lp->seedVal < 0)
-      lp->seedVal += 0x10000;
-    lp->seedVal = (lp->seedVal * 15625 + 1) & 0xFFFF;
-    if (lp->seedVal >= 0x8000)
-      lp->seedVal -= 0x10000;
+    if (lp->seedVal[n] < 0)
+      lp->seedVal[n] += 0x10000;
+    lp->seedVal[n] = (lp->seedVal[n] * 15625 + 1) & 0xFFFF;
+    if (lp->seedVal[n] >= 0x8000)
+      lp->seedVal[n] -= 0x10000;
     /* length of next segment in samples */
-    lp->randLine_cnt = (int) ((p->sampleRate / reverbParams[n][2]) + 0.5);
-    prvDel = (double) lp->writePos;
-    prvDel -= ((double) lp->readPos
-               + ((double) lp->readPosFrac / (double) DELAYPOS_SCALE));
+    lp->randLine_cnt[n] = (int) ((sampleRate / reverbParams[n][2]) + 0.5);
+    prvDel = (double) lp->writePos[n];
+    prvDel -= ((double) lp->readPos[n]
+               + ((double) lp->readPosFrac[n] / (double) DELAYPOS_SCALE));
     while (prvDel < 0.0)
-      prvDel += (double) lp->bufferSize;
-    prvDel = prvDel / p->sampleRate;    /* previous delay time in seconds */
-    nxtDel = (double) lp->seedVal * reverbParams[n][1] / 32768.0;
+      prvDel += (double) lp->bufferSize[n];
+    prvDel = prvDel / sampleRate;       /* previous delay time in seconds */
+    nxtDel = (double) lp->seedVal[n] * reverbParams[n][1] / 32768.0;
     /* next delay time in seconds */
-    nxtDel = reverbParams[n][0] + (nxtDel * (double) *(p->iPitchMod));
+    nxtDel = reverbParams[n][0] + (nxtDel * pitchMod);
     /* calculate phase increment per sample */
-    phs_incVal = (prvDel - nxtDel) / (double) lp->randLine_cnt;
-    phs_incVal = phs_incVal * p->sampleRate + 1.0;
-    lp->readPosFrac_inc = (int) (phs_incVal * DELAYPOS_SCALE + 0.5);
+    phs_incVal = (prvDel - nxtDel) / (double) lp->randLine_cnt[n];
+    phs_incVal = phs_incVal * sampleRate + 1.0;
+    lp->readPosFrac_inc[n] = (int) (phs_incVal * DELAYPOS_SCALE + 0.5);
 }
 
-static void init_delay_line(SC_REVERB *p, delayLine *lp, int n)
+/* set up the delay lines of one reverb, using the buffer space at buf */
+
+static void init_delay_lines(delayLines *lp, MYFLT *buf,
+                             double sampleRate, double pitchMod)
 {
     double  readPos;
-    /* int     i; */
-
-    /* calculate length of delay line */
-    lp->bufferSize = delay_line_max_samples(p, n);
-    lp->dummy = 0;
-    lp->writePos = 0;
-    /* set random seed */
-    lp->seedVal = (int) (reverbParams[n][3] + 0.5);
-    /* set initial delay time */
-    readPos = (double) lp->seedVal * reverbParams[n][1] / 32768;
-    readPos = reverbParams[n][0] + (readPos * (double) *(p->iPitchMod));
-    readPos = (double) lp->bufferSize - (readPos * p->sampleRate);
-    lp->readPos = (int) readPos;
-    readPos = (readPos - (double) lp->readPos) * (double) DELAYPOS_SCALE;
-    lp->readPosFrac = (int) (readPos + 0.5);
-    /* initialise first random line segment */
-    next_random_lineseg(p, lp, n);
-    /* clear delay line to zero */
-    lp->filterState = 0.0;
-    memset(lp->buf, 0, sizeof(MYFLT)*lp->bufferSize);
-    /* for (i = 0; i < lp->bufferSize; i++) */
-    /*   lp->buf[i] = FL(0.0); */
+    int     n, align = 16 / (int) sizeof(MYFLT);
+
+    for (n = 0; n < 8; n++) {
+      /* calculate length of delay line */
+      lp->bufferSize[n] = delay_line_max_samples(sampleRate, pitchMod, n);
+      lp->buf[n] = buf;
+      buf += ((lp->bufferSize[n] + align - 1) / align) * align;
+      lp->writePos[n] = 0;
+      /* set random seed */
+      lp->seedVal[n] = (int) (reverbParams[n][3] + 0.5);
+      /* set initial delay time */
+      readPos = (double) lp->seedVal[n] * reverbParams[n][1] / 32768;
+      readPos = reverbParams[n][0] + (readPos * pitchMod);
+      readPos = (double) lp->bufferSize[n] - (readPos * sampleRate);
+      lp->readPos[n] = (int) readPos;
+      readPos = (readPos - (double) lp->readPos[n]) * (double) DELAYPOS_SCALE;
+      lp->readPosFrac[n] = (int) (readPos + 0.5);
+      /* initialise first random line segment */
+      next_random_lineseg(lp, n, sampleRate, pitchMod);
+      /* clear delay line to zero */
+      lp->filterState[n] = 0.0;
+      memset(lp->buf[n], 0, sizeof(MYFLT) * lp->bufferSize[n]);
+    }
 }
 
-static int sc_reverb_init(CSOUND *csound, SC_REVERB *p)
+static int sc_reverb_check(CSOUND *csound, MYFLT iSampleRate,
+                           MYFLT iPitchMod, double *sampleRate)
 {
-    int i;
-    int nBytes;
-
     /* check for valid parameters */
-    if (*(p->iSampleRate) <= FL(0.0))
-      p->sampleRate = (double) CS_ESR;
+    if (iSampleRate <= FL(0.0))
+      *sampleRate = (double) CS_ESR;
     else
-      p->sampleRate = (double) *(p->iSampleRate);
-    if (UNLIKELY(p->sampleRate < MIN_SRATE || p->sampleRate > MAX_SRATE)) {
+      *sampleRate = (double) iSampleRate;
+    if (UNLIKELY(*sampleRate < MIN_SRATE || *sampleRate > MAX_SRATE)) {
       return csound->InitError(csound,
                                Str("reverbsc: sample rate is out of range"));
     }
-    if (UNLIKELY(*(p->iPitchMod) < FL(0.0) ||
-                 *(p->iPitchMod) > (MYFLT) MAX_PITCHMOD)) {
+    if (UNLIKELY(iPitchMod < FL(0.0) || iPitchMod > (MYFLT) MAX_PITCHMOD)) {
       return csound->InitError(csound,
                                Str("reverbsc: invalid pitch modulation factor"));
     }
+    return OK;
+}
+
+/* tone filter coefficient for a cutoff frequency */
+
+static double sc_reverb_damp(double freq, double sampleRate)
+{
+    double  dampFact;
+
+    dampFact = 2.0 - cos(freq * TWOPI / sampleRate);
+    return (dampFact - sqrt(dampFact * dampFact - 1.0));
+}
+
+static int sc_reverb_init(CSOUND *csound, SC_REVERB *p)
+{
+    size_t  nBytes;
+
+    if (UNLIKELY(sc_reverb_check(csound, *(p->iSampleRate), *(p->iPitchMod),
+                                 &(p->sampleRate)) != OK))
+      return NOTOK;
     /* calculate the number of bytes to allocate */
-    nBytes = 0;
-    for (i = 0; i < 8; i++)
-      nBytes += delay_line_bytes_alloc(p, i);
-    if (nBytes != (int)p->auxData.size)
-      csound->AuxAlloc(csound, (size_t) nBytes, &(p->auxData));
+    nBytes = sizeof(MYFLT) * (size_t) delay_lines_samples(p->sampleRate,
+                                                          *(p->iPitchMod));
+    if (nBytes != p->auxData.size)
+      csound->AuxAlloc(csound, nBytes, &(p->auxData));
     else if (p->initDone && *(p->iSkipInit) != FL(0.0))
       return OK;    /* skip initialisation if requested */
     /* set up delay lines */
-    nBytes = 0;
-    for (i = 0; i < 8; i++) {
-      p->delayLines[i] = (delayLine*) ((unsigned char*) (p->auxData.auxp)
-                                       + (int) nBytes);
-      init_delay_line(p, p->delayLines[i], i);
-      nBytes += delay_line_bytes_alloc(p, i);
-    }
+    init_delay_lines(&(p->lines), (MYFLT*) p->auxData.auxp,
+                     p->sampleRate, (double) *(p->iPitchMod));
     p->dampFact = 1.0;
     p->prv_LPFreq = FL(0.0);
     p->initDone = 1;
@@ -202,24 +239,109 @@ static int sc_reverb_init(CSOUND *csound, SC_REVERB *p)
     return OK;
 }
 
+/* Run the eight delay lines of one reverb over samples offset to nsmps-1. */
+/* Per sample, the lines are first written and the four samples around    */
+/* each read position fetched, then the interpolation, feedback and tone  */
+/* filter are calculated for all lines in one loop over the lines, which  */
+/* the compiler can vectorise.                                            */
+
+static void sc_reverb_run(delayLines *lp, const MYFLT *inL, const MYFLT *inR,
+                          MYFLT *outL, MYFLT *outR,
+                          uint32_t offset, uint32_t nsmps,
+                          double feedback, double dampFact,
+                          double sampleRate, double pitchMod)
+{
+    double    vm1[8], v0[8], v1[8], v2[8], frac[8];
+    double    ainL, ainR, aoutL, aoutR, junction;
+    uint32_t  i;
+    int       n;
+
+    for (i = offset; i < nsmps; i++) {
+      /* calculate "resultant junction pressure" and mix to input signals */
+      junction = 0.0;
+      for (n = 0; n < 8; n++)
+        junction += lp->filterState[n];
+      junction *= jpScale;
+      ainR = junction + (double) inR[i];
+      ainL = junction + (double) inL[i];
+      /* send input signal and feedback to delay lines, */
+      /* and read four samples for interpolation        */
+      for (n = 0; n < 8; n++) {
+        MYFLT *buf = lp->buf[n];
+        int   bufferSize = lp->bufferSize[n], readPos;
+
+        buf[lp->writePos[n]] = (MYFLT) ((n & 1 ? ainR : ainL)
+                                        - lp->filterState[n]);
+        if (UNLIKELY(++lp->writePos[n] >= bufferSize))
+          lp->writePos[n] -= bufferSize;
+        if (lp->readPosFrac[n] >= DELAYPOS_SCALE) {
+          lp->readPos[n] += (lp->readPosFrac[n] >> DELAYPOS_SHIFT);
+          lp->readPosFrac[n] &= DELAYPOS_MASK;
+        }
+        if (UNLIKELY(lp->readPos[n] >= bufferSize))
+          lp->readPos[n] -= bufferSize;
+        readPos = lp->readPos[n];
+        frac[n] = (double) lp->readPosFrac[n] * (1.0 / (double) DELAYPOS_SCALE);
+        if (readPos > 0 && readPos < (bufferSize - 2)) {
+          vm1[n] = (double) buf[readPos - 1];
+          v0[n]  = (double) buf[readPos];
+          v1[n]  = (double) buf[readPos + 1];
+          v2[n]  = (double) buf[readPos + 2];
+        }
+        else {
+          /* at buffer wrap-around, need to check index */
+          if (--readPos < 0) readPos += bufferSize;
+          vm1[n] = (double) buf[readPos];
+          if (++readPos >= bufferSize) readPos -= bufferSize;
+          v0[n] = (double) buf[readPos];
+          if (++readPos >= bufferSize) readPos -= bufferSize;
+          v1[n] = (double) buf[readPos];
+          if (++readPos >= bufferSize) readPos -= bufferSize;
+          v2[n] = (double) buf[readPos];
+        }
+      }
+      /* cubic interpolation, feedback gain and lowpass filter */
+      for (n = 0; n < 8; n++) {
+        double  am1, a0, a1, a2, v;
+
+        /* calculate interpolation coefficients */
+        a2 = frac[n] * frac[n]; a2 -= 1.0; a2 *= (1.0 / 6.0);
+        a1 = frac[n]; a1 += 1.0; a1 *= 0.5; am1 = a1 - 1.0;
+        a0 = 3.0 * a2; a1 -= a0; am1 -= a2; a0 -= frac[n];
+        v = (am1 * vm1[n] + a0 * v0[n] + a1 * v1[n] + a2 * v2[n]) * frac[n]
+            + v0[n];
+        /* update buffer read position */
+        lp->readPosFrac[n] += lp->readPosFrac_inc[n];
+        /* apply feedback gain and lowpass filter */
+        v *= feedback;
+        lp->filterState[n] = (lp->filterState[n] - v) * dampFact + v;
+      }
+      /* mix to output */
+      aoutL = lp->filterState[0] + lp->filterState[2]
+              + lp->filterState[4] + lp->filterState[6];
+      aoutR = lp->filterState[1] + lp->filterState[3]
+              + lp->filterState[5] + lp->filterState[7];
+      /* start next random line segment if current one has reached endpoint */
+      for (n = 0; n < 8; n++) {
+        if (--(lp->randLine_cnt[n]) <= 0)
+          next_random_lineseg(lp, n, sampleRate, pitchMod);
+      }
+      outL[i] = (MYFLT) (aoutL * outputGain);
+      outR[i] = (MYFLT) (aoutR * outputGain);
+    }
+}
+
 static int sc_reverb_perf(CSOUND *csound, SC_REVERB *p)
 {
-    double    ainL, ainR, aoutL, aoutR;
-    double    vm1, v0, v1, v2, am1, a0, a1, a2, frac;
-    delayLine *lp;
-    int       readPos;
     uint32_t offset = p->h.insdshead->ksmps_offset;
     uint32_t early  = p->h.insdshead->ksmps_no_end;
-    uint32_t i, n, nsmps = CS_KSMPS;
-    int       bufferSize; /* Local copy */
-    double    dampFact = p->dampFact;
+    uint32_t nsmps = CS_KSMPS;
 
     if (p->initDone <= 0) goto err1;
     /* calculate tone filter coefficient if frequency changed */
     if (*(p->kLPFreq) != p->prv_LPFreq) {
       p->prv_LPFreq = *(p->kLPFreq);
-      dampFact = 2.0 - cos(p->prv_LPFreq * TWOPI / p->sampleRate);
-      dampFact = p->dampFact = dampFact - sqrt(dampFact * dampFact - 1.0);
+      p->dampFact = sc_reverb_damp((double) p->prv_LPFreq, p->sampleRate);
     }
     if (UNLIKELY(offset)) {
       memset(p->aoutL, '\0', offset*sizeof(MYFLT));
@@ -230,73 +352,84 @@ static int sc_reverb_perf(CSOUND *csound, SC_REVERB *p)
       memset(&p->aoutL[nsmps], '\0', early*sizeof(MYFLT));
       memset(&p->aoutR[nsmps], '\0', early*sizeof(MYFLT));
     }
-    /* update delay lines */
-    for (i = offset; i < nsmps; i++) {
-      /* calculate "resultant junction pressure" and mix to input signals */
-      ainL = aoutL = aoutR = 0.0;
-      for (n = 0; n < 8; n++)
-        ainL += p->delayLines[n]->filterState;
-      ainL *= jpScale;
-      ainR = ainL + (double) p->ainR[i];
-      ainL = ainL + (double) p->ainL[i];
-      /* loop through all delay lines */
-      for (n = 0; n < 8; n++) {
-        lp = p->delayLines[n];
-        bufferSize = lp->bufferSize;
-        /* send input signal and feedback to delay line */
-        lp->buf[lp->writePos] = (MYFLT) ((n & 1 ? ainR : ainL)
-                                         - lp->filterState);
-        if (UNLIKELY(++lp->writePos >= bufferSize))
-          lp->writePos -= bufferSize;
-        /* read from delay line with cubic interpolation */
-        if (lp->readPosFrac >= DELAYPOS_SCALE) {
-          lp->readPos += (lp->readPosFrac >> DELAYPOS_SHIFT);
-          lp->readPosFrac &= DELAYPOS_MASK;
-        }
-        if (UNLIKELY(lp->readPos >= bufferSize))
-          lp->readPos -= bufferSize;
-        readPos = lp->readPos;
-        frac = (double) lp->readPosFrac * (1.0 / (double) DELAYPOS_SCALE);
-        /* calculate interpolation coefficients */
-        a2 = frac * frac; a2 -= 1.0; a2 *= (1.0 / 6.0);
-        a1 = frac; a1 += 1.0; a1 *= 0.5; am1 = a1 - 1.0;
-        a0 = 3.0 * a2; a1 -= a0; am1 -= a2; a0 -= frac;
-        /* read four samples for interpolation */
-        if (readPos > 0 && readPos < (bufferSize - 2)) {
-          vm1 = (double) (lp->buf[readPos - 1]);
-          v0  = (double) (lp->buf[readPos]);
-          v1  = (double) (lp->buf[readPos + 1]);
-          v2  = (double) (lp->buf[readPos + 2]);
-        }
-        else {
-          /* at buffer wrap-around, need to check index */
-          if (--readPos < 0) readPos += bufferSize;
-          vm1 = (double) lp->buf[readPos];
-          if (++readPos >= bufferSize) readPos -= bufferSize;
-          v0 = (double) lp->buf[readPos];
-          if (++readPos >= bufferSize) readPos -= bufferSize;
-          v1 = (double) lp->buf[readPos];
-          if (++readPos >= bufferSize) readPos -= bufferSize;
-          v2 = (double) lp->buf[readPos];
-        }
-        v0 = (am1 * vm1 + a0 * v0 + a1 * v1 + a2 * v2) * frac + v0;
-        /* update buffer read position */
-        lp->readPosFrac += lp->readPosFrac_inc;
-        /* apply feedback gain and lowpass filter */
-        v0 *= (double) *(p->kFeedBack);
-        v0 = (lp->filterState - v0) * dampFact + v0;
-        lp->filterState = v0;
-        /* mix to output */
-        if (n & 1)
-          aoutR += v0;
-        else
-          aoutL += v0;
-        /* start next random line segment if current one has reached endpoint */
-        if (--(lp->randLine_cnt) <= 0)
-          next_random_lineseg(p, lp, n);
+    sc_reverb_run(&(p->lines), p->ainL, p->ainR, p->aoutL, p->aoutR,
+                  offset, nsmps, (double) *(p->kFeedBack), p->dampFact,
+                  p->sampleRate, (double) *(p->iPitchMod));
+
+    return OK;
+ err1:
+    return csound->PerfError(csound, p->h.insdshead,
+                             Str("reverbsc: not initialised"));
+}
+
+static int sc_reverb_init_a(CSOUND *csound, SC_REVERB_A *p)
+{
+    size_t  nBytes;
+    int     nSamples, i;
+
+    if (UNLIKELY(p->ainL->data == NULL || p->ainR->data == NULL ||
+                 p->aoutL->data == NULL || p->aoutR->data == NULL))
+      return csound->InitError(csound, Str("reverbsc: array not initialised"));
+    p->nBusses = p->ainL->sizes[0];
+    if (UNLIKELY(p->ainR->sizes[0] != p->nBusses ||
+                 p->aoutL->sizes[0] < p->nBusses ||
+                 p->aoutR->sizes[0] < p->nBusses))
+      return csound->InitError(csound,
+                               Str("reverbsc: array sizes do not match"));
+    if (UNLIKELY(sc_reverb_check(csound, *(p->iSampleRate), *(p->iPitchMod),
+                                 &(p->sampleRate)) != OK))
+      return NOTOK;
+    nSamples = delay_lines_samples(p->sampleRate, *(p->iPitchMod));
+    nBytes = sizeof(MYFLT) * (size_t) nSamples * (size_t) p->nBusses;
+    if (nBytes != p->auxData.size ||
+        sizeof(delayLines) * (size_t) p->nBusses != p->lines.size) {
+      csound->AuxAlloc(csound, nBytes, &(p->auxData));
+      csound->AuxAlloc(csound, sizeof(delayLines) * (size_t) p->nBusses,
+                       &(p->lines));
+    }
+    else if (p->initDone && *(p->iSkipInit) != FL(0.0))
+      return OK;    /* skip initialisation if requested */
+    for (i = 0; i < p->nBusses; i++)
+      init_delay_lines((delayLines*) p->lines.auxp + i,
+                       (MYFLT*) p->auxData.auxp + (size_t) i * nSamples,
+                       p->sampleRate, (double) *(p->iPitchMod));
+    p->dampFact = 1.0;
+    p->prv_LPFreq = FL(0.0);
+    p->initDone = 1;
+
+    return OK;
+}
+
+static int sc_reverb_perf_a(CSOUND *csound, SC_REVERB_A *p)
+{
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t ksmps = CS_KSMPS, nsmps = ksmps - early;
+    int      i;
+
+    if (p->initDone <= 0) goto err1;
+    /* calculate tone filter coefficient if frequency changed */
+    if (*(p->kLPFreq) != p->prv_LPFreq) {
+      p->prv_LPFreq = *(p->kLPFreq);
+      p->dampFact = sc_reverb_damp((double) p->prv_LPFreq, p->sampleRate);
+    }
+    for (i = 0; i < p->nBusses; i++) {
+      MYFLT *aoutL = p->aoutL->data + (size_t) i * ksmps;
+      MYFLT *aoutR = p->aoutR->data + (size_t) i * ksmps;
+
+      if (UNLIKELY(offset)) {
+        memset(aoutL, '\0', offset*sizeof(MYFLT));
+        memset(aoutR, '\0', offset*sizeof(MYFLT));
+      }
+      if (UNLIKELY(early)) {
+        memset(&aoutL[nsmps], '\0', early*sizeof(MYFLT));
+        memset(&aoutR[nsmps], '\0', early*sizeof(MYFLT));
       }
-      p->aoutL[i] = (MYFLT) (aoutL * outputGain);
-      p->aoutR[i] = (MYFLT) (aoutR * outputGain);
+      sc_reverb_run((delayLines*) p->lines.auxp + i,
+                    p->ainL->data + (size_t) i * ksmps,
+                    p->ainR->data + (size_t) i * ksmps, aoutL, aoutR,
+                    offset, nsmps, (double) *(p->kFeedBack), p->dampFact,
+                    p->sampleRate, (double) *(p->iPitchMod));
     }
 
     return OK;
@@ -307,12 +440,17 @@ static int sc_reverb_perf(CSOUND *csound, SC_REVERB *p)
 
 /* module interface functions */
 
+#define S(x)    sizeof(x)
+
+static OENTRY localops[] = {
+  { "reverbsc", S(SC_REVERB), 0, 5, "aa", "aakkjpo",
+    (SUBR) sc_reverb_init, (SUBR) NULL, (SUBR) sc_reverb_perf },
+  { "reverbsc.A", S(SC_REVERB_A), 0, 5, "a[]a[]", "a[]a[]kkjpo",
+    (SUBR) sc_reverb_init_a, (SUBR) NULL, (SUBR) sc_reverb_perf_a }
+};
+
 int reverbsc_init_(CSOUND *csound)
 {
-    return csound->AppendOpcode(csound, "reverbsc",
-                                (int) sizeof(SC_REVERB), 0, 5, "aa", "aakkjpo",
-                                (int (*)(CSOUND *, void *)) sc_reverb_init,
-                                (int (*)(CSOUND *, void *)) NULL,
-                                (int (*)(CSOUND *, void *)) sc_reverb_perf);
+    return csound->AppendOpcodes(csound, &(localops[0]),
+                                 (int) (sizeof(localops) / sizeof(OENTRY)));
 }
-
@@ -125,6 +125,8 @@ struct _SFBANK {
         instrType *instr;
         SHORT *sampleData;
         CHUNKS chunk;
+        void *mapBase;          /* file mapping holding the chunks, or NULL */
+        size_t mapSize;
 } PACKED;
 typedef struct _SFBANK SFBANK;
 
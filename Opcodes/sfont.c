@@ -39,18 +39,28 @@
 #include <errno.h>
 #include "sfenum.h"
 #include "sfont.h"
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H) && !defined(WIN32)
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  define SFONT_MMAP 1
+#endif
 
 #define s2d(x)  *((DWORD *) (x))
 
 
 
 static int chunk_read(CSOUND *, FILE *f, CHUNK *chunk);
+#ifdef SFONT_MMAP
+static int chunk_map(CSOUND *, FILE *f, SFBANK *sf);
+#endif
 static void fill_SfPointers(CSOUND *);
 static int  fill_SfStruct(CSOUND *);
 static void layerDefaults(layerType *layer);
 static void splitDefaults(splitType *split);
 
-#define MAX_SFONT               (10)
+#define SFONT_TABLE_SIZE        (8)     /* initial size, grows as needed */
 #define MAX_SFPRESET            (16384)
 #define GLOBAL_ATTENUATION      (FL(0.3))
 
@@ -88,7 +98,12 @@ int sfont_ModuleDestroy(CSOUND *csound)
         csound->Free(csound, sfArray[j].instr[l].split);
       }
       csound->Free(csound, sfArray[j].instr);
-      csound->Free(csound, sfArray[j].chunk.main_chunk.ckDATA);
+#ifdef SFONT_MMAP
+      if (sfArray[j].mapBase != NULL)
+        munmap(sfArray[j].mapBase, sfArray[j].mapSize);
+      else
+#endif
+        csound->Free(csound, sfArray[j].chunk.main_chunk.ckDATA);
     }
     csound->Free(csound, sfArray);
     globals->currSFndx = 0;
@@ -99,7 +114,7 @@ int sfont_ModuleDestroy(CSOUND *csound)
     return 0;
 }
 
-static void SoundFontLoad(CSOUND *csound, char *fname)
+static int SoundFontLoad(CSOUND *csound, char *fname)
 {
     FILE *fil;
     void *fd;
@@ -113,7 +128,7 @@ static void SoundFontLoad(CSOUND *csound, char *fname)
       csound->ErrorMsg(csound,
                   Str("sfload: cannot open SoundFont file \"%s\" (error %s)"),
                   fname, strerror(errno));
-      return;
+      return NOTOK;
     }
     soundFont = &globals->sfArray[globals->currSFndx];
     /* if (UNLIKELY(soundFont==NULL)){ */
@@ -122,12 +137,21 @@ static void SoundFontLoad(CSOUND *csound, char *fname)
     /* } */
     strncpy(soundFont->name, csound->GetFileName(fd), 255);
     soundFont->name[255]='\0';
-    if (UNLIKELY(chunk_read(csound, fil, &soundFont->chunk.main_chunk)<0))
-      csound->Message(csound, Str("sfont: failed to read file\n"));
+    soundFont->mapBase = NULL;
+    soundFont->mapSize = 0;
+#ifdef SFONT_MMAP
+    if (chunk_map(csound, fil, soundFont) <= 0)
+#endif
+    if (UNLIKELY(chunk_read(csound, fil, &soundFont->chunk.main_chunk)<=0)) {
+      csound->ErrorMsg(csound, Str("sfont: failed to read file\n"));
+      csound->FileClose(csound, fd);
+      return NOTOK;
+    }
     csound->FileClose(csound, fd);
     globals->soundFont = soundFont;
     fill_SfPointers(csound);
     fill_SfStruct(csound);
+    return OK;
 }
 
 static int compare(presetType * elem1, presetType *elem2)
@@ -164,17 +188,21 @@ static int SfLoad_(CSOUND *csound, SFLOAD *p, int istring)
     }
     /*    strcpy(fname, (char*) p->fname); */
     Gfname = fname;
-    SoundFontLoad(csound, fname);
+    if (UNLIKELY(SoundFontLoad(csound, fname) != OK)) {
+      csound->Free(csound,fname);
+      return csound->InitError(csound, Str("sfload: could not load SoundFont"));
+    }
     *p->ihandle = (float) globals->currSFndx;
     sf = &globals->sfArray[globals->currSFndx];
     qsort(sf->preset, sf->presets_num, sizeof(presetType),
         (int (*)(const void *, const void * )) compare);
     csound->Free(csound,fname);
     if (UNLIKELY(++globals->currSFndx>=globals->maxSFndx)) {
-      globals->maxSFndx += 5;
-      globals->sfArray = (SFBANK *)realloc(globals->sfArray,
-                                           globals->maxSFndx*sizeof(SFBANK));
-      csound->Warning(csound, Str("Extending soundfonts"));
+      /* handles are indices, so the table may move */
+      globals->maxSFndx *= 2;
+      globals->sfArray = (SFBANK *)
+        csound->ReAlloc(csound, globals->sfArray,
+                        globals->maxSFndx*sizeof(SFBANK));
     }
     return OK;
 }
@@ -2010,6 +2038,41 @@ static int chunk_read(CSOUND *csound, FILE *fil, CHUNK *chunk)
     return fread(chunk->ckDATA,1,chunk->ckSize,fil);
 }
 
+#ifdef SFONT_MMAP
+/* Map the RIFF chunk of a SoundFont file instead of reading it.  Only the
+   pages holding the preset, instrument and sample headers are touched
+   when the font is loaded; sample data is paged in as it is played, and
+   the pages are shared with every other user of the file.  The mapping
+   is private, so the byte swapping on big-endian hosts stays local. */
+
+static int chunk_map(CSOUND *csound, FILE *fil, SFBANK *sf)
+{
+    CHUNK *chunk = &sf->chunk.main_chunk;
+    struct stat st;
+    void *base;
+
+    (void) csound;
+    if (fstat(fileno(fil), &st) != 0 || st.st_size < 8)
+      return 0;
+    base = mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE, fileno(fil), 0);
+    if (base == MAP_FAILED)
+      return 0;
+    memcpy(chunk->ckID, base, 4);
+    memcpy(&chunk->ckSize, (char *) base + 4, 4);
+    ChangeByteOrder("d", (char *)&chunk->ckSize, 4);
+    if (UNLIKELY((off_t) chunk->ckSize > st.st_size - 8)) {
+      /* truncated file: leave it to chunk_read */
+      munmap(base, (size_t) st.st_size);
+      return 0;
+    }
+    chunk->ckDATA = (BYTE *) base + 8;
+    sf->mapBase = base;
+    sf->mapSize = (size_t) st.st_size;
+    return 1;
+}
+#endif
+
 static DWORD dword(char *p)
 {
     union cheat {
@@ -2597,13 +2660,14 @@ int sfont_ModuleCreate(CSOUND *csound)
       return csound->InitError(csound,
                                Str("error... could not create sfont globals\n"));
 
-    globals->sfArray = (SFBANK *) csound->Malloc(csound, MAX_SFONT*sizeof(SFBANK));
+    globals->sfArray =
+      (SFBANK *) csound->Malloc(csound, SFONT_TABLE_SIZE*sizeof(SFBANK));
     globals->presetp =
       (presetType **) csound->Malloc(csound, MAX_SFPRESET *sizeof(presetType *));
     globals->sampleBase =
       (SHORT **) csound->Malloc(csound, MAX_SFPRESET*sizeof(SHORT *));
     globals->currSFndx = 0;
-    globals->maxSFndx = MAX_SFONT;
+    globals->maxSFndx = SFONT_TABLE_SIZE;
     for (j=0; j<128; j++) {
       globals->pitches[j] = (MYFLT) (440.0 * pow(2.0, (double)(j- 69)/12.0));
     }
@@ -103,6 +103,7 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cstdio>
 #include <cstring>
@@ -110,6 +111,7 @@
 #include <iostream>
 #include <map>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "OpcodeBase.hpp"
 #include <pstream.h>
@@ -136,7 +138,6 @@ struct AlwaysOn;
 struct FtGenOnce;
 
 static void* cs_sfg_ftables = 0;
-static void* cs_sfg_ports = 0;
 
 std::ostream &operator << (std::ostream &stream, const EVTBLK &a)
 {
@@ -219,30 +220,308 @@ bool operator < (const EventBlock &a, const EventBlock &b)
     return false;
 }
 
-// Identifiers are always "sourcename:outletname" and "sinkname:inletname",
-// or "sourcename:idname:outletname" and "sinkname:inletname."
+// Identifiers are always "sourcename:outletname" and "sinkname:inletname".
+// They are interned to small integer port ids when an outlet, inlet, or
+// connection first names them, so that no strings are compared after init.
+
+/**
+ * The instances of one outlet port.
+ *
+ * Instances are kept in an array of slots. Each instance remembers its
+ * slot, so that adding it at init time and removing it at note off take
+ * constant time; freed slots are reused. Inlets read the slots during
+ * performance without locking. When the array grows, the old array is
+ * retired rather than deleted, because an inlet may still be reading it.
+ * Writers must hold the registry mutex.
+ */
+template<typename T>
+struct OutletPort {
+    std::atomic<std::atomic<T *> *> slots;
+    std::atomic<size_t> slotCount;
+    size_t capacity;
+    std::vector<size_t> freeSlots;
+    std::vector<std::atomic<T *> *> retired;
+    OutletPort() : slots(0), slotCount(0), capacity(0)
+    {
+    }
+    ~OutletPort()
+    {
+        delete[] slots.load();
+        for (size_t i = 0, n = retired.size(); i < n; ++i) {
+            delete[] retired[i];
+        }
+    }
+    void add(T *outlet)
+    {
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = slotCount.load(std::memory_order_relaxed);
+            if (slot == capacity) {
+                size_t newCapacity = capacity ? capacity * 2 : 8;
+                std::atomic<T *> *oldSlots = slots.load(std::memory_order_relaxed);
+                std::atomic<T *> *newSlots = new std::atomic<T *>[newCapacity];
+                for (size_t i = 0; i < newCapacity; ++i) {
+                    newSlots[i].store(i < capacity ?
+                                      oldSlots[i].load(std::memory_order_relaxed) : 0,
+                                      std::memory_order_relaxed);
+                }
+                slots.store(newSlots, std::memory_order_release);
+                if (oldSlots) {
+                    retired.push_back(oldSlots);
+                }
+                capacity = newCapacity;
+            }
+        }
+        outlet->port = this;
+        outlet->slot = slot;
+        slots.load(std::memory_order_relaxed)[slot].store(outlet,
+                std::memory_order_release);
+        if (slot == slotCount.load(std::memory_order_relaxed)) {
+            slotCount.store(slot + 1, std::memory_order_release);
+        }
+    }
+    void remove(T *outlet)
+    {
+        slots.load(std::memory_order_relaxed)[outlet->slot].store(0,
+                std::memory_order_release);
+        freeSlots.push_back(outlet->slot);
+        outlet->port = 0;
+    }
+    /**
+     * Returns the number of slots and sets items to the slot array.
+     * Empty slots hold null. Safe to call during performance.
+     */
+    size_t read(std::atomic<T *> *&items) const
+    {
+        size_t n = slotCount.load(std::memory_order_acquire);
+        items = slots.load(std::memory_order_acquire);
+        return n;
+    }
+};
+
+/**
+ * The outlet ports connected to one inlet port. The list is immutable once
+ * published; a new connection publishes a new list and retires the old one.
+ */
+template<typename T>
+struct InletPort {
+    typedef std::vector<OutletPort<T> *> Sources;
+    std::atomic<const Sources *> sources;
+    std::vector<const Sources *> retired;
+    InletPort() : sources(new Sources)
+    {
+    }
+    ~InletPort()
+    {
+        delete sources.load();
+        for (size_t i = 0, n = retired.size(); i < n; ++i) {
+            delete retired[i];
+        }
+    }
+    void publish(const Sources *newSources)
+    {
+        retired.push_back(sources.load(std::memory_order_relaxed));
+        sources.store(newSources, std::memory_order_release);
+    }
+    const Sources &read() const
+    {
+        return *sources.load(std::memory_order_acquire);
+    }
+};
+
+/**
+ * Outlet and inlet ports of one signal type, indexed by port id.
+ */
+template<typename T>
+struct PortTable {
+    std::vector<OutletPort<T> *> outlets;
+    std::vector<InletPort<T> *> inlets;
+    ~PortTable()
+    {
+        clear();
+    }
+    void clear()
+    {
+        for (size_t i = 0, n = outlets.size(); i < n; ++i) {
+            delete outlets[i];
+        }
+        for (size_t i = 0, n = inlets.size(); i < n; ++i) {
+            delete inlets[i];
+        }
+        outlets.clear();
+        inlets.clear();
+    }
+};
+
+/**
+ * All ports and connections of one instance of Csound, stored in the
+ * global variable "signalflowgraph::ports". The mutex serializes init time
+ * and note off changes, which may come from an init thread as well as the
+ * performance thread; performance code never takes it.
+ */
+struct PortRegistry {
+    void *mutex;
+    std::string key;
+    std::unordered_map<std::string, int> idsForNames;
+    std::unordered_map<std::string, int> instanceIdsForNames;
+    std::vector< std::vector<int> > sourceIdsForSinkIds;
+    PortTable<Outleta> aports;
+    PortTable<Outletk> kports;
+    PortTable<Outletf> fports;
+    PortTable<Outletv> vports;
+    PortTable<Outletkid> kidports;
+    PortRegistry(CSOUND *csound) : mutex(csound->Create_Mutex(1))
+    {
+    }
+    static PortRegistry *get(CSOUND *csound)
+    {
+        PortRegistry **registry = (PortRegistry **)
+            csound->QueryGlobalVariable(csound, "signalflowgraph::ports");
+        return registry ? *registry : 0;
+    }
+    PortTable<Outleta> &table(const Outleta *)
+    {
+        return aports;
+    }
+    PortTable<Outletk> &table(const Outletk *)
+    {
+        return kports;
+    }
+    PortTable<Outletf> &table(const Outletf *)
+    {
+        return fports;
+    }
+    PortTable<Outletv> &table(const Outletv *)
+    {
+        return vports;
+    }
+    PortTable<Outletkid> &table(const Outletkid *)
+    {
+        return kidports;
+    }
+    int intern(const std::string &name)
+    {
+        std::unordered_map<std::string, int>::const_iterator it =
+            idsForNames.find(name);
+        if (it != idsForNames.end()) {
+            return it->second;
+        }
+        int id = (int) idsForNames.size();
+        idsForNames.insert(std::make_pair(name, id));
+        sourceIdsForSinkIds.resize(id + 1);
+        return id;
+    }
+    /**
+     * Returns the id of the port Sname of the instrument running opds.
+     */
+    int portId(CSOUND *csound, const OPDS &opds, const STRINGDAT *Sname)
+    {
+        int insno = opds.insdshead->insno;
+        const char *insname = csound->GetInstrumentList(csound)[insno]->insname;
+        if (insname) {
+            key.assign(insname);
+        } else {
+            key = std::to_string(insno);
+        }
+        key += ':';
+        key += (const char *) Sname->data;
+        return intern(key);
+    }
+    int instanceId(const char *name)
+    {
+        std::unordered_map<std::string, int>::const_iterator it =
+            instanceIdsForNames.find(name);
+        if (it != instanceIdsForNames.end()) {
+            return it->second;
+        }
+        int id = (int) instanceIdsForNames.size();
+        instanceIdsForNames.insert(std::make_pair(std::string(name), id));
+        return id;
+    }
+    template<typename T>
+    OutletPort<T> *outletPort(int id)
+    {
+        PortTable<T> &ports = table((const T *) 0);
+        if ((size_t) id >= ports.outlets.size()) {
+            ports.outlets.resize(id + 1, 0);
+        }
+        if (!ports.outlets[id]) {
+            ports.outlets[id] = new OutletPort<T>;
+        }
+        return ports.outlets[id];
+    }
+    template<typename T>
+    const typename InletPort<T>::Sources *sources(int sinkId)
+    {
+        typename InletPort<T>::Sources *sources =
+            new typename InletPort<T>::Sources;
+        const std::vector<int> &sourceIds = sourceIdsForSinkIds[sinkId];
+        for (size_t i = 0, n = sourceIds.size(); i < n; ++i) {
+            sources->push_back(outletPort<T>(sourceIds[i]));
+        }
+        return sources;
+    }
+    template<typename T>
+    InletPort<T> *inletPort(int id)
+    {
+        PortTable<T> &ports = table((const T *) 0);
+        if ((size_t) id >= ports.inlets.size()) {
+            ports.inlets.resize(id + 1, 0);
+        }
+        if (!ports.inlets[id]) {
+            ports.inlets[id] = new InletPort<T>;
+            ports.inlets[id]->publish(sources<T>(id));
+        }
+        return ports.inlets[id];
+    }
+    template<typename T>
+    void reconnect(int sinkId)
+    {
+        PortTable<T> &ports = table((const T *) 0);
+        if ((size_t) sinkId < ports.inlets.size() && ports.inlets[sinkId]) {
+            ports.inlets[sinkId]->publish(sources<T>(sinkId));
+        }
+    }
+    void connect(const std::string &sourceOutletId, const std::string &sinkInletId)
+    {
+        int sourceId = intern(sourceOutletId);
+        int sinkId = intern(sinkInletId);
+        std::vector<int> &sourceIds = sourceIdsForSinkIds[sinkId];
+        if (std::find(sourceIds.begin(), sourceIds.end(), sourceId) != sourceIds.end()) {
+            return;
+        }
+        sourceIds.push_back(sourceId);
+        // Inlets already running see the new connection at their next
+        // k-period.
+        reconnect<Outleta>(sinkId);
+        reconnect<Outletk>(sinkId);
+        reconnect<Outletf>(sinkId);
+        reconnect<Outletv>(sinkId);
+        reconnect<Outletkid>(sinkId);
+    }
+    void clear()
+    {
+        aports.clear();
+        kports.clear();
+        fports.clear();
+        vports.clear();
+        kidports.clear();
+        sourceIdsForSinkIds.clear();
+        idsForNames.clear();
+        instanceIdsForNames.clear();
+    }
+};
 
-std::map<CSOUND *, std::map< std::string, std::vector< Outleta * > > > aoutletsForCsoundsForSourceOutletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Outletk * > > > koutletsForCsoundsForSourceOutletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Outletf * > > > foutletsForCsoundsForSourceOutletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Outletv * > > > voutletsForCsoundsForSourceOutletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Outletkid * > > > kidoutletsForCsoundsForSourceOutletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Inleta * > > > ainletsForCsoundsForSinkInletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Inletk * > > > kinletsForCsoundsForSinkInletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Inletf * > > > finletsForCsoundsForSinkInletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Inletv * > > > vinletsForCsoundsForSinkInletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< Inletkid * > > > kidinletsForCsoundsForSinkInletIds;
-std::map<CSOUND *, std::map< std::string, std::vector< std::string > > > connectionsForCsounds;
 std::map<CSOUND *, std::map< EventBlock, int > > functionTablesForCsoundsForEvtblks;
-std::map<CSOUND *, std::vector< std::vector< std::vector<Outleta *> *> * > > aoutletVectorsForCsounds;
-std::map<CSOUND *, std::vector< std::vector< std::vector<Outletk *> *> * > > koutletVectorsForCsounds;
-std::map<CSOUND *, std::vector< std::vector< std::vector<Outletf *> *> * > > foutletVectorsForCsounds;
-std::map<CSOUND *, std::vector< std::vector< std::vector<Outletv *> *> * > > voutletVectorsForCsounds;
-std::map<CSOUND *, std::vector< std::vector< std::vector<Outletkid *> *> * > > kidoutletVectorsForCsounds;
 
 // For true thread-safety, access to shared data must be protected.
-// We will use one critical section for each logically independent
-// potential data race here: ports and ftables.
+// Ports are protected by the mutex of each registry, function tables
+// by one critical section shared by all instances of Csound.
+
+static void clearFunctionTables(CSOUND *csound);
 
 /**
  * All it does is clear the data structures for the current instance of Csound,
@@ -252,10 +531,59 @@ struct SignalFlowGraph : public OpcodeBase<SignalFlowGraph> {
     int init(CSOUND *csound)
     {
         warn(csound, "signalflowgraph::init(0x%p)\n", csound);
-        return csoundModuleDestroy(csound);
+        PortRegistry *registry = PortRegistry::get(csound);
+        if (registry) {
+            csound->LockMutex(registry->mutex);
+            registry->clear();
+            csound->UnlockMutex(registry->mutex);
+        }
+        clearFunctionTables(csound);
+        return OK;
     };
 };
 
+/**
+ * Registers an outlet instance with its port, once per instance, and
+ * removes it again at note off.
+ */
+template<typename T>
+static void addOutlet(CSOUND *csound, T *outlet, const STRINGDAT *Sname)
+{
+    PortRegistry *registry = PortRegistry::get(csound);
+    csound->LockMutex(registry->mutex);
+    if (!outlet->port) {
+        int id = registry->portId(csound, outlet->opds, Sname);
+        registry->outletPort<T>(id)->add(outlet);
+    }
+    csound->UnlockMutex(registry->mutex);
+}
+
+template<typename T>
+static void removeOutlet(CSOUND *csound, T *outlet)
+{
+    PortRegistry *registry = PortRegistry::get(csound);
+    if (registry && outlet->port) {
+        csound->LockMutex(registry->mutex);
+        outlet->port->remove(outlet);
+        csound->UnlockMutex(registry->mutex);
+    }
+}
+
+/**
+ * Finds the inlet port of an inlet instance, which knows the outlet
+ * ports connected to it.
+ */
+template<typename T, typename I>
+static InletPort<T> *findInlet(CSOUND *csound, I *inlet, const STRINGDAT *Sname)
+{
+    PortRegistry *registry = PortRegistry::get(csound);
+    csound->LockMutex(registry->mutex);
+    int id = registry->portId(csound, inlet->opds, Sname);
+    InletPort<T> *sink = registry->inletPort<T>(id);
+    csound->UnlockMutex(registry->mutex);
+    return sink;
+}
+
 struct Outleta : public OpcodeNoteoffBase<Outleta> {
     /**
      * Inputs.
@@ -265,41 +593,16 @@ struct Outleta : public OpcodeNoteoffBase<Outleta> {
     /**
      * State.
      */
-    char sourceOutletId[0x100];
+    OutletPort<Outleta> *port;
+    size_t slot;
     int init(CSOUND *csound)
     {
-        //warn(csound, "BEGAN Outleta::init()...\n");
-        csound->LockMutex(cs_sfg_ports);
-        {
-            sourceOutletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Outleta *> &aoutlets =
-                aoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-            if (std::find(aoutlets.begin(), aoutlets.end(), this) == aoutlets.end()) {
-                aoutlets.push_back(this);
-                warn(csound, "Created instance 0x%x of %d instances of outlet %s\n",
-                     this, aoutlets.size(), sourceOutletId);
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
-        //warn(csound, "ENDED Outleta::init()...\n");
+        addOutlet(csound, this, Sname);
         return OK;
     }
     int noteoff(CSOUND *csound)
     {
-        std::vector<Outleta *> &aoutlets =
-            aoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-        std::vector<Outleta *>::iterator thisoutlet = std::find(aoutlets.begin(), aoutlets.end(), this);
-        aoutlets.erase(thisoutlet);
-        warn(csound, "Removed instance 0x%x of %d instances of outleta %s\n",
-             this, aoutlets.size(), sourceOutletId);
+        removeOutlet(csound, this);
         return OK;
     }
 };
@@ -316,61 +619,12 @@ struct Inleta : public OpcodeBase<Inleta> {
     /**
      * State.
      */
-    char sinkInletId[0x100];
-    std::vector< std::vector<Outleta *> *> *sourceOutlets;
+    InletPort<Outleta> *inletPort;
     int sampleN;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            warn(csound, "BEGAN Inleta::init()...\n");
-            sampleN = opds.insdshead->ksmps;
-            warn(csound, "sourceOutlets: 0x%x\n", sourceOutlets);
-            //think problem is here
-            //should always create
-            if (std::find(aoutletVectorsForCsounds[csound].begin(),
-                          aoutletVectorsForCsounds[csound].end(),
-                          sourceOutlets) == aoutletVectorsForCsounds[csound].end()) {
-                sourceOutlets = new std::vector< std::vector<Outleta *> *>;
-                aoutletVectorsForCsounds[csound].push_back(sourceOutlets);
-            } else {
-                sourceOutlets->clear();
-            }
-            warn(csound, "sourceOutlets: 0x%x\n", sourceOutlets);
-            sinkInletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sinkInletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sinkInletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Inleta *> &ainlets =
-                ainletsForCsoundsForSinkInletIds[csound][sinkInletId];
-            if (std::find(ainlets.begin(), ainlets.end(), this) == ainlets.end()) {
-                ainlets.push_back(this);
-                warn(csound, "Created instance 0x%x of inlet %s\n", this, sinkInletId);
-            }
-            // Find source outlets connecting to this.
-            // Any number of sources may connect to any number of sinks.
-            std::vector<std::string> &sourceOutletIds =
-                connectionsForCsounds[csound][sinkInletId];
-            for (size_t i = 0, n = sourceOutletIds.size(); i < n; i++) {
-                const std::string &sourceOutletId = sourceOutletIds[i];
-                std::vector<Outleta *> &aoutlets =
-                    aoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-                if (std::find(sourceOutlets->begin(), sourceOutlets->end(),
-                              &aoutlets) == sourceOutlets->end()) {
-                    sourceOutlets->push_back(&aoutlets);
-                    warn(csound,
-                         Str("Connected instances of outlet %s to instance 0x%x of "
-                             "inlet %s.\n"), sourceOutletId.c_str(), this, sinkInletId);
-                }
-            }
-            warn(csound, "ENDED Inleta::init().\n");
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        sampleN = opds.insdshead->ksmps;
+        inletPort = findInlet<Outleta>(csound, this, Sname);
         return OK;
     }
     /**
@@ -378,34 +632,30 @@ struct Inleta : public OpcodeBase<Inleta> {
      */
     int audio(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            //warn(csound, "BEGAN Inleta::audio()...\n");
-            // Zero the inlet buffer.
-            for (int sampleI = 0; sampleI < sampleN; sampleI++) {
-                asignal[sampleI] = FL(0.0);
-            }
-            // Loop over the source connections...
-            for (size_t sourceI = 0, sourceN = sourceOutlets->size();
-                    sourceI < sourceN;
-                    sourceI++) {
-                // Loop over the source connection instances...
-                std::vector<Outleta *> *instances = sourceOutlets->at(sourceI);
-                for (size_t instanceI = 0, instanceN = instances->size();
-                        instanceI < instanceN;
-                        instanceI++) {
-                    Outleta *sourceOutlet = instances->at(instanceI);
-                    // Skip inactive instances.
-                    if (sourceOutlet->opds.insdshead->actflg) {
-                        for (int sampleI = 0, sampleN = ksmps(); sampleI < sampleN; ++sampleI) {
-                            asignal[sampleI] += sourceOutlet->asignal[sampleI];
-                        }
+        // Zero the inlet buffer.
+        for (int sampleI = 0; sampleI < sampleN; sampleI++) {
+            asignal[sampleI] = FL(0.0);
+        }
+        // Loop over the source connections...
+        const InletPort<Outleta>::Sources &sources = inletPort->read();
+        for (size_t sourceI = 0, sourceN = sources.size();
+                sourceI < sourceN;
+                sourceI++) {
+            // Loop over the source connection instances...
+            std::atomic<Outleta *> *instances;
+            for (size_t instanceI = 0, instanceN = sources[sourceI]->read(instances);
+                    instanceI < instanceN;
+                    instanceI++) {
+                const Outleta *sourceOutlet =
+                    instances[instanceI].load(std::memory_order_acquire);
+                // Skip empty slots and inactive instances.
+                if (sourceOutlet && sourceOutlet->opds.insdshead->actflg) {
+                    for (int sampleI = 0; sampleI < sampleN; ++sampleI) {
+                        asignal[sampleI] += sourceOutlet->asignal[sampleI];
                     }
                 }
             }
-            //warn(csound, "ENDED Inleta::audio().\n");
         }
-        csound->UnlockMutex(cs_sfg_ports);
         return OK;
     }
 };
@@ -419,38 +669,16 @@ struct Outletk : public OpcodeNoteoffBase<Outletk> {
     /**
      * State.
      */
-    char sourceOutletId[0x100];
+    OutletPort<Outletk> *port;
+    size_t slot;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Outletk *> &koutlets =
-                koutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-            if (std::find(koutlets.begin(), koutlets.end(), this) == koutlets.end()) {
-                koutlets.push_back(this);
-                warn(csound, Str("Created instance 0x%x of %d instances of outlet %s\n"),
-                     this, koutlets.size(), sourceOutletId);
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        addOutlet(csound, this, Sname);
         return OK;
     }
     int noteoff(CSOUND *csound)
     {
-        std::vector<Outletk *> &koutlets =
-            koutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-        std::vector<Outletk *>::iterator thisoutlet = std::find(koutlets.begin(), koutlets.end(), this);
-        koutlets.erase(thisoutlet);
-        warn(csound, "Removed 0x%x of %d instances of outletk %s\n",
-             this, koutlets.size(), sourceOutletId);
+        removeOutlet(csound, this);
         return OK;
     }
 };
@@ -467,56 +695,10 @@ struct Inletk : public OpcodeBase<Inletk> {
     /**
      * State.
      */
-    char sinkInletId[0x100];
-    std::vector< std::vector<Outletk *> *> *sourceOutlets;
-    int ksmps;
+    InletPort<Outletk> *inletPort;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-
-            ksmps = opds.insdshead->ksmps;
-            if (std::find(koutletVectorsForCsounds[csound].begin(),
-                          koutletVectorsForCsounds[csound].end(),
-                          sourceOutlets) == koutletVectorsForCsounds[csound].end()) {
-                sourceOutlets = new std::vector< std::vector<Outletk *> *>;
-                koutletVectorsForCsounds[csound].push_back(sourceOutlets);
-            } else {
-                sourceOutlets->clear();
-            }
-            sinkInletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sinkInletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sinkInletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Inletk *> &kinlets =
-                kinletsForCsoundsForSinkInletIds[csound][sinkInletId];
-            if (std::find(kinlets.begin(), kinlets.end(), this) == kinlets.end()) {
-                kinlets.push_back(this);
-                warn(csound, "Created instance 0x%x of inlet %s\n", this, sinkInletId);
-            }
-            // Find source outlets connecting to this.
-            // Any number of sources may connect to any number of sinks.
-            std::vector<std::string> &sourceOutletIds =
-                connectionsForCsounds[csound][sinkInletId];
-            for (size_t i = 0, n = sourceOutletIds.size(); i < n; i++) {
-                const std::string &sourceOutletId = sourceOutletIds[i];
-                std::vector<Outletk *> &koutlets =
-                    koutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-                if (std::find(sourceOutlets->begin(),
-                              sourceOutlets->end(), &koutlets) == sourceOutlets->end()) {
-                    sourceOutlets->push_back(&koutlets);
-                    warn(csound, Str("Connected instances of outlet %s to instance 0x%x"
-                                     "of inlet %s.\n"),
-                         sourceOutletId.c_str(), this, sinkInletId);
-                }
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        inletPort = findInlet<Outletk>(csound, this, Sname);
         return OK;
     }
     /**
@@ -524,27 +706,26 @@ struct Inletk : public OpcodeBase<Inletk> {
      */
     int kontrol(CSOUND *csound)
     {
-        {
-            // Zero the inlet buffer.
-            *ksignal = FL(0.0);
-            // Loop over the source connections...
-            for (size_t sourceI = 0, sourceN = sourceOutlets->size();
-                    sourceI < sourceN;
-                    sourceI++) {
-                // Loop over the source connection instances...
-                const std::vector<Outletk *> *instances = sourceOutlets->at(sourceI);
-                for (size_t instanceI = 0, instanceN = instances->size();
-                        instanceI < instanceN;
-                        instanceI++) {
-                    const Outletk *sourceOutlet = instances->at(instanceI);
-                    // Skip inactive instances.
-                    if (sourceOutlet->opds.insdshead->actflg) {
-                        *ksignal += *sourceOutlet->ksignal;
-                    }
+        // Zero the inlet buffer.
+        *ksignal = FL(0.0);
+        // Loop over the source connections...
+        const InletPort<Outletk>::Sources &sources = inletPort->read();
+        for (size_t sourceI = 0, sourceN = sources.size();
+                sourceI < sourceN;
+                sourceI++) {
+            // Loop over the source connection instances...
+            std::atomic<Outletk *> *instances;
+            for (size_t instanceI = 0, instanceN = sources[sourceI]->read(instances);
+                    instanceI < instanceN;
+                    instanceI++) {
+                const Outletk *sourceOutlet =
+                    instances[instanceI].load(std::memory_order_acquire);
+                // Skip empty slots and inactive instances.
+                if (sourceOutlet && sourceOutlet->opds.insdshead->actflg) {
+                    *ksignal += *sourceOutlet->ksignal;
                 }
             }
         }
-        csound->UnlockMutex(cs_sfg_ports);
         return OK;
     }
 };
@@ -558,36 +739,16 @@ struct Outletf : public OpcodeNoteoffBase<Outletf> {
     /**
      * State.
      */
-    char sourceOutletId[0x100];
+    OutletPort<Outletf> *port;
+    size_t slot;
     int init(CSOUND *csound)
     {
-        {
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Outletf *> &foutlets =
-                foutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-            if (std::find(foutlets.begin(), foutlets.end(), this) == foutlets.end()) {
-                foutlets.push_back(this);
-                warn(csound, "Created instance 0x%x of outlet %s\n", this, sourceOutletId);
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        addOutlet(csound, this, Sname);
         return OK;
     }
     int noteoff(CSOUND *csound)
     {
-        std::vector<Outletf *> &foutlets =
-            foutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-        std::vector<Outletf *>::iterator thisoutlet = std::find(foutlets.begin(), foutlets.end(), this);
-        foutlets.erase(thisoutlet);
-        warn(csound, "Removed 0x%x of %d instances of outletf %s\n",
-             this, foutlets.size(), sourceOutletId);
+        removeOutlet(csound, this);
         return OK;
     }
 };
@@ -604,59 +765,16 @@ struct Inletf : public OpcodeBase<Inletf> {
     /**
      * State.
      */
-    char sinkInletId[0x100];
-    std::vector< std::vector<Outletf *> *> *sourceOutlets;
+    InletPort<Outletf> *inletPort;
     int ksmps;
     int lastframe;
     bool fsignalInitialized;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            ksmps = opds.insdshead->ksmps;
-            lastframe = 0;
-            fsignalInitialized = false;
-            if (std::find(foutletVectorsForCsounds[csound].begin(),
-                          foutletVectorsForCsounds[csound].end(),
-                          sourceOutlets) == foutletVectorsForCsounds[csound].end()) {
-                sourceOutlets = new std::vector< std::vector<Outletf *> *>;
-                foutletVectorsForCsounds[csound].push_back(sourceOutlets);
-            } else {
-                sourceOutlets->clear();
-            }
-            sinkInletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sinkInletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sinkInletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Inletf *> &finlets =
-                finletsForCsoundsForSinkInletIds[csound][sinkInletId];
-            if (std::find(finlets.begin(), finlets.end(), this) == finlets.end()) {
-                finlets.push_back(this);
-                warn(csound, "Created instance 0x%x of inlet %s\n", this, sinkInletId);
-            }
-            // Find source outlets connecting to this.
-            // Any number of sources may connect to any number of sinks.
-            std::vector<std::string> &sourceOutletIds =
-                connectionsForCsounds[csound][sinkInletId];
-            for (size_t i = 0, n = sourceOutletIds.size(); i < n; i++) {
-                const std::string &sourceOutletId = sourceOutletIds[i];
-                std::vector<Outletf *> &foutlets =
-                    foutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-                if (std::find(sourceOutlets->begin(),
-                              sourceOutlets->end(), &foutlets) == sourceOutlets->end()) {
-                    sourceOutlets->push_back(&foutlets);
-                    warn(csound,
-                         Str("Connected instances of outlet %s to instance 0x%x of inlet %s.\n"),
-                         sourceOutletId.c_str(), this, sinkInletId);
-                }
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        ksmps = opds.insdshead->ksmps;
+        lastframe = 0;
+        fsignalInitialized = false;
+        inletPort = findInlet<Outletf>(csound, this, Sname);
         return OK;
     }
     /**
@@ -665,90 +783,92 @@ struct Inletf : public OpcodeBase<Inletf> {
     int audio(CSOUND *csound)
     {
         int result = OK;
-        csound->LockMutex(cs_sfg_ports);
-        {
-            float *sink = 0;
-            float *source = 0;
-            CMPLX *sinkFrame = 0;
-            CMPLX *sourceFrame = 0;
-            // Loop over the source connections...
-            for (size_t sourceI = 0, sourceN = sourceOutlets->size();
-                    sourceI < sourceN;
-                    sourceI++) {
-                // Loop over the source connection instances...
-                const std::vector<Outletf *> *instances = sourceOutlets->at(sourceI);
-                for (size_t instanceI = 0, instanceN = instances->size();
-                        instanceI < instanceN;
-                        instanceI++) {
-                    const Outletf *sourceOutlet = instances->at(instanceI);
-                    // Skip inactive instances.
-                    if (sourceOutlet->opds.insdshead->actflg) {
-                        if (!fsignalInitialized) {
-                            int32 N = sourceOutlet->fsignal->N;
-                            if (UNLIKELY(sourceOutlet->fsignal == fsignal)) {
-                                csound->Warning(csound,
-                                                Str("Unsafe to have same fsig as in and out"));
-                            }
-                            fsignal->sliding = 0;
-                            if (sourceOutlet->fsignal->sliding) {
-                                if (fsignal->frame.auxp == NULL ||
-                                        fsignal->frame.size <
-                                        sizeof(MYFLT) * opds.insdshead->ksmps * (N + 2))
-                                    csound->AuxAlloc(csound,
-                                                     (N + 2) * sizeof(MYFLT) * opds.insdshead->ksmps,
-                                                     &fsignal->frame);
-                                fsignal->NB = sourceOutlet->fsignal->NB;
-                                fsignal->sliding = 1;
-                            } else if (fsignal->frame.auxp == NULL ||
-                                       fsignal->frame.size < sizeof(float) * (N + 2)) {
+        float *sink = 0;
+        float *source = 0;
+        CMPLX *sinkFrame = 0;
+        CMPLX *sourceFrame = 0;
+        // Loop over the source connections...
+        const InletPort<Outletf>::Sources &sources = inletPort->read();
+        for (size_t sourceI = 0, sourceN = sources.size();
+                sourceI < sourceN;
+                sourceI++) {
+            // Loop over the source connection instances...
+            std::atomic<Outletf *> *instances;
+            for (size_t instanceI = 0, instanceN = sources[sourceI]->read(instances);
+                    instanceI < instanceN;
+                    instanceI++) {
+                const Outletf *sourceOutlet =
+                    instances[instanceI].load(std::memory_order_acquire);
+                // Skip empty slots.
+                if (!sourceOutlet) {
+                    continue;
+                }
+                // Skip inactive instances.
+                if (sourceOutlet->opds.insdshead->actflg) {
+                    if (!fsignalInitialized) {
+                        int32 N = sourceOutlet->fsignal->N;
+                        if (UNLIKELY(sourceOutlet->fsignal == fsignal)) {
+                            csound->Warning(csound,
+                                            Str("Unsafe to have same fsig as in and out"));
+                        }
+                        fsignal->sliding = 0;
+                        if (sourceOutlet->fsignal->sliding) {
+                            if (fsignal->frame.auxp == NULL ||
+                                    fsignal->frame.size <
+                                    sizeof(MYFLT) * opds.insdshead->ksmps * (N + 2))
                                 csound->AuxAlloc(csound,
-                                                 (N + 2) * sizeof(float), &fsignal->frame);
-                            }
-                            fsignal->N = N;
-                            fsignal->overlap = sourceOutlet->fsignal->overlap;
-                            fsignal->winsize = sourceOutlet->fsignal->winsize;
-                            fsignal->wintype = sourceOutlet->fsignal->wintype;
-                            fsignal->format = sourceOutlet->fsignal->format;
-                            fsignal->framecount = 1;
-                            lastframe = 0;
-                            if (UNLIKELY(!(fsignal->format == PVS_AMP_FREQ) ||
-                                         (fsignal->format == PVS_AMP_PHASE)))
-                                result =
-                                    csound->InitError(csound, Str("inletf: signal format "
-                                                                  "must be amp-phase or amp-freq."));
-                            fsignalInitialized = true;
+                                                 (N + 2) * sizeof(MYFLT) * opds.insdshead->ksmps,
+                                                 &fsignal->frame);
+                            fsignal->NB = sourceOutlet->fsignal->NB;
+                            fsignal->sliding = 1;
+                        } else if (fsignal->frame.auxp == NULL ||
+                                   fsignal->frame.size < sizeof(float) * (N + 2)) {
+                            csound->AuxAlloc(csound,
+                                             (N + 2) * sizeof(float), &fsignal->frame);
                         }
-                        if (fsignal->sliding) {
-                            for (int frameI = 0; frameI < ksmps; frameI++) {
-                                sinkFrame = (CMPLX*) fsignal->frame.auxp + (fsignal->NB * frameI);
-                                sourceFrame =
-                                    (CMPLX*) sourceOutlet->fsignal->frame.auxp + (fsignal->NB * frameI);
-                                for (size_t binI = 0, binN = fsignal->NB; binI < binN; binI++) {
-                                    if (sourceFrame[binI].re > sinkFrame[binI].re) {
-                                        sinkFrame[binI] = sourceFrame[binI];
-                                    }
+                        fsignal->N = N;
+                        fsignal->overlap = sourceOutlet->fsignal->overlap;
+                        fsignal->winsize = sourceOutlet->fsignal->winsize;
+                        fsignal->wintype = sourceOutlet->fsignal->wintype;
+                        fsignal->format = sourceOutlet->fsignal->format;
+                        fsignal->framecount = 1;
+                        lastframe = 0;
+                        if (UNLIKELY(!(fsignal->format == PVS_AMP_FREQ) ||
+                                     (fsignal->format == PVS_AMP_PHASE)))
+                            result =
+                                csound->InitError(csound, Str("inletf: signal format "
+                                                              "must be amp-phase or amp-freq."));
+                        fsignalInitialized = true;
+                    }
+                    if (fsignal->sliding) {
+                        for (int frameI = 0; frameI < ksmps; frameI++) {
+                            sinkFrame = (CMPLX*) fsignal->frame.auxp + (fsignal->NB * frameI);
+                            sourceFrame =
+                                (CMPLX*) sourceOutlet->fsignal->frame.auxp + (fsignal->NB * frameI);
+                            for (size_t binI = 0, binN = fsignal->NB; binI < binN; binI++) {
+                                if (sourceFrame[binI].re > sinkFrame[binI].re) {
+                                    sinkFrame[binI] = sourceFrame[binI];
                                 }
                             }
                         }
-                    } else {
-                        sink = (float *)fsignal->frame.auxp;
-                        source = (float *)sourceOutlet->fsignal->frame.auxp;
-                        if (lastframe < int(fsignal->framecount)) {
-                            for (size_t binI = 0, binN = fsignal->N + 2;
-                                    binI < binN;
-                                    binI += 2) {
-                                if (source[binI] > sink[binI]) {
-                                    source[binI] = sink[binI];
-                                    source[binI + 1] = sink[binI + 1];
-                                }
+                    }
+                } else {
+                    sink = (float *)fsignal->frame.auxp;
+                    source = (float *)sourceOutlet->fsignal->frame.auxp;
+                    if (lastframe < int(fsignal->framecount)) {
+                        for (size_t binI = 0, binN = fsignal->N + 2;
+                                binI < binN;
+                                binI += 2) {
+                            if (source[binI] > sink[binI]) {
+                                source[binI] = sink[binI];
+                                source[binI + 1] = sink[binI + 1];
                             }
-                            fsignal->framecount = lastframe = sourceOutlet->fsignal->framecount;
                         }
+                        fsignal->framecount = lastframe = sourceOutlet->fsignal->framecount;
                     }
                 }
             }
         }
-        csound->UnlockMutex(cs_sfg_ports);
         return result;
     }
 };
@@ -762,41 +882,16 @@ struct Outletv : public OpcodeNoteoffBase<Outletv> {
     /**
      * State.
      */
-    char sourceOutletId[0x100];
+    OutletPort<Outletv> *port;
+    size_t slot;
     int init(CSOUND *csound)
     {
-        warn(csound, "BEGAN Outletv::init()...\n");
-        csound->UnlockMutex(cs_sfg_ports);
-        {
-            sourceOutletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Outletv *> &voutlets =
-                voutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-            if (std::find(voutlets.begin(), voutlets.end(), this) == voutlets.end()) {
-                voutlets.push_back(this);
-                warn(csound, "Created instance 0x%x of %d instances of outlet %s (out arraydat: 0x%x dims: %2d size: %4d [%4d] data: 0x%x (0x%x))\n",
-                     this, voutlets.size(), sourceOutletId, vsignal, vsignal->dimensions, vsignal->sizes[0], vsignal->arrayMemberSize, vsignal->data, &vsignal->data);
-            }
-        }
-        warn(csound, "ENDED Outletv::init()...\n");
-        csound->UnlockMutex(cs_sfg_ports);
+        addOutlet(csound, this, Sname);
         return OK;
     }
     int noteoff(CSOUND *csound)
     {
-        std::vector<Outletv *> &voutlets =
-            voutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-        std::vector<Outletv *>::iterator thisoutlet = std::find(voutlets.begin(), voutlets.end(), this);
-        voutlets.erase(thisoutlet);
-        warn(csound, "Removed 0x%x of %d instances of outletv %s\n",
-             this, voutlets.size(), sourceOutletId);
+        removeOutlet(csound, this);
         return OK;
     }
 };
@@ -813,70 +908,20 @@ struct Inletv : public OpcodeBase<Inletv> {
     /**
      * State.
      */
-    char sinkInletId[0x100];
-    std::vector< std::vector<Outletv *> *> *sourceOutlets;
+    InletPort<Outletv> *inletPort;
     size_t arraySize;
     size_t myFltsPerArrayElement;
     int sampleN;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            warn(csound, "BEGAN Inletv::init()...\n");
-            sampleN = opds.insdshead->ksmps;
-            // The array elements may be krate (1 MYFLT) or arate (ksmps MYFLT).
-            myFltsPerArrayElement = vsignal->arrayMemberSize / sizeof(MYFLT);
-            warn(csound, "myFltsPerArrayElement: %d\n", myFltsPerArrayElement);
-            arraySize = myFltsPerArrayElement;
-            for(size_t dimension = 0; dimension < vsignal->dimensions; ++dimension) {
-                arraySize *= MYFLT2LRND(vsignal->sizes[dimension]);
-            }
-            warn(csound, "arraySize: %d\n", arraySize);
-            warn(csound, "sourceOutlets: 0x%x\n", sourceOutlets);
-            if (std::find(voutletVectorsForCsounds[csound].begin(),
-                          voutletVectorsForCsounds[csound].end(),
-                          sourceOutlets) == voutletVectorsForCsounds[csound].end()) {
-                sourceOutlets = new std::vector< std::vector<Outletv *> *>;
-                voutletVectorsForCsounds[csound].push_back(sourceOutlets);
-            } else {
-                sourceOutlets->clear();
-            }
-            warn(csound, "sourceOutlets: 0x%x\n", sourceOutlets);
-            sinkInletId[0] = 0;
-            const char *insname =
-                csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sinkInletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sinkInletId, "%d:%s", opds.insdshead->insno,
-                             (char *)Sname->data);
-            }
-            std::vector<Inletv *> &vinlets =
-                vinletsForCsoundsForSinkInletIds[csound][sinkInletId];
-            if (std::find(vinlets.begin(), vinlets.end(), this) == vinlets.end()) {
-                vinlets.push_back(this);
-                warn(csound, "Created instance 0x%x of inlet %s (in arraydat: 0x%x dims: %2d size: %4d [%4d] data: 0x%x (0x%x))\n",
-                     this, sinkInletId, vsignal, vsignal->dimensions, vsignal->sizes[0], vsignal->arrayMemberSize, vsignal->data, &vsignal->data);
-            }
-            // Find source outlets connecting to this.
-            // Any number of sources may connect to any number of sinks.
-            std::vector<std::string> &sourceOutletIds =
-                connectionsForCsounds[csound][sinkInletId];
-            for (size_t i = 0, n = sourceOutletIds.size(); i < n; i++) {
-                const std::string &sourceOutletId = sourceOutletIds[i];
-                std::vector<Outletv*> &voutlets =
-                    voutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-                if (std::find(sourceOutlets->begin(), sourceOutlets->end(),
-                              &voutlets) == sourceOutlets->end()) {
-                    sourceOutlets->push_back(&voutlets);
-                    warn(csound,
-                         Str("Connected instances of outlet %s to instance 0x%x of "
-                             "inlet %s\n"), sourceOutletId.c_str(), this, sinkInletId);
-                }
-            }
-            warn(csound, "ENDED Inletv::init().\n");
+        sampleN = opds.insdshead->ksmps;
+        // The array elements may be krate (1 MYFLT) or arate (ksmps MYFLT).
+        myFltsPerArrayElement = vsignal->arrayMemberSize / sizeof(MYFLT);
+        arraySize = myFltsPerArrayElement;
+        for(size_t dimension = 0; dimension < vsignal->dimensions; ++dimension) {
+            arraySize *= MYFLT2LRND(vsignal->sizes[dimension]);
         }
-        csound->UnlockMutex(cs_sfg_ports);
+        inletPort = findInlet<Outletv>(csound, this, Sname);
         return OK;
     }
     /**
@@ -884,36 +929,30 @@ struct Inletv : public OpcodeBase<Inletv> {
      */
     int audio(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            //warn(csound, "BEGAN Inletv::audio()...\n");
-            for (uint32_t signalI = 0; signalI < arraySize; ++signalI) {
-                vsignal->data[signalI] = FL(0.0);
-            }
-            // Loop over the source connections...
-            for (size_t sourceI = 0, sourceN = sourceOutlets->size();
-                    sourceI < sourceN;
-                    sourceI++) {
-                // Loop over the source connection instances...
-                std::vector<Outletv *> *instances = sourceOutlets->at(sourceI);
-                for (size_t instanceI = 0, instanceN = instances->size();
-                        instanceI < instanceN;
-                        instanceI++) {
-                    Outletv *sourceOutlet = instances->at(instanceI);
-                    // Skip inactive instances.
-                    if (sourceOutlet->opds.insdshead->actflg) {
-                        for (uint32_t signalI = 0; signalI < arraySize; ++signalI) {
-                            ARRAYDAT *insignal = sourceOutlet->vsignal;
-                            MYFLT *indata = insignal->data;
-                            //warn(csound, "Inletv::audio: sourceOutlet: 0%x in arraydat: 0x%x data: 0x%x (0x%x)\n", sourceOutlet, insignal, indata, &insignal->data);
-                            vsignal->data[signalI] += indata[signalI];
-                        }
+        for (uint32_t signalI = 0; signalI < arraySize; ++signalI) {
+            vsignal->data[signalI] = FL(0.0);
+        }
+        // Loop over the source connections...
+        const InletPort<Outletv>::Sources &sources = inletPort->read();
+        for (size_t sourceI = 0, sourceN = sources.size();
+                sourceI < sourceN;
+                sourceI++) {
+            // Loop over the source connection instances...
+            std::atomic<Outletv *> *instances;
+            for (size_t instanceI = 0, instanceN = sources[sourceI]->read(instances);
+                    instanceI < instanceN;
+                    instanceI++) {
+                const Outletv *sourceOutlet =
+                    instances[instanceI].load(std::memory_order_acquire);
+                // Skip empty slots and inactive instances.
+                if (sourceOutlet && sourceOutlet->opds.insdshead->actflg) {
+                    const MYFLT *indata = sourceOutlet->vsignal->data;
+                    for (uint32_t signalI = 0; signalI < arraySize; ++signalI) {
+                        vsignal->data[signalI] += indata[signalI];
                     }
                 }
             }
-            //warn(csound, "ENDED Inletv::audio().\n");
         }
-        csound->UnlockMutex(cs_sfg_ports);
         return OK;
     }
 };
@@ -928,45 +967,21 @@ struct Outletkid : public OpcodeNoteoffBase<Outletkid> {
     /**
      * State.
      */
-    char sourceOutletId[0x100];
-    char *instanceId;
+    OutletPort<Outletkid> *port;
+    size_t slot;
+    int instanceId;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            const char *insname = csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            instanceId = csound->strarg2name(csound,
-                                             (char*) NULL,
-                                             SinstanceId->data,
-                                             (char *)"",
-                                             1);
-            if (insname && instanceId) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno, (char *)Sname->data);
-            }
-            if (insname) {
-                std::sprintf(sourceOutletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sourceOutletId, "%d:%s", opds.insdshead->insno, (char *)Sname->data);
-            }
-            std::vector<Outletkid *> &koutlets = kidoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-            if (std::find(koutlets.begin(), koutlets.end(), this) == koutlets.end()) {
-                koutlets.push_back(this);
-                warn(csound, "Created instance 0x%x of %d instances of outlet %s\n", this, koutlets.size(), sourceOutletId);
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
+        instanceId = registry->instanceId(SinstanceId->data);
+        csound->UnlockMutex(registry->mutex);
+        addOutlet(csound, this, Sname);
         return OK;
     }
     int noteoff(CSOUND *csound)
     {
-        std::vector<Outletkid *> &koutlets =
-            kidoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-        std::vector<Outletkid *>::iterator thisoutlet = std::find(koutlets.begin(), koutlets.end(), this);
-        koutlets.erase(thisoutlet);
-        warn(csound, "Removed 0x%x of %d instances of outletkid %s\n",
-             this, koutlets.size(), sourceOutletId);
+        removeOutlet(csound, this);
         return OK;
     }
 };
@@ -984,53 +999,15 @@ struct Inletkid : public OpcodeBase<Inletkid> {
     /**
      * State.
      */
-    char sinkInletId[0x100];
-    char *instanceId;
-    std::vector< std::vector<Outletkid *> *> *sourceOutlets;
-    int ksmps;
+    InletPort<Outletkid> *inletPort;
+    int instanceId;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            ksmps = opds.insdshead->ksmps;
-            if (std::find(kidoutletVectorsForCsounds[csound].begin(),
-                          kidoutletVectorsForCsounds[csound].end(),
-                          sourceOutlets) == kidoutletVectorsForCsounds[csound].end()) {
-                sourceOutlets = new std::vector< std::vector<Outletkid *> *>;
-                kidoutletVectorsForCsounds[csound].push_back(sourceOutlets);
-            } else {
-                sourceOutlets->clear();
-            }
-            sinkInletId[0] = 0;
-            instanceId = csound->strarg2name(csound,
-                                             (char*) NULL,
-                                             SinstanceId->data,
-                                             (char *)"",
-                                             1);
-            const char *insname = csound->GetInstrumentList(csound)[opds.insdshead->insno]->insname;
-            if (insname) {
-                std::sprintf(sinkInletId, "%s:%s", insname, (char *)Sname->data);
-            } else {
-                std::sprintf(sinkInletId, "%d:%s", opds.insdshead->insno, (char *)Sname->data);
-            }
-            std::vector<Inletkid *> &kinlets = kidinletsForCsoundsForSinkInletIds[csound][sinkInletId];
-            if (std::find(kinlets.begin(), kinlets.end(), this) == kinlets.end()) {
-                kinlets.push_back(this);
-                warn(csound, "Created instance 0x%x of inlet %s\n", this, sinkInletId);
-            }
-            // Find source outlets connecting to this.
-            // Any number of sources may connect to any number of sinks.
-            std::vector<std::string> &sourceOutletIds = connectionsForCsounds[csound][sinkInletId];
-            for (size_t i = 0, n = sourceOutletIds.size(); i < n; i++) {
-                const std::string &sourceOutletId = sourceOutletIds[i];
-                std::vector<Outletkid *> &koutlets = kidoutletsForCsoundsForSourceOutletIds[csound][sourceOutletId];
-                if (std::find(sourceOutlets->begin(), sourceOutlets->end(), &koutlets) == sourceOutlets->end()) {
-                    sourceOutlets->push_back(&koutlets);
-                    warn(csound, "Connected instances of outlet %s to instance 0x%x of inlet %s.\n", sourceOutletId.c_str(), this, sinkInletId);
-                }
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
+        instanceId = registry->instanceId(SinstanceId->data);
+        csound->UnlockMutex(registry->mutex);
+        inletPort = findInlet<Outletkid>(csound, this, Sname);
         return OK;
     }
     /**
@@ -1038,30 +1015,28 @@ struct Inletkid : public OpcodeBase<Inletkid> {
      */
     int kontrol(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
-        {
-            // Zero the / buffer.
-            *ksignal = FL(0.0);
-            // Loop over the source connections...
-            for (size_t sourceI = 0, sourceN = sourceOutlets->size();
-                    sourceI < sourceN;
-                    sourceI++) {
-                // Loop over the source connection instances...
-                const std::vector<Outletkid *> *instances = sourceOutlets->at(sourceI);
-                for (size_t instanceI = 0, instanceN = instances->size();
-                        instanceI < instanceN;
-                        instanceI++) {
-                    const Outletkid *sourceOutlet = instances->at(instanceI);
-                    // Skip inactive instances and also all non-matching instances.
-                    if (sourceOutlet->opds.insdshead->actflg) {
-                        if (std::strcmp(sourceOutlet->instanceId, instanceId) == 0) {
-                            *ksignal += *sourceOutlet->ksignal;
-                        }
-                    }
+        // Zero the / buffer.
+        *ksignal = FL(0.0);
+        // Loop over the source connections...
+        const InletPort<Outletkid>::Sources &sources = inletPort->read();
+        for (size_t sourceI = 0, sourceN = sources.size();
+                sourceI < sourceN;
+                sourceI++) {
+            // Loop over the source connection instances...
+            std::atomic<Outletkid *> *instances;
+            for (size_t instanceI = 0, instanceN = sources[sourceI]->read(instances);
+                    instanceI < instanceN;
+                    instanceI++) {
+                const Outletkid *sourceOutlet =
+                    instances[instanceI].load(std::memory_order_acquire);
+                // Skip empty slots, inactive instances, and also all
+                // non-matching instances.
+                if (sourceOutlet && sourceOutlet->opds.insdshead->actflg &&
+                        sourceOutlet->instanceId == instanceId) {
+                    *ksignal += *sourceOutlet->ksignal;
                 }
             }
         }
-        csound->UnlockMutex(cs_sfg_ports);
         return OK;
     }
 };
@@ -1077,7 +1052,8 @@ struct Connect : public OpcodeBase<Connect> {
     MYFLT *gain;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
         {
             std::string sourceOutletId = csound->strarg2name(csound,
                                          (char *) 0,
@@ -1107,9 +1083,9 @@ struct Connect : public OpcodeBase<Connect> {
                                                (char *)"",
                                                1);
             warn(csound, "Connected outlet %s to inlet %s.\n", sourceOutletId.c_str(), sinkInletId.c_str());
-            connectionsForCsounds[csound][sinkInletId].push_back(sourceOutletId);
+            registry->connect(sourceOutletId, sinkInletId);
         }
-        csound->UnlockMutex(cs_sfg_ports);
+        csound->UnlockMutex(registry->mutex);
         return OK;
     }
 };
@@ -1125,7 +1101,8 @@ struct Connecti : public OpcodeBase<Connecti> {
     MYFLT *gain;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
         {
             std::string sourceOutletId = csound->strarg2name(csound,
                                          (char *) 0,
@@ -1152,9 +1129,9 @@ struct Connecti : public OpcodeBase<Connecti> {
                                                (char *)"",
                                                1);
             warn(csound, "Connected outlet %s to inlet %s.\n", sourceOutletId.c_str(), sinkInletId.c_str());
-            connectionsForCsounds[csound][sinkInletId].push_back(sourceOutletId);
+            registry->connect(sourceOutletId, sinkInletId);
         }
-        csound->UnlockMutex(cs_sfg_ports);
+        csound->UnlockMutex(registry->mutex);
         return OK;
     }
 };
@@ -1171,7 +1148,8 @@ struct Connectii : public OpcodeBase<Connectii> {
     MYFLT *gain;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
         {
             std::string sourceOutletId = csound->strarg2name(csound,
                                          (char *) 0,
@@ -1200,9 +1178,9 @@ struct Connectii : public OpcodeBase<Connectii> {
                                                1);
             warn(csound, Str("Connected outlet %s to inlet %s.\n"),
                  sourceOutletId.c_str(), sinkInletId.c_str());
-            connectionsForCsounds[csound][sinkInletId].push_back(sourceOutletId);
+            registry->connect(sourceOutletId, sinkInletId);
         }
-        csound->UnlockMutex(cs_sfg_ports);
+        csound->UnlockMutex(registry->mutex);
         return OK;
     }
 };
@@ -1218,7 +1196,8 @@ struct ConnectS : public OpcodeBase<ConnectS> {
     MYFLT *gain;
     int init(CSOUND *csound)
     {
-        csound->LockMutex(cs_sfg_ports);
+        PortRegistry *registry = PortRegistry::get(csound);
+        csound->LockMutex(registry->mutex);
         {
             std::string sourceOutletId = csound->strarg2name(csound,
                                          (char *) 0,
@@ -1244,9 +1223,9 @@ struct ConnectS : public OpcodeBase<ConnectS> {
                                                1);
             warn(csound, Str("Connected outlet %s to inlet %s.\n"),
                  sourceOutletId.c_str(), sinkInletId.c_str());
-            connectionsForCsounds[csound][sinkInletId].push_back(sourceOutletId);
+            registry->connect(sourceOutletId, sinkInletId);
         }
-        csound->UnlockMutex(cs_sfg_ports);
+        csound->UnlockMutex(registry->mutex);
         return OK;
     }
 };
@@ -1489,6 +1468,17 @@ static int ftgenonce_SS(CSOUND *csound, FTGEN *p)
     return ftgenonce_(csound, p, true, true);
 }
 
+static void clearFunctionTables(CSOUND *csound)
+{
+    csound->LockMutex(cs_sfg_ftables);
+    {
+        if (functionTablesForCsoundsForEvtblks.find(csound) != functionTablesForCsoundsForEvtblks.end()) {
+            functionTablesForCsoundsForEvtblks[csound].clear();
+        }
+    }
+    csound->UnlockMutex(cs_sfg_ftables);
+}
+
 extern "C"
 {
     static OENTRY oentries[] = {
@@ -1554,8 +1544,8 @@ extern "C"
             3,
             (char *)"",
             (char *)"SSk",
-            (SUBR)&Outletk::init_,
-            (SUBR)&Outletk::kontrol_,
+            (SUBR)&Outletkid::init_,
+            (SUBR)&Outletkid::kontrol_,
             0
         },
         {
@@ -1565,8 +1555,8 @@ extern "C"
             3,
             (char *)"k",
             (char *)"SS",
-            (SUBR)&Inletk::init_,
-            (SUBR)&Inletk::kontrol_,
+            (SUBR)&Inletkid::init_,
+            (SUBR)&Inletkid::kontrol_,
             0
         },
         {
@@ -1731,8 +1721,11 @@ extern "C"
         if(csound->GetDebug(csound)) {
             csound->Message(csound, "signalflowgraph: csoundModuleCreate(%p)\n", csound);
         }
-        if (cs_sfg_ports == 0) {
-            cs_sfg_ports = csound->Create_Mutex(1);
+        if (!PortRegistry::get(csound)) {
+            csound->CreateGlobalVariable(csound, "signalflowgraph::ports",
+                                         sizeof(PortRegistry *));
+            *(PortRegistry **) csound->QueryGlobalVariable(csound,
+                    "signalflowgraph::ports") = new PortRegistry(csound);
         }
         if (cs_sfg_ftables == 0) {
             cs_sfg_ftables = csound->Create_Mutex(1);
@@ -1768,47 +1761,13 @@ extern "C"
         if(csound->GetDebug(csound)) {
             csound->Message(csound, "signalflowgraph: csoundModuleDestroy(%p)\n", csound);
         }
-        csound->LockMutex(cs_sfg_ports);
-        {
-            if (aoutletsForCsoundsForSourceOutletIds.find(csound) != aoutletsForCsoundsForSourceOutletIds.end()) {
-                aoutletsForCsoundsForSourceOutletIds[csound].clear();
-            }
-            if (ainletsForCsoundsForSinkInletIds.find(csound) != ainletsForCsoundsForSinkInletIds.end()) {
-                ainletsForCsoundsForSinkInletIds[csound].clear();
-            }
-            if (aoutletVectorsForCsounds.find(csound) != aoutletVectorsForCsounds.end()) {
-                aoutletVectorsForCsounds[csound].clear();
-            }
-            if (koutletsForCsoundsForSourceOutletIds.find(csound) != koutletsForCsoundsForSourceOutletIds.end()) {
-                koutletsForCsoundsForSourceOutletIds[csound].clear();
-            }
-            if (kinletsForCsoundsForSinkInletIds.find(csound) != kinletsForCsoundsForSinkInletIds.end()) {
-                kinletsForCsoundsForSinkInletIds[csound].clear();
-            }
-            if (koutletVectorsForCsounds.find(csound) != koutletVectorsForCsounds.end()) {
-                koutletVectorsForCsounds[csound].clear();
-            }
-            if (foutletsForCsoundsForSourceOutletIds.find(csound) != foutletsForCsoundsForSourceOutletIds.end()) {
-                foutletsForCsoundsForSourceOutletIds[csound].clear();
-            }
-            if (finletsForCsoundsForSinkInletIds.find(csound) != finletsForCsoundsForSinkInletIds.end()) {
-                finletsForCsoundsForSinkInletIds[csound].clear();
-            }
-            if (foutletVectorsForCsounds.find(csound) != foutletVectorsForCsounds.end()) {
-                foutletVectorsForCsounds[csound].clear();
-            }
-            if (connectionsForCsounds.find(csound) != connectionsForCsounds.end()) {
-                connectionsForCsounds[csound].clear();
-            }
-        }
-        csound->UnlockMutex(cs_sfg_ports);
-        csound->LockMutex(cs_sfg_ftables);
-        {
-            if (functionTablesForCsoundsForEvtblks.find(csound) != functionTablesForCsoundsForEvtblks.end()) {
-                functionTablesForCsoundsForEvtblks[csound].clear();
-            }
+        PortRegistry *registry = PortRegistry::get(csound);
+        if (registry) {
+            csound->DestroyMutex(registry->mutex);
+            delete registry;
+            csound->DestroyGlobalVariable(csound, "signalflowgraph::ports");
         }
-        csound->UnlockMutex(cs_sfg_ftables);
+        clearFunctionTables(csound);
         return 0;
     }
 }
@@ -21,6 +21,13 @@
     02111-1307 USA
 */
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* for recvmmsg() */
+#endif
+#define HAVE_RECVMMSG
+#endif
+
 #include "csoundCore.h"
 #include <unistd.h>
 #include <stdlib.h>
@@ -35,6 +42,8 @@
 #endif
 #include <string.h>
 #include <errno.h>
+#include <math.h>
+#include "sockstream.h"
 
 #define MAXBUFS 32
 #define MTU (1456)
@@ -83,6 +92,42 @@ typedef struct {
     struct sockaddr_in server_addr;
 } SOCKRECV;
 
+/* one jitter buffer slot, holding the packet with sequence number seq */
+typedef struct {
+    uint32_t seq;
+    int     valid, nchnls, nframes;
+    float   *data;
+} SST_SLOT;
+
+typedef struct {
+    OPDS    h;
+    MYFLT   *aout[SST_MAXCHNLS];
+    MYFLT   *port, *mindepth, *maxdepth;
+    AUXCH   slots, samples, last, pkt, batch;
+    SST_SLOT *slot;
+    int     sock, nchnls, ndepth, target, mintarget;
+    int     depth, playing, started, settle;
+    uint32_t next;              /* sequence number to play next */
+    float   *cur;               /* packet being played, NULL for silence */
+    int     curchnls, curframes, rp, lastframes, pktframes, concealed;
+    MYFLT   gain, gstep;
+    int64_t transit;
+    int     havetransit;
+    double  jitter;             /* interarrival jitter in frames */
+    uint64_t played, received, lost, late, underruns;
+    CSOUND  *cs;
+    void    *cb, *thrid;
+    volatile int threadon;
+    struct sockaddr_in server_addr;
+} SOCKSTREAMRECV;
+
+typedef struct {
+    OPDS    h;
+    MYFLT   *received, *lost, *late, *underruns, *depth, *jitter;
+    MYFLT   *port;
+    SOCKSTREAMRECV **rcv;
+} SOCKSTREAMSTAT;
+
 static int deinit_udpRecv(CSOUND *csound, void *pdata)
 {
     SOCKRECV *p = (SOCKRECV *) pdata;
@@ -357,6 +402,386 @@ static int send_srecv(CSOUND *csound, SOCKRECVT *p)
     return OK;
 }
 
+/* Streaming version: the I/O thread collects datagrams with recvmmsg()
+   and queues them for the audio thread, which sorts them into a jitter
+   buffer by sequence number.  Playback starts once target packets are
+   buffered; the target grows with the measured jitter and after
+   underruns, and shrinks again when the stream has been stable for a
+   while.  A missing packet is concealed by repeating the previous one
+   with a fade out. */
+
+#define SST_RESYNC   (1024)     /* older packets mean the sender restarted */
+#define SST_CONCEAL  (4)        /* packets to fade out over */
+#define SST_SETTLE   (2.0)      /* seconds of stable playback to shrink */
+
+static void stream_name(char *name, MYFLT port)
+{
+    snprintf(name, 32, "sockstream:%d", (int) port);
+}
+
+static int stream_valid(const unsigned char *pkt, int len)
+{
+    int     nchnls, nframes;
+
+    if (len < SST_HDRSIZE || sst_get_u32(pkt) != SST_MAGIC)
+      return 0;
+    nchnls = (pkt[16] << 8) | pkt[17];
+    nframes = (pkt[18] << 8) | pkt[19];
+    return (nchnls > 0 && nframes > 0 && nchnls * nframes <= SST_MAXSAMPS &&
+            SST_HDRSIZE + 4 * nchnls * nframes <= len);
+}
+
+static uintptr_t stream_recv_thread(void *pdata)
+{
+    SOCKSTREAMRECV *p = (SOCKSTREAMRECV *) pdata;
+    CSOUND  *csound = p->cs;
+    unsigned char *buf = (unsigned char *) p->batch.auxp;
+    int     i, n, len[SST_BATCH];
+#ifdef HAVE_RECVMMSG
+    struct mmsghdr msgs[SST_BATCH];
+    struct iovec iov[SST_BATCH];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < SST_BATCH; i++) {
+      iov[i].iov_base = buf + i * SST_MTU;
+      iov[i].iov_len = SST_MTU;
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+
+    while (p->threadon) {
+      /* blocks for at most the receive timeout set on the socket */
+#ifdef HAVE_RECVMMSG
+      n = recvmmsg(p->sock, msgs, SST_BATCH, MSG_WAITFORONE, NULL);
+      for (i = 0; i < n; i++)
+        len[i] = (int) msgs[i].msg_len;
+#else
+      n = ((len[0] = (int) recvfrom(p->sock, (void *) buf, SST_MTU, 0,
+                                    NULL, NULL)) > 0);
+#endif
+      for (i = 0; i < n; i++) {
+        if (!stream_valid(buf + i * SST_MTU, len[i]))
+          continue;
+        /* if the queue is full the packet is dropped, which the audio
+           thread will see as a gap in the sequence */
+        csound->WriteCircularBuffer(csound, p->cb, buf + i * SST_MTU, 1);
+      }
+    }
+    return (uintptr_t) 0;
+}
+
+static void stream_reset(SOCKSTREAMRECV *p)
+{
+    int     i;
+
+    for (i = 0; i < p->ndepth; i++)
+      p->slot[i].valid = 0;
+    p->depth = 0;
+    p->playing = 0;
+    p->havetransit = 0;
+}
+
+/* file a received packet in the jitter buffer */
+static void stream_accept(SOCKSTREAMRECV *p, const unsigned char *pkt)
+{
+    uint32_t seq = sst_get_u32(pkt + 4);
+    uint64_t clock = ((uint64_t) sst_get_u32(pkt + 8) << 32) |
+                     (uint64_t) sst_get_u32(pkt + 12);
+    int     nchnls = (pkt[16] << 8) | pkt[17];
+    int     nframes = (pkt[18] << 8) | pkt[19];
+    int     i, n = nchnls * nframes;
+    int32_t d;
+    int64_t transit;
+    SST_SLOT *s;
+
+    if (UNLIKELY(!p->started)) {
+      p->started = 1;
+      p->next = seq;
+    }
+    d = (int32_t) (seq - p->next);
+    if (d < 0 && d > -SST_RESYNC) {         /* too late to be played */
+      p->late++;
+      return;
+    }
+    if (UNLIKELY(d < 0 || d >= p->ndepth)) {
+      /* the sender restarted, or so much was lost that the buffer
+         cannot bridge it: start again from this packet */
+      if (d > p->depth)
+        p->lost += d - p->depth;
+      stream_reset(p);
+      p->next = seq;
+    }
+    /* every valid slot holds a packet in [next, next + ndepth) */
+    s = p->slot + (seq % (uint32_t) p->ndepth);
+    if (s->valid) {                         /* duplicate */
+      p->late++;
+      return;
+    }
+    for (i = 0; i < n; i++)
+      s->data[i] = sst_get_f32(pkt + SST_HDRSIZE + 4 * i);
+    s->seq = seq;
+    s->nchnls = nchnls;
+    s->nframes = nframes;
+    s->valid = 1;
+    p->depth++;
+    p->received++;
+    p->pktframes = nframes;
+    /* interarrival jitter as in RFC 3550, measured against the frames
+       played here */
+    transit = (int64_t) p->played - (int64_t) clock;
+    if (p->havetransit)
+      p->jitter += (fabs((double) (transit - p->transit)) - p->jitter) / 16.0;
+    p->transit = transit;
+    p->havetransit = 1;
+}
+
+/* adjust the target depth and trim excess latency, once per k-period */
+static void stream_adapt(CSOUND *csound, SOCKSTREAMRECV *p, int nsmps)
+{
+    int     want = p->mintarget;
+
+    if (p->pktframes > 0)
+      want += (int) ceil(2.0 * p->jitter / p->pktframes);
+    if (want > p->ndepth - 1)
+      want = p->ndepth - 1;
+    if (want > p->target)
+      p->target = want;
+    else if (p->target > want &&
+             (p->settle += nsmps) > (int) (SST_SETTLE * csound->esr)) {
+      p->target--;
+      p->settle = 0;
+    }
+    if (p->playing && p->depth > p->target + 1) {
+      SST_SLOT *s = p->slot + (p->next % (uint32_t) p->ndepth);
+      if (s->valid) {
+        s->valid = 0;
+        p->depth--;
+        p->late++;
+      }
+      p->next++;
+    }
+    if (!p->playing && p->depth >= p->target)
+      p->playing = 1;
+}
+
+/* select what to play after the current packet: the next packet in
+   sequence, a concealment of a missing one, or silence while filling */
+static void stream_next(SOCKSTREAMRECV *p, int remaining)
+{
+    SST_SLOT *s;
+
+    p->rp = 0;
+    if (p->playing) {
+      s = p->slot + (p->next % (uint32_t) p->ndepth);
+      if (s->valid) {
+        memcpy(p->last.auxp, s->data, sizeof(float) * s->nchnls * s->nframes);
+        s->valid = 0;
+        p->depth--;
+        p->next++;
+        p->cur = (float *) p->last.auxp;
+        p->curchnls = s->nchnls;
+        p->curframes = p->lastframes = s->nframes;
+        p->gain = FL(1.0);
+        p->gstep = FL(0.0);
+        p->concealed = 0;
+        return;
+      }
+      if (p->depth > 0) {           /* later packets arrived: this is lost */
+        p->lost++;
+        p->next++;
+      }
+      else {                        /* nothing buffered: refill */
+        p->underruns++;
+        p->playing = 0;
+        p->settle = 0;
+        if (p->target < p->ndepth - 1)
+          p->target++;
+      }
+      if (p->lastframes > 0) {
+        if (p->concealed < SST_CONCEAL) {
+          p->cur = (float *) p->last.auxp;
+          p->curframes = p->lastframes;
+          p->gain = (MYFLT) (SST_CONCEAL - p->concealed) / SST_CONCEAL;
+          p->gstep = -FL(1.0) / (SST_CONCEAL * p->lastframes);
+          p->concealed++;
+          return;
+        }
+        if (p->playing) {           /* keep time with the lost packets */
+          p->cur = NULL;
+          p->curframes = p->lastframes;
+          return;
+        }
+      }
+    }
+    p->cur = NULL;
+    p->curframes = remaining;
+}
+
+static int deinit_stream(CSOUND *csound, void *pdata)
+{
+    SOCKSTREAMRECV *p = (SOCKSTREAMRECV *) pdata;
+    SOCKSTREAMRECV **rcv;
+    char    name[32];
+
+    p->threadon = 0;
+    csound->JoinThread(p->thrid);
+    p->thrid = NULL;
+    stream_name(name, *p->port);
+    rcv = (SOCKSTREAMRECV **) csound->QueryGlobalVariable(csound, name);
+    if (rcv != NULL && *rcv == p)
+      *rcv = NULL;
+    if (csound->oparms->msglevel & TIMEMSG)
+      csound->Message(csound, Str("sockstreamrecv: %llu packets received, "
+                                  "%llu lost, %llu late, %llu underruns\n"),
+                      (unsigned long long) p->received,
+                      (unsigned long long) p->lost,
+                      (unsigned long long) p->late,
+                      (unsigned long long) p->underruns);
+    csound->DestroyCircularBuffer(csound, p->cb);
+#ifndef WIN32
+    close(p->sock);
+#else
+    closesocket(p->sock);
+#endif
+    return OK;
+}
+
+static int init_stream(CSOUND *csound, SOCKSTREAMRECV *p)
+{
+    SOCKSTREAMRECV **rcv;
+    char    name[32];
+    int     i;
+#ifdef WIN32
+    DWORD   timeout = 100;
+    WSADATA wsaData = {0};
+    int err;
+    if ((err=WSAStartup(MAKEWORD(2,2), &wsaData))!= 0)
+      csound->InitError(csound, Str("Winsock2 failed to start: %d"), err);
+#else
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+#endif
+
+    if (p->thrid != NULL)       /* reinit: keep receiving */
+      return OK;
+    p->nchnls = (int) p->OUTOCOUNT;
+    p->ndepth = *p->maxdepth > FL(0.0) ? (int) *p->maxdepth : 32;
+    if (p->ndepth < 4) p->ndepth = 4;
+    p->mintarget = *p->mindepth > FL(0.0) ? (int) *p->mindepth : 2;
+    if (p->mintarget > p->ndepth - 1) p->mintarget = p->ndepth - 1;
+
+    p->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (UNLIKELY(p->sock < 0)) {
+      return csound->InitError(csound, Str("creating socket"));
+    }
+    /* a receive timeout lets the I/O thread notice when to stop */
+    setsockopt(p->sock, SOL_SOCKET, SO_RCVTIMEO,
+               (const char *) &timeout, sizeof(timeout));
+    memset(&p->server_addr, 0, sizeof(p->server_addr));
+    p->server_addr.sin_family = AF_INET;    /* it is an INET address */
+    p->server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    p->server_addr.sin_port = htons((int) *p->port);    /* the port */
+    if (UNLIKELY(bind(p->sock, (struct sockaddr *) &p->server_addr,
+                      sizeof(p->server_addr)) < 0))
+      return csound->InitError(csound, Str("bind failed"));
+
+    csound->AuxAlloc(csound, p->ndepth * sizeof(SST_SLOT), &p->slots);
+    csound->AuxAlloc(csound, p->ndepth * SST_MAXSAMPS * sizeof(float),
+                     &p->samples);
+    csound->AuxAlloc(csound, SST_MAXSAMPS * sizeof(float), &p->last);
+    csound->AuxAlloc(csound, SST_MTU, &p->pkt);
+    csound->AuxAlloc(csound, SST_BATCH * SST_MTU, &p->batch);
+    p->slot = (SST_SLOT *) p->slots.auxp;
+    for (i = 0; i < p->ndepth; i++)
+      p->slot[i].data = (float *) p->samples.auxp + i * SST_MAXSAMPS;
+    stream_reset(p);
+    p->target = p->mintarget;
+    p->started = p->settle = 0;
+    p->cur = NULL;
+    p->curframes = p->rp = p->lastframes = p->pktframes = p->concealed = 0;
+    p->jitter = 0.0;
+    p->played = p->received = p->lost = p->late = p->underruns = 0;
+
+    /* make the statistics available to sockstreamstat */
+    stream_name(name, *p->port);
+    csound->CreateGlobalVariable(csound, name, sizeof(SOCKSTREAMRECV *));
+    rcv = (SOCKSTREAMRECV **) csound->QueryGlobalVariable(csound, name);
+    if (rcv != NULL)
+      *rcv = p;
+
+    p->cs = csound;
+    p->cb = csound->CreateCircularBuffer(csound, SST_QUEUE, SST_MTU);
+    p->threadon = 1;
+    p->thrid = csound->CreateThread(stream_recv_thread, (void *) p);
+    csound->RegisterDeinitCallback(csound, (void *) p, deinit_stream);
+    return OK;
+}
+
+static int recv_stream(CSOUND *csound, SOCKSTREAMRECV *p)
+{
+    unsigned char *pkt = (unsigned char *) p->pkt.auxp;
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t i, nsmps = CS_KSMPS;
+    int     c, n, nchnls = p->nchnls;
+    float   *f;
+
+    while (csound->ReadCircularBuffer(csound, p->cb, pkt, 1) == 1)
+      stream_accept(p, pkt);
+    stream_adapt(csound, p, nsmps);
+
+    for (c = 0; c < nchnls; c++)
+      memset(p->aout[c], 0, sizeof(MYFLT) * nsmps);
+    /* whole k-periods are consumed to stay in step with the sender */
+    for (i = 0; i < nsmps; i++, p->rp++) {
+      if (p->rp >= p->curframes)
+        stream_next(p, nsmps - i);
+      if (p->cur == NULL)
+        continue;
+      if (LIKELY(i >= offset && i < nsmps - early)) {
+        f = p->cur + p->rp * p->curchnls;
+        n = nchnls < p->curchnls ? nchnls : p->curchnls;
+        for (c = 0; c < n; c++)
+          p->aout[c][i] = p->gain * f[c];
+      }
+      p->gain += p->gstep;
+    }
+    p->played += nsmps;
+    return OK;
+}
+
+static int init_stream_stat(CSOUND *csound, SOCKSTREAMSTAT *p)
+{
+    char    name[32];
+
+    stream_name(name, *p->port);
+    csound->CreateGlobalVariable(csound, name, sizeof(SOCKSTREAMRECV *));
+    p->rcv = (SOCKSTREAMRECV **) csound->QueryGlobalVariable(csound, name);
+    if (UNLIKELY(p->rcv == NULL))
+      return csound->InitError(csound, Str("sockstreamstat: no receiver"));
+    return OK;
+}
+
+static int stream_stat(CSOUND *csound, SOCKSTREAMSTAT *p)
+{
+    SOCKSTREAMRECV *r = *p->rcv;
+
+    if (r == NULL) {
+      *p->received = *p->lost = *p->late = *p->underruns = FL(0.0);
+      *p->depth = *p->jitter = FL(0.0);
+      return OK;
+    }
+    *p->received = (MYFLT) r->received;
+    *p->lost = (MYFLT) r->lost;
+    *p->late = (MYFLT) r->late;
+    *p->underruns = (MYFLT) r->underruns;
+    *p->depth = (MYFLT) r->depth;
+    *p->jitter = (MYFLT) (1000.0 * r->jitter / csound->esr);
+    return OK;
+}
+
 #define S(x)    sizeof(x)
 
 static OENTRY sockrecv_localops[] = {
@@ -365,7 +790,12 @@ static OENTRY sockrecv_localops[] = {
   { "sockrecvs", S(SOCKRECV), 0, 5, "aa", "ii", (SUBR) init_recvS, NULL,
     (SUBR) send_recvS },
   { "strecv", S(SOCKRECVT), 0, 5, "a", "Si", (SUBR) init_srecv, NULL,
-    (SUBR) send_srecv }
+    (SUBR) send_srecv },
+  { "sockstreamrecv", S(SOCKSTREAMRECV), 0, 5,
+    "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "ioo",
+    (SUBR) init_stream, NULL, (SUBR) recv_stream },
+  { "sockstreamstat", S(SOCKSTREAMSTAT), 0, 3, "kkkkkk", "i",
+    (SUBR) init_stream_stat, (SUBR) stream_stat, NULL }
 };
 
 LINKAGE_BUILTIN(sockrecv_localops)
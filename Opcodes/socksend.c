@@ -21,6 +21,13 @@
     02111-1307 USA
 */
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* for sendmmsg() */
+#endif
+#define HAVE_SENDMMSG
+#endif
+
 #include "csoundCore.h"
 #include <sys/types.h>
 #ifdef WIN32
@@ -34,6 +41,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include "sockstream.h"
+#include "envvar.h"
 
 extern  int     inet_aton(const char *cp, struct in_addr *inp);
 
@@ -76,6 +85,22 @@ typedef struct {
     struct sockaddr_in server_addr;
 } SOCKSENDS;
 
+typedef struct {
+    OPDS    h;
+    STRINGDAT *ipaddress;
+    MYFLT   *port, *frames;
+    MYFLT   *asig[VARGMAX-3];
+    AUXCH   pkt, batch;
+    int     sock, nchnls, nframes, wp, pktsize;
+    uint32_t seq;
+    uint64_t clock;
+    void    *cb, *wakeup, *thread;
+    volatile int threadon;
+    uint64_t sent, failed, dropped;
+    CSOUND  *cs;
+    struct sockaddr_in server_addr;
+} SOCKSTREAM;
+
 #define MTU (1456)
 
 /* UDP version one channel */
@@ -393,6 +418,208 @@ static int send_ssend(CSOUND *csound, SOCKSEND *p)
     return OK;
 }
 
+/* Streaming version: every packet carries a sequence number and the
+   sample clock of its first frame (see sockstream.h).  Full packets are
+   queued to an I/O thread, so the audio thread never blocks in sendto(),
+   and the thread sends whatever has accumulated in one sendmmsg() call. */
+static int stream_send_batch(SOCKSTREAM *p, unsigned char *buf, int n)
+{
+    const struct sockaddr *to = (const struct sockaddr *) (&p->server_addr);
+#ifdef HAVE_SENDMMSG
+    struct mmsghdr msgs[SST_BATCH];
+    struct iovec iov[SST_BATCH];
+    int     i, r, done = 0;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < n; i++) {
+      iov[i].iov_base = buf + i * p->pktsize;
+      iov[i].iov_len = p->pktsize;
+      msgs[i].msg_hdr.msg_name = (void *) to;
+      msgs[i].msg_hdr.msg_namelen = sizeof(p->server_addr);
+      msgs[i].msg_hdr.msg_iov = &iov[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (done < n) {
+      if ((r = sendmmsg(p->sock, msgs + done, n - done, 0)) > 0)
+        done += r;
+      else if (r < 0 && errno == EINTR)
+        continue;
+      else break;
+    }
+    return done;
+#else
+    int     i;
+
+    for (i = 0; i < n; i++)
+      if (sendto(p->sock, (void *) (buf + i * p->pktsize), p->pktsize, 0,
+                 to, sizeof(p->server_addr)) < 0)
+        break;
+    return i;
+#endif
+}
+
+/* wake the sender thread; where thread locks are plain mutexes
+   (!CS_THREADLOCK_WAKEUP) it polls the queue instead */
+
+static inline void stream_wakeup(CSOUND *csound, SOCKSTREAM *p)
+{
+#if CS_THREADLOCK_WAKEUP
+    csound->NotifyThreadLock(p->wakeup);
+#else
+    IGN(csound);
+    IGN(p);
+#endif
+}
+
+static uintptr_t stream_send_thread(void *data)
+{
+    SOCKSTREAM *p = (SOCKSTREAM *) data;
+    CSOUND  *csound = p->cs;
+    unsigned char *buf = (unsigned char *) p->batch.auxp;
+    int     n, done;
+
+    while (1) {
+      n = csound->ReadCircularBuffer(csound, p->cb, buf, SST_BATCH);
+      if (n == 0) {
+        /* drain the queue before leaving */
+        if (!p->threadon) break;
+#if CS_THREADLOCK_WAKEUP
+        csound->WaitThreadLock(p->wakeup, 10);
+#else
+        csound->Sleep(1);
+#endif
+        continue;
+      }
+      done = stream_send_batch(p, buf, n);
+      p->sent += done;
+      p->failed += n - done;
+    }
+    return (uintptr_t) 0;
+}
+
+static int deinit_stream(CSOUND *csound, void *pdata)
+{
+    SOCKSTREAM *p = (SOCKSTREAM *) pdata;
+
+    p->threadon = 0;
+    stream_wakeup(csound, p);
+    csound->JoinThread(p->thread);
+    p->thread = NULL;
+    if (csound->oparms->msglevel & TIMEMSG)
+      csound->Message(csound, Str("sockstreamsend: %llu packets sent, "
+                                  "%llu dropped\n"),
+                      (unsigned long long) p->sent,
+                      (unsigned long long) (p->failed + p->dropped));
+    csound->DestroyThreadLock(p->wakeup);
+    csound->DestroyCircularBuffer(csound, p->cb);
+#ifndef WIN32
+    close(p->sock);
+#else
+    closesocket(p->sock);
+#endif
+    return OK;
+}
+
+static int init_stream(CSOUND *csound, SOCKSTREAM *p)
+{
+    int     nframes;
+#ifdef WIN32
+    WSADATA wsaData = {0};
+    int err;
+    if ((err=WSAStartup(MAKEWORD(2,2), &wsaData))!= 0)
+      csound->InitError(csound, Str("Winsock2 failed to start: %d"), err);
+#endif
+
+    if (p->thread != NULL)      /* reinit: keep streaming */
+      return OK;
+    p->nchnls = (int) p->INOCOUNT - 3;
+    if (UNLIKELY(p->nchnls < 1 || p->nchnls > SST_MAXCHNLS))
+      return csound->InitError(csound, Str("sockstreamsend: between 1 and %d "
+                                           "channels are supported"),
+                               SST_MAXCHNLS);
+    if ((nframes = (int) *p->frames) <= 0)
+      nframes = (int) CS_KSMPS;
+    if (nframes * p->nchnls > SST_MAXSAMPS) {
+      nframes = SST_MAXSAMPS / p->nchnls;
+      csound->Warning(csound, Str("sockstreamsend: packets reduced to %d "
+                                  "frames to fit in a udp-packet"), nframes);
+    }
+    p->nframes = nframes;
+    p->pktsize = SST_HDRSIZE + 4 * nframes * p->nchnls;
+    p->wp = 0;
+    p->seq = 0;
+    p->clock = 0;
+    p->sent = p->failed = p->dropped = 0;
+
+    p->sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (UNLIKELY(p->sock < 0)) {
+      return csound->InitError(csound, Str("creating socket"));
+    }
+    /* create server address: where we want to send to and clear it out */
+    memset(&p->server_addr, 0, sizeof(p->server_addr));
+    p->server_addr.sin_family = AF_INET;    /* it is an INET address */
+#ifdef WIN32
+    p->server_addr.sin_addr.S_un.S_addr =
+      inet_addr((const char *) p->ipaddress->data);
+#else
+    inet_aton((const char *) p->ipaddress->data,
+              &p->server_addr.sin_addr);    /* the server IP address */
+#endif
+    p->server_addr.sin_port = htons((int) *p->port);    /* the port */
+
+    csound->AuxAlloc(csound, p->pktsize, &p->pkt);
+    csound->AuxAlloc(csound, SST_BATCH * p->pktsize, &p->batch);
+    p->cb = csound->CreateCircularBuffer(csound, SST_QUEUE, p->pktsize);
+    p->wakeup = csound->CreateThreadLock();
+    p->cs = csound;
+    p->threadon = 1;
+    p->thread = csound->CreateThread(stream_send_thread, (void *) p);
+    csound->RegisterDeinitCallback(csound, (void *) p, deinit_stream);
+    return OK;
+}
+
+static int send_stream(CSOUND *csound, SOCKSTREAM *p)
+{
+    uint32_t offset = p->h.insdshead->ksmps_offset;
+    uint32_t early  = p->h.insdshead->ksmps_no_end;
+    uint32_t i, nsmps = CS_KSMPS;
+    int     c, nchnls = p->nchnls, wp = p->wp;
+    unsigned char *pkt = (unsigned char *) p->pkt.auxp;
+    unsigned char *q = pkt + SST_HDRSIZE + 4 * nchnls * wp;
+
+    /* whole k-periods are streamed so that the sample clock stays
+       continuous; frames outside the active part are sent as silence */
+    for (i = 0; i < nsmps; i++) {
+      if (UNLIKELY(i < offset || i >= nsmps - early))
+        memset(q, 0, 4 * nchnls);
+      else
+        for (c = 0; c < nchnls; c++)
+          sst_put_f32(q + 4 * c, p->asig[c][i]);
+      q += 4 * nchnls;
+      if (++wp == p->nframes) {
+        sst_put_u32(pkt, SST_MAGIC);
+        sst_put_u32(pkt + 4, p->seq);
+        sst_put_u32(pkt + 8, (uint32_t) (p->clock >> 32));
+        sst_put_u32(pkt + 12, (uint32_t) p->clock);
+        pkt[16] = (unsigned char) (nchnls >> 8);
+        pkt[17] = (unsigned char) nchnls;
+        pkt[18] = (unsigned char) (wp >> 8);
+        pkt[19] = (unsigned char) wp;
+        /* a full queue means the network cannot keep up: drop the packet,
+           the receiver sees the gap in the sequence numbers */
+        if (UNLIKELY(csound->WriteCircularBuffer(csound, p->cb, pkt, 1) != 1))
+          p->dropped++;
+        stream_wakeup(csound, p);
+        p->seq++;
+        p->clock += wp;
+        wp = 0;
+        q = pkt + SST_HDRSIZE;
+      }
+    }
+    p->wp = wp;
+    return OK;
+}
+
 #define S(x)    sizeof(x)
 
 static OENTRY socksend_localops[] = {
@@ -405,7 +632,9 @@ static OENTRY socksend_localops[] = {
   { "socksends", S(SOCKSENDS), 0, 5, "", "aaSiio", (SUBR) init_sendS, NULL,
     (SUBR) send_sendS },
   { "stsend", S(SOCKSEND), 0, 5, "", "aSi", (SUBR) init_ssend, NULL,
-    (SUBR) send_ssend }
+    (SUBR) send_ssend },
+  { "sockstreamsend", S(SOCKSTREAM), 0, 5, "", "Siiy", (SUBR) init_stream, NULL,
+    (SUBR) send_stream }
 };
 
 LINKAGE_BUILTIN(socksend_localops)
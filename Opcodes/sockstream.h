@@ -0,0 +1,77 @@
+/*
+    sockstream.h:
+
+    Copyright (C) 2026
+    The Csound Developers
+
+    This file is part of Csound.
+
+    The Csound Library is free software; you can redistribute it
+    and/or modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    Csound is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with Csound; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+    02111-1307 USA
+*/
+
+#ifndef SOCKSTREAM_H
+#define SOCKSTREAM_H
+
+/* Packet layout shared by sockstreamsend and sockstreamrecv.
+
+   Every datagram starts with a 20 byte header, all fields big-endian:
+
+     u32  magic        "CSST"
+     u32  sequence     incremented by one for every packet sent
+     u32  clock (hi)   sample clock of the first frame in the packet,
+     u32  clock (lo)   counted in frames since the sender started
+     u16  nchnls
+     u16  nframes
+
+   followed by nframes * nchnls interleaved samples as big-endian
+   IEEE 32 bit floats.  The sequence number lets the receiver reorder
+   packets and detect losses, the sample clock lets it measure jitter. */
+
+#define SST_MAGIC       (0x43535354)
+#define SST_HDRSIZE     (20)
+#define SST_MTU         (1456)
+#define SST_MAXSAMPS    ((SST_MTU - SST_HDRSIZE) / 4)
+#define SST_MAXCHNLS    (32)
+#define SST_BATCH       (16)    /* datagrams per sendmmsg/recvmmsg call */
+#define SST_QUEUE       (64)    /* packets between audio and I/O thread */
+
+static inline void sst_put_u32(unsigned char *b, uint32_t x)
+{
+    b[0] = (unsigned char) (x >> 24); b[1] = (unsigned char) (x >> 16);
+    b[2] = (unsigned char) (x >> 8);  b[3] = (unsigned char) x;
+}
+
+static inline uint32_t sst_get_u32(const unsigned char *b)
+{
+    return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) |
+           ((uint32_t) b[2] << 8) | (uint32_t) b[3];
+}
+
+static inline void sst_put_f32(unsigned char *b, MYFLT x)
+{
+    union { float f; uint32_t i; } u;
+    u.f = (float) x;
+    sst_put_u32(b, u.i);
+}
+
+static inline float sst_get_f32(const unsigned char *b)
+{
+    union { float f; uint32_t i; } u;
+    u.i = sst_get_u32(b);
+    return u.f;
+}
+
+#endif  /* SOCKSTREAM_H */
@@ -37,6 +37,8 @@ struct fileinTag {
     void        *fd;          /* file handle returned by CSOUND::FileOpen */
     char        *name;        /* short name */
     int         do_scale;     /* non-zero if 0dBFS scaling should be applied */
+    int         async;        /* non-zero if served by the file I/O thread */
+    uint32      dropped;      /* samples lost to write buffer overruns */
     uint32      refCount;   /* reference count, | 0x80000000 if close reqd */
 };
 
@@ -58,6 +60,7 @@ typedef struct STDOPCOD_GLOBALS_ {
     int         denorm_seed;
     int         vco2_nr_table_arrays;
     VCO2_TABLE_ARRAY  **vco2_tables;
+    int         vco2_cache_reset;   /* cache unmap callback registered */
     /* ugnorman.c */
     ATSBUFREAD  *atsbufreadaddr;
     int         swapped_warning;
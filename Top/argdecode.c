@@ -249,6 +249,8 @@ static const char *longUsageList[] = {
   Str_noop("--strsetN=VALUE\t\tSet strset table at index N to VALUE"),
   Str_noop("--utility=NAME\t\tRun utility program"),
   Str_noop("--verbose\t\tVerbose orch translation"),
+  Str_noop("--no-expression-opt\tCompile each operator of an audio expression"),
+  Str_noop("\t\t\tas a separate opcode (default is to fuse them)"),
   Str_noop("--list-opcodes\t\tList opcodes in this version"),
   Str_noop("--list-opcodesN\t\tList opcodes in style N in this version"),
   Str_noop("--dither\t\tDither output"),
@@ -282,7 +284,7 @@ static const char *longUsageList[] = {
   Str_noop("--daemon\t\t daemon mode: do not exit if CSD/orchestra is "
            "not given, is empty or does not compile"),
   Str_noop("--port=N\t\t listen to UDP port N for instruments/orchestra "
-           "code (implies --daemon)"),
+           "code and message batches (implies --daemon)"),
   Str_noop("--vbr-quality=Ft\t set quality of variable bit0rate compression"),
     Str_noop("--devices[=in|out] \t\t list available MIDI devices and exit"),
   Str_noop("--devices[=in|out] \t\t list available audio devices and exit"),
@@ -807,15 +809,13 @@ static int decode_long(CSOUND *csound, char *s, int argc, char **argv)
       return 1;
     }
     /* IV - Jan 27 2005: --expression-opt */
-    /* NOTE these do nothing */
+    /* fuse audio-rate expressions into single ##expr opcodes */
     else if (!(strcmp (s, "expression-opt"))) {
-      //O->expr_opt = 1;
-      csound->Warning(csound, Str("option expresson-opt has no affect\n"));
+      csound->expr_opt = 1;
       return 1;
     }
     else if (!(strcmp (s, "no-expression-opt"))) {
-      //O->expr_opt = 0;
-      csound->Warning(csound, Str("option no-expresson-opt has no affect\n"));
+      csound->expr_opt = 0;
       return 1;
     }
     else if (!(strncmp (s, "env:", 4))) {
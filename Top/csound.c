@@ -99,6 +99,8 @@ extern MYFLT csoundPow2(CSOUND *csound, MYFLT a);
 extern int csoundInitStaticModules(CSOUND *);
 extern void close_all_files(CSOUND *);
 extern void csoundInputMessageInternal(CSOUND *csound, const char *message);
+extern void csound_orc_cache_destroy(CSOUND *);
+extern void async_compile_stop(CSOUND *);
 
 void (*msgcallback_)(CSOUND *, int, const char *, va_list) = NULL;
 
@@ -439,12 +441,14 @@ static const CSOUND cenviron_ = {
     csoundSetScoreOffsetSeconds,
     csoundRewindScore,
     csoundInputMessageInternal,
+    csoundPrefetchSoundFile,
+    csoundSetExternalMidiReadTimedCallback,
     {
       NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
       NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
       NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
       NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
-      NULL, NULL, NULL,
+      NULL,
     },
     /* ------- private data (not to be used by hosts or externals) ------- */
     /* callback function pointers */
@@ -513,6 +517,7 @@ static const CSOUND cenviron_ = {
       },
       NULL,
       MAXINSNO,     /* engineState          */
+      NULL          /* nxtstate */
     },
     (INSTRTXT *) NULL, /* instr0  */
     (INSTRTXT**)NULL,  /* dead_instr_pool */
@@ -641,6 +646,7 @@ static const CSOUND cenviron_ = {
 #endif
     0,              /* file_io_start   */
     NULL,           /* file_io_threadlock */
+    NULL,           /* file_io_wakeup */
     0,              /* realtime_audio_flag */
 #if defined(WIN32) //&& (__GNUC_VERSION__ < 40800)
     (pthread_t){0, 0},   /* init pass thread    */
@@ -723,6 +729,8 @@ static const CSOUND cenviron_ = {
       1U,           /*  nframes             */
       NULL, NULL,   /*  pin, pout           */
       0,            /*dither                */
+      NULL, NULL,   /*  chnpeak, chnover    */
+      NULL          /*  writer              */
     },
     0,              /*  warped              */
     0,              /*  sstrlen             */
@@ -872,7 +880,22 @@ static const CSOUND cenviron_ = {
     -1,             /* audio system sr */
     0,              /* csdebug_data */
     kperf_nodebug,  /* current kperf function - nodebug by default */
-    0               /* which score parser */
+    0,              /* which score parser */
+    NULL,           /* symbtab */
+    1,              /* mmap_sndfiles */
+    1,              /* orc_cache */
+    NULL,           /* orcCache */
+    NULL,           /* compile_lock */
+    NULL,           /* compile_thread */
+    NULL,           /* compile_wakeup */
+    NULL,           /* compile_queue */
+    0,              /* compile_stop */
+    NULL,           /* pending_states */
+    0,              /* pending_lock */
+    0,              /* async_sndout */
+    0,              /* fout_async */
+    0,              /* fout_direct */
+    1               /* expr_opt */
     /*, NULL */           /* self-reference */
 };
 
@@ -1160,6 +1183,7 @@ PUBLIC CSOUND *csoundCreate(void *hostdata)
     csoundUnLock();
     csoundReset(csound);
     csound->API_lock = csoundCreateMutex(1);
+    csound->compile_lock = csoundCreateMutex(1);
     /* NB: as suggested by F Pinot, keep the
        address of the pointer to CSOUND inside
        the struct, so it can be cleared later */
@@ -1222,6 +1246,7 @@ PUBLIC void csoundDestroy(CSOUND *csound)
     free(p);
 
     reset(csound);
+    csound_orc_cache_destroy(csound);
 
     if (csound->csoundCallbacks_ != NULL) {
       CsoundCallbackEntry_t *pp, *nxt;
@@ -1236,6 +1261,8 @@ PUBLIC void csoundDestroy(CSOUND *csound)
       //csoundLockMutex(csound->API_lock);
       csoundDestroyMutex(csound->API_lock);
     }
+    if (csound->compile_lock != NULL)
+      csoundDestroyMutex(csound->compile_lock);
     /* clear the pointer */
     //*(csound->self) = NULL;
     free((void*) csound);
@@ -2728,6 +2755,16 @@ PUBLIC void csoundSetExternalMidiReadCallback(CSOUND *csound,
                                                           unsigned char *, int))
 {
     csound->midiGlobals->MidiReadCallback = func;
+    csound->midiGlobals->MidiReadTimedCallback = NULL;
+}
+
+PUBLIC void csoundSetExternalMidiReadTimedCallback(CSOUND *csound,
+                                                   int (*func)(CSOUND *,
+                                                               void *,
+                                                               unsigned char *,
+                                                               int, int64_t *))
+{
+    csound->midiGlobals->MidiReadTimedCallback = func;
 }
 
 PUBLIC void csoundSetExternalMidiInCloseCallback(CSOUND *csound,
@@ -2940,6 +2977,8 @@ static void reset(CSOUND *csound)
     uintptr_t end, start;
     int n = 0;
 
+    /* finish any compilation still running in the background */
+    async_compile_stop(csound);
     csoundCleanup(csound);
 
     /* call registered reset callbacks */
@@ -2973,6 +3012,7 @@ static void reset(CSOUND *csound)
     /* delete temporary files created by this Csound instance */
     remove_tmpfiles(csound);
     rlsmemfiles(csound);
+    rlssndmemfiles(csound);
 
      memRESET(csound);
 
@@ -3002,6 +3042,7 @@ static void reset(CSOUND *csound)
     memcpy(p1, (void*) &(saved_env->first_callback_), (size_t) length);
     csound->csoundCallbacks_ = saved_env->csoundCallbacks_;
     csound->API_lock = saved_env->API_lock;
+    csound->compile_lock = saved_env->compile_lock;
 #ifdef HAVE_PTHREAD_SPIN_LOCK
     csound->memlock = saved_env->memlock;
     csound->spinlock = saved_env->spinlock;
@@ -3011,6 +3052,7 @@ static void reset(CSOUND *csound)
     csound->enableHostImplementedMIDIIO = saved_env->enableHostImplementedMIDIIO;
     memcpy(&(csound->exitjmp), &(saved_env->exitjmp), sizeof(jmp_buf));
     csound->memalloc_db = saved_env->memalloc_db;
+    csound->orcCache = saved_env->orcCache;
     //csound->self = self;
     free(saved_env);
 
@@ -3307,6 +3349,48 @@ PUBLIC void csoundReset(CSOUND *csound)
                                       CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
                                       Str("Ignore <CsOptions> in CSD files"
                                           " (default: no)"), NULL);
+    csoundCreateConfigurationVariable(csound, "mmap_sndfiles",
+                                      &(csound->mmap_sndfiles),
+                                      CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
+                                      Str("Map uncompressed float sound files"
+                                          " into memory instead of loading"
+                                          " them (default: yes)"), NULL);
+    csoundCreateConfigurationVariable(csound, "async_sndout",
+                                      &(csound->async_sndout),
+                                      CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
+                                      Str("Write the output sound file from"
+                                          " a separate thread (default: no)"),
+                                      NULL);
+    csoundCreateConfigurationVariable(csound, "fout_async",
+                                      &(csound->fout_async),
+                                      CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
+                                      Str("Write fout sound files from the"
+                                          " file I/O thread also when not"
+                                          " running in real time (default: no)"),
+                                      NULL);
+    csoundCreateConfigurationVariable(csound, "fout_direct",
+                                      &(csound->fout_direct),
+                                      CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
+                                      Str("Push fout sound files out to disk"
+                                          " as they are written and keep them"
+                                          " out of the page cache; implies"
+                                          " fout_async (default: no)"),
+                                      NULL);
+    csoundCreateConfigurationVariable(csound, "orc_cache",
+                                      &(csound->orc_cache),
+                                      CSOUNDCFG_BOOLEAN, 0, NULL, NULL,
+                                      Str("Reuse instruments compiled earlier"
+                                          " from the same text (default: yes)"),
+                                      NULL);
+    max_len = 256;
+    csoundCreateGlobalVariable(csound, "_ORC_CACHE_DIR", (size_t) max_len);
+    csoundCreateConfigurationVariable(csound, "orc_cache_dir",
+                                      csoundQueryGlobalVariable(csound,
+                                                            "_ORC_CACHE_DIR"),
+                                      CSOUNDCFG_STRING, 0, NULL, &max_len,
+                                      Str("Directory in which compiled"
+                                          " instruments are also stored"),
+                                      NULL);
 }
 
 PUBLIC int csoundGetDebug(CSOUND *csound)
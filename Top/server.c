@@ -36,6 +36,38 @@ typedef unsigned int u_int32_t;
 
 
 
+/*
+  Besides orchestra code, the server accepts binary message batches on
+  the same port.  A batch is a datagram starting with the four bytes
+  "CSB1" followed by a 16-bit record count and the records; all numbers
+  are big-endian and values are IEEE 754 doubles.
+
+    1  score event   opcode (1 byte: i, f, q, a or e), n (1 byte),
+                     n values (p1 ... pn)
+    2  bind handle   handle (16 bits), length (1 byte), channel name;
+                     creates the control channel if needed
+    3  set control   handle (16 bits), value
+    4  table write   table (32 bits), start index (32 bits),
+                     n (16 bits), n values
+
+  Batches are checked and queued by the server thread without touching
+  the compiler, and applied in order by the performance thread at the
+  start of the next k-cycle, so all records of a batch take effect in
+  the same k-cycle.  Any other datagram is compiled as orchestra code.
+*/
+
+#define UDP_MAGIC       "CSB1"
+#define UDP_EVENT       1
+#define UDP_BIND        2
+#define UDP_CONTROL     3
+#define UDP_TABLE       4
+
+typedef struct udp_batch {
+  struct udp_batch *nxt;
+  size_t  size;
+  unsigned char data[1];
+} UDP_BATCH;
+
 typedef struct {
   int port;
   int     sock;
@@ -43,10 +75,211 @@ typedef struct {
   void    *thrid;
   void  *cb;
   struct sockaddr_in server_addr;
+  void    *batches;     /* received, waiting for the performance thread */
+  int     lock;         /* guards batches without atomic builtins */
+  MYFLT   **handles;    /* channel pointers by handle */
+  int     nhandles;
+  uint64_t events;      /* counts of records applied, for --m-benchmarks */
+  uint64_t nbatches;
 } UDPCOM;
 
 #define MAXSTR 1048576 /* 1MB */
 
+static uint32_t get_u16(const unsigned char *b)
+{
+    return ((uint32_t) b[0] << 8) | b[1];
+}
+
+static uint32_t get_u32(const unsigned char *b)
+{
+    return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) |
+           ((uint32_t) b[2] << 8) | b[3];
+}
+
+static MYFLT get_f64(const unsigned char *b)
+{
+    uint64_t  u = ((uint64_t) get_u32(b) << 32) | get_u32(b + 4);
+    double    d;
+    memcpy(&d, &u, sizeof(double));
+    return (MYFLT) d;
+}
+
+/* returns the size of the record at b, or 0 if it is malformed */
+static size_t udp_record_size(const unsigned char *b, size_t n)
+{
+    size_t  size;
+
+    if (n < 1)
+      return 0;
+    switch (b[0]) {
+    case UDP_EVENT:
+      if (n < 3 || strchr("ifqae", b[1]) == NULL || b[1] == '\0')
+        return 0;
+      size = 3 + 8 * (size_t) b[2];
+      break;
+    case UDP_BIND:
+      if (n < 4 || b[3] == 0)
+        return 0;
+      size = 4 + (size_t) b[3];
+      break;
+    case UDP_CONTROL:
+      size = 11;
+      break;
+    case UDP_TABLE:
+      if (n < 11)
+        return 0;
+      size = 11 + 8 * (size_t) get_u16(b + 9);
+      break;
+    default:
+      return 0;
+    }
+    return (size <= n ? size : 0);
+}
+
+/* checks every record of a batch; returns the record count or -1 */
+static int udp_batch_check(const unsigned char *b, size_t n)
+{
+    size_t  pos = 6, size;
+    int     i, count;
+
+    if (n < 6 || memcmp(b, UDP_MAGIC, 4) != 0)
+      return -1;
+    count = (int) get_u16(b + 4);
+    for (i = 0; i < count; i++, pos += size)
+      if ((size = udp_record_size(b + pos, n - pos)) == 0)
+        return -1;
+    return (pos == n ? count : -1);
+}
+
+static void udp_push(UDPCOM *p, UDP_BATCH *batch)
+{
+#ifdef HAVE_ATOMIC_BUILTIN
+    void    *old;
+    do {
+      old = p->batches;
+      batch->nxt = (UDP_BATCH *) old;
+    } while (!__sync_bool_compare_and_swap(&p->batches, old, batch));
+#else
+    csoundSpinLock(&p->lock);
+    batch->nxt = (UDP_BATCH *) p->batches;
+    p->batches = batch;
+    csoundSpinUnLock(&p->lock);
+#endif
+}
+
+/* takes all queued batches, oldest first */
+static UDP_BATCH *udp_take(UDPCOM *p)
+{
+    UDP_BATCH *list, *nxt, *fifo = NULL;
+#ifdef HAVE_ATOMIC_BUILTIN
+    list = (UDP_BATCH *) __sync_lock_test_and_set(&p->batches, NULL);
+#else
+    csoundSpinLock(&p->lock);
+    list = (UDP_BATCH *) p->batches;
+    p->batches = NULL;
+    csoundSpinUnLock(&p->lock);
+#endif
+    for ( ; list != NULL; list = nxt) {
+      nxt = list->nxt;
+      list->nxt = fifo;
+      fifo = list;
+    }
+    return fifo;
+}
+
+static void udp_bind(CSOUND *csound, UDPCOM *p, int handle,
+                     const unsigned char *name, int len)
+{
+    char    buf[256];
+    MYFLT   *ptr;
+
+    if (handle >= p->nhandles) {
+      int     n = p->nhandles ? p->nhandles : 64;
+      MYFLT   **tmp;
+      while (n <= handle) n <<= 1;
+      tmp = (MYFLT **) realloc(p->handles, n * sizeof(MYFLT *));
+      if (UNLIKELY(tmp == NULL))
+        return;
+      memset(tmp + p->nhandles, 0, (n - p->nhandles) * sizeof(MYFLT *));
+      p->handles = tmp;
+      p->nhandles = n;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    if (csoundGetChannelPtr(csound, &ptr, buf,
+                            CSOUND_CONTROL_CHANNEL | CSOUND_INPUT_CHANNEL)
+        == CSOUND_SUCCESS)
+      p->handles[handle] = ptr;
+    else
+      csound->Warning(csound, Str("UDP server: could not bind channel %s"), buf);
+}
+
+static void udp_apply(CSOUND *csound, UDPCOM *p, const unsigned char *b)
+{
+    EVTBLK  evt;
+    MYFLT   *table;
+    size_t  pos = 6;
+    int     i, n, count = (int) get_u16(b + 4), len;
+    uint32_t  start;
+
+    for ( ; count > 0; count--) {
+      const unsigned char *r = b + pos;
+      pos += udp_record_size(r, (size_t) -1 / 2);
+      switch (r[0]) {
+      case UDP_EVENT:
+        n = r[2];
+        evt.strarg = NULL; evt.scnt = 0; evt.pinstance = NULL;
+        evt.opcod = (char) r[1];
+        evt.pcnt = (int16) n;
+        for (i = 0; i < n; i++)
+          evt.p[i + 1] = get_f64(r + 3 + 8 * i);
+        if (insert_score_event_at_sample(csound, &evt, csound->icurTime) != 0)
+          csound->Warning(csound, Str("UDP server: could not insert event"));
+        p->events++;
+        break;
+      case UDP_BIND:
+        udp_bind(csound, p, (int) get_u16(r + 1), r + 4, r[3]);
+        break;
+      case UDP_CONTROL:
+        i = (int) get_u16(r + 1);
+        if (LIKELY(i < p->nhandles && p->handles[i] != NULL))
+          *p->handles[i] = get_f64(r + 3);
+        p->events++;
+        break;
+      case UDP_TABLE:
+        n = (int) get_u16(r + 9);
+        start = get_u32(r + 5);
+        len = csoundGetTable(csound, &table, (int) get_u32(r + 1));
+        if (UNLIKELY(len < 0 || start >= (uint32_t) len)) {
+          csound->Warning(csound, Str("UDP server: invalid table write"));
+          break;
+        }
+        if ((uint32_t) n > (uint32_t) len - start)
+          n = (int) ((uint32_t) len - start);
+        for (i = 0; i < n; i++)
+          table[start + i] = get_f64(r + 11 + 8 * i);
+        p->events++;
+        break;
+      }
+    }
+    p->nbatches++;
+}
+
+/* sense event callback: applies the queued batches in arrival order */
+static void udp_dispatch(CSOUND *csound, void *pdata)
+{
+    UDPCOM    *p = (UDPCOM *) pdata;
+    UDP_BATCH *batch, *nxt;
+
+    if (p->batches == NULL)
+      return;
+    for (batch = udp_take(p); batch != NULL; batch = nxt) {
+      nxt = batch->nxt;
+      udp_apply(csound, p, batch->data);
+      free(batch);
+    }
+}
+
 static uintptr_t udp_recv(void *pdata)
 {
     struct sockaddr from;
@@ -54,15 +287,32 @@ static uintptr_t udp_recv(void *pdata)
     UDPCOM *p = (UDPCOM *) pdata;
     CSOUND *csound = p->cs;
     int port = p->port;
-    char   *orchestra = csound->Malloc(csound, MAXSTR);
+    char   *orchestra = csound->Malloc(csound, MAXSTR + 1);
+    int    n;
 
     csound->Message(csound, "UDP server started on port %d \n",port);
-    while (recvfrom(p->sock, (void *)orchestra, MAXSTR, 0, &from, &clilen) > 0) {
+    while ((n = (int) recvfrom(p->sock, (void *)orchestra, MAXSTR, 0,
+                               &from, &clilen)) > 0) {
+      if (n >= 4 && memcmp(orchestra, UDP_MAGIC, 4) == 0) {
+        UDP_BATCH *batch;
+        if (UNLIKELY(udp_batch_check((unsigned char *) orchestra,
+                                     (size_t) n) < 0)) {
+          csound->Warning(csound, Str("UDP server: malformed message batch"));
+          continue;
+        }
+        batch = (UDP_BATCH *) malloc(sizeof(UDP_BATCH) + n);
+        if (UNLIKELY(batch == NULL))
+          continue;
+        batch->size = (size_t) n;
+        memcpy(batch->data, orchestra, n);
+        udp_push(p, batch);
+        continue;
+      }
+      orchestra[n] = '\0';
       if (csound->oparms->odebug)
         csound->Message(csound, "orchestra: \n%s\n", orchestra);
       if (strncmp("##close##",orchestra,9)==0) break;
-      csoundCompileOrc(csound, orchestra);
-      memset(orchestra,0, MAXSTR);
+      csoundCompileOrcAsync(csound, orchestra);
     }
     csound->Message(csound, "UDP server on port %d stopped\n",port);
     csound->Free(csound, orchestra);
@@ -97,6 +347,8 @@ static int udp_start(CSOUND *csound, UDPCOM *p)
       csound->Warning(csound, Str("bind failed"));
       return NOTOK;
     }
+    /* message batches are applied at the start of each k-cycle */
+    csound->RegisterSenseEventCallback(csound, udp_dispatch, (void *) p);
     /* create thread */
     p->thrid = csoundCreateThread(udp_recv, (void *) p);
 
@@ -121,6 +373,19 @@ int UDPServerClose(CSOUND *csound)
 #else
       closesocket(p->sock);
 #endif
+      {
+        UDP_BATCH *batch, *nxt;
+        for (batch = udp_take(p); batch != NULL; batch = nxt) {
+          nxt = batch->nxt;
+          free(batch);
+        }
+      }
+      if (csound->oparms->msglevel & TIMEMSG)
+        csound->Message(csound, Str("UDP server: %llu records in %llu "
+                                    "message batches\n"),
+                        (unsigned long long) p->events,
+                        (unsigned long long) p->nbatches);
+      free(p->handles);
       csound->DestroyGlobalVariable(csound,"::UDPCOM");
     }
     return OK;
@@ -219,6 +219,7 @@ $(CSOUND_SRC_ROOT)/Opcodes/pvoc.c \
 $(CSOUND_SRC_ROOT)/Engine/csound_orc_semantics.c \
 $(CSOUND_SRC_ROOT)/Engine/csound_orc_expressions.c \
 $(CSOUND_SRC_ROOT)/Engine/csound_orc_optimize.c \
+$(CSOUND_SRC_ROOT)/Engine/csound_orc_cache.c \
 $(CSOUND_SRC_ROOT)/Engine/csound_orc_compile.c \
 $(CSOUND_SRC_ROOT)/Engine/new_orc_parser.c \
 $(CSOUND_SRC_ROOT)/Engine/symbtab.c \
@@ -628,6 +628,24 @@ extern "C" {
     */
     PUBLIC int csoundCompileOrc(CSOUND *csound, const char *str);
 
+    /**
+     * Asynchronous version of csoundCompileOrc().  The orchestra is
+     * queued and parsed and compiled on a background thread; the result
+     * is merged into the running engine by the performance thread at the
+     * start of the next control cycle, and any global space code is run
+     * then.  Returns CSOUND_SUCCESS once the orchestra has been queued;
+     * compilation errors are reported through the message callback.
+     * Before the first compilation this is the same as csoundCompileOrc().
+     */
+    PUBLIC int csoundCompileOrcAsync(CSOUND *csound, const char *str);
+
+    /**
+     * Asynchronous version of csoundCompileTree(): the TREE is compiled on
+     * the calling thread and merged into the running engine at the start
+     * of the next control cycle, as for csoundCompileOrcAsync().
+     */
+    PUBLIC int csoundCompileTreeAsync(CSOUND *csound, TREE *root);
+
    /**
     *   Parse and compile an orchestra given on an string,
     *   evaluating any global space code (i-time only).
@@ -1143,6 +1161,24 @@ extern "C" {
             int (*func)(CSOUND *, void *userData,
                     unsigned char *buf, int nBytes));
 
+    /**
+     * Sets a callback for reading timestamped real time MIDI input, which
+     * is used instead of the one set with
+     * csoundSetExternalMidiReadCallback().  The callback stores up to
+     * nBytes bytes in buf as the plain read callback does, and the time of
+     * each byte in times, in sample frames on the same clock as
+     * csoundGetCurrentTimeSamples().  Note on events then start at their
+     * sample position within the k-period, using the same offset
+     * mechanism as sample-accurate score events, so MIDI timing no longer
+     * depends on ksmps.  Bytes stamped in the past are handled at once;
+     * bytes stamped beyond the current k-period are held back until it is
+     * reached, so a host can schedule input up to one period ahead to
+     * remove jitter entirely.  Setting a plain read callback clears this.
+     */
+    PUBLIC void csoundSetExternalMidiReadTimedCallback(CSOUND *,
+            int (*func)(CSOUND *, void *userData,
+                    unsigned char *buf, int nBytes, int64_t *times));
+
     /**
      * Sets callback for closing real time MIDI input.
      */
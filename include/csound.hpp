@@ -180,6 +180,10 @@ public:
   {
     return csoundCompileTree(csound, root);
   }
+  virtual int CompileTreeAsync(TREE *root)
+  {
+    return csoundCompileTreeAsync(csound, root);
+  }
   virtual void DeleteTree(TREE *root)
   {
     csoundDeleteTree(csound, root);
@@ -188,6 +192,10 @@ public:
   {
     return csoundCompileOrc(csound, str);
   }
+  virtual int CompileOrcAsync(const char *str)
+  {
+    return csoundCompileOrcAsync(csound, str);
+  }
   virtual MYFLT EvalCode(const char *str)
   {
     return csoundEvalCode(csound, str);
@@ -531,6 +539,11 @@ public:
   {
     csoundSetExternalMidiReadCallback(csound, func);
   }
+  virtual void SetExternalMidiReadTimedCallback(
+      int (*func)(CSOUND *, void *, unsigned char *, int, int64_t *))
+  {
+    csoundSetExternalMidiReadTimedCallback(csound, func);
+  }
   virtual void SetExternalMidiInCloseCallback(
       int (*func)(CSOUND *, void *))
   {
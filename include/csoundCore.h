@@ -784,6 +784,11 @@ typedef struct {
     unsigned char mbuf[MBUFSIZ];
     unsigned char *bufp, *endatp;
     int16   datreq, datcnt;
+    int     (*MidiReadTimedCallback)(CSOUND *, void *, unsigned char *, int,
+                                     int64_t *);
+    int64_t mstamp[MBUFSIZ];    /* sample time of each byte in mbuf */
+    uint32_t midiOffset;        /* k-period offset of the last note event */
+    MEVENT  runevt;             /* device message being parsed            */
   } MGLOBAL;
 
   typedef struct eventnode {
@@ -904,6 +909,7 @@ typedef struct NAME__ {
     INSTRTXT      instxtanchor;
     CS_HASH_TABLE *instrumentNames; /* instrument names */
     int           maxinsno;
+    struct engine_state *nxtstate; /* next state waiting to be merged */
   } ENGINE_STATE;
 
 
@@ -1292,10 +1298,20 @@ typedef struct NAME__ {
     void (*RewindScore)(CSOUND *);
     void (*InputMessage)(CSOUND *, const char *message__);
        /**@}*/
+    /** @name Sound file memory */
+    /**@{ */
+    void (*PrefetchSoundFile)(CSOUND *, SNDMEMFILE *,
+                              size_t startFrame, size_t nFrames);
+    /**@}*/
+    /** @name Timestamped MIDI input */
+    /**@{ */
+    void (*SetExternalMidiReadTimedCallback)(CSOUND *,
+                int (*func)(CSOUND *, void *, unsigned char *, int, int64_t *));
+    /**@}*/
     /** @name Placeholders
         To allow the API to grow while maintining backward binary compatibility. */
     /**@{ */
-    SUBR dummyfn_2[43];
+    SUBR dummyfn_2[41];
     /**@}*/
 #ifdef __BUILDING_LIBCSOUND
     /* ------- private data (not to be used by hosts or externals) ------- */
@@ -1479,6 +1495,7 @@ typedef struct NAME__ {
     pthread_t    file_io_thread;
     int          file_io_start;
     void         *file_io_threadlock;
+    void         *file_io_wakeup;   /* signalled when a stream needs service */
     int          realtime_audio_flag;
     pthread_t    init_pass_thread;
     int          init_pass_loop;
@@ -1573,6 +1590,9 @@ typedef struct NAME__ {
       uint32        nframes               /* = 1UL */;
       FILE          *pin, *pout;
       int           dither;
+      MYFLT         *chnpeak;             /* spoutsf level metering       */
+      uint32        *chnover;
+      void          *writer;              /* -+async_sndout thread        */
     } libsndStatics;
 
     int           warped;               /* rdscor.c */
@@ -1699,6 +1719,20 @@ typedef struct NAME__ {
                                and nodebug function */
     int           score_parser;
     CS_HASH_TABLE* symbtab;
+    int           mmap_sndfiles; /* map float sound files instead of loading */
+    int           orc_cache;     /* reuse compiled instruments */
+    void          *orcCache;     /* kept across csoundReset() */
+    void          *compile_lock; /* serialises parsing and compilation */
+    void          *compile_thread; /* csoundCompileOrcAsync() worker */
+    void          *compile_wakeup;
+    void          *compile_queue; /* orchestras waiting to be compiled */
+    int           compile_stop;
+    void          *pending_states; /* compiled, waiting for a k-cycle */
+    int           pending_lock;
+    int           async_sndout;  /* write output file from a thread */
+    int           fout_async;    /* fout: always use the file I/O thread */
+    int           fout_direct;   /* fout: write behind, bypass page cache */
+    int           expr_opt;      /* fuse audio expressions (--expression-opt) */
     /*struct CSOUND_ **self;*/
     /**@}*/
 #endif  /* __BUILDING_LIBCSOUND */
@@ -121,6 +121,8 @@ extern "C" {
                                                    const char* name);
     PUBLIC int csoundAddVariable(CSOUND* csound, CS_VAR_POOL* pool,
                                  CS_VARIABLE* var);
+    PUBLIC int csoundRemoveVariable(CSOUND* csound, CS_VAR_POOL* pool,
+                                    const char* name);
     PUBLIC void recalculateVarPoolMemory(void* csound, CS_VAR_POOL* pool);
     PUBLIC void reallocateVarPoolMemory(void* csound, CS_VAR_POOL* pool);
     PUBLIC void initializeVarPool(MYFLT* memBlock, CS_VAR_POOL* pool);
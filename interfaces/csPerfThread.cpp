@@ -30,6 +30,95 @@
 
 // ----------------------------------------------------------------------------
 
+/*
+ * Messages are passed to the performance thread through a bounded ring of
+ * preallocated records, so that sending a score event neither allocates
+ * memory nor takes a lock the performance thread could be waiting on.
+ * Any number of threads may queue records; each record carries a sequence
+ * number telling whether it is free (== its position), ready to be run
+ * (== position + 1), or still owned by the previous lap of the ring.
+ * Score events and short input messages are stored in the record itself;
+ * control messages, and events too large for a record, pass a pointer to
+ * a heap allocated CsoundPerformanceThreadMessage instead.
+ */
+
+#define CSPT_QUEUE_SIZE   1024          /* records, must be a power of two */
+#define CSPT_MAX_BATCH    (CSPT_QUEUE_SIZE / 4)
+#define CSPT_PFIELDS      16
+#define CSPT_STRLEN       128
+
+#ifdef HAVE_ATOMIC_BUILTIN
+#  define CSPT_LOCK(pt)
+#  define CSPT_UNLOCK(pt)
+#  define CSPT_LOAD(x)          __sync_fetch_and_add(&(x), 0)
+#  define CSPT_STORE(x, v)      do { __sync_synchronize(); (x) = (v); } while (0)
+#  define CSPT_CAS(x, o, n)     __sync_bool_compare_and_swap(&(x), (o), (n))
+#  define CSPT_ADD(x, v)        __sync_fetch_and_add(&(x), (v))
+#else
+/* without atomics, the ring is protected by queueLock */
+#  define CSPT_LOCK(pt)         csoundLockMutex((pt)->queueLock)
+#  define CSPT_UNLOCK(pt)       csoundUnlockMutex((pt)->queueLock)
+#  define CSPT_LOAD(x)          (x)
+#  define CSPT_STORE(x, v)      ((x) = (v))
+#  define CSPT_CAS(x, o, n)     ((x) == (o) ? ((x) = (n), true) : false)
+#  define CSPT_ADD(x, v)        ((x) += (v))
+#endif
+
+enum {
+    CSPT_SCORE_EVENT,
+    CSPT_INPUT_MESSAGE,
+    CSPT_MESSAGE
+};
+
+struct CsPerfThreadEventRecord {
+    volatile unsigned int seq;
+    int     type;
+    char    opcod;
+    int     absp2mode;
+    int     pcnt;
+    int64_t frame;
+    CsoundPerformanceThreadMessage *msg;
+    union {
+      MYFLT p[CSPT_PFIELDS];
+      char  s[CSPT_STRLEN];
+    } u;
+};
+
+/**
+ * Sends a score event, converting p2 to the time relative to now if
+ * absp2mode is set or a sample frame is given.
+ */
+
+static void csPerfThread_scoreEvent(CSOUND *csound, int absp2mode,
+                                    int64_t frame, char opcod,
+                                    int pcnt, MYFLT *pp)
+{
+    if ((absp2mode || frame >= 0) && pcnt > 1) {
+      double  p2;
+      if (frame >= 0)
+        p2 = (double) pp[1]
+             + (double) (frame - csoundGetCurrentTimeSamples(csound))
+               / (double) csoundGetSr(csound);
+      else
+        p2 = (double) pp[1] - csoundGetScoreTime(csound);
+      if (p2 < 0.0) {
+        if (pcnt > 2 && pp[2] >= (MYFLT) 0 &&
+            (opcod == 'a' || opcod == 'i')) {
+          pp[2] = (MYFLT) ((double) pp[2] + p2);
+          if (pp[2] <= (MYFLT) 0)
+            return;
+        }
+        p2 = 0.0;
+      }
+      pp[1] = (MYFLT) p2;
+    }
+    if (csoundScoreEvent(csound, opcod, pp, (long) pcnt) != 0)
+      csoundMessageS(csound, CSOUNDMSG_WARNING,
+                     "WARNING: could not create score event\n");
+}
+
+// ----------------------------------------------------------------------------
+
 /**
  * Base class for event messages.
  */
@@ -64,12 +153,10 @@ class CsoundPerformanceThreadMessage {
     }
 
  public:
-    CsoundPerformanceThreadMessage *nxt;
     virtual int run() = 0;
     CsoundPerformanceThreadMessage(CsoundPerformanceThread *pt)
     {
       pt_ = pt;
-      nxt = (CsoundPerformanceThreadMessage*) 0;
     }
     virtual ~CsoundPerformanceThreadMessage() {}
 };
@@ -270,10 +357,11 @@ class CsPerfThreadMsg_Stop : public CsoundPerformanceThreadMessage {
 };
 
 /**
- * Score event message
+ * Score event message, for events with more than CSPT_PFIELDS p-fields
  *
  * absp2mode: if non-zero, start times are measured from the beginning of
  *            performance, instead of the current time
+ * frame:     if not negative, start times are measured from this sample
  * opcod:     score opcode (e.g. 'i' for a note event)
  * pcnt:      number of p-fields
  * *p:        array of p-fields, p[0] is p1
@@ -284,69 +372,46 @@ class CsPerfThreadMsg_ScoreEvent : public CsoundPerformanceThreadMessage {
     char    opcod;
     int     absp2mode;
     int     pcnt;
+    int64_t frame;
     MYFLT   *pp;
-    MYFLT   p[10];
  public:
     CsPerfThreadMsg_ScoreEvent(CsoundPerformanceThread *pt,
-                               int absp2mode, char opcod,
+                               int absp2mode, int64_t frame, char opcod,
                                int pcnt, const MYFLT *p)
     : CsoundPerformanceThreadMessage(pt)
     {
       this->opcod = opcod;
       this->absp2mode = absp2mode;
+      this->frame = frame;
       this->pcnt = pcnt;
-      if (pcnt <= 10)
-        this->pp = &(this->p[0]);
-      else
-        this->pp = new MYFLT[(unsigned int) pcnt];
+      this->pp = new MYFLT[(unsigned int) pcnt];
       for (int i = 0; i < pcnt; i++)
         this->pp[i] = p[i];
     }
     int run() {
-      CSOUND  *csound = pt_->GetCsound();
-      if (absp2mode && pcnt > 1) {
-        double  p2 = (double) pp[1] - csoundGetScoreTime(csound);
-        if (p2 < 0.0) {
-          if (pcnt > 2 && pp[2] >= (MYFLT) 0 &&
-              (opcod == 'a' || opcod == 'i')) {
-            pp[2] = (MYFLT) ((double) pp[2] + p2);
-            if (pp[2] <= (MYFLT) 0)
-              return 0;
-          }
-          p2 = 0.0;
-        }
-        pp[1] = (MYFLT) p2;
-      }
-      if (csoundScoreEvent(csound, opcod, pp, (long) pcnt) != 0)
-        csoundMessageS(csound, CSOUNDMSG_WARNING,
-                       "WARNING: could not create score event\n");
+      csPerfThread_scoreEvent(pt_->GetCsound(), absp2mode, frame,
+                              opcod, pcnt, pp);
       return 0;
     }
     ~CsPerfThreadMsg_ScoreEvent()
     {
-      if (pcnt > 10)
-        delete[] pp;
+      delete[] pp;
     }
 };
 
 /**
- * Score event message as a string
+ * Score event message as a string, for strings that do not fit in a
+ * queue record
  */
 
 class CsPerfThreadMsg_InputMessage : public CsoundPerformanceThreadMessage {
  private:
-    int     len;
     char    *sp;
-    char    s[128];
  public:
     CsPerfThreadMsg_InputMessage(CsoundPerformanceThread *pt, const char *s)
     : CsoundPerformanceThreadMessage(pt)
     {
-      len = (int) strlen(s);
-      if (len < 128)
-        this->sp = &(this->s[0]);
-      else
-        this->sp = new char[(unsigned int) (len + 1)];
+      this->sp = new char[(unsigned int) (strlen(s) + 1)];
       strcpy(this->sp, s);
     }
     int run()
@@ -356,8 +421,7 @@ class CsPerfThreadMsg_InputMessage : public CsoundPerformanceThreadMessage {
     }
     ~CsPerfThreadMsg_InputMessage()
     {
-      if (len >= 128)
-        delete[] sp;
+      delete[] sp;
     }
 };
 
@@ -391,40 +455,85 @@ public:
  * Returns a negative value on error.
  */
 
+/**
+ * Runs all messages queued so far, stopping early if one of them returns
+ * non-zero (stop or error). Called from the performance thread only.
+ */
+
+int CsoundPerformanceThread::ProcessQueue()
+{
+    int retval = 0;
+    CSPT_LOCK(this);
+    do {
+      unsigned int pos = queueHead;
+      CsPerfThreadEventRecord *rec = &queue[pos & (CSPT_QUEUE_SIZE - 1)];
+      if (CSPT_LOAD(rec->seq) != pos + 1)
+        break;
+      switch (rec->type) {
+      case CSPT_SCORE_EVENT:
+        csPerfThread_scoreEvent(csound, rec->absp2mode, rec->frame,
+                                rec->opcod, rec->pcnt, rec->u.p);
+        break;
+      case CSPT_INPUT_MESSAGE:
+        csoundInputMessage(csound, rec->u.s);
+        break;
+      default:
+        retval = rec->msg->run();
+        delete rec->msg; // TODO: This should be moved out of the Perform function
+        rec->msg = (CsoundPerformanceThreadMessage*) 0;
+        break;
+      }
+      // hand the record back to the senders for the next lap
+      CSPT_STORE(rec->seq, pos + CSPT_QUEUE_SIZE);
+      CSPT_STORE(queueHead, pos + 1);
+    } while (!retval);
+    CSPT_UNLOCK(this);
+    if (CSPT_LOAD(flushWaiting))
+      csoundNotifyThreadLock(flushLock);
+    return retval;
+}
+
+/**
+ * Deletes all queued messages without running them.
+ */
+
+void CsoundPerformanceThread::DiscardQueue()
+{
+    if (!queue || !queueLock)
+      return;
+    CSPT_LOCK(this);
+    for (;;) {
+      unsigned int pos = queueHead;
+      CsPerfThreadEventRecord *rec = &queue[pos & (CSPT_QUEUE_SIZE - 1)];
+      if (CSPT_LOAD(rec->seq) != pos + 1)
+        break;
+      if (rec->type == CSPT_MESSAGE) {
+        delete rec->msg;
+        rec->msg = (CsoundPerformanceThreadMessage*) 0;
+      }
+      CSPT_STORE(rec->seq, pos + CSPT_QUEUE_SIZE);
+      CSPT_STORE(queueHead, pos + 1);
+    }
+    CSPT_UNLOCK(this);
+}
+
 int CsoundPerformanceThread::Perform()
 {
     int retval = 0;
     do {
-      while (firstMessage) {
-        csoundLockMutex(queueLock);
-        do {
-          CsoundPerformanceThreadMessage *msg;
-          // get oldest message
-          msg = (CsoundPerformanceThreadMessage*) firstMessage;
-          if (!msg)
-            break;
-          // unlink from FIFO
-          firstMessage = msg->nxt;
-          if (!msg->nxt)
-            lastMessage = (CsoundPerformanceThreadMessage*) 0;
-          // process and destroy message
-          retval = msg->run();
-          delete msg; // TODO: This should be moved out of the Perform function
-        } while (!retval);
-        if (paused)
-          csoundWaitThreadLock(pauseLock, (size_t) 0);
-        // mark queue as empty
-        csoundNotifyThreadLock(flushLock);
-        csoundUnlockMutex(queueLock);
-        // if error or end of score, return now
-        if (retval)
-          goto endOfPerf;
-        // if paused, wait until a new message is received, then loop back
-        if (!paused)
-          break;
-        // VL: if this is paused, then it will double lock.
+      {
+        unsigned int pos = queueHead;
+        if (CSPT_LOAD(queue[pos & (CSPT_QUEUE_SIZE - 1)].seq) == pos + 1) {
+          retval = ProcessQueue();
+          // if error or end of score, return now
+          if (retval)
+            goto endOfPerf;
+        }
+      }
+      // if paused, wait until a new message is received, then loop back
+      if (paused) {
         csoundWaitThreadLockNoTimeout(pauseLock);
-        csoundNotifyThreadLock(pauseLock);
+        continue;
       }
       if(processcallback != NULL)
            processcallback(cdata);
@@ -451,20 +560,8 @@ int CsoundPerformanceThread::Perform()
     status = retval;
     csoundCleanup(csound);
     // delete any pending messages
-    csoundLockMutex(queueLock);
-    {
-      CsoundPerformanceThreadMessage *msg;
-      msg = (CsoundPerformanceThreadMessage*) firstMessage;
-      firstMessage = (CsoundPerformanceThreadMessage*) 0;
-      lastMessage = (CsoundPerformanceThreadMessage*) 0;
-      while (msg) {
-        CsoundPerformanceThreadMessage *nxt = msg->nxt;
-        delete msg;
-        msg = nxt;
-      }
-    }
+    DiscardQueue();
     csoundNotifyThreadLock(flushLock);
-    csoundUnlockMutex(queueLock);
     running = 1;
     return retval;
 }
@@ -501,8 +598,9 @@ extern "C" {
 void CsoundPerformanceThread::csPerfThread_constructor(CSOUND *csound_)
 {
     csound = csound_;
-    firstMessage = (CsoundPerformanceThreadMessage*) 0;
-    lastMessage = (CsoundPerformanceThreadMessage*) 0;
+    queue = (CsPerfThreadEventRecord*) 0;
+    queueHead = queueTail = 0U;
+    flushWaiting = 0;
     queueLock = (void*) 0;
     pauseLock = (void*) 0;
     flushLock = (void*) 0;
@@ -526,12 +624,15 @@ void CsoundPerformanceThread::csPerfThread_constructor(CSOUND *csound_)
     if (!recordLock)
       return;
     try {
-      lastMessage = new CsPerfThreadMsg_Pause(this);
+      queue = new CsPerfThreadEventRecord[CSPT_QUEUE_SIZE];
     }
     catch (std::bad_alloc&) {
       return;
     }
-    firstMessage = lastMessage;
+    for (unsigned int i = 0; i < CSPT_QUEUE_SIZE; i++) {
+      queue[i].seq = i;
+      queue[i].msg = (CsoundPerformanceThreadMessage*) 0;
+    }
     recordData.cbuf = NULL;
     recordData.sfile = NULL;
     recordData.thread = NULL;
@@ -577,28 +678,70 @@ CsoundPerformanceThread::~CsoundPerformanceThread()
     if (!status)
       this->Stop();     // FIXME: should handle memory errors here
     this->Join();
+    delete[] queue;
 }
 
 // ----------------------------------------------------------------------------
 
+/**
+ * Reserves n consecutive queue records, waiting for the performance thread
+ * if the queue is full. Returns NULL if performance has already finished.
+ * Without atomic builtins, returns with queueLock held until the records
+ * are committed.
+ */
+
+CsPerfThreadEventRecord *
+CsoundPerformanceThread::ReserveRecords(int n, unsigned int *pos)
+{
+    for (;;) {
+      if (status)
+        return (CsPerfThreadEventRecord*) 0;
+      CSPT_LOCK(this);
+      unsigned int p = CSPT_LOAD(queueTail);
+      unsigned int last = p + (unsigned int) (n - 1);
+      // records are freed in order, so if the last one is free all are
+      int dif = (int) (CSPT_LOAD(queue[last & (CSPT_QUEUE_SIZE - 1)].seq)
+                       - last);
+      if (dif == 0 && CSPT_CAS(queueTail, p, p + (unsigned int) n)) {
+        *pos = p;
+        return queue;
+      }
+      CSPT_UNLOCK(this);
+      if (dif < 0) {
+        // full: wake up the performance thread and give it time to catch up
+        csoundNotifyThreadLock(pauseLock);
+        csoundSleep(1);
+      }
+    }
+}
+
+/**
+ * Hands n records filled by the caller over to the performance thread.
+ */
+
+void CsoundPerformanceThread::CommitRecords(unsigned int pos, int n)
+{
+    for (int i = 0; i < n; i++) {
+      unsigned int p = pos + (unsigned int) i;
+      CSPT_STORE(queue[p & (CSPT_QUEUE_SIZE - 1)].seq, p + 1);
+    }
+    CSPT_UNLOCK(this);
+    // wake up from pause
+    csoundNotifyThreadLock(pauseLock);
+}
+
 void CsoundPerformanceThread::QueueMessage(CsoundPerformanceThreadMessage *msg)
 {
-    if (status) {
+    unsigned int pos;
+    CsPerfThreadEventRecord *q = ReserveRecords(1, &pos);
+    if (!q) {
       delete msg;
       return;
     }
-    csoundLockMutex(queueLock);
-    // link message into FIFO
-    if (!lastMessage)
-      firstMessage = msg;
-    else
-      lastMessage->nxt = msg;
-    lastMessage = msg;
-    // mark queue as non-empty
-    csoundWaitThreadLock(flushLock, (size_t) 0);
-    // wake up from pause
-    csoundNotifyThreadLock(pauseLock);
-    csoundUnlockMutex(queueLock);
+    CsPerfThreadEventRecord *rec = &q[pos & (CSPT_QUEUE_SIZE - 1)];
+    rec->type = CSPT_MESSAGE;
+    rec->msg = msg;
+    CommitRecords(pos, 1);
 }
 
 void CsoundPerformanceThread::Play()
@@ -637,13 +780,66 @@ void CsoundPerformanceThread::StopRecord()
 void CsoundPerformanceThread::ScoreEvent(int absp2mode, char opcod,
                                          int pcnt, const MYFLT *p)
 {
-    QueueMessage(new CsPerfThreadMsg_ScoreEvent(this,
-                                                absp2mode, opcod, pcnt, p));
+    CsoundPerformanceThreadEvent  ev;
+    ev.opcod = opcod;
+    ev.absp2mode = absp2mode;
+    ev.pcnt = pcnt;
+    ev.p = p;
+    ev.frame = -1;
+    ScoreEvents(1, &ev);
+}
+
+void CsoundPerformanceThread::ScoreEvents(int nevents,
+                                          const CsoundPerformanceThreadEvent
+                                          *events)
+{
+    while (nevents > 0) {
+      int n = (nevents < CSPT_MAX_BATCH ? nevents : CSPT_MAX_BATCH);
+      unsigned int pos;
+      CsPerfThreadEventRecord *q = ReserveRecords(n, &pos);
+      if (!q)
+        return;
+      for (int i = 0; i < n; i++) {
+        CsPerfThreadEventRecord *rec =
+          &q[(pos + (unsigned int) i) & (CSPT_QUEUE_SIZE - 1)];
+        const CsoundPerformanceThreadEvent *ev = &events[i];
+        if (ev->pcnt <= CSPT_PFIELDS) {
+          rec->type = CSPT_SCORE_EVENT;
+          rec->opcod = ev->opcod;
+          rec->absp2mode = ev->absp2mode;
+          rec->frame = ev->frame;
+          rec->pcnt = ev->pcnt;
+          for (int j = 0; j < ev->pcnt; j++)
+            rec->u.p[j] = ev->p[j];
+        }
+        else {
+          rec->type = CSPT_MESSAGE;
+          rec->msg = new CsPerfThreadMsg_ScoreEvent(this, ev->absp2mode,
+                                                    ev->frame, ev->opcod,
+                                                    ev->pcnt, ev->p);
+        }
+      }
+      CommitRecords(pos, n);
+      events += n;
+      nevents -= n;
+    }
 }
 
 void CsoundPerformanceThread::InputMessage(const char *s)
 {
-    QueueMessage(new CsPerfThreadMsg_InputMessage(this, s));
+    size_t  len = strlen(s);
+    if (len >= CSPT_STRLEN) {
+      QueueMessage(new CsPerfThreadMsg_InputMessage(this, s));
+      return;
+    }
+    unsigned int pos;
+    CsPerfThreadEventRecord *q = ReserveRecords(1, &pos);
+    if (!q)
+      return;
+    CsPerfThreadEventRecord *rec = &q[pos & (CSPT_QUEUE_SIZE - 1)];
+    rec->type = CSPT_INPUT_MESSAGE;
+    memcpy(rec->u.s, s, len + 1);
+    CommitRecords(pos, 1);
 }
 
 void CsoundPerformanceThread::SetScoreOffsetSeconds(double timeVal)
@@ -663,17 +859,7 @@ int CsoundPerformanceThread::Join()
     }
 
     // delete any pending messages
-    {
-      CsoundPerformanceThreadMessage *msg;
-      msg = (CsoundPerformanceThreadMessage*) firstMessage;
-      firstMessage = (CsoundPerformanceThreadMessage*) 0;
-      lastMessage = (CsoundPerformanceThreadMessage*) 0;
-      while (msg) {
-        CsoundPerformanceThreadMessage *nxt = msg->nxt;
-        delete msg;
-        msg = nxt;
-      }
-    }
+    DiscardQueue();
     // delete all thread locks
     if (queueLock) {
       csoundDestroyMutex(queueLock);
@@ -700,8 +886,16 @@ int CsoundPerformanceThread::Join()
 
 void CsoundPerformanceThread::FlushMessageQueue()
 {
-    if (firstMessage) {
-      csoundWaitThreadLockNoTimeout(flushLock);
-      csoundNotifyThreadLock(flushLock);
-    }
+    if (!queue || !flushLock)
+      return;
+    unsigned int target = CSPT_LOAD(queueTail);
+    CSPT_LOCK(this);
+    CSPT_ADD(flushWaiting, 1);
+    CSPT_UNLOCK(this);
+    // the timeout covers a wakeup sent just before we started waiting
+    while (!status && (int) (CSPT_LOAD(queueHead) - target) < 0)
+      csoundWaitThreadLock(flushLock, (size_t) 10);
+    CSPT_LOCK(this);
+    CSPT_ADD(flushWaiting, -1);
+    CSPT_UNLOCK(this);
 }
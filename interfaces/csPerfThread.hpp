@@ -26,6 +26,7 @@
 
 class CsoundPerformanceThreadMessage;
 class CsPerfThread_PerformScore;
+struct CsPerfThreadEventRecord;
 
 #ifdef SWIG
 %include <std_string.i>
@@ -106,6 +107,25 @@ struct PUBLIC pycallbackdata {
 };
 #endif
 
+/**
+ * A score event for CsoundPerformanceThread::ScoreEvents().
+ *
+ * opcod:     score opcode (e.g. 'i' for a note event)
+ * absp2mode: if non-zero, p2 is measured from the beginning of performance
+ * pcnt:      number of p-fields
+ * p:         array of p-fields, p[0] is p1; copied when the event is queued
+ * frame:     if not negative, p2 is measured from this sample frame
+ *            (see csoundGetCurrentTimeSamples()) instead, so that events
+ *            sent from another thread keep their relative timing
+ */
+typedef struct {
+    char    opcod;
+    int     absp2mode;
+    int     pcnt;
+    const MYFLT *p;
+    int64_t frame;
+} CsoundPerformanceThreadEvent;
+
 typedef struct {
     void *cbuf;
     void *sfile;
@@ -118,9 +138,11 @@ typedef struct {
 class PUBLIC CsoundPerformanceThread {
  private:
     CSOUND  *csound;
-    volatile CsoundPerformanceThreadMessage *firstMessage;
-    CsoundPerformanceThreadMessage *lastMessage;
-    void    *queueLock;         // this is actually a mutex
+    CsPerfThreadEventRecord *queue;     // preallocated message ring
+    volatile unsigned int queueHead;    // next record to be run
+    volatile unsigned int queueTail;    // next record to be handed out
+    volatile int flushWaiting;
+    void    *queueLock;         // a mutex, used only without atomic builtins
     void    *pauseLock;
     void    *flushLock;
     void    *recordLock;
@@ -133,6 +155,10 @@ class PUBLIC CsoundPerformanceThread {
     void (*processcallback)(void *cdata);
     int  Perform();
     void csPerfThread_constructor(CSOUND *);
+    CsPerfThreadEventRecord *ReserveRecords(int n, unsigned int *pos);
+    void CommitRecords(unsigned int pos, int n);
+    int  ProcessQueue();
+    void DiscardQueue();
     void QueueMessage(CsoundPerformanceThreadMessage *);
  public:
 #ifdef SWIGPYTHON
@@ -205,6 +231,11 @@ class PUBLIC CsoundPerformanceThread {
      * performance, instead of the default of relative to the current time.
      */
     void ScoreEvent(int absp2mode, char opcod, int pcnt, const MYFLT *p);
+    /**
+     * Sends 'nevents' score events at once. The events are queued in
+     * order, and the performance thread is woken only once.
+     */
+    void ScoreEvents(int nevents, const CsoundPerformanceThreadEvent *events);
     /**
      * Sends a score event as a string, similarly to line events (-L).
      */
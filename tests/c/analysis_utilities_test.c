@@ -0,0 +1,230 @@
+#include "csound.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <CUnit/Basic.h>
+
+#include <stdlib.h>
+
+/* The input and the reference analyses are in the source directory. The
+   references were made from this input by the single threaded hetro and
+   lpanal, so the -j tests also check the results are unchanged. They
+   store doubles, and are only compared with in double precision builds. */
+#define INPUT_FILE      "analysis_test_input.wav"
+#define REF_HET         "analysis_test_ref.het"
+#define REF_LPC         "analysis_test_ref.lpc"
+#define REF_POLES       "analysis_test_ref_poles.lpc"
+
+static char srcdir[1024] = "";
+
+static char *source_file(char *buf, const char *name)
+{
+    snprintf(buf, 1024, "%s%s", srcdir, name);
+    return buf;
+}
+
+int init_suite1(void)
+{
+    return 0;
+}
+
+int clean_suite1(void)
+{
+    return 0;
+}
+
+static int run_utility(const char *name, int argc, char **argv)
+{
+    int ret;
+    CSOUND  *csound = csoundCreate(NULL);
+    ret = csoundRunUtility(csound, name, argc, argv);
+    csoundDestroy(csound);
+    return ret;
+}
+
+static long read_file(const char *name, unsigned char **data)
+{
+    FILE *f = fopen(name, "rb");
+    long len;
+
+    *data = NULL;
+    if (f == NULL)
+      return -1;
+    fseek(f, 0L, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0L, SEEK_SET);
+    *data = (unsigned char *) malloc(len > 0 ? len : 1);
+    if (fread(*data, 1, len, f) != (size_t) len)
+      len = -1;
+    fclose(f);
+    return len;
+}
+
+/* Returns 1 if both files exist and have the same contents. */
+static int files_equal(const char *a, const char *b)
+{
+    unsigned char *da, *db;
+    long la = read_file(a, &da), lb = read_file(b, &db);
+    int equal = (la >= 0 && la == lb && memcmp(da, db, la) == 0);
+
+    free(da);
+    free(db);
+    return equal;
+}
+
+/* Returns 1 if two text format hetro files hold the same values, allowing
+   for the last digit to be rounded differently. */
+static int het_matches(const char *name, const char *ref)
+{
+    FILE *fa = fopen(name, "r"), *fb = fopen(ref, "r");
+    int a, b, na, nb, equal = 0;
+
+    if (fa != NULL && fb != NULL &&
+        fscanf(fa, "HETRO %d", &a) == 1 && fscanf(fb, "HETRO %d", &b) == 1 &&
+        a == b) {
+      do {
+        na = fscanf(fa, " %d ,", &a);
+        nb = fscanf(fb, " %d ,", &b);
+      } while (na == 1 && nb == 1 && abs(a - b) <= 1);
+      equal = (na == EOF && nb == EOF);
+    }
+    if (fa != NULL) fclose(fa);
+    if (fb != NULL) fclose(fb);
+    return equal;
+}
+
+/* Returns 1 if two lpanal files have the same header and their values
+   agree to within rounding. */
+static int lpc_matches(const char *name, const char *ref)
+{
+    unsigned char *da, *db;
+    long la = read_file(name, &da), lb = read_file(ref, &db);
+    int32_t hdr;
+    long i;
+    int equal = (la > 4 && la == lb);
+
+    if (equal) {
+      memcpy(&hdr, db, sizeof(int32_t));
+      equal = (hdr > 0 && hdr <= la && memcmp(da, db, hdr) == 0 &&
+               (la - hdr) % sizeof(double) == 0);
+      for (i = hdr; equal && i < la; i += sizeof(double)) {
+        double x, y;
+        memcpy(&x, da + i, sizeof(double));
+        memcpy(&y, db + i, sizeof(double));
+        equal = (x == y || fabs(x - y) <= 1.0e-6 * (fabs(x) + fabs(y)));
+      }
+    }
+    free(da);
+    free(db);
+    return equal;
+}
+
+static int have_reference(void)
+{
+    return (csoundGetSizeOfMYFLT() == (int) sizeof(double));
+}
+
+void test_hetro_threads(void)
+{
+    char input[1024], ref[1024];
+    char *serial[] = { "hetro", "-f220", "-h12", "-j1",
+                       input, "analysis_test_serial.het" };
+    char *parallel[] = { "hetro", "-f220", "-h12", "-j4",
+                         input, "analysis_test_parallel.het" };
+
+    source_file(input, INPUT_FILE);
+    source_file(ref, REF_HET);
+    CU_ASSERT(run_utility("hetro", 6, serial) == 0);
+    CU_ASSERT(run_utility("hetro", 6, parallel) == 0);
+    CU_ASSERT(files_equal("analysis_test_serial.het",
+                          "analysis_test_parallel.het"));
+    if (have_reference())
+      CU_ASSERT(het_matches("analysis_test_serial.het", ref));
+    remove("analysis_test_serial.het");
+    remove("analysis_test_parallel.het");
+}
+
+void test_lpanal_threads(void)
+{
+    char input[1024], ref[1024];
+    char *serial[] = { "lpanal", "-p24", "-h128", "-P100", "-Q400", "-j1",
+                       input, "analysis_test_serial.lpc" };
+    char *parallel[] = { "lpanal", "-p24", "-h128", "-P100", "-Q400", "-j3",
+                         input, "analysis_test_parallel.lpc" };
+
+    source_file(input, INPUT_FILE);
+    source_file(ref, REF_LPC);
+    CU_ASSERT(run_utility("lpanal", 8, serial) == 0);
+    CU_ASSERT(run_utility("lpanal", 8, parallel) == 0);
+    CU_ASSERT(files_equal("analysis_test_serial.lpc",
+                          "analysis_test_parallel.lpc"));
+    if (have_reference())
+      CU_ASSERT(lpc_matches("analysis_test_serial.lpc", ref));
+    remove("analysis_test_serial.lpc");
+    remove("analysis_test_parallel.lpc");
+}
+
+void test_lpanal_poles_threads(void)
+{
+    char input[1024], ref[1024];
+    char *serial[] = { "lpanal", "-a", "-p24", "-h128", "-P100", "-Q400",
+                       "-j1", input, "analysis_test_serial.lpc" };
+    char *parallel[] = { "lpanal", "-a", "-p24", "-h128", "-P100", "-Q400",
+                         "-j4", input, "analysis_test_parallel.lpc" };
+
+    source_file(input, INPUT_FILE);
+    source_file(ref, REF_POLES);
+    CU_ASSERT(run_utility("lpanal", 9, serial) == 0);
+    CU_ASSERT(run_utility("lpanal", 9, parallel) == 0);
+    CU_ASSERT(files_equal("analysis_test_serial.lpc",
+                          "analysis_test_parallel.lpc"));
+    if (have_reference())
+      CU_ASSERT(lpc_matches("analysis_test_serial.lpc", ref));
+    remove("analysis_test_serial.lpc");
+    remove("analysis_test_parallel.lpc");
+}
+
+int main(int argc, char **argv)
+{
+    CU_pSuite pSuite = NULL;
+    int i;
+
+    /* pick up the plugin directory passed in by the test runner, so that
+       the utilities in libstdutil can be found, and the directory of the
+       test input */
+    for (i = 1; i < argc; i++) {
+      if (strncmp(argv[i], "-+env:OPCODE6DIR64=", 19) == 0)
+        csoundSetGlobalEnv("OPCODE6DIR64", argv[i] + 19);
+      else if (argv[i][0] != '-')
+        snprintf(srcdir, sizeof(srcdir), "%s", argv[i]);
+    }
+
+    /* initialize the CUnit test registry */
+    if (CUE_SUCCESS != CU_initialize_registry())
+       return CU_get_error();
+
+    /* add a suite to the registry */
+    pSuite = CU_add_suite("Analysis Utility Tests", init_suite1, clean_suite1);
+    if (NULL == pSuite) {
+       CU_cleanup_registry();
+       return CU_get_error();
+    }
+
+    /* add the tests to the suite */
+    if ((NULL == CU_add_test(pSuite, "hetro threads", test_hetro_threads))
+        || (NULL == CU_add_test(pSuite, "lpanal threads", test_lpanal_threads))
+        || (NULL == CU_add_test(pSuite, "lpanal poles threads",
+                                test_lpanal_poles_threads))
+       ) {
+       CU_cleanup_registry();
+       return CU_get_error();
+    }
+
+    /* Run all tests using the CUnit Basic interface */
+    CU_basic_set_mode(CU_BRM_VERBOSE);
+    CU_basic_run_tests();
+    CU_cleanup_registry();
+    return CU_get_error();
+}
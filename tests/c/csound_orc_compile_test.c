@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include "csoundCore.h"
 #include "CUnit/Basic.h"
 
@@ -166,6 +167,331 @@ void test_linenum(void)
 }
 
 
+/* Runs an instrument computing the same expression once as a single
+   statement, which is fused into one ##expr opcode unless disabled, and
+   once operator by operator; returns the largest difference seen. */
+static MYFLT run_expression(const char *option, MYFLT *rms)
+{
+    CSOUND  *csound;
+    MYFLT   diff;
+    char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "instr 1 \n"
+            "kf line 1, p3, 2 \n"
+            "a1 oscili 0.5, 220 \n"
+            "a2 oscili 0.3, 331 \n"
+            "ifac = p4 \n"
+            "aout = a1*kf + a2*0.5 - sin(a1*ifac)/kf + abs(-a2) \n"
+            "at1 = a1*kf \n"
+            "at2 = a2*0.5 \n"
+            "at3 = a1*ifac \n"
+            "at4 = sin(at3) \n"
+            "at5 = at4/kf \n"
+            "at6 = at1+at2 \n"
+            "at7 = at6-at5 \n"
+            "at8 = abs(a2) \n"
+            "aref = at7+at8 \n"
+            "kd max_k aout-aref, 1, 1 \n"
+            "kmax init 0 \n"
+            "kmax = (kd > kmax ? kd : kmax) \n"
+            "chnset kmax, \"diff\" \n"
+            "krms rms aout \n"
+            "chnset krms, \"rms\" \n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    csoundSetOption(csound, "--sample-accurate");
+    if (option != NULL)
+      csoundSetOption(csound, (char *) option);
+    CU_ASSERT(csoundCompileOrc(csound, instrument) == 0);
+    csoundReadScore(csound, "i 1 0.0123 0.5 1.5\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    while (csoundPerformKsmps(csound) == 0);
+    diff = csoundGetControlChannel(csound, "diff", NULL);
+    *rms = csoundGetControlChannel(csound, "rms", NULL);
+    csoundDestroy(csound);
+    return diff;
+}
+
+void test_fused_expression(void)
+{
+    MYFLT   rms1, rms2;
+
+    CU_ASSERT_EQUAL(run_expression(NULL, &rms1), 0.0);
+    CU_ASSERT_EQUAL(run_expression("--no-expression-opt", &rms2), 0.0);
+    CU_ASSERT(rms1 > 0.0);
+    CU_ASSERT_EQUAL(rms1, rms2);
+}
+
+
+/* Runs an instrument with foldable constants, a common subexpression
+   and a k-rate function of i-time values, storing the channel values. */
+static void run_optimised(const char *option, MYFLT *res)
+{
+    CSOUND  *csound;
+    char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "instr 1 \n"
+            "ka line 0, p3, 1 \n"
+            "kb = 0.25 \n"
+            "ifreq = 440 * 2 ^ (1/12) \n"
+            "ihalf = i(ifreq) / 2 \n"
+            "kc = (ka+kb)*(ka+kb) - (ka+kb) \n"
+            "ks = sin:k(ihalf/1000) * 2 \n"
+            "chnset ifreq, \"freq\" \n"
+            "chnset ihalf, \"half\" \n"
+            "chnset kc, \"c\" \n"
+            "chnset ks, \"s\" \n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    if (option != NULL)
+      csoundSetOption(csound, (char *) option);
+    CU_ASSERT(csoundCompileOrc(csound, instrument) == 0);
+    csoundReadScore(csound, "i 1 0 0.5\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    while (csoundPerformKsmps(csound) == 0);
+    res[0] = csoundGetControlChannel(csound, "freq", NULL);
+    res[1] = csoundGetControlChannel(csound, "half", NULL);
+    res[2] = csoundGetControlChannel(csound, "c", NULL);
+    res[3] = csoundGetControlChannel(csound, "s", NULL);
+    csoundDestroy(csound);
+}
+
+void test_optimised_expressions(void)
+{
+    MYFLT   res1[4], res2[4];
+    int     i;
+
+    run_optimised(NULL, res1);
+    run_optimised("--no-expression-opt", res2);
+    for (i = 0; i < 4; i++)
+      CU_ASSERT_EQUAL(res1[i], res2[i]);
+    CU_ASSERT_DOUBLE_EQUAL(res1[0], 466.1637615, 0.0001);
+    CU_ASSERT_DOUBLE_EQUAL(res1[1], 233.0818808, 0.0001);
+    CU_ASSERT(res1[2] > 0.0);
+}
+
+/* counts the instruments the orchestra cache reports as reused */
+static int cache_hits;
+
+static void count_cache_hits(CSOUND *csound, int attr,
+                             const char *format, va_list args)
+{
+    char    buf[256];
+    int     reused, total;
+
+    (void) csound; (void) attr;
+    vsnprintf(buf, 256, format, args);
+    if (sscanf(buf, "orchestra cache: %d of %d", &reused, &total) == 2)
+      cache_hits += reused;
+}
+
+/* compiles and runs an orchestra, returning the instruments taken from
+   the cache; the cache outlives csoundReset() */
+static int compile_cached(CSOUND *csound, const char *option,
+                          const char *orc, const char *score)
+{
+    cache_hits = 0;
+    csoundSetMessageCallback(csound, count_cache_hits);
+    csoundSetOption(csound, "-n");
+    csoundSetOption(csound, "-m128");
+    if (option != NULL)
+      csoundSetOption(csound, (char *) option);
+    CU_ASSERT(csoundCompileOrc(csound, orc) == 0);
+    csoundReadScore(csound, (char *) score);
+    CU_ASSERT(csoundStart(csound) == 0);
+    while (csoundPerformKsmps(csound) == 0);
+    return cache_hits;
+}
+
+/* compiles and runs the same orchestra twice, resetting in between, so
+   that the second run can take its instruments from the cache */
+static void run_cached(const char *option, MYFLT *res, int *hits)
+{
+    CSOUND  *csound;
+    int     i;
+    char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "gkcount init 0\n"
+            "opcode twice, k, k\n"
+            "kin xin\n"
+            "xout kin * 2\n"
+            "endop\n"
+            "instr 1 \n"
+            "gkcount += 1 \n"
+            "gisum = 3 + 4 \n"
+            "kx twice gkcount \n"
+            "chnset kx, \"x\" \n"
+            "endin \n"
+            "instr 2 \n"
+            "chnset gisum, \"sum\" \n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    for (i = 0; i < 2; i++) {
+      hits[i] = compile_cached(csound, option, instrument,
+                               "i 1 0 0.1\ni 2 0.05 0.05\n");
+      res[2 * i] = csoundGetControlChannel(csound, "x", NULL);
+      res[2 * i + 1] = csoundGetControlChannel(csound, "sum", NULL);
+      csoundReset(csound);
+    }
+    csoundDestroy(csound);
+}
+
+void test_orc_cache(void)
+{
+    MYFLT   res1[4], res2[4];
+    int     hits1[2], hits2[2];
+    int     i;
+
+    run_cached(NULL, res1, hits1);
+    run_cached("-+orc_cache=0", res2, hits2);
+    for (i = 0; i < 4; i++)
+      CU_ASSERT_EQUAL(res1[i], res2[i]);
+    CU_ASSERT_EQUAL(res1[0], res1[2]);
+    CU_ASSERT_EQUAL(res1[1], 7.0);
+    CU_ASSERT_EQUAL(res1[3], 7.0);
+    /* the second compile is served from the cache */
+    CU_ASSERT_EQUAL(hits1[0], 0);
+    CU_ASSERT_EQUAL(hits1[1], 2);
+    CU_ASSERT_EQUAL(hits2[1], 0);
+}
+
+/* the same instrument text compiled against a global that has changed
+   from an array to a scalar must not reuse the cached body, which calls
+   the array version of the UDO */
+void test_orc_cache_type_change(void)
+{
+    CSOUND  *csound;
+    const char *udos =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "opcode f, k, k\n"
+            "kin xin\n"
+            "xout kin + 1\n"
+            "endop\n"
+            "opcode f, k, k[]\n"
+            "kin[] xin\n"
+            "klen lenarray kin\n"
+            "xout klen\n"
+            "endop\n";
+    const char *body =
+            "instr 1 \n"
+            "kv f gkx \n"
+            "chnset kv, \"v\" \n"
+            "endin \n";
+    const char *score = "i 1 0 0.01\n";
+    char    array[1024], scalar[1024];
+
+    snprintf(array, 1024, "%sgkx[] init 3\n%s", udos, body);
+    snprintf(scalar, 1024, "%sgkx init 10\n%s", udos, body);
+    csound = csoundCreate(NULL);
+    CU_ASSERT_EQUAL(compile_cached(csound, NULL, array, score), 0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "v", NULL), 3.0);
+    csoundReset(csound);
+    CU_ASSERT_EQUAL(compile_cached(csound, NULL, scalar, score), 0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "v", NULL), 11.0);
+    csoundReset(csound);
+    CU_ASSERT_EQUAL(compile_cached(csound, NULL, array, score), 1);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "v", NULL), 3.0);
+    csoundDestroy(csound);
+}
+
+void test_compile_async(void)
+{
+    CSOUND  *csound;
+    int     i;
+    MYFLT   val = FL(0.0);
+    char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "instr 1 \n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    CU_ASSERT(csoundCompileOrc(csound, instrument) == 0);
+    csoundReadScore(csound, "f 0 100\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    CU_ASSERT(csoundPerformKsmps(csound) == 0);
+    CU_ASSERT(csoundCompileOrcAsync(csound,
+                                    "giasync = 42\n"
+                                    "chnset giasync, \"async\"\n"
+                                    "instr 2 \n"
+                                    "chnset giasync + 1, \"async\"\n"
+                                    "endin \n") == 0);
+    /* the new code is merged at a k-cycle once it has been compiled */
+    for (i = 0; i < 5000 && val != FL(42.0); i++) {
+      CU_ASSERT(csoundPerformKsmps(csound) == 0);
+      val = csoundGetControlChannel(csound, "async", NULL);
+      if (val != FL(42.0))
+        csoundSleep(1);
+    }
+    CU_ASSERT_EQUAL(val, 42.0);
+    csoundInputMessage(csound, "i 2 0 0.01\n");
+    for (i = 0; i < 10; i++)
+      csoundPerformKsmps(csound);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "async", NULL), 43.0);
+    csoundDestroy(csound);
+}
+
+void test_compile_async_dependent(void)
+{
+    CSOUND  *csound;
+    int     i;
+    MYFLT   val = FL(0.0);
+    char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 100\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "instr 1 \n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    CU_ASSERT(csoundCompileOrc(csound, instrument) == 0);
+    csoundReadScore(csound, "f 0 100\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    CU_ASSERT(csoundPerformKsmps(csound) == 0);
+    /* the second orchestra uses a global and an instrument defined by the
+       first, queued within the same k-cycle */
+    CU_ASSERT(csoundCompileOrcAsync(csound,
+                                    "gidep = 5\n"
+                                    "instr 3 \n"
+                                    "chnset gidep + 1, \"dep3\"\n"
+                                    "endin \n") == 0);
+    CU_ASSERT(csoundCompileOrcAsync(csound,
+                                    "chnset gidep * 2, \"dep\"\n"
+                                    "schedule 3, 0, 0.01\n") == 0);
+    for (i = 0; i < 5000 && val != FL(10.0); i++) {
+      CU_ASSERT(csoundPerformKsmps(csound) == 0);
+      val = csoundGetControlChannel(csound, "dep", NULL);
+      if (val != FL(10.0))
+        csoundSleep(1);
+    }
+    CU_ASSERT_EQUAL(val, 10.0);
+    for (i = 0; i < 10; i++)
+      csoundPerformKsmps(csound);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "dep3", NULL), 6.0);
+    csoundDestroy(csound);
+}
 
 int main() {
     CU_pSuite pSuite = NULL;
@@ -186,7 +512,18 @@ int main() {
             (NULL == CU_add_test(pSuite, "Test splitArgs", test_split_args)) ||
             (NULL == CU_add_test(pSuite, "Test Compilation", test_compile)) ||
             (NULL == CU_add_test(pSuite, "Test Reuse Instance", test_reuse)) ||
-        (NULL == CU_add_test(pSuite, "Test Line Numbers", test_linenum))) {
+        (NULL == CU_add_test(pSuite, "Test Line Numbers", test_linenum)) ||
+        (NULL == CU_add_test(pSuite, "Test Fused Expressions",
+                             test_fused_expression)) ||
+        (NULL == CU_add_test(pSuite, "Test Optimised Expressions",
+                             test_optimised_expressions)) ||
+        (NULL == CU_add_test(pSuite, "Test Orchestra Cache", test_orc_cache)) ||
+        (NULL == CU_add_test(pSuite, "Test Orchestra Cache Type Change",
+                             test_orc_cache_type_change)) ||
+        (NULL == CU_add_test(pSuite, "Test Asynchronous Compilation",
+                             test_compile_async)) ||
+        (NULL == CU_add_test(pSuite, "Test Dependent Asynchronous Compilation",
+                             test_compile_async_dependent))) {
         CU_cleanup_registry();
         return CU_get_error();
     }
@@ -1,6 +1,12 @@
 #include "csound.h"
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
 #include <CUnit/Basic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
 
 #include "time.h"
 
@@ -30,6 +36,229 @@ void test_udp_server(void)
     csoundDestroy(csound);
 }
 
+/* builds message batches for the UDP server (see Top/server.c) */
+typedef struct {
+    unsigned char data[8192];
+    size_t  len;
+    int     count;
+} BATCH;
+
+static void batch_begin(BATCH *b)
+{
+    memcpy(b->data, "CSB1", 4);
+    b->len = 6;
+    b->count = 0;
+}
+
+static void put_u8(BATCH *b, unsigned int v)
+{
+    b->data[b->len++] = (unsigned char) v;
+}
+
+static void put_u16(BATCH *b, unsigned int v)
+{
+    put_u8(b, v >> 8);
+    put_u8(b, v & 0xFF);
+}
+
+static void put_u32(BATCH *b, uint32_t v)
+{
+    put_u16(b, v >> 16);
+    put_u16(b, v & 0xFFFF);
+}
+
+static void put_f64(BATCH *b, double d)
+{
+    uint64_t u;
+    memcpy(&u, &d, sizeof(double));
+    put_u32(b, (uint32_t) (u >> 32));
+    put_u32(b, (uint32_t) u);
+}
+
+static void batch_event(BATCH *b, char opcod, int n, const double *p)
+{
+    int i;
+    put_u8(b, 1); put_u8(b, opcod); put_u8(b, n);
+    for (i = 0; i < n; i++)
+      put_f64(b, p[i]);
+    b->count++;
+}
+
+static void batch_bind(BATCH *b, int handle, const char *name)
+{
+    put_u8(b, 2); put_u16(b, handle); put_u8(b, strlen(name));
+    memcpy(b->data + b->len, name, strlen(name));
+    b->len += strlen(name);
+    b->count++;
+}
+
+static void batch_control(BATCH *b, int handle, double value)
+{
+    put_u8(b, 3); put_u16(b, handle); put_f64(b, value);
+    b->count++;
+}
+
+static void batch_table(BATCH *b, int table, int start, int n,
+                        const double *v)
+{
+    int i;
+    put_u8(b, 4); put_u32(b, table); put_u32(b, start); put_u16(b, n);
+    for (i = 0; i < n; i++)
+      put_f64(b, v[i]);
+    b->count++;
+}
+
+static void batch_send(int sock, struct sockaddr_in *to, BATCH *b)
+{
+    b->data[4] = (unsigned char) (b->count >> 8);
+    b->data[5] = (unsigned char) b->count;
+    sendto(sock, b->data, b->len, 0, (struct sockaddr *) to, sizeof(*to));
+}
+
+static CSOUND *start_udp_csound(int port, struct sockaddr_in *to, int *sock)
+{
+    CSOUND  *csound;
+    char    opt[32];
+    const char *orc =
+        "sr = 44100\n"
+        "ksmps = 32\n"
+        "nchnls = 1\n"
+        "gicount init 0\n"
+        "instr 1\n"
+        "gicount = gicount + 1\n"
+        "chnset gicount, \"count\"\n"
+        "endin\n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    snprintf(opt, 32, "--port=%d", port);
+    csoundSetOption(csound, opt);
+    CU_ASSERT(csoundCompileOrc(csound, orc) == 0);
+    csoundReadScore(csound, "f 1 0 16 -2 0\nf 0 3600\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    *sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(to, 0, sizeof(*to));
+    to->sin_family = AF_INET;
+    to->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to->sin_port = htons(port);
+    return csound;
+}
+
+void test_udp_batches(void)
+{
+    CSOUND  *csound;
+    struct sockaddr_in to;
+    BATCH   b;
+    MYFLT   *table;
+    double  pf[3] = { 1, 0, 0.001 }, tv[2] = { 0.25, -0.75 };
+    int     sock, i;
+
+    csound = start_udp_csound(12346, &to, &sock);
+    batch_begin(&b);
+    batch_bind(&b, 7, "ctl");
+    batch_control(&b, 7, 0.5);
+    batch_table(&b, 1, 3, 2, tv);
+    batch_event(&b, 'i', 3, pf);
+    batch_event(&b, 'i', 3, pf);
+    batch_send(sock, &to, &b);
+    for (i = 0; i < 10000 &&
+           csoundGetControlChannel(csound, "count", NULL) < 2.0; i++) {
+      csoundPerformKsmps(csound);
+      if (i % 10 == 9) usleep(1000);
+    }
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "count", NULL), 2.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "ctl", NULL), 0.5);
+    CU_ASSERT(csoundGetTable(csound, &table, 1) == 16);
+    CU_ASSERT_EQUAL(table[3], 0.25);
+    CU_ASSERT_EQUAL(table[4], -0.75);
+    close(sock);
+    csoundStop(csound);
+    csoundDestroy(csound);
+}
+
+/* loopback benchmark: score events per second through the UDP server */
+void test_udp_benchmark(void)
+{
+    CSOUND  *csound;
+    struct sockaddr_in to;
+    BATCH   b;
+    RTCLOCK clk;
+    double  pf[3] = { 1, 0, 0.001 }, secs;
+    int     sock, i, j, nbatches = 200, nevents = 100, received = 0;
+
+    csound = start_udp_csound(12347, &to, &sock);
+    csoundInitTimerStruct(&clk);
+    for (i = 0; i < nbatches; i++) {
+      batch_begin(&b);
+      for (j = 0; j < nevents; j++)
+        batch_event(&b, 'i', 3, pf);
+      batch_send(sock, &to, &b);
+      csoundPerformKsmps(csound);
+    }
+    /* datagrams may be dropped under load: wait until nothing arrives */
+    for (i = 0; i < 2000; i++) {
+      int n = (int) csoundGetControlChannel(csound, "count", NULL);
+      csoundPerformKsmps(csound);
+      if (n == nbatches * nevents) break;
+      if (n == received && i > 200) break;
+      received = n;
+      usleep(500);
+    }
+    received = (int) csoundGetControlChannel(csound, "count", NULL);
+    secs = csoundGetRealTime(&clk);
+    printf("\nUDP loopback: %d of %d events in %.3f s, %.0f events/s\n",
+           received, nbatches * nevents, secs,
+           secs > 0.0 ? received / secs : 0.0);
+    CU_ASSERT(received > 0);
+    close(sock);
+    csoundStop(csound);
+    csoundDestroy(csound);
+}
+
+/* audio streamed to ourselves over loopback with sockstreamsend/recv */
+void test_sockstream(void)
+{
+    CSOUND  *csound;
+    int     i, seen = 0;
+    const char *orc =
+        "sr = 44100\n"
+        "ksmps = 32\n"
+        "nchnls = 2\n"
+        "0dbfs = 1\n"
+        "instr 1\n"
+        "asig init 0.5\n"
+        "sockstreamsend \"127.0.0.1\", 12348, 0, asig, -asig\n"
+        "al, ar sockstreamrecv 12348\n"
+        "kr, kl, klate, ku, kd, kj sockstreamstat 12348\n"
+        "kleft downsamp al\n"
+        "kright downsamp ar\n"
+        "chnset kr, \"received\"\n"
+        "chnset kl, \"lost\"\n"
+        "chnset kleft, \"left\"\n"
+        "chnset kright, \"right\"\n"
+        "endin\n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    CU_ASSERT(csoundCompileOrc(csound, orc) == 0);
+    csoundReadScore(csound, "i 1 0 3600\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    /* run at roughly real time so the I/O threads keep up */
+    for (i = 0; i < 5000 &&
+           csoundGetControlChannel(csound, "received", NULL) < 500.0; i++) {
+      csoundPerformKsmps(csound);
+      if (csoundGetControlChannel(csound, "left", NULL) == 0.5 &&
+          csoundGetControlChannel(csound, "right", NULL) == -0.5)
+        seen = 1;
+      usleep(700);
+    }
+    CU_ASSERT(csoundGetControlChannel(csound, "received", NULL) > 0.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "lost", NULL), 0.0);
+    CU_ASSERT(seen);
+    csoundStop(csound);
+    csoundDestroy(csound);
+}
+
 int main()
 {
     CU_pSuite pSuite = NULL;
@@ -46,7 +275,13 @@ int main()
     }
 
     /* add the tests to the suite */
-    if ((NULL == CU_add_test(pSuite, "Test UDP Server", test_udp_server))
+    if ((NULL == CU_add_test(pSuite, "Test UDP Server", test_udp_server)) ||
+        (NULL == CU_add_test(pSuite, "Test UDP Message Batches",
+                             test_udp_batches)) ||
+        (NULL == CU_add_test(pSuite, "Test UDP Loopback Benchmark",
+                             test_udp_benchmark)) ||
+        (NULL == CU_add_test(pSuite, "Test Socket Audio Streaming",
+                             test_sockstream))
         )
     {
         CU_cleanup_registry();
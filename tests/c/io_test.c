@@ -255,6 +255,126 @@ void test_midi_hostbased(void)
     csoundReset(csound);
 }
 
+/* one note on, timed 100 samples into the k-period starting at 1024 */
+static int timed_sent = 0;
+
+static int timed_open(CSOUND *csound, void **userData, const char *dev)
+{
+    *userData = NULL;
+    return 0;
+}
+
+static int timed_read(CSOUND *csound, void *userData,
+                      unsigned char *buf, int nbytes, int64_t *times)
+{
+    if (timed_sent || csoundGetCurrentTimeSamples(csound) < 1024)
+      return 0;
+    buf[0] = 0x90; buf[1] = 60; buf[2] = 100;
+    times[0] = times[1] = times[2] = 1024 + 100;
+    timed_sent = 1;
+    return 3;
+}
+
+void test_midi_timestamped(void)
+{
+    CSOUND  *csound;
+    const MYFLT *spout;
+    int     i, first = -1;
+    const char  *instrument =
+            "sr = 44100\n"
+            "ksmps = 256\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "instr 1 \n"
+            "asig linseg 1, 1, 1\n"
+            "out asig\n"
+            "endin \n";
+
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    csoundSetOption(csound, "-M0");
+    csoundSetHostImplementedMIDIIO(csound, 1);
+    csoundSetExternalMidiInOpenCallback(csound, timed_open);
+    csoundSetExternalMidiReadTimedCallback(csound, timed_read);
+    csoundSetExternalMidiInCloseCallback(csound, NULL);
+    csoundCompileOrc(csound, instrument);
+    csoundReadScore(csound, "f 0 1\n");
+    timed_sent = 0;
+    CU_ASSERT(csoundStart(csound) == 0);
+    while (csoundGetCurrentTimeSamples(csound) < 1024)
+      csoundPerformKsmps(csound);
+    csoundPerformKsmps(csound);
+    CU_ASSERT(timed_sent);
+    spout = csoundGetSpout(csound);
+    for (i = 0; i < 256 && first < 0; i++)
+      if (spout[i] != 0.0) first = i;
+    CU_ASSERT_EQUAL(first, 100);
+    csoundDestroy(csound);
+}
+
+/* format 0 SMF, 50 ticks per beat at 120 BPM: one tick per k-period at
+   kr = 100; the 'a' statement skips the first 100 k-periods */
+static const unsigned char seek_smf[] = {
+    'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 50,
+    'M', 'T', 'r', 'k', 0, 0, 0, 31,
+    0x00, 0xB0, 7, 90,          /*   0: volume 90            */
+    0x00, 0xC0, 2,              /*   0: program 2 (instr 3)  */
+    0x0A, 0x90, 60, 100,        /*  10: skipped note         */
+    0x0A, 0xB0, 7, 64,          /*  20: volume 64            */
+    0x0A, 0x80, 60, 0,          /*  30                       */
+    0x78, 0x90, 62, 100,        /* 150: first note played    */
+    0x14, 0x80, 62, 0,          /* 170                       */
+    0x1E, 0xFF, 0x2F, 0         /* 200: end of track         */
+};
+
+void test_midifile_seek(void)
+{
+    CSOUND  *csound;
+    FILE    *f;
+    int     i;
+    const char  *instrument =
+            "sr = 1000\n"
+            "ksmps = 10\n"
+            "nchnls = 1\n"
+            "0dbfs = 1\n"
+            "gicount init 0\n"
+            "instr 1 \n"
+            "chnset 1, \"instr1\"\n"
+            "endin \n"
+            "instr 3 \n"
+            "gicount = gicount + 1\n"
+            "inote notnum\n"
+            "ivol ctrl7 1, 7, 0, 127\n"
+            "istart timek\n"
+            "chnset gicount, \"count\"\n"
+            "chnset inote, \"note\"\n"
+            "chnset ivol, \"vol\"\n"
+            "chnset istart, \"start\"\n"
+            "endin \n";
+
+    f = fopen("midifile_seek_test.mid", "wb");
+    CU_ASSERT_PTR_NOT_NULL_FATAL(f);
+    fwrite(seek_smf, 1, sizeof(seek_smf), f);
+    fclose(f);
+    csound = csoundCreate(NULL);
+    csoundSetOption(csound, "-n");
+    csoundSetOption(csound, "--midifile=midifile_seek_test.mid");
+    csoundCompileOrc(csound, instrument);
+    csoundReadScore(csound, "a 0 0 1\nf 0 3\n");
+    CU_ASSERT(csoundStart(csound) == 0);
+    for (i = 0; i < 180; i++)
+      csoundPerformKsmps(csound);
+    /* the note before the seek point is not started, the one after it
+       starts on its own k-period in the chased program's instrument,
+       with the last controller value before the seek point */
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "count", NULL), 1.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "instr1", NULL), 0.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "note", NULL), 62.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "vol", NULL), 64.0);
+    CU_ASSERT_EQUAL(csoundGetControlChannel(csound, "start", NULL), 150.0);
+    csoundDestroy(csound);
+    remove("midifile_seek_test.mid");
+}
 
 int main(int argc, char **argv)
 {
@@ -278,6 +398,10 @@ int main(int argc, char **argv)
             || (NULL == CU_add_test(pSuite, "Audio Hostbased", test_audio_hostbased))
             || (NULL == CU_add_test(pSuite, "MIDI Modules", test_midi_modules))
             || (NULL == CU_add_test(pSuite, "MIDI Hostbased", test_midi_hostbased))
+            || (NULL == CU_add_test(pSuite, "MIDI Timestamped Input",
+                                    test_midi_timestamped))
+            || (NULL == CU_add_test(pSuite, "MIDI File Seek",
+                                    test_midifile_seek))
         )
     {
        CU_cleanup_registry();
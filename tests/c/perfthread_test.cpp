@@ -79,6 +79,109 @@ void test_record(void)
     csound.Reset();
 }
 
+/* more events than the 1024 record queue holds, from two threads */
+#define PRODUCER_EVENTS 1000
+
+struct producer_data {
+    CsoundPerformanceThread *pt;
+    int id;
+};
+
+static uintptr_t producer(void *data)
+{
+    producer_data *d = (producer_data *) data;
+    MYFLT p[25][5];
+    CsoundPerformanceThreadEvent events[25];
+    int i = 0;
+    while (i < PRODUCER_EVENTS) {
+      /* alternate single events and batches */
+      int n = ((i / 25) & 1) ? 25 : 1;
+      for (int j = 0; j < n; j++, i++) {
+        p[j][0] = 1; p[j][1] = 0; p[j][2] = 0.01;
+        p[j][3] = d->id; p[j][4] = i;
+        events[j].opcod = 'i';
+        events[j].absp2mode = 0;
+        events[j].pcnt = 5;
+        events[j].p = p[j];
+        events[j].frame = -1;
+      }
+      if (n == 1)
+        d->pt->ScoreEvent(0, 'i', 5, p[0]);
+      else
+        d->pt->ScoreEvents(n, events);
+    }
+    return 0;
+}
+
+void test_score_events(void)
+{
+    /* instr 1 counts events and checks that p5 follows on from the last
+       one sent by the same producer (p4) */
+    const char  *instrument =
+            "sr = 1000\n"
+            "ksmps = 10\n"
+            "gilast0 init -1\n"
+            "gilast1 init -1\n"
+            "gicount init 0\n"
+            "gibad init 0\n"
+            "instr 1 \n"
+            "if p4 == 0 then\n"
+            "gibad = gibad + (p5 == gilast0 + 1 ? 0 : 1)\n"
+            "gilast0 = p5\n"
+            "else\n"
+            "gibad = gibad + (p5 == gilast1 + 1 ? 0 : 1)\n"
+            "gilast1 = p5\n"
+            "endif\n"
+            "gicount = gicount + 1\n"
+            "chnset gicount, \"count\"\n"
+            "chnset gibad, \"bad\"\n"
+            "endin \n"
+            "instr 2 \n"
+            "istart timek\n"
+            "chnset istart, \"start\"\n"
+            "endin \n"
+            "instr 3 \n"
+            "chnset 1, \"message\"\n"
+            "endin \n";
+
+    Csound csound;
+    csound.SetOption((char*)"-n");
+    csound.CompileOrc(instrument);
+    csound.ReadScore((char*)"f 0 1\n");
+    csound.Start();
+    CsoundPerformanceThread performanceThread(csound.GetCsound());
+    /* the performance is paused, so the producers fill the queue and
+       wait for the performance thread to drain it */
+    producer_data d[2];
+    void *threads[2];
+    for (int i = 0; i < 2; i++) {
+      d[i].pt = &performanceThread;
+      d[i].id = i;
+      threads[i] = csoundCreateThread(producer, &d[i]);
+      CU_ASSERT_PTR_NOT_NULL(threads[i]);
+    }
+    /* p2 counts from frame 500, 50 k-periods at ksmps = 10 */
+    MYFLT p[5] = { 2, 0, 0.01, 0, 0 };
+    CsoundPerformanceThreadEvent ev;
+    ev.opcod = 'i';
+    ev.absp2mode = 0;
+    ev.pcnt = 3;
+    ev.p = p;
+    ev.frame = 500;
+    performanceThread.ScoreEvents(1, &ev);
+    performanceThread.InputMessage("i 3 0 0.01");
+    for (int i = 0; i < 2; i++)
+      csoundJoinThread(threads[i]);
+    performanceThread.Play();
+    performanceThread.Join();
+    CU_ASSERT_EQUAL(csound.GetChannel("count"), 2 * PRODUCER_EVENTS);
+    CU_ASSERT_EQUAL(csound.GetChannel("bad"), 0);
+    CU_ASSERT_EQUAL(csound.GetChannel("start"), 50);
+    CU_ASSERT_EQUAL(csound.GetChannel("message"), 1);
+    csound.Cleanup();
+    csound.Reset();
+}
+
 int main()
 {
     CU_pSuite pSuite = NULL;
@@ -97,6 +200,7 @@ int main()
     /* add the tests to the suite */
     if ((NULL == CU_add_test(pSuite, "Test Record", test_record))
             || (NULL == CU_add_test(pSuite, "Test Performance Thread", test_perfthread))
+            || (NULL == CU_add_test(pSuite, "Test Score Events", test_score_events))
         )
     {
         CU_cleanup_registry();
@@ -46,6 +46,7 @@ static int is_sdiffile(char *name);
 #define SQRTOF3 1.73205080756887729352
 #define SQUELCH 0.5     /* % of max ampl below which delta_f is frozen */
 #define HMAX    50
+#define MAXHETTHREADS 64
 
 /* Authors:   Tom Sullivan, Nov'86, Mar'87;  bv revised Jun'92, Aug'92  */
 /* Function:  Fixed frequency heterodyne filter analysis.               */
@@ -74,6 +75,7 @@ typedef struct {
          *a_avg,                /* output dev. freq. buffer*/
          new_ph,                /* new phase value*/
          old_ph,                /* previous phase value*/
+         first_ph,              /* phase at the first sample */
          jmp_ph,                /* for phase unwrap*/
          *ph_av1, *ph_av2, *ph_av3,      /*tempor. buffers*/
          *amp_av1, *amp_av2, *amp_av3,   /* same for ampl.*/
@@ -91,10 +93,28 @@ typedef struct {
          *outfilnam;            /* output file name */
   MYFLT  *auxp;                 /* pointer to input file */
   MYFLT  *adp;                  /* pointer to front of sample file */
-  double *c_p,*s_p;             /* pointers to space for sine and cos terms */
+  double *c_p,*s_p;             /* rings of quadrature terms, one fund. */
+  int32  qmask;                 /*   period long: size qmask + 1        */
   int    newformat;             /* flag for m/c independent format */
+  int    poll;                  /* call CheckEvents from this thread */
+  volatile int *stop;           /* set to abandon the analysis */
 } HET;
 
+/* state of one analysis thread: each takes every nthreads'th harmonic */
+/* of the todo list                                                    */
+
+typedef struct {
+  CSOUND *csound;
+  HET    het;                   /* private copy with its own buffers */
+  MYFLT  *freq_ests;            /* centre frequency of each harmonic */
+  MYFLT  *max_frqs, *max_amps;  /* results per harmonic, for reporting */
+  double *start_ph,             /* old_ph each harmonic was started with, */
+         *first_ph, *last_ph;   /*   its first and its last phase value   */
+  int    *todo, ntodo;          /* harmonics to analyse */
+  int    first, nthreads, retval;
+  char   *dspace;
+} HETWORKER;
+
 #if INCSDIF
 static int writesdif(CSOUND*, HET*);
 #endif
@@ -102,6 +122,7 @@ static  double  GETVAL(HET *, double *, int32);
 static  double  sq(double);
 static  void    PUTVAL(HET *,double *, int32, double);
 static  int     hetdyn(CSOUND *csound, HET *, int);
+static  uintptr_t hetworker(void *);
 static  void    lpinit(HET*);
 static  void    lowpass(HET *,double *, double *, int32);
 static  void    average(HET *,int32, double *, double *, int32);
@@ -134,15 +155,102 @@ static void init_het(HET *thishet)
     thishet->bufsiz    = 1;             /* circular buffer size */
     thishet->skip      = 0;             /* JPff: this was missing */
     thishet->newformat = 1;
+    thishet->poll      = 1;
+    thishet->stop      = NULL;
+}
+
+/* carve the per-harmonic work buffers for one thread out of one block */
+
+static char *het_alloc(CSOUND *csound, HET *thishet)
+{
+    int32   bufspc = thishet->bufsiz * sizeof(double);
+    int32   qspc = (thishet->qmask + 1) * sizeof(double);
+    char    *dsp, *dspace;
+
+    dsp = dspace = csound->Malloc(csound, qspc * 2 + bufspc * 13);
+    thishet->c_p = (double *) dsp;      dsp += qspc;    /* space for the    */
+    thishet->s_p = (double *) dsp;      dsp += qspc;    /* quadrature terms */
+    thishet->cos_mul = (double *) dsp;  dsp += bufspc;  /* bufs that will be */
+    thishet->sin_mul = (double *) dsp;  dsp += bufspc;  /* refilled each hno */
+    thishet->a_term = (double *) dsp;   dsp += bufspc;
+    thishet->b_term = (double *) dsp;   dsp += bufspc;
+    thishet->r_ampl = (double *) dsp;   dsp += bufspc;
+    thishet->ph_av1 = (double *) dsp;   dsp += bufspc;
+    thishet->ph_av2 = (double *) dsp;   dsp += bufspc;
+    thishet->ph_av3 = (double *) dsp;   dsp += bufspc;
+    thishet->r_phase = (double *) dsp;  dsp += bufspc;
+    thishet->amp_av1 = (double *) dsp;  dsp += bufspc;
+    thishet->amp_av2 = (double *) dsp;  dsp += bufspc;
+    thishet->amp_av3 = (double *) dsp;  dsp += bufspc;
+    thishet->a_avg = (double *) dsp;
+    return dspace;
+}
+
+/* analyse one harmonic; only the phase unwrap carries over from the */
+/* previous one, through old_ph                                       */
+
+static int het_harmonic(CSOUND *csound, HET *thishet, int hno,
+                        MYFLT freq_est)
+{
+    thishet->freq_est = freq_est;
+    thishet->cur_est = freq_est;
+    /* clear all refilling buffers */
+    memset(thishet->cos_mul, 0, 13 * thishet->bufsiz * sizeof(double));
+    thishet->max_frq = FL(0.0);
+    thishet->max_amp = FL(0.0);
+    return hetdyn(csound, thishet, hno);
+}
+
+static uintptr_t hetworker(void *arg)
+{
+    HETWORKER   *w = (HETWORKER *) arg;
+    int         i, hno;
+
+    for (i = w->first; i < w->ntodo; i += w->nthreads) {
+      if (*w->het.stop)
+        break;
+      hno = w->todo[i];
+      w->het.old_ph = w->start_ph[hno];
+      if (het_harmonic(w->csound, &w->het, hno, w->freq_ests[hno]) != 0) {
+        *w->het.stop = 1;
+        w->retval = -1;
+        break;
+      }
+      w->max_frqs[hno] = w->het.max_frq;
+      w->max_amps[hno] = w->het.max_amp;
+      w->first_ph[hno] = w->het.first_ph;
+      w->last_ph[hno] = w->het.old_ph;
+    }
+    return 0;
+}
+
+/* run the todo list on nthreads threads, this one included */
+
+static int het_run(HETWORKER *w, int nthreads)
+{
+    void    *threads[MAXHETTHREADS];
+    int     i, retval = 0;
+
+    for (i = 1; i < nthreads; i++)
+      threads[i] = w->csound->CreateThread(hetworker, &w[i]);
+    hetworker(&w[0]);
+    for (i = 1; i < nthreads; i++) {
+      if (threads[i] != NULL)
+        w->csound->JoinThread(threads[i]);
+      else
+        hetworker(&w[i]);           /* could not start: do its share here */
+    }
+    for (i = 0; i < nthreads; i++)
+      retval |= w[i].retval;
+    return retval;
 }
 
 static int hetro(CSOUND *csound, int argc, char **argv)
 {
     SNDFILE *infd;
-    int     i, hno, channel = 1, retval = 0;
-    int32   nsamps, smpspc, bufspc, mgfrspc;
+    int     i, hno, channel = 1, retval = 0, nthreads = 1;
+    int32   nsamps, mgfrspc;
     char    *dsp, *dspace, *mspace;
-    double  *begbufs, *endbufs;
     HET     het;
     HET     *thishet = &het;
     SOUNDIN *p;         /* space allocated by SAsndgetset() */
@@ -225,6 +333,12 @@ static int hetro(CSOUND *csound, int argc, char **argv)
           csound->sscanf(s,"%f",&thishet->freq_c);
 #endif
           break;
+        case 'j':
+          FIND(Str("no number of threads"))
+          sscanf(s,"%d",&nthreads);
+          if (nthreads < 1 || nthreads > MAXHETTHREADS)
+            return quit(csound, Str("number of threads out of range"));
+          break;
         case 'X':
           het.newformat = 1;
           break;
@@ -295,30 +409,16 @@ static int hetro(CSOUND *csound, int argc, char **argv)
     thishet->midbuf = thishet->bufsiz/2;
     thishet->bufmask = thishet->bufsiz - 1;
 
-    smpspc = thishet->smpsin * sizeof(double);
-    bufspc = thishet->bufsiz * sizeof(double);
-
-    dsp = dspace = csound->Malloc(csound, smpspc * 2 + bufspc * 13);
-    thishet->c_p = (double *) dsp;      dsp += smpspc;  /* space for the    */
-    thishet->s_p = (double *) dsp;      dsp += smpspc;  /* quadrature terms */
-    begbufs = (double *) dsp;
-    thishet->cos_mul = (double *) dsp;  dsp += bufspc;  /* bufs that will be */
-    thishet->sin_mul = (double *) dsp;  dsp += bufspc;  /* refilled each hno */
-    thishet->a_term = (double *) dsp;   dsp += bufspc;
-    thishet->b_term = (double *) dsp;   dsp += bufspc;
-    thishet->r_ampl = (double *) dsp;   dsp += bufspc;
-    thishet->ph_av1 = (double *) dsp;   dsp += bufspc;
-    thishet->ph_av2 = (double *) dsp;   dsp += bufspc;
-    thishet->ph_av3 = (double *) dsp;   dsp += bufspc;
-    thishet->r_phase = (double *) dsp;  dsp += bufspc;
-    thishet->amp_av1 = (double *) dsp;  dsp += bufspc;
-    thishet->amp_av2 = (double *) dsp;  dsp += bufspc;
-    thishet->amp_av3 = (double *) dsp;  dsp += bufspc;
-    thishet->a_avg = (double *) dsp;    dsp += bufspc;
-    endbufs = (double *) dsp;
+    /* the quadrature terms are only needed one fund. period back */
+    thishet->qmask = 1;
+    while (thishet->qmask <= thishet->windsiz)
+      thishet->qmask *= 2;
+    thishet->qmask -= 1;
+    dspace = het_alloc(csound, thishet);
 
     mgfrspc = thishet->num_pts * sizeof(MYFLT);
-    dsp = mspace = csound->Malloc(csound, mgfrspc * thishet->hmax * 2);
+    /* cleared, so points a short file never reaches are reproducible */
+    dsp = mspace = csound->Calloc(csound, mgfrspc * thishet->hmax * 2);
     thishet->MAGS = (MYFLT **) csound->Malloc(csound,
                                               thishet->hmax * sizeof(MYFLT*));
     thishet->FREQS = (MYFLT **) csound->Malloc(csound,
@@ -329,25 +429,101 @@ static int hetro(CSOUND *csound, int argc, char **argv)
     }
     lpinit(thishet);                        /* calculate LPF coeffs.  */
     thishet->adp = thishet->auxp;           /* point to beg sample data block */
-    for (hno = 0; hno < thishet->hmax; hno++) { /* for requested harmonics */
-      double *dblp;
-      thishet->freq_est += thishet->fund_est; /*   do analysis */
-      thishet->cur_est = thishet->freq_est;
-      dblp = begbufs;
-      do {
-        *dblp++ = FL(0.0);                    /* clear all refilling buffers */
-      } while (dblp < endbufs);
-      thishet->max_frq = FL(0.0);
-      thishet->max_amp = FL(0.0);
-
-      csound->Message(csound,Str("analyzing harmonic #%d\n"),hno);
-      csound->Message(csound,Str("freq estimate %6.1f,"), thishet->cur_est);
-      if (hetdyn(csound, thishet, hno) != 0)  /* perform actual computation */
-        return -1;
-      if (!csound->CheckEvents(csound))
+    if (nthreads > thishet->hmax)
+      nthreads = thishet->hmax;
+    if (nthreads <= 1) {
+      for (hno = 0; hno < thishet->hmax; hno++) { /* for requested harmonics */
+        csound->Message(csound,Str("analyzing harmonic #%d\n"),hno);
+        csound->Message(csound,Str("freq estimate %6.1f,"),
+                        thishet->freq_est + thishet->fund_est);
+        /*   do analysis */
+        if (het_harmonic(csound, thishet, hno,
+                         thishet->freq_est + thishet->fund_est) != 0)
+          return -1;                /* perform actual computation */
+        if (!csound->CheckEvents(csound))
+          return -1;
+        csound->Message(csound, Str(" max found %6.1f, rel amp %6.1f\n"),
+                                thishet->max_frq, thishet->max_amp);
+      }
+    }
+    else {
+      /* the harmonics are independent: share them out between threads,
+         with this thread taking the first share and polling for events */
+      HETWORKER     *w;
+      MYFLT         *ests;
+      double        *phs, prev;
+      int           *todo, ntodo;
+      volatile int  stop = 0;
+
+      w = (HETWORKER *) csound->Calloc(csound, nthreads * sizeof(HETWORKER));
+      ests = (MYFLT *) csound->Malloc(csound, 3 * thishet->hmax * sizeof(MYFLT));
+      phs = (double *) csound->Calloc(csound, 3 * thishet->hmax * sizeof(double));
+      todo = (int *) csound->Malloc(csound, thishet->hmax * sizeof(int));
+      for (hno = 0; hno < thishet->hmax; hno++) {
+        ests[hno] = thishet->freq_est += thishet->fund_est;
+        todo[hno] = hno;
+      }
+      ntodo = thishet->hmax;
+      csound->Message(csound, Str("analyzing %d harmonics on %d threads\n"),
+                      (int) thishet->hmax, nthreads);
+      for (i = 0; i < nthreads; i++) {
+        w[i].csound = csound;
+        w[i].het = *thishet;
+        w[i].het.poll = (i == 0);
+        w[i].het.stop = &stop;
+        w[i].freq_ests = ests;
+        w[i].max_frqs = ests + thishet->hmax;
+        w[i].max_amps = ests + 2 * thishet->hmax;
+        w[i].start_ph = phs;
+        w[i].first_ph = phs + thishet->hmax;
+        w[i].last_ph = phs + 2 * thishet->hmax;
+        w[i].todo = todo;
+        w[i].ntodo = ntodo;
+        w[i].first = i;
+        w[i].nthreads = nthreads;
+        w[i].dspace = (i == 0 ? dspace : het_alloc(csound, &w[i].het));
+      }
+      /* The phase unwrap of each harmonic starts from the last phase of
+         the one before, as in the serial analysis. That phase does not
+         depend on where the unwrap started, and only decides whether the
+         first sample counts as a jump. So every harmonic is analysed
+         starting from 0, and those for which the jump test comes out
+         differently with the real starting phase are done again. */
+      retval = het_run(w, nthreads);
+      if (!retval && !stop && thishet->smpsin > thishet->windsiz) {
+        ntodo = 0;
+        for (hno = 0, prev = 0.0; hno < thishet->hmax; hno++) {
+          double first = w[0].first_ph[hno];
+          if ((fabs(first - prev) > PI) !=
+              (fabs(first - w[0].start_ph[hno]) > PI)) {
+            w[0].start_ph[hno] = prev;
+            todo[ntodo++] = hno;
+          }
+          prev = w[0].last_ph[hno];
+        }
+        if (ntodo > 0) {
+          for (i = 0; i < nthreads; i++)
+            w[i].ntodo = ntodo;
+          retval = het_run(w, nthreads);
+        }
+      }
+      for (i = 1; i < nthreads; i++)
+        csound->Free(csound, w[i].dspace);
+      if (!retval && !stop) {
+        for (hno = 0; hno < thishet->hmax; hno++) {
+          csound->Message(csound,Str("analyzing harmonic #%d\n"),hno);
+          csound->Message(csound,Str("freq estimate %6.1f,"), ests[hno]);
+          csound->Message(csound, Str(" max found %6.1f, rel amp %6.1f\n"),
+                          ests[thishet->hmax + hno],
+                          ests[2 * thishet->hmax + hno]);
+        }
+      }
+      csound->Free(csound, todo);
+      csound->Free(csound, phs);
+      csound->Free(csound, ests);
+      csound->Free(csound, w);
+      if (retval || stop)
         return -1;
-      csound->Message(csound, Str(" max found %6.1f, rel amp %6.1f\n"),
-                              thishet->max_frq, thishet->max_amp);
     }
     csound->Free(csound, dspace);
 #if INCSDIF
@@ -380,40 +556,43 @@ static int hetdyn(CSOUND *csound, HET* thishet, int hno) /* HETERODYNE FILTER */
 {
     int32   smplno;
     double  temp_a, temp_b, tpidelest;
-    double  *cos_p, *sin_p, *cos_wp, *sin_wp;
-    int32   n;
+    double  *cos_p = thishet->c_p, *sin_p = thishet->s_p;
+    int32   n, wp, qmask = thishet->qmask;
     int     outpnt, lastout = -1;
     MYFLT   *ptr;
 
     thishet->jmp_ph = 0;                     /* set initial phase to 0 */
     temp_a = temp_b = 0;
-    cos_p = thishet->c_p;
-    sin_p = thishet->s_p;
     tpidelest = TWOPI * thishet->cur_est * thishet->delta_t;
-    for (smplno = 0; smplno < thishet->smpsin; smplno++) {
-      double phase = smplno * tpidelest;     /* do all quadrature calcs */
-      ptr = thishet->adp + smplno;           /* at once and point to it */
-      *cos_p++ = (double)(*ptr) * cos(phase);
-      *sin_p++ = (double)(*ptr) * sin(phase);
-    }
 
-    cos_p = cos_wp = thishet->c_p;
-    sin_p = sin_wp = thishet->s_p;
+    /* the quadrature terms are calculated as the window reaches them, */
+    /* into rings holding the last period of the fundamental           */
+#define QUAD(smpl) {                                            \
+      double phase = (smpl) * tpidelest;                        \
+      ptr = thishet->adp + (smpl);                              \
+      cos_p[(smpl) & qmask] = (double)(*ptr) * cos(phase);      \
+      sin_p[(smpl) & qmask] = (double)(*ptr) * sin(phase);      \
+    }
     for (smplno = 0; smplno < thishet->smpsin - thishet->windsiz; smplno++) {
       if (smplno == 0 && thishet->smpsin >= thishet->windsiz) {
         /* for first smplno */
         n = thishet->windsiz;
+        wp = 0;
         do {
-          temp_a += *cos_wp++;     /* sum over windsiz = nsmps in */
-          temp_b += *sin_wp++;     /*    1 period of fund. freq.  */
+          QUAD(wp);
+          temp_a += cos_p[wp];     /* sum over windsiz = nsmps in */
+          temp_b += sin_p[wp];     /*    1 period of fund. freq.  */
+          wp++;
         } while (--n);
       }
       else {      /* if more than 1 fund. per. away from file end */
                   /* remove front value and add on new rear value */
                   /* to obtain summation term for new sample! */
         if (smplno <= thishet->smpsin - thishet->windsiz) {
-          temp_a += (*cos_wp++ - *cos_p++);  /* _wp = _p + windsiz */
-          temp_b += (*sin_wp++ - *sin_p++);
+          wp = smplno - 1 + thishet->windsiz;
+          QUAD(wp);
+          temp_a += (cos_p[wp & qmask] - cos_p[(smplno - 1) & qmask]);
+          temp_b += (sin_p[wp & qmask] - sin_p[(smplno - 1) & qmask]);
         }
         else {
           thishet->skip = 1;
@@ -434,11 +613,15 @@ static int hetdyn(CSOUND *csound, HET* thishet, int hno) /* HETERODYNE FILTER */
         lowpass(thishet, thishet->b_term,thishet->sin_mul,smplno);
       }
       output_ph(thishet, smplno);       /* calculate mag. & phase for sample */
+      if (smplno == 0)
+        thishet->first_ph = thishet->new_ph;
       if ((outpnt = (int)(smplno * thishet->outdelta_t)) > lastout) {
         /* if next out-time */
         output(thishet, smplno, hno, outpnt);  /*     place in     */
         lastout = outpnt;                      /*     output array */
-        if (!csound->CheckEvents(csound))
+        if (thishet->poll && !csound->CheckEvents(csound))
+          return -1;
+        if (thishet->stop != NULL && *thishet->stop)
           return -1;
       }
       if (thishet->skip) {
@@ -446,6 +629,7 @@ static int hetdyn(CSOUND *csound, HET* thishet, int hno) /* HETERODYNE FILTER */
         break;
       }
     }
+#undef QUAD
 
     return 0;
 }
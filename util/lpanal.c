@@ -51,6 +51,28 @@ typedef struct {
   WINDAT   pwindow;
 } LPC;
 
+/* Frames are queued in order, the filter (and pole) solutions are shared
+   out between threads, and the frames are then written in order again.
+   Pitch tracking filters the signal continuously, so it stays in order. */
+
+#define MAXLPTHREADS    64
+#define LPFRAMES        16      /* frames queued per thread */
+
+typedef struct {
+  MYFLT   *sig;                 /* WINDIN input samples */
+  MYFLT   *coef;                /* output frame */
+  MYFLT   pitch;
+  int     counter, poleFound;
+} LPFRAME;
+
+typedef struct {
+  CSOUND  *csound;
+  LPC     lpc;                  /* private copy with its own work arrays */
+  LPFRAME *frames;
+  int     first, nthreads, count, storePoles;
+  double  dPI;
+} LPWORKER;
+
 #ifdef TRACE
 static  FILE *trace;
 #endif
@@ -84,6 +106,9 @@ static  void    quit(CSOUND *, char *), lpdieu(CSOUND *, char *);
 static  void    usage(CSOUND *);
 static  void    ptable(CSOUND *, MYFLT, MYFLT, MYFLT, int, LPANAL_GLOBALS*);
 static  MYFLT   getpch(CSOUND *, MYFLT *, LPANAL_GLOBALS*);
+static  int     lpframe(CSOUND *, LPC *, MYFLT *, MYFLT *, int, double);
+static  int     lpflush(CSOUND *, LPWORKER *, int, int, FILE *, int,
+                        unsigned int);
 
 /* Search for an argument and report of not found */
 #define FIND(MSG)   if (*s == '\0')  \
@@ -345,10 +370,9 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
 {
     SNDFILE *infd;
     int     slice, analframes, counter, channel;
-    MYFLT   *coef, beg_time, input_dur, sr = FL(0.0);
+    MYFLT   beg_time, input_dur, sr = FL(0.0);
     char    *infilnam, *outfilnam;
     int     ofd;
-    double  errn, rms1, rms2, filterCoef[MAXPOLES+1];
     MYFLT   *sigbuf, *sigbuf2;      /* changed from short */
     long    n;
     unsigned int     osiz, nb;
@@ -361,17 +385,14 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
 
 /* Added by MR to handle pole storage */
 
-    int     i, j, indic, storePoles;
-    int     poleFound;
-    double  pr, pi, pm, pp, dPI;
-    double  polePart1[MAXPOLES], polePart2[MAXPOLES];
-    double  z1, workArray1[MAXPOLES];
-#ifdef _DEBUG
-    double  polyReal[MAXPOLES], polyImag[MAXPOLES];
-#endif
+    int     i, storePoles;
+    double  dPI;
     LPANAL_GLOBALS *lpg;
     int     new_format=0;
     FILE    *oFd;
+    int     nthreads = 1, nslots, count, k;
+    LPWORKER *w;
+    LPFRAME *frames;
 
     lpc.debug   = 0;
     lpc.verbose = 0;
@@ -470,6 +491,11 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
         case 'X':
                         new_format = 1;
                         break;
+        case 'j':       FIND(Str("no number of threads"))
+                        sscanf(s,"%d",&nthreads);
+                        if (nthreads < 1 || nthreads > MAXLPTHREADS)
+                          quit(csound,Str("number of threads out of range"));
+                        break;
         default:
           {
             char errmsg[256];
@@ -488,9 +514,6 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
     outfilnam = *argv;
     if (lpc.poleCount > MAXPOLES)
       quit(csound,Str("poles exceeds maximum allowed"));
-    /* Allocate space now */
-    coef = (MYFLT*) csound->Malloc(csound, (NDATA+lpc.poleCount*2)*sizeof(MYFLT));
-    /* Space allocated */
     if (slice < lpc.poleCount * 5)
       csound->Warning(csound,Str("hopsize may be too small, "
                                  "recommend at least poleCount * 5\n"));
@@ -607,119 +630,272 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
     csound->FileOpen2(csound, &trace, CSFILE_STD, "lpanal.trace", "w", NULL,
                       CSFTYPE_OTHER_TEXT, 0);
 #endif
+    /* Queue of frames; with one thread each frame is analysed as read */
+    nslots = (nthreads > 1 ? nthreads * LPFRAMES : 1);
+    frames = (LPFRAME *) csound->Calloc(csound, nslots * sizeof(LPFRAME));
+    for (k = 0; k < nslots; k++) {
+      frames[k].sig = (MYFLT *) csound->Malloc(csound,
+                                               lpc.WINDIN * sizeof(MYFLT));
+      frames[k].coef = (MYFLT *) csound->Malloc(csound,
+                                 (NDATA+lpc.poleCount*2) * sizeof(MYFLT));
+    }
+    w = (LPWORKER *) csound->Calloc(csound, nthreads * sizeof(LPWORKER));
+    for (k = 0; k < nthreads; k++) {
+      w[k].csound = csound;
+      w[k].lpc = lpc;
+      w[k].frames = frames;
+      w[k].first = k;
+      w[k].nthreads = nthreads;
+      w[k].storePoles = storePoles;
+      w[k].dPI = dPI;
+      if (k > 0) {
+        w[k].lpc.a = (double (*)[MAXPOLES])
+          csound->Malloc(csound, MAXPOLES * MAXPOLES * sizeof(double));
+        w[k].lpc.x = (double *) csound->Malloc(csound,
+                                               lpc.WINDIN * sizeof(double));
+      }
+    }
+    if (nthreads > 1)
+      csound->Message(csound, Str("Analysing on %d threads\n"), nthreads);
+    count = 0;
     /* Do the analysis */
     do {
-      MYFLT *fp1;
-      double *dfp;
+      LPFRAME *f;
 
-      /* Analyze current frame */
+      /* Queue current frame */
 #ifdef TRACE_POLES
       csound->Message
         (csound, Str("Starting new frame...\n"));
 #endif
       counter++;
-      alpol(&lpc, sigbuf, &errn, &rms1, &rms2, filterCoef);
-      /* Transfer results */
-      coef[0] = (MYFLT)rms2;
-      coef[1] = (MYFLT)rms1;
-      coef[2] = (MYFLT)errn;
+      f = &frames[count++];
+      f->counter = counter;
+      memcpy(f->sig, sigbuf, lpc.WINDIN * sizeof(MYFLT));
       if (lpc.doPitch)
-        coef[3] = getpch(csound, sigbuf, lpg);
-      else coef[3] = FL(0.0);
-      if (lpc.debug) csound->Message(csound,"%d\t%9.4f\t%9.4f\t%9.4f\t%9.4f\n",
-                                 counter, coef[0], coef[1], coef[2], coef[3]);
-#ifdef TRACE
-      if (lpc.debug) fprintf(trace,"%d\t%9.4f\t%9.4f\t%9.4f\t%9.4f\n",
-                         counter, coef[0], coef[1], coef[2], coef[3]);
+        f->pitch = getpch(csound, sigbuf, lpg);
+      else f->pitch = FL(0.0);
+
+      if (count == nslots) {
+        if (lpflush(csound, w, count, new_format, oFd, ofd, osiz) != 0)
+          return -1;
+        count = 0;
+      }
+      memcpy(sigbuf, sigbuf2, sizeof(MYFLT)*slice);
+
+      /* Some unused stuff. I think from when all snd was in mem */
+      /*  ( MYFLT *fp2; for (fp1=sigbuf, fp2=sigbuf2, n=slice; n--; ) */
+      /* move slice forward */
+      /*              *fp1++ = *fp2++;} */
+
+      /* Get next sound frame */
+      if ((n = csound->getsndin(csound, infd, sigbuf2, slice, p)) == 0)
+        break;          /* refill til EOF */
+      if (!csound->CheckEvents(csound))
+        return -1;
+    } while (counter < analframes); /* or nsmps done */
+    /* frames still queued when the input ran out */
+    if (lpflush(csound, w, count, new_format, oFd, ofd, osiz) != 0)
+      return -1;
+#if 0
+    /* clean up stuff */
+    dispexit(csound);
+#endif
+    csound->Message(csound, Str("%d lpc frames written to %s\n"),
+                            counter, outfilnam);
+    csound->Free(csound, lpc.a);
+    csound->Free(csound, lpc.x);
+    for (k = 1; k < nthreads; k++) {
+      csound->Free(csound, w[k].lpc.a);
+      csound->Free(csound, w[k].lpc.x);
+    }
+    csound->Free(csound, w);
+    for (k = 0; k < nslots; k++) {
+      csound->Free(csound, frames[k].sig);
+      csound->Free(csound, frames[k].coef);
+    }
+    csound->Free(csound, frames);
+    csound->Free(csound, lpg->Dwind_dbuf);
+    for (i=0;  i<FREQS; ++i) {
+      csound->Free(csound, lpg->tphi[i]);
+      csound->Free(csound, lpg->tpsi[i]);
+      csound->Free(csound, lpg->tgamph[i]);
+      csound->Free(csound, lpg->tgamps[i]);
+    }
+    csound->Free(csound, lpg);
+    return 0;
+}
+
+/*
+ *
+ *  Analysis of one frame: filter coefficients, and optionally poles
+ *  Returns the number of poles found.
+ *
+ */
+
+static int lpframe(CSOUND *csound, LPC *lpc, MYFLT *sig, MYFLT *coef,
+                   int storePoles, double dPI)
+{
+    double  errn, rms1, rms2, filterCoef[MAXPOLES+1];
+    MYFLT   *fp1;
+    double  *dfp;
+    int     i, j, n, indic;
+    int     poleFound = lpc->poleCount;
+    double  pr, pi, pm, pp;
+    double  polePart1[MAXPOLES], polePart2[MAXPOLES];
+    double  z1, workArray1[MAXPOLES];
+#ifdef _DEBUG
+    double  polyReal[MAXPOLES], polyImag[MAXPOLES];
 #endif
+
+    IGN(csound);
+    alpol(lpc, sig, &errn, &rms1, &rms2, filterCoef);
+    /* Transfer results */
+    coef[0] = (MYFLT)rms2;
+    coef[1] = (MYFLT)rms1;
+    coef[2] = (MYFLT)errn;
   /*  for (fp1=coef+NDATA, dfp=cc+poleCount, n=poleCount; n--; ) */
   /*    *fp1++ = - (MYFLT) *--dfp; */  /* rev coefs & chng sgn */
-#if 0
-      CS_SPRINTF(lpc.pwindow.caption, "pitch: %8.2f", coef[3]);
-      display(csound, &lpc.pwindow);
-#endif
 
-      /* Prepare buffer for output */
+    /* Prepare buffer for output */
 
-      if (storePoles) {
-        /* Treat (swap) filter coefs for resolution */
-        filterCoef[lpc.poleCount] = 1.0;
-        for (i=0; i<(lpc.poleCount+1)/2; i++) {
-          j = lpc.poleCount-1-i;
-          z1 = filterCoef[i];
-          filterCoef[i] = filterCoef[j];
-          filterCoef[j] = z1;
-        }
+    if (storePoles) {
+      /* Treat (swap) filter coefs for resolution */
+      filterCoef[lpc->poleCount] = 1.0;
+      for (i=0; i<(lpc->poleCount+1)/2; i++) {
+        j = lpc->poleCount-1-i;
+        z1 = filterCoef[i];
+        filterCoef[i] = filterCoef[j];
+        filterCoef[j] = z1;
+      }
 
-        /* Get the Filter Poles */
+      /* Get the Filter Poles */
 
-        polyzero(lpc.poleCount,filterCoef,polePart1,polePart2,
-                 &poleFound,2000,&indic,workArray1);
+      polyzero(lpc->poleCount,filterCoef,polePart1,polePart2,
+               &poleFound,2000,&indic,workArray1);
 
-        if (poleFound<lpc.poleCount) {
-          csound->Message(csound,
-                          Str("Found only %d poles...sorry\n"), poleFound);
-          csound->Message(csound,
-                          Str("wanted %d poles\n"), lpc.poleCount);
-          return -1;
-        }
-        InvertPoles(lpc.poleCount,polePart1,polePart2);
+      if (poleFound<lpc->poleCount)
+        return poleFound;
+      InvertPoles(lpc->poleCount,polePart1,polePart2);
 
 #ifdef TRACE_POLES
-        DumpPoles(csound,
-                  lpc.poleCount, polePart1, polePart2, 0, "Extracted Poles");
+      DumpPoles(csound,
+                lpc->poleCount, polePart1, polePart2, 0, "Extracted Poles");
 #endif
 
 #ifdef _DEBUG
-        /* Resynthetize the filter for check */
-        InvertPoles(lpc.poleCount,polePart1,polePart2);
+      /* Resynthetize the filter for check */
+      InvertPoles(lpc->poleCount,polePart1,polePart2);
 
-        synthetize(lpc.poleCount,polePart1,polePart2,polyReal,polyImag);
+      synthetize(lpc->poleCount,polePart1,polePart2,polyReal,polyImag);
 
-        for (i=0; i<lpc.poleCount; i++) {
+      for (i=0; i<lpc->poleCount; i++) {
 #ifdef TRACE_FILTER
-          csound->Message(csound, "filterCoef: %f\n", filterCoef[i]);
+        csound->Message(csound, "filterCoef: %f\n", filterCoef[i]);
 #endif
-          if (filterCoef[i]-polyReal[poleCount-i]>1e-10)
-            csound->Message(csound, Str("Error in coef %d : %f <> %f \n"),
-                                    i, filterCoef[i], polyReal[poleCount-i]);
-        }
-        csound->Message(csound,".");
-        InvertPoles(lpc.poleCount,polePart1,polePart2);
+        if (filterCoef[i]-polyReal[lpc->poleCount-i]>1e-10)
+          csound->Message(csound, Str("Error in coef %d : %f <> %f \n"),
+                          i, filterCoef[i], polyReal[lpc->poleCount-i]);
+      }
+      csound->Message(csound,".");
+      InvertPoles(lpc->poleCount,polePart1,polePart2);
 #endif
-        /* Switch to pole magnitude and phase */
-
-        for (i=0; i<lpc.poleCount;i++) {
-          /* Store magnitude and phase (PI,-PI) */
-          pr = polePart1[i];
-          pi = polePart2[i];
-          pm = sqrt(pr*pr+pi*pi);
-          if (pm!=0) {
-            pp = atan2(pi,pr);
-            if (pp>dPI)
-              pp = 2*dPI-pp;
-          }
-          else
-            pp = 0;
-          polePart1[i] = pm;
-          polePart2[i] = pp;
+      /* Switch to pole magnitude and phase */
+
+      for (i=0; i<lpc->poleCount;i++) {
+        /* Store magnitude and phase (PI,-PI) */
+        pr = polePart1[i];
+        pi = polePart2[i];
+        pm = sqrt(pr*pr+pi*pi);
+        if (pm!=0) {
+          pp = atan2(pi,pr);
+          if (pp>dPI)
+            pp = 2*dPI-pp;
         }
+        else
+          pp = 0;
+        polePart1[i] = pm;
+        polePart2[i] = pp;
+      }
 
-  /*    DumpPoles(csound, poleCount,polePart1,polePart2,1,"About to store"); */
+  /*  DumpPoles(csound, poleCount,polePart1,polePart2,1,"About to store"); */
 
-        /* Store in output buffer */
-        fp1 = coef+NDATA;
-        for (i=0; i<lpc.poleCount;i++) {
-          *fp1++ = (MYFLT)polePart1[i];
-          *fp1++ = (MYFLT)polePart2[i];
-        }
+      /* Store in output buffer */
+      fp1 = coef+NDATA;
+      for (i=0; i<lpc->poleCount;i++) {
+        *fp1++ = (MYFLT)polePart1[i];
+        *fp1++ = (MYFLT)polePart2[i];
       }
-      else {
-        /* Move filter data into output buffer */
-        dfp = filterCoef+lpc.poleCount;
-        fp1 = coef+NDATA;
-        for (n=0;n<lpc.poleCount; n++)
-          *fp1++ = - (MYFLT) *--dfp;
+    }
+    else {
+      /* Move filter data into output buffer */
+      dfp = filterCoef+lpc->poleCount;
+      fp1 = coef+NDATA;
+      for (n=0;n<lpc->poleCount; n++)
+        *fp1++ = - (MYFLT) *--dfp;
+    }
+    return poleFound;
+}
+
+static uintptr_t lpworker(void *arg)
+{
+    LPWORKER *w = (LPWORKER *) arg;
+    int      k;
+
+    for (k = w->first; k < w->count; k += w->nthreads)
+      w->frames[k].poleFound =
+        lpframe(w->csound, &w->lpc, w->frames[k].sig, w->frames[k].coef,
+                w->storePoles, w->dPI);
+    return 0;
+}
+
+/* analyse the queued frames, then write them out in order */
+
+static int lpflush(CSOUND *csound, LPWORKER *w, int count,
+                   int new_format, FILE *oFd, int ofd, unsigned int osiz)
+{
+    LPC     *lpc = &w[0].lpc;
+    LPFRAME *frames = w[0].frames;
+    void    *threads[MAXLPTHREADS];
+    int     k, nthreads = w[0].nthreads;
+
+    if (count == 0)
+      return 0;
+    if (nthreads > count)
+      nthreads = count;
+    for (k = 0; k < nthreads; k++)
+      w[k].count = count;
+    for (k = 1; k < nthreads; k++)
+      threads[k] = csound->CreateThread(lpworker, &w[k]);
+    lpworker(&w[0]);
+    for (k = 1; k < nthreads; k++) {
+      if (threads[k] != NULL)
+        csound->JoinThread(threads[k]);
+      else
+        lpworker(&w[k]);        /* could not start: do its share here */
+    }
+    for (k = 0; k < count; k++) {
+      MYFLT *coef = frames[k].coef;
+      coef[3] = frames[k].pitch;
+      if (lpc->debug) csound->Message(csound,
+                                      "%d\t%9.4f\t%9.4f\t%9.4f\t%9.4f\n",
+                                      frames[k].counter, coef[0], coef[1],
+                                      coef[2], coef[3]);
+#ifdef TRACE
+      if (lpc->debug) fprintf(trace,"%d\t%9.4f\t%9.4f\t%9.4f\t%9.4f\n",
+                              frames[k].counter,
+                              coef[0], coef[1], coef[2], coef[3]);
+#endif
+#if 0
+      CS_SPRINTF(lpc->pwindow.caption, "pitch: %8.2f", coef[3]);
+      display(csound, &lpc->pwindow);
+#endif
+      if (frames[k].poleFound<lpc->poleCount) {
+        csound->Message(csound,
+                        Str("Found only %d poles...sorry\n"),
+                        frames[k].poleFound);
+        csound->Message(csound,
+                        Str("wanted %d poles\n"), lpc->poleCount);
+        return -1;
       }
 
       /* Write frame to disk */
@@ -729,38 +905,9 @@ static int lpanal(CSOUND *csound, int argc, char **argv)
           fprintf(oFd, "%a\n", coef[j]);
       }
       else
-        if ((nb = write(ofd, (char *)coef, osiz)) != osiz)
+        if (write(ofd, (char *)coef, osiz) != (int) osiz)
           quit(csound, Str("write error"));
-      memcpy(sigbuf, sigbuf2, sizeof(MYFLT)*slice);
-
-      /* Some unused stuff. I think from when all snd was in mem */
-      /*  ( MYFLT *fp2; for (fp1=sigbuf, fp2=sigbuf2, n=slice; n--; ) */
-      /* move slice forward */
-      /*              *fp1++ = *fp2++;} */
-
-      /* Get next sound frame */
-      if ((n = csound->getsndin(csound, infd, sigbuf2, slice, p)) == 0)
-        break;          /* refill til EOF */
-      if (!csound->CheckEvents(csound))
-        return -1;
-    } while (counter < analframes); /* or nsmps done */
-#if 0
-    /* clean up stuff */
-    dispexit(csound);
-#endif
-    csound->Message(csound, Str("%d lpc frames written to %s\n"),
-                            counter, outfilnam);
-    csound->Free(csound, lpc.a);
-    csound->Free(csound, lpc.x);
-    csound->Free(csound, coef);
-    csound->Free(csound, lpg->Dwind_dbuf);
-    for (i=0;  i<FREQS; ++i) {
-      csound->Free(csound, lpg->tphi[i]);
-      csound->Free(csound, lpg->tpsi[i]);
-      csound->Free(csound, lpg->tgamph[i]);
-      csound->Free(csound, lpg->tgamps[i]);
     }
-    csound->Free(csound, lpg);
     return 0;
 }
 
@@ -954,6 +1101,7 @@ static const char *usage_txt[] = {
            " (default 0)"),
   Str_noop("-g\tgraphical display of results"),
   Str_noop("-a\t\talternate (pole) file storage"),
+  Str_noop("-j<threads>\tsolve frames on this many threads (default 1)"),
   Str_noop("-- fname\tLog output to file"),
   Str_noop("see also:  Csound Manual Appendix"),
     NULL
@@ -110,6 +110,34 @@ typedef struct pvocex_ch {
 
 } PVX;
 
+/* A frame on its way through the analysis: the input window is gathered
+   in order, the windowing, FFT and polar conversion can then run on any
+   thread, and the phase differencing against the previous frame of the
+   same channel is done in order again before the frame is written. */
+
+typedef struct pvx_frame {
+        PVX     *pvx;
+        long    nI;             /* input time of the frame centre */
+        MYFLT   *win;           /* 2*analWinLen+1 input samples */
+        MYFLT   *anal;          /* N+2 analysis values */
+        double  *phase;         /* N/2+1 bin phases */
+        float   *frame;         /* output frame, RWD MUST be 32bit */
+} PVXFRAME;
+
+typedef struct pvx_queue {
+        CSOUND  *csound;
+        PVXFRAME *slot;
+        int     nslots, count, nthreads, frametype;
+        int     pvfile, displays;
+        long    chans, blocks_written;
+        void    *disp;
+} PVXQUEUE;
+
+typedef struct pvx_worker {
+        PVXQUEUE *q;
+        int     id;
+} PVXWORKER;
+
 /* prototype arguments */
 
 static  int     pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd,
@@ -117,9 +145,15 @@ static  int     pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd,
                                         long srate, long chans, long fftsize,
                                         long overlap, long winsize,
                                         pv_wtype wintype,
-                                        double beta, int displays);
-static  long    generate_frame(CSOUND*, PVX *pvx, MYFLT *fbuf, float *outanal,
-                                        long samps, int frametype);
+                                        double beta, int displays,
+                                        int nthreads);
+static  long    input_frame(PVX *pvx, const MYFLT *fbuf, long samps,
+                                        MYFLT *win);
+static  void    analyse_frame(CSOUND*, const PVX *pvx, const MYFLT *win,
+                                        long nI, MYFLT *anal, double *phase,
+                                        int frametype);
+static  void    convert_frame(PVX *pvx, MYFLT *anal, const double *phase,
+                                        float *outanal, int frametype);
 static  void    chan_split(CSOUND*, const MYFLT *inbuf, MYFLT **chbuf,
                                     long insize, long chans);
 static  int     init(CSOUND *csound,
@@ -145,6 +179,8 @@ static  int     quit(CSOUND *, char *msg);
 #define MAXPVXCHANS     (8)
 #define DEFAULT_BUFLEN  (8192)  /* per channel */
 #define DISPFRAMES      30
+#define MAXPVXTHREADS   (64)
+#define BATCH_SAMPS     (32768) /* FFT points per thread per batch */
 
 static int pvanal(CSOUND *csound, int argc, char **argv)
 {
@@ -164,6 +200,7 @@ static int pvanal(CSOUND *csound, int argc, char **argv)
     char    err_msg[512];
     double  beta = 6.8;
     int displays = 0;
+    int nthreads = 1;           /* worker threads for the analysis */
 
 
     if (!(--argc))
@@ -224,6 +261,15 @@ static int pvanal(CSOUND *csound, int argc, char **argv)
             break;
           case 'g':  displays = 1;
             break;
+          case 'j':  FIND(Str("no number of threads"));
+            sscanf(s, "%d", &nthreads);
+            if (nthreads < 1 || nthreads > MAXPVXTHREADS) {
+              snprintf(err_msg, 512,
+                       Str("number of threads must be between 1 and %d"),
+                       MAXPVXTHREADS);
+              return quit(csound, err_msg);
+            }
+            break;
           case 'G':  FIND(Str("no latch"));
             sscanf(s, "%d", &latch);
             displays = 1;
@@ -300,7 +346,7 @@ static int pvanal(CSOUND *csound, int argc, char **argv)
     if (pvxanal(csound, p, infd, outfilnam, p->sr,
                         ((!channel || channel == ALLCHNLS) ? p->nchanls : 1),
                         frameSize, frameIncr, frameSize * 2,
-                WindowType, beta, displays) != 0) {
+                WindowType, beta, displays, nthreads) != 0) {
       csound->Message(csound, Str("error generating pvocex file.\n"));
       return -1;
     }
@@ -323,6 +369,7 @@ static const char *pvanal_usage_txt[] = {
   Str_noop("    -H: use Hamming window instead of the default (von Hann)"),
   Str_noop("    -K: use Kaiser window"),
   Str_noop("    -B <beta>: parameter for Kaiser window"),
+  Str_noop("    -j <threads>: analyse frames on this many threads"),
     NULL
 };
 
@@ -398,27 +445,110 @@ static void PVDisplay_Display(PVDISPLAY *p, int frame)
     p->dispFrame++;
 }
 
+/* Analyse the queued frames, splitting them between the calling thread
+   and nthreads-1 helper threads, then convert and write them in order. */
+
+static uintptr_t pvx_worker(void *arg)
+{
+    PVXWORKER   *w = (PVXWORKER *) arg;
+    PVXQUEUE    *q = w->q;
+    int         i;
+
+    for (i = w->id; i < q->count; i += q->nthreads) {
+      PVXFRAME *f = &q->slot[i];
+      analyse_frame(q->csound, f->pvx, f->win, f->nI, f->anal, f->phase,
+                    q->frametype);
+    }
+    return 0;
+}
+
+static int pvx_flush(PVXQUEUE *q)
+{
+    CSOUND      *csound = q->csound;
+    PVXWORKER   w[MAXPVXTHREADS];
+    void        *thread[MAXPVXTHREADS];
+    int         i, nthreads = q->nthreads;
+
+    if (q->count == 0)
+      return 0;
+    if (nthreads > q->count)
+      nthreads = q->count;
+    for (i = 0; i < nthreads; i++) {
+      w[i].q = q;
+      w[i].id = i;
+      thread[i] = NULL;
+    }
+    /* a batch too short for all threads still strides by q->nthreads */
+    for (i = 1; i < nthreads; i++)
+      thread[i] = csound->CreateThread(pvx_worker, &w[i]);
+    for (i = 1; i < nthreads; i++)      /* run a failed thread's share here */
+      if (thread[i] == NULL)
+        pvx_worker(&w[i]);
+    pvx_worker(&w[0]);
+    for (i = 1; i < nthreads; i++)
+      if (thread[i] != NULL)
+        csound->JoinThread(thread[i]);
+
+    for (i = 0; i < q->count; i++) {
+      PVXFRAME *f = &q->slot[i];
+      if (!csound->CheckEvents(csound))
+        csound->LongJmp(csound, 1);
+      convert_frame(f->pvx, f->anal, f->phase, f->frame, q->frametype);
+      if (!csound->PVOC_PutFrames(csound, q->pvfile, f->frame, 1)) {
+        csound->Message(csound,
+                        Str("pvxanal: error writing analysis frames: %s\n"),
+                        csound->PVOC_ErrorString(csound));
+        q->count = 0;
+        return 1;
+      }
+      q->blocks_written++;
+      if (q->displays) PVDisplay_Update((PVDISPLAY *) q->disp, f->frame);
+      if ((q->blocks_written/q->chans) % 20 == 0) {
+        csound->Message(csound, "%ld\n", q->blocks_written/q->chans);
+      }
+      if (q->displays)
+        PVDisplay_Display((PVDISPLAY *) q->disp,
+                          (int) (q->blocks_written / q->chans));
+    }
+    q->count = 0;
+    return 0;
+}
+
+/* take the next hop of input for one channel; the frame is analysed */
+/* once the queue is full                                            */
+
+static int pvx_queue_frame(PVXQUEUE *q, PVX *pvx, const MYFLT *chanbuf,
+                           long samps)
+{
+    PVXFRAME    *f = &q->slot[q->count++];
+
+    f->pvx = pvx;
+    f->nI = input_frame(pvx, chanbuf, samps, f->win);
+    if (q->count < q->nslots)
+      return 0;
+    return pvx_flush(q);
+}
+
 /* Only supports PVOC_AMP_FREQ format for now */
 
 /* cannot add display code, as we may have 8 channels here...*/
 
 static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
                    long srate, long chans, long fftsize, long overlap,
-                   long winsize, pv_wtype wintype, double beta, int displays)
+                   long winsize, pv_wtype wintype, double beta, int displays,
+                   int nthreads)
 {
     int         i, k, pvfile = -1, rc = 0;
     pv_stype    stype = STYPE_16;
     long        buflen, buflen_samps;
     long        sampsread;
-    long        blocks_written = 0;     /* m/c framecount for user */
     PVX         *pvx[MAXPVXCHANS];
     MYFLT       *inbuf_c[MAXPVXCHANS];
-    float       *frame_c[MAXPVXCHANS];  /* RWD : MUST be 32bit  */
     MYFLT       *inbuf = NULL;
-    float       *frame;                 /* RWD : MUST be 32bit  */
     MYFLT       *chanbuf;
     long        total_sampsread = 0;
     PVDISPLAY   disp;
+    PVXQUEUE    q;
 
     switch (p->format) {
       case AE_SHORT:  stype = STYPE_16; break;
@@ -433,8 +563,8 @@ static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
     for (i = 0; i < MAXPVXCHANS; i++) {
       pvx[i] = NULL;
       inbuf_c[i] = NULL;
-      frame_c[i] = NULL;
     }
+    memset(&q, 0, sizeof(PVXQUEUE));
 
     /* TODO: save some memory and create analysis window once! */
 
@@ -451,10 +581,39 @@ static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
     buflen = (buflen/overlap) * overlap;
     buflen_samps = buflen * chans;
     inbuf = (MYFLT *) csound->Malloc(csound, buflen_samps * sizeof(MYFLT));
-    for (i=0;i < chans;i++) {
+    for (i=0;i < chans;i++)
       inbuf_c[i] = (MYFLT *) csound->Malloc(csound, buflen * sizeof(MYFLT));
-      frame_c[i] = (float*) csound->Malloc(csound,      /* RWD 32bit */
-                                           (fftsize + 2) * sizeof(float));
+
+    /* frames are analysed in batches; with one thread a batch is a single
+       frame, which gives the original frame by frame processing */
+    q.csound = csound;
+    q.nthreads = nthreads;
+    q.nslots = 1;
+    if (nthreads > 1) {
+      q.nslots = (int) (BATCH_SAMPS / pvx[0]->N);
+      q.nslots = nthreads * (q.nslots < 1 ? 1 : q.nslots);
+    }
+    q.frametype = PVOC_AMP_FREQ;
+    q.displays = displays;
+    q.disp = &disp;
+    q.chans = chans;
+    q.slot = (PVXFRAME *) csound->Calloc(csound, q.nslots * sizeof(PVXFRAME));
+    for (i = 0; i < q.nslots; i++) {
+      q.slot[i].win = (MYFLT *) csound->Malloc(csound,
+                                  (2 * pvx[0]->analWinLen + 1) * sizeof(MYFLT));
+      q.slot[i].anal = (MYFLT *) csound->Malloc(csound,
+                                  (pvx[0]->N + 2) * sizeof(MYFLT));
+      q.slot[i].phase = (double *) csound->Malloc(csound,
+                                  (pvx[0]->N2 + 1) * sizeof(double));
+      q.slot[i].frame = (float*) csound->Malloc(csound,   /* RWD 32bit */
+                                  (fftsize + 2) * sizeof(float));
+    }
+    if (nthreads > 1) {
+      /* build the FFT tables now, rather than racing to do it in workers */
+      memset(q.slot[0].anal, 0, (pvx[0]->N + 2) * sizeof(MYFLT));
+      csound->RealFFTnp2(csound, q.slot[0].anal, pvx[0]->N);
+      csound->Message(csound, Str("pvanal: analysing on %d threads\n"),
+                      nthreads);
     }
 
     pvfile  = csound->PVOC_CreateFile(csound, fname, fftsize, overlap, chans,
@@ -467,6 +626,7 @@ static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
       rc = 1;
       goto error;
     }
+    q.pvfile = pvfile;
     if(displays)
     PVDisplay_Init(csound, &disp, (int) fftsize,
                    (int) (((long) p->getframes * chans / overlap)
@@ -486,25 +646,12 @@ static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
 
       for (i = 0; i < sampsread/chans; i+= overlap) {
         for (k = 0; k < chans; k++) {
-          frame = frame_c[k];
           chanbuf = inbuf_c[k];
-          if (!csound->CheckEvents(csound))
-            csound->LongJmp(csound, 1);
-          generate_frame(csound, pvx[k],chanbuf+i,frame,overlap,PVOC_AMP_FREQ);
-          if (!csound->PVOC_PutFrames(csound, pvfile, frame, 1)) {
-            csound->Message(csound,
-                            Str("pvxanal: error writing analysis frames: %s\n"),
-                            csound->PVOC_ErrorString(csound));
+          if (pvx_queue_frame(&q, pvx[k], chanbuf+i, overlap)) {
             rc = 1;
             goto error;
           }
-          blocks_written++;
-          if(displays) PVDisplay_Update(&disp, frame);
-          if ((blocks_written/chans) % 20 == 0) {
-            csound->Message(csound, "%ld\n", blocks_written/chans);
         }
-          if(displays) PVDisplay_Display(&disp, (int) (blocks_written / chans));
-      }
       }
       if (total_sampsread >= p->getframes*chans)
         break;
@@ -518,25 +665,19 @@ static int pvxanal(CSOUND *csound, SOUNDIN *p, SNDFILE *fd, const char *fname,
     chan_split(csound,inbuf,inbuf_c,sampsread,chans);
     for (i = 0; i < sampsread/chans; i+= overlap) {
       for (k = 0; k < chans; k++) {
-        frame = frame_c[k];
         chanbuf = inbuf_c[k];
-        if (!csound->CheckEvents(csound))
-          csound->LongJmp(csound, 1);
-        generate_frame(csound,pvx[k],chanbuf+i,frame,overlap,PVOC_AMP_FREQ);
-        if (!csound->PVOC_PutFrames(csound, pvfile, frame, 1)) {
-          csound->Message(csound,
-                          Str("pvxanal: error writing analysis frames: %s\n"),
-                          csound->PVOC_ErrorString(csound));
+        if (pvx_queue_frame(&q, pvx[k], chanbuf+i, overlap)) {
           rc = 1;
           goto error;
         }
-        blocks_written++;
-        if(displays) PVDisplay_Update(&disp, frame);
       }
-      if(displays) PVDisplay_Display(&disp, (int) (blocks_written / chans));
+    }
+    if (pvx_flush(&q)) {
+      rc = 1;
+      goto error;
     }
     csound->Message(csound, Str("\n%ld %d-chan blocks written to %s\n"),
-                    (long) blocks_written / (long) chans, (int) chans, fname);
+                    (long) q.blocks_written / (long) chans, (int) chans, fname);
 
  error:
     if (pvfile >= 0)
@@ -702,19 +843,15 @@ static int init(CSOUND *csound,
 #define MAX(a,b) (a>b ? a : b)
 #define MIN(a,b) (a<b ? a : b)
 
-/* RWD outanal MUST be 32bit */
+/* Stage 1, in order: push the next hop of input into the circular input
+   buffer and gather the samples under the analysis window into win.
+   Returns the input time of the frame. */
 
-static long generate_frame(CSOUND *csound, PVX *pvx,
-                                           MYFLT *fbuf, float *outanal,
-                                           long samps, int frametype)
+static long input_frame(PVX *pvx, const MYFLT *fbuf, long samps, MYFLT *win)
 {
-    int     got, tocp, i, j, k;
-    long    N = pvx->N;
-    MYFLT   *fp, *oi, *i0, *i1, real, imag, *anal, angleDif;
-    double  rratio, phase;
-    float   *ofp;           /* RWD MUST be 32bit */
-
-    anal = pvx->anal;
+    int     got, tocp, i, j;
+    long    nI;
+    const MYFLT *fp;
 
     got = samps;            /* always assume */
     if (got < pvx->Dd)
@@ -742,10 +879,35 @@ static long generate_frame(CSOUND *csound, PVX *pvx,
           pvx->nextIn -= pvx->ibuflen;
       }
 
+    /* the analysis operates on input samples (n - analWinLen) thru
+       (n + analWinLen), found in input[(n +- analWinLen) mod ibuflen] */
+    j = (pvx->nI - pvx->analWinLen-1+pvx->ibuflen)%pvx->ibuflen;  /*input pntr*/
+    for (i = 0; i <= 2 * pvx->analWinLen; i++) {
+      if (++j >= pvx->ibuflen)
+        j -= pvx->ibuflen;
+      win[i] = pvx->input[j];
+    }
+
+    nI = pvx->nI;
+    pvx->nI += pvx->D;                          /* increment time */
+    pvx->Dd = MIN(pvx->D,                       /* CARL */
+                  MAX(0, pvx->D + pvx->nMax - pvx->nI - pvx->analWinLen));
+    return nI;
+}
+
+/* Stage 2, on any thread: only reads the analysis setup in pvx. */
+
+static void analyse_frame(CSOUND *csound, const PVX *pvx, const MYFLT *win,
+                          long nI, MYFLT *anal, double *phase, int frametype)
+{
+    int     i, k;
+    long    N = pvx->N;
+    MYFLT   *i0, *i1, real, imag;
+
     /* analysis: The analysis subroutine computes the complex output at
        time n of (N/2 + 1) of the phase vocoder channels.  It operates
        on input samples (n - analWinLen) thru (n + analWinLen) and
-       expects to find these in input[(n +- analWinLen) mod ibuflen].
+       expects to find these in win[0] thru win[2*analWinLen].
        It expects analWindow to point to the center of a
        symmetric window of length (2 * analWinLen +1).  It is the
        responsibility of the main program to ensure that these values
@@ -759,41 +921,56 @@ static long generate_frame(CSOUND *csound, PVX *pvx,
     /*   *(anal + i) = FL(0.0); */
     memset(anal, 0, sizeof(MYFLT)*(N+2));
 
-    j = (pvx->nI - pvx->analWinLen-1+pvx->ibuflen)%pvx->ibuflen;  /*input pntr*/
-
-    k = pvx->nI - pvx->analWinLen - 1;                  /*time shift*/
+    k = nI - pvx->analWinLen - 1;                       /*time shift*/
     while (k < 0)
       k += N;
     k = k % N;
+    win += pvx->analWinLen;
     for (i = -pvx->analWinLen; i <= pvx->analWinLen; i++) {
-      if (++j >= pvx->ibuflen)
-        j -= pvx->ibuflen;
       if (++k >= N)
         k -= N;
-      *(anal + k) += *(pvx->analWindow + i) * *(pvx->input + j);
+      *(anal + k) += *(pvx->analWindow + i) * *(win + i);
     }
     csound->RealFFTnp2(csound, anal, pvx->N);
     /* conversion: The real and imaginary values in anal are converted to
-       magnitude and angle-difference-per-second (assuming an
-       intermediate sampling rate of rIn) and are returned in
-       anal. */
+       magnitude and phase; the phase difference to the previous frame
+       is taken in convert_frame(). */
     /* only support this format for now, in Csound */
     if (frametype == PVOC_AMP_FREQ) {
-      for (i=0,i0=anal,i1=anal+1,oi=pvx->oldInPhase;
-           i <= pvx->N2;
-           i++,i0+=2,i1+=2, oi++) {
+      for (i=0,i0=anal,i1=anal+1; i <= pvx->N2; i++,i0+=2,i1+=2) {
         real = *i0;
         imag = *i1;
         *i0 =(MYFLT) sqrt((double)(real * real + imag * imag));
+        /* RWD don't mess with v small numbers! */
+        if (*i0 >= FL(1.0E-10))
+          phase[i] = atan2((double)imag,(double)real);
+      }
+    }
+}
+
+/* Stage 3, in order: phase unwrapping against the previous frame of the
+   same channel, and conversion to the 32 bit output frame. */
+
+static void convert_frame(PVX *pvx, MYFLT *anal, const double *phase,
+                          float *outanal, int frametype)
+{
+    int     i;
+    long    N = pvx->N;
+    MYFLT   *fp, *oi, *i0, *i1, angleDif;
+    float   *ofp;           /* RWD MUST be 32bit */
+
+    if (frametype == PVOC_AMP_FREQ) {
+      for (i=0,i0=anal,i1=anal+1,oi=pvx->oldInPhase;
+           i <= pvx->N2;
+           i++,i0+=2,i1+=2, oi++) {
         /* phase unwrapping */
         /*if (*i0 == 0.)*/
         if (*i0 < FL(1.0E-10))        /* RWD don't mess with v small numbers! */
           angleDif = FL(0.0);
 
         else {
-          rratio = atan2((double)imag,(double)real);
-          angleDif  = (MYFLT)((phase = rratio) - *oi);
-          *oi = (MYFLT) phase;
+          angleDif  = (MYFLT)(phase[i] - *oi);
+          *oi = (MYFLT) phase[i];
         }
 
         if (angleDif > PI)
@@ -810,12 +987,6 @@ static long generate_frame(CSOUND *csound, PVX *pvx,
     ofp = outanal;
     for (i=0;i < N+2;i++)
       *ofp++ = (float) *fp++;  /* RWD need 32bit cast incase MYFLT is double */
-
-    pvx->nI += pvx->D;                          /* increment time */
-    pvx->Dd = MIN(pvx->D,                       /* CARL */
-                  MAX(0, pvx->D + pvx->nMax - pvx->nI - pvx->analWinLen));
-
-    return pvx->D;
 }
 
 static void chan_split(CSOUND *csound, const MYFLT *inbuf, MYFLT **chbuf,
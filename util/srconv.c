@@ -39,8 +39,13 @@
  *                    R = input sample rate (must be specified)
  *                    P = input sample rate / output sample rate
  *                    Q = quality factor (1 to 8: default = 2)
+ *                    j = number of files converted at once
  *                    if a time-varying control file is given, it must be last
  *
+ *               given several input files, each is converted to a file of
+ *               the same name with the output rate appended, in the
+ *               directory named by -o if any.
+ *
  *    MODIFIED:  John ffitch December 2000; changes to Csound context
  */
 
@@ -49,9 +54,9 @@
 #include <math.h>
 #include <ctype.h>
 
-#define IBUF    (4096)
-#define IBUF2   (IBUF/2)
+#define IBLK    (2048)          /* input frames read at a time */
 #define OBUF    (4096)
+#define MAXSRCTHREADS (64)
 
 #define FIND(MSG)                                                   \
 {                                                                   \
@@ -140,87 +145,571 @@ static void dieu(CSOUND *csound, char *s)
     usage(csound);
 }
 
-#if 0
-static int srconv(CSOUND *csound, int argc, char **argv)
+ /* this program performs arbitrary sample-rate conversion
+    with high fidelity.  the method is to step through the
+    input at the desired sampling increment, and to compute
+    the output points as appropriately weighted averages of
+    the surrounding input points.  there are two cases to
+    consider: 1) sample rates are in a small-integer ratio -
+    weights are obtained from table, 2) sample rates are in
+    a large-integer ratio - weights are linearly
+    interpolated from table.
+
+    The window is sampled at L*Rin, so the taps used for one output
+    point are every L-th window value starting at its phase.  These
+    are laid out once as a polyphase bank of L+1 rows of ntaps
+    contiguous coefficients, and each output point is then a plain
+    inner product of one row with the input; in case 2 the row is first
+    interpolated from the two neighbouring phases. */
+
+typedef struct {
+    int     L;          /* internal sample rate is L*Rin */
+    int     del;        /* increment at L*Rin, rounded */
+    int     exact;      /* constant ratio with integer del: case 1 */
+    int     wLen;       /* half-length of window at Rin */
+    int     ntaps;      /* taps per output point */
+    MYFLT   fdel;       /* float del */
+    MYFLT   *bank;      /* row o+1 holds the taps for phase o, o = -1..L-1 */
+} SRCFILTER;
+
+typedef struct {
+    int     len;        /* number of (time, ratio) pairs, 0 if constant */
+    MYFLT   *x;         /* times */
+    MYFLT   *y;         /* ratios Rin / Rout */
+    MYFLT   Pmax;       /* largest ratio */
+} SRCWARP;
+
+typedef struct {
+    CSOUND  *csound;
+    OPARMS  *O;
+    char    **infiles;
+    int     nfiles;
+    int     next;       /* next file to convert */
+    int     failed;     /* number of files not converted */
+    char    *outdir;
+    MYFLT   P, Rout;
+    int     Q;
+    SRCWARP *tv;
+    void    *lock;      /* guards next, failed and file opening */
+    volatile int stop;
+} SRCBATCH;
+
+/* make window: the window is the product of a kaiser and a sin(x)/x */
+
+static void srcfilter_make(CSOUND *csound, SRCFILTER *f, MYFLT Rin, MYFLT Rout,
+                           int Q, const SRCWARP *tv)
+{
+    float   *window;
+    MYFLT   sum, beta = FL(6.8), *row;
+    int     L = 120, N = 120, M = 2401, WinLen, i, o, t;
+
+ /* calculate increment: if decimating, then window is impulse response of low-
+    pass filter with cutoff frequency at half of Rout; if interpolating,
+    then window is ipulse response of lowpass filter with cutoff frequency
+    at half of Rin. */
+
+    f->L = L;
+    f->fdel = ((MYFLT) (L * Rin) / Rout);
+    f->del = (int) ((double) f->fdel + 0.5);
+    f->exact = (tv->len == 0 && (MYFLT) f->del == f->fdel);
+    if (f->del > L)
+      N = f->del;
+    if ((Q >= 1) && (Q <= 8))
+      M = Q * N * 10 + 1;
+    if (tv->len)
+      f->fdel = tv->y[0] * L;
+
+    window = (float*) csound->Calloc(csound, (size_t) (M + 2) * sizeof(float));
+    WinLen = (M-1)/2;
+    window += WinLen;
+
+    kaiser(M, window, WinLen, 1, (double) beta);
+
+    for (i = 1; i <= WinLen; i++) {
+      double  tmp = (double) N;
+      tmp = tmp * sin(PI * (double) i / tmp) / (PI * (double) i);
+      window[i] = (float) ((double) window[i] * tmp);
+    }
+
+    if (Rout < Rin)
+      sum = Rout / (Rin * (MYFLT) window[0]);
+    else
+      sum = FL(1.0) / (MYFLT) window[0];
+
+    window[0] = (float) ((double) window[0] * (double) sum);
+    for (i = 1; i <= WinLen; i++) {
+      window[i] = (float) ((double) window[i] * (double) sum);
+      *(window - i) = window[i];
+    }
+
+    window[WinLen + 1] = 0.0f;
+
+    /* tap t of phase o sits at window[(t - wLen) * L - o]; phase -1 is
+       the neighbour of phase 0 used when interpolating */
+    f->wLen = (M/2 - L) / L;
+    f->ntaps = 2 * f->wLen + 2;
+    f->bank = (MYFLT*) csound->Malloc(csound, (size_t) (L + 1) * f->ntaps
+                                               * sizeof(MYFLT));
+    for (o = -1; o < L; o++) {
+      row = f->bank + (o + 1) * f->ntaps;
+      for (t = 0; t < f->ntaps; t++)
+        row[t] = (MYFLT) window[(t - f->wLen) * L - o];
+    }
+    csound->Free(csound, window - WinLen);
+}
+
+/* Inner products are summed into four independent partial sums so that
+   the loops vectorise without reassociating a single running sum. */
+
+static MYFLT src_dot(const MYFLT *h, const MYFLT *x, int n)
+{
+    MYFLT   s0 = FL(0.0), s1 = FL(0.0), s2 = FL(0.0), s3 = FL(0.0);
+    int     t;
+
+    for (t = 0; t + 4 <= n; t += 4) {
+      s0 += h[t] * x[t];
+      s1 += h[t + 1] * x[t + 1];
+      s2 += h[t + 2] * x[t + 2];
+      s3 += h[t + 3] * x[t + 3];
+    }
+    for ( ; t < n; t++)
+      s0 += h[t] * x[t];
+    return (s0 + s1) + (s2 + s3);
+}
+
+/* Interleaved form: all channels of a frame are accumulated together,
+   so every input frame is read once per output point.  Inlined so that
+   the common stereo case gets a constant channel count. */
+
+static inline void src_dotn(const MYFLT *h, const MYFLT *x, int n, int chans,
+                            MYFLT *acc)
+{
+    int     t, c;
+
+    for (c = 0; c < chans; c++)
+      acc[c] = FL(0.0);
+    for (t = 0; t < n; t++, x += chans) {
+      MYFLT hv = h[t];
+      for (c = 0; c < chans; c++)
+        acc[c] += hv * x[c];
+    }
+}
+
+/* Apply the taps h to the frame(s) at x, writing one output frame. */
+
+static inline MYFLT *src_apply(const MYFLT *h, const MYFLT *x, int n,
+                               int chans, MYFLT *acc, MYFLT *out)
+{
+    int     c;
+
+    if (chans == 1) {
+      *out++ = src_dot(h, x, n);
+      return out;
+    }
+    if (chans == 2)
+      src_dotn(h, x, n, 2, acc);
+    else
+      src_dotn(h, x, n, chans, acc);
+    for (c = 0; c < chans; c++)
+      *out++ = acc[c];
+    return out;
+}
+
+/* Convert one opened sound file.  Input frames are kept in a linear
+   buffer of ntaps + IBLK frames, refilled a block at a time.  Returns 0,
+   or -1 if stopped by CheckEvents() or by another thread. */
+
+static int srconv_stream(CSOUND *csound, const SRCFILTER *f, const SRCWARP *tv,
+                         SNDFILE *inf, SOUNDIN *p, SNDFILE *outfd, OPARMS *O,
+                         volatile int *stop, int poll)
 {
     MYFLT
-      *input,     /* pointer to start of input buffer */
-      *output,    /* pointer to start of output buffer */
-      *nextIn,    /* pointer to next empty word in input */
-      *nextOut,   /* pointer to next empty word in output */
-      *fxval = 0, /* pointer to startb of time-array for time-vary function */
-      *fyval = 0, /* pointer to start of P-scale-array for time-vary func */
-      *i0,        /* pointer */
-      *i1;        /* pointer */
+      *input,                   /* input frames base .. base+nin-1 */
+      *output,                  /* output buffer */
+      *nextOut,                 /* next empty word in output */
+      *acc,                     /* per channel sums */
+      *iw,                      /* interpolated window */
+      *x;                       /* first input frame under window */
 
-    float
-      *window,    /* pointer to center of analysis window */
-      *wj,        /* pointer to window */
-      *wj1;       /* pointer to window */
+    const MYFLT
+      *h, *h1;                  /* taps for phases o and o-1 */
 
-    int
-      M = 2401,   /* length of window impulse response */
-      N = 120,    /* length of sinc period */
-      L = 120,    /* internal sample rate is L*Rin */
-      m,          /* current input sample in buffer */
-      o,          /* current input at L*Rin mod L */
-      del,        /* increment */
-      WinLen,     /* half-length of window at L*Rin */
-      wLen,       /* half-length of window at Rin */
-      jMin,       /* initial offset in window */
-      mMax;       /* maximum valid m */
-
-    long
-      n,                        /* current input sample */
-      nMax = 2000000000;        /* last input sample (unless EOF) */
+    int64_t
+      n = 0,                    /* current input sample */
+      base,                     /* input sample held in input[0] */
+      nMax = INT64_MAX;         /* last input sample (once EOF is seen) */
 
     MYFLT
-      beta = FL(6.8),           /* parameter for Kaiser window */
-      sum,                      /* scale factor for renormalizing windows */
-      fdel,                     /* float del */
-      idel,                     /* float del */
-      fo,                       /* float o */
+      fdel = f->fdel,           /* float del */
+      fo = FL(0.0),             /* float o */
       of,                       /* fractional o */
-      fL = (MYFLT) L,           /* float L */
-      iw,                       /* interpolated window */
-      tvx0 = 0,                 /* current x value of time-var function */
-      tvx1 = 0,                 /* next x value of time-var function */
-      tvdx,                     /* tvx1 - tvx0 */
-      tvy0 = 0,                 /* current y value of time-var function */
-      tvy1 = 0,                 /* next y value of time-var function */
-      tvdy,                     /* tvy1 - tvy0 */
-      tvslope = 0,              /* tvdy / tvdx */
+      fL = (MYFLT) f->L,        /* float L */
+      scale = FL(1.0) / csound->Get0dBFS(csound),
+      invRin = FL(1.0) / (MYFLT) p->sr,
       time,                     /* n / Rin */
-      invRin,                   /* 1. / Rin */
+      tvx0 = 0, tvx1 = 0, tvy0 = 0, tvy1 = 0, tvslope = 0;
+
+    int
+      chans = p->nchanls,
+      L = f->L,
+      ntaps = f->ntaps,
+      wLen = f->wLen,
+      o = 0,                    /* current input at L*Rin mod L */
+      nin,                      /* frames held in input */
+      obufsiz,                  /* samples per output write */
+      block = 0,
+      tvflg = (tv->len != 0),
+      tvnxt = 1,
+      i, nread, drop;
+
+    input = (MYFLT*) csound->Calloc(csound, (size_t) (ntaps + IBLK) * chans
+                                             * sizeof(MYFLT));
+    obufsiz = (OBUF / chans) * chans;
+    if (obufsiz == 0)
+      obufsiz = chans;
+    output = (MYFLT*) csound->Calloc(csound, (size_t) obufsiz * sizeof(MYFLT));
+    acc = (MYFLT*) csound->Calloc(csound, (size_t) chans * sizeof(MYFLT));
+    iw = (MYFLT*) csound->Calloc(csound, (size_t) ntaps * sizeof(MYFLT));
+    nextOut = output;
+
+    /* samples before the start of the file are zero */
+    base = -wLen;
+    nin = wLen;
+
+    if (tvflg) {
+      tvx0 = tv->x[0]; tvx1 = tv->x[1];
+      tvy0 = tv->y[0]; tvy1 = tv->y[1];
+      tvslope = (tvy1 - tvy0) / (tvx1 - tvx0);
+    }
+
+    while (1) {
+      /* read until the last tap, sample n+wLen+1, is in the buffer */
+      while (n + wLen + 1 >= base + nin) {
+        if (poll && !csound->CheckEvents(csound))
+          *stop = 1;
+        if (*stop)
+          goto stopped;
+        drop = (int) ((n - wLen) - base);
+        if (drop > nin)
+          drop = nin;
+        if (drop > 0) {
+          memmove(input, input + drop * chans,
+                  (size_t) (nin - drop) * chans * sizeof(MYFLT));
+          base += drop;
+          nin -= drop;
+        }
+        nread = csound->getsndin(csound, inf, input + nin * chans,
+                                 IBLK * chans, p);
+        for (i = 0; i < nread; i++)
+          input[nin * chans + i] *= scale;
+        if (nread < IBLK * chans && nMax == INT64_MAX)
+          nMax = base + nin + nread / chans;
+        nin += IBLK;
+      }
+      if (n >= nMax)
+        break;
+
+      time = n * invRin;
+      x = input + (n - wLen - base) * chans;
+
+      /* case 1:  (Rin / Rout) * 120 = integer  */
+
+      if (f->exact) {
+        nextOut = src_apply(f->bank + (o + 1) * ntaps, x, ntaps, chans,
+                            acc, nextOut);
+
+        /* move window (window advances by del samples at L*Rin sample rate) */
+
+        o += f->del;
+        while (o >= L) {
+          o -= L;
+          n++;
+        }
+      }
+
+      /* case 2: (Rin / Rout) * 120 = non-integer constant */
+
+      else {
+
+        /* apply window (window values are linearly interpolated) */
+
+        o = (int) fo;
+        of = fo - o;
+        h = f->bank + (o + 1) * ntaps;
+        h1 = h - ntaps;
+        for (i = 0; i < ntaps; i++)
+          iw[i] = h[i] + of * (h1[i] - h[i]);
+        nextOut = src_apply(iw, x, ntaps, chans, acc, nextOut);
+
+        /* move window */
+
+        fo += fdel;
+        while (fo >= fL) {
+          fo -= fL;
+          n++;
+        }
+
+        if (tvflg && (time > FL(0.0))) {
+          while (tvflg && (time >= tvx1)) {
+            if (++tvnxt >= tv->len)
+              tvflg = 0;
+            else {
+              tvx0 = tvx1;
+              tvx1 = tv->x[tvnxt];
+              tvy0 = tvy1;
+              tvy1 = tv->y[tvnxt];
+              tvslope = (tvy1 - tvy0) / (tvx1 - tvx0);
+            }
+          }
+          fdel = (MYFLT) L * (tvy0 + tvslope * (time - tvx0));
+        }
+      }
+
+      if (nextOut >= (output + obufsiz)) {
+        nextOut = output;
+        writebuffer(csound, output, &block, outfd, obufsiz, O);
+      }
+    }
+    writebuffer(csound, output, &block, outfd, (int) (nextOut - output), O);
+    csound->Free(csound, iw);
+    csound->Free(csound, acc);
+    csound->Free(csound, output);
+    csound->Free(csound, input);
+    return 0;
+
+ stopped:
+    csound->Free(csound, iw);
+    csound->Free(csound, acc);
+    csound->Free(csound, output);
+    csound->Free(csound, input);
+    return -1;
+}
+
+/* Output rate for a file read at Rin. */
+
+static MYFLT srconv_rate(MYFLT Rin, MYFLT P, MYFLT Rout, const SRCWARP *tv)
+{
+    if (tv->len)
+      return Rin / tv->Pmax;    /* this is min Rout */
+    if (P != FL(0.0))
+      return Rin / P;
+    if (Rout == FL(0.0))
+      return Rin;
+    return Rout;
+}
+
+static SNDFILE *srconv_openout(CSOUND *csound, OPARMS *O, char *outfilename,
+                               MYFLT Rout, int chans, void **fh, char *err_msg)
+{
+    SF_INFO sfinfo;
+    SNDFILE *outfd;
+    char    *name;
+
+    memset(&sfinfo, 0, sizeof(SF_INFO));
+    sfinfo.samplerate = (int) ((double) Rout + 0.5);
+    sfinfo.channels = chans;
+    sfinfo.format = TYPE2SF(O->filetyp) | FORMAT2SF(O->outformat);
+    if (strcmp(outfilename, "stdout") != 0) {
+      name = csound->FindOutputFile(csound, outfilename, "SFDIR");
+      if (name == NULL) {
+        snprintf(err_msg, 256, Str("cannot open %s."), outfilename);
+        return NULL;
+      }
+      outfd = sf_open(name, SFM_WRITE, &sfinfo);
+      if (outfd != NULL)
+        csound->NotifyFileOpened(csound, name,
+                                 csound->type2csfiletype(O->filetyp,
+                                                         O->outformat),
+                                 1, 0);
+      else {
+        snprintf(err_msg, 256, Str("libsndfile error: %s\n"),
+                 sf_strerror(NULL));
+        csound->Free(csound, name);
+        return NULL;
+      }
+      csound->Free(csound, name);
+    }
+    else
+      outfd = sf_open_fd(1, SFM_WRITE, &sfinfo, 1);
+    if (outfd == NULL) {
+      snprintf(err_msg, 256, Str("cannot open %s."), outfilename);
+      return NULL;
+    }
+    /* register file to be closed by csoundReset() */
+    *fh = csound->CreateFileHandle(csound, &outfd, CSFILE_SND_W, outfilename);
+    sf_command(outfd, SFC_SET_CLIPPING, NULL, SF_TRUE);
+    return outfd;
+}
+
+/* In batch mode each output is named after its input, with the output
+   rate added before the extension: dir/name.wav -> outdir/name_48000.wav */
+
+static char *srconv_batchname(CSOUND *csound, SRCBATCH *b, const char *infile,
+                              MYFLT Rout)
+{
+    const char *base, *ext, *s;
+    char    *name;
+    size_t  len;
+
+    base = infile;
+    for (s = infile; *s != '\0'; s++)
+      if (*s == '/' || *s == '\\')
+        base = s + 1;
+    ext = strrchr(base, '.');
+    if (ext == NULL)
+      ext = base + strlen(base);
+    if (b->O->filetyp == TYP_WAV)
+      s = ".wav";
+    else if (b->O->filetyp == TYP_AIFF)
+      s = ".aif";
+    else
+      s = ext;
+    len = (b->outdir != NULL ? strlen(b->outdir) + 1 : (size_t) (base - infile))
+          + strlen(infile) + strlen(s) + 16;
+    name = (char*) csound->Malloc(csound, len);
+    if (b->outdir != NULL)
+      snprintf(name, len, "%s/%.*s_%d%s", b->outdir, (int) (ext - base), base,
+               (int) ((double) Rout + 0.5), s);
+    else
+      snprintf(name, len, "%.*s_%d%s", (int) (ext - infile), infile,
+               (int) ((double) Rout + 0.5), s);
+    return name;
+}
+
+/* Convert files of a batch until none are left.  Opening and closing
+   files goes through the shared file list, so it is done under the
+   batch lock; the conversion itself runs unlocked. */
+
+static void srconv_batch_run(SRCBATCH *b, int poll)
+{
+    CSOUND  *csound = b->csound;
+
+    while (1) {
+      SRCFILTER f;
+      SOUNDIN   *p;
+      SNDFILE   *inf, *outfd;
+      void      *outfh = NULL;
+      MYFLT     beg_time = FL(0.0), input_dur = FL(0.0), sr = FL(0.0), Rout;
+      char      *outname, err_msg[256];
+      int       i, ret;
+
+      csound->LockMutex(b->lock);
+      if (b->stop || b->next >= b->nfiles) {
+        csound->UnlockMutex(b->lock);
+        break;
+      }
+      i = b->next++;
+      if ((inf = csound->SAsndgetset(csound, b->infiles[i], &p, &beg_time,
+                                     &input_dur, &sr, ALLCHNLS)) == NULL) {
+        csound->ErrorMsg(csound, Str("error while opening %s"), b->infiles[i]);
+        b->failed++;
+        csound->UnlockMutex(b->lock);
+        continue;
+      }
+      Rout = srconv_rate((MYFLT) p->sr, b->P, b->Rout, b->tv);
+      outname = srconv_batchname(csound, b, b->infiles[i], Rout);
+      outfd = srconv_openout(csound, b->O, outname, Rout, p->nchanls,
+                             &outfh, err_msg);
+      if (outfd == NULL) {
+        csound->ErrorMsg(csound, "%s", err_msg);
+        csound->FileClose(csound, p->fd);
+        csound->Free(csound, p);
+        csound->Free(csound, outname);
+        b->failed++;
+        csound->UnlockMutex(b->lock);
+        continue;
+      }
+      csound->Message(csound, "%s -> %s\n", b->infiles[i], outname);
+      csound->UnlockMutex(b->lock);
+
+      srcfilter_make(csound, &f, (MYFLT) p->sr, Rout, b->Q, b->tv);
+      ret = srconv_stream(csound, &f, b->tv, inf, p, outfd, b->O,
+                          &b->stop, poll);
+      csound->Free(csound, f.bank);
+
+      csound->LockMutex(b->lock);
+      csound->FileClose(csound, outfh);
+      csound->FileClose(csound, p->fd);
+      csound->Free(csound, p);
+      csound->Free(csound, outname);
+      if (ret != 0)
+        b->failed++;
+      csound->UnlockMutex(b->lock);
+    }
+}
+
+static uintptr_t srconv_thread(void *b)
+{
+    srconv_batch_run((SRCBATCH*) b, 0);
+    return 0;
+}
+
+/* Convert several files, nthreads at a time.  The calling thread takes
+   part and is the only one to poll for events. */
+
+static int srconv_batch(SRCBATCH *b, int nthreads)
+{
+    CSOUND  *csound = b->csound;
+    void    *threads[MAXSRCTHREADS];
+    int     i;
+
+    b->lock = csound->Create_Mutex(0);
+    for (i = 1; i < nthreads; i++)
+      threads[i] = csound->CreateThread(srconv_thread, (void*) b);
+    srconv_batch_run(b, 1);
+    for (i = 1; i < nthreads; i++)
+      if (threads[i] != NULL)
+        csound->JoinThread(threads[i]);
+    csound->DestroyMutex(b->lock);
+    if (b->stop)
+      csound->LongJmp(csound, 1);
+    if (b->failed) {
+      csound->ErrorMsg(csound, Str("srconv: %d of %d files not converted\n"),
+                       b->failed, b->nfiles);
+      return -1;
+    }
+    return 0;
+}
+
+static int srconv(CSOUND *csound, int argc, char **argv)
+{
+    MYFLT
+      *i0,        /* pointer */
+      *i1;        /* pointer */
+
+    MYFLT
       P = FL(0.0),              /* Rin / Rout */
       Rin = FL(0.0),            /* input sampling rate */
       Rout = FL(0.0);           /* output sample rate */
 
     int
-      i,k,                      /* index variables */
-      nread,                    /* number of bytes read */
+      i,                        /* index variables */
       tvflg = 0,                /* flag for time-varying time-scaling */
-      tvnxt = 0,                /* counter for stepping thru time-var func */
-      tvlen,                    /* length of time-varying function */
       Chans = 1,                /* number of channels */
-      chan,                     /* current channel */
+      nfiles = 0,               /* number of input files */
+      nthreads = 1,             /* files converted at once in batch mode */
       Q = 2;                    /* quality factor */
 
+    SRCWARP     tv;             /* time-vary function */
+    SRCFILTER   f;
     FILE        *tvfp = NULL;   /* time-vary function file */
     SOUNDIN     *p;
     int         channel = ALLCHNLS;
     MYFLT       beg_time = FL(0.0), input_dur = FL(0.0), sr = FL(0.0);
-    char        *infile = NULL, *bfile = NULL;
+    char        **infiles, *bfile = NULL;
     SNDFILE     *inf = NULL;
     char        c, *s;
     const char  *envoutyp;
     char        outformch = 's';
     unsigned    outbufsiz = 0U;
     SNDFILE     *outfd = NULL;
+    void        *outfh = NULL;
     OPARMS      O;
-    int         block = 0;
+    volatile int stop = 0;
     char        err_msg[256];
 
+    memset(&O, 0, sizeof(OPARMS));
+    memset(&tv, 0, sizeof(SRCWARP));
     O.outformat = AE_SHORT;
     /* csound->e0dbfs = csound->dbfs_to_float = FL(1.0);*/
 
@@ -239,6 +728,8 @@ static int srconv(CSOUND *csound, int argc, char **argv)
       }
     }
 
+    infiles = (char**) csound->Malloc(csound, (size_t) argc * sizeof(char*));
+
     /* call getopt to interpret commandline */
 
     ++argv;
@@ -327,6 +818,15 @@ static int srconv(CSOUND *csound, int argc, char **argv)
             bfile = s;
             while ((*s++)) {}; s--;
             break;
+          case 'j':
+            FIND(Str("No j argument"))
+            sscanf(s,"%d", &nthreads);
+            if (nthreads < 1 || nthreads > MAXSRCTHREADS) {
+              dieu(csound, Str("number of threads out of range"));
+              return -1;
+            }
+            while (*++s);
+            break;
           default:
             csound->Message(csound, Str("Looking at %c\n"), c);
             usage(csound);    /* this exits with error */
@@ -334,44 +834,23 @@ static int srconv(CSOUND *csound, int argc, char **argv)
           }
         }
       }
-      else if (infile == NULL) {
-        infile = --s;
-        csound->Message(csound, Str("Infile set to %s\n"), infile);
-      }
       else {
-        csound->Message(csound, Str("End with %s\n"), s);
-        usage(csound);
-        return -1;
+        infiles[nfiles++] = --s;
+        csound->Message(csound, Str("Infile set to %s\n"), s);
       }
     }
-    if (infile == NULL) {
+    if (nfiles == 0) {
       csound->Message(csound, Str("No input given\n"));
       usage(csound);
       return -1;
     }
-    if ((inf = csound->SAsndgetset(csound, infile, &p, &beg_time,
-                                   &input_dur, &sr, channel)) == NULL) {
-      csound->ErrorMsg(csound, Str("error while opening %s"), infile);
-      return -1;
-    }
-    if (Rin == FL(0.0))
-      Rin = (MYFLT)p->sr;
-    if (Chans == 0)
-      Chans = (int) p->nchanls;
-    if (Chans == 0)
-      Chans = 1;
 
     if ((P != FL(0.0)) && (Rout != FL(0.0))) {
       strncpy(err_msg, Str("srconv: cannot specify both -r and -P"), 256);
       goto err_rtn_msg;
     }
-    if (P != FL(0.0))
-      Rout = Rin / P;
-    else if (Rout == FL(0.0))
-      Rout = Rin;
 
     if (tvflg) {
-      P = FL(0.0);        /* will be reset to max in time-vary function */
       if ((tvfp = fopen(bfile, "r")) == NULL) {
         strncpy(err_msg,
                 Str("srconv: cannot open time-vary function file"), 256);
@@ -379,17 +858,17 @@ static int srconv(CSOUND *csound, int argc, char **argv)
       }
       /* register file to be closed by csoundReset() */
       (void) csound->CreateFileHandle(csound, &tvfp, CSFILE_STD, bfile);
-      if (UNLIKELY(fscanf(tvfp, "%d", &tvlen) != 1))
+      if (UNLIKELY(fscanf(tvfp, "%d", &tv.len) != 1))
         csound->Message(csound, Str("Read failure\n"));
-      if(tvlen <= 0) {
-            strncpy(err_msg, Str("srconv: tvlen <= 0 "), 256);
-            goto err_rtn_msg;
-       }
-      fxval = (MYFLT*) csound->Malloc(csound, tvlen * sizeof(MYFLT));
-      fyval = (MYFLT*) csound->Malloc(csound, tvlen * sizeof(MYFLT));
-      i0 = fxval;
-      i1 = fyval;
-      for (i = 0; i < tvlen; i++, i0++, i1++) {
+      if (tv.len <= 0) {
+        strncpy(err_msg, Str("srconv: tvlen <= 0 "), 256);
+        goto err_rtn_msg;
+      }
+      tv.x = (MYFLT*) csound->Malloc(csound, tv.len * sizeof(MYFLT));
+      tv.y = (MYFLT*) csound->Malloc(csound, tv.len * sizeof(MYFLT));
+      i0 = tv.x;
+      i1 = tv.y;
+      for (i = 0; i < tv.len; i++, i0++, i1++) {
 #ifdef USE_DOUBLE
         if ((fscanf(tvfp, "%lf %lf", i0, i1)) != 2)
 #else
@@ -400,41 +879,29 @@ static int srconv(CSOUND *csound, int argc, char **argv)
                                  "in time-vary function file"), 256);
             goto err_rtn_msg;
           }
-        if (*i1 > P)
-          P = *i1;
+        if (*i1 > tv.Pmax)
+          tv.Pmax = *i1;
+        if (i > 0 && *i0 <= *(i0 - 1)) {
+          strncpy(err_msg,
+                  Str("srconv: invalid x values in time-vary function"), 256);
+          goto err_rtn_msg;
+        }
+      }
+      if (tv.len < 2) {
+        strncpy(err_msg, Str("srconv: too few x-y pairs "
+                             "in time-vary function file"), 256);
+        goto err_rtn_msg;
       }
-      Rout = Rin / P;    /* this is min Rout */
-      tvx0 = fxval[0];
-      tvx1 = fxval[1];
-      tvy0 = fyval[0];
-      tvy1 = fyval[1];
-      tvdx = tvx1 - tvx0;
-      if (tvx0 != FL(0.0)) {
+      if (tv.x[0] != FL(0.0)) {
         strncpy(err_msg, Str("srconv: first x value "
                              "in time-vary function must be 0"), 256);
         goto err_rtn_msg;
       }
-      if (tvy0 <= FL(0.0)) {
+      if (tv.y[0] <= FL(0.0)) {
         strncpy(err_msg, Str("srconv: invalid initial y value "
                              "in time-vary function"),256);
         goto err_rtn_msg;
       }
-      if (tvdx <= FL(0.0)) {
-        strncpy(err_msg,
-                       Str("srconv: invalid x values in time-vary function"),
-                       256);
-        goto err_rtn_msg;
-      }
-      tvdy = tvy1 - tvy0;
-      tvslope = tvdy / tvdx;
-      tvnxt = 1;
-    }
-    /* This is not right *********  */
-    if (P != FL(0.0)) {
-      csound->SetUtilSr(csound,Rin);
-    }
-    if (P == FL(0.0)) {
-      csound->SetUtilSr(csound,Rout);
     }
 
     if (O.outformat == 0)
@@ -446,6 +913,54 @@ static int srconv(CSOUND *csound, int argc, char **argv)
     }
     else
       O.sfheader = 1;
+
+    if (nfiles > 1) {
+      /* batch mode: -o names the output directory */
+      SRCBATCH  b;
+      int       ret;
+
+      if (O.outfilename != NULL && strcmp(O.outfilename, "stdout") == 0) {
+        strncpy(err_msg, Str("srconv: cannot write several files "
+                             "to stdout"), 256);
+        goto err_rtn_msg;
+      }
+      memset(&b, 0, sizeof(SRCBATCH));
+      b.csound = csound;
+      b.O = &O;
+      b.infiles = infiles;
+      b.nfiles = nfiles;
+      b.outdir = O.outfilename;
+      b.P = P;
+      b.Rout = Rout;
+      b.Q = Q;
+      b.tv = &tv;
+      O.heartbeat = 0;
+      if (nthreads > nfiles)
+        nthreads = nfiles;
+      ret = srconv_batch(&b, nthreads);
+      csound->Free(csound, infiles);
+      if (O.ringbell)
+        csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
+      return ret;
+    }
+
+    if ((inf = csound->SAsndgetset(csound, infiles[0], &p, &beg_time,
+                                   &input_dur, &sr, channel)) == NULL) {
+      csound->ErrorMsg(csound, Str("error while opening %s"), infiles[0]);
+      return -1;
+    }
+    Rin = (MYFLT)p->sr;
+    Rout = srconv_rate(Rin, P, Rout, &tv);
+    if (tvflg)
+      P = tv.Pmax;
+    /* This is not right *********  */
+    if (P != FL(0.0)) {
+      csound->SetUtilSr(csound,Rin);
+    }
+    if (P == FL(0.0)) {
+      csound->SetUtilSr(csound,Rout);
+    }
+
 #ifdef NeXT
     if (O.outfilename == NULL && !O.filetyp)
       O.outfilename = "test.snd";
@@ -461,43 +976,9 @@ static int srconv(CSOUND *csound, int argc, char **argv)
         O.outfilename = "test";
     }
 #endif
-    {
-      SF_INFO sfinfo;
-      char    *name;
-      memset(&sfinfo, 0, sizeof(SF_INFO));
-      sfinfo.samplerate = (int) ((double) Rout + 0.5);
-      sfinfo.channels = (int) p->nchanls;
-      //printf("filetyp=%x outformat=%x\n", O.filetyp, O.outformat);
-      sfinfo.format = TYPE2SF(O.filetyp) | FORMAT2SF(O.outformat);
-      if (strcmp(O.outfilename, "stdout") != 0) {
-        name = csound->FindOutputFile(csound, O.outfilename, "SFDIR");
-        if (name == NULL) {
-          snprintf(err_msg, 256, Str("cannot open %s."), O.outfilename);
-          goto err_rtn_msg;
-        }
-        outfd = sf_open(name, SFM_WRITE, &sfinfo);
-        if (outfd != NULL)
-          csound->NotifyFileOpened(csound, name,
-                                   csound->type2csfiletype(O.filetyp,
-                                                           O.outformat),
-                                   1, 0);
-        else {
-          snprintf(err_msg, 256, Str("libsndfile error: %s\n"), sf_strerror(NULL));
-          goto err_rtn_msg;
-        }
-        csound->Free(csound, name);
-      }
-      else
-        outfd = sf_open_fd(1, SFM_WRITE, &sfinfo, 1);
-      if (outfd == NULL) {
-        snprintf(err_msg, 256, Str("cannot open %s."), O.outfilename);
-        goto err_rtn_msg;
-      }
-      /* register file to be closed by csoundReset() */
-      (void) csound->CreateFileHandle(csound, &outfd, CSFILE_SND_W,
-                                      O.outfilename);
-      sf_command(outfd, SFC_SET_CLIPPING, NULL, SF_TRUE);
-    }
+    if ((outfd = srconv_openout(csound, &O, O.outfilename, Rout,
+                                (int) p->nchanls, &outfh, err_msg)) == NULL)
+      goto err_rtn_msg;
     csound->SetUtilSr(csound, (MYFLT)p->sr);
     csound->SetUtilNchnls(csound, Chans = p->nchanls);
 
@@ -507,243 +988,11 @@ static int srconv(CSOUND *csound, int argc, char **argv)
                     O.outfilename);
     csound->Message(csound, " (%s)\n", csound->type2string(O.filetyp));
 
- /* this program performs arbitrary sample-rate conversion
-    with high fidelity.  the method is to step through the
-    input at the desired sampling increment, and to compute
-    the output points as appropriately weighted averages of
-    the surrounding input points.  there are two cases to
-    consider: 1) sample rates are in a small-integer ratio -
-    weights are obtained from table, 2) sample rates are in
-    a large-integer ratio - weights are linearly
-    interpolated from table.  */
-
- /* calculate increment: if decimating, then window is impulse response of low-
-    pass filter with cutoff frequency at half of Rout; if interpolating,
-    then window is ipulse response of lowpass filter with cutoff frequency
-    at half of Rin. */
-
-    fdel = ((MYFLT) (L * Rin) / Rout);
-    del = (int) ((double) fdel + 0.5);
-    idel = (MYFLT) del;
-    if (del > L)
-      N = del;
-    if ((Q >= 1) && (Q <= 8))
-      M = Q * N * 10 + 1;
-    if (tvflg)
-      fdel = tvy0 * L;
-
-    invRin  =  FL(1.0) / Rin;
-
-    /* make window: the window is the product of a kaiser and a sin(x)/x */
-    window = (float*) csound->Calloc(csound, (size_t) (M + 2) * sizeof(float));
-    WinLen = (M-1)/2;
-    window += WinLen;
-    wLen = (M/2 - L) / L;
-
-    kaiser(M, window, WinLen, 1, (double) beta);
-
-    for (i = 1; i <= WinLen; i++) {
-      double  tmp = (double) N;
-      tmp = tmp * sin(PI * (double) i / tmp) / (PI * (double) i);
-      window[i] = (float) ((double) window[i] * tmp);
-    }
-
-    if (Rout < Rin) {
-#if 0
-      sum = (MYFLT) window[0];
-      for (i = L-1; i <= WinLen; i += L)
-        sum += (MYFLT) window[i];
-      sum = FL(2.0) / sum;
-#else
-      sum = Rout / (Rin * (MYFLT) window[0]);
-#endif
-    }
-    else
-      sum = FL(1.0) / (MYFLT) window[0];
-
-    window[0] = (float) ((double) window[0] * (double) sum);
-    for (i = 1; i <= WinLen; i++) {
-      window[i] = (float) ((double) window[i] * (double) sum);
-      *(window - i) = window[i];
-    }
-
-    window[WinLen + 1] = 0.0f;
-
- /* set up input buffer:  nextIn always points to the next empty
-    word in the input buffer.  If the buffer is full, then
-    nextIn jumps back to the beginning, and the old values
-    are written over. */
-
-    input = (MYFLT*) csound->Calloc(csound, (size_t) IBUF * sizeof(MYFLT));
-
- /* set up output buffer:  nextOut always points to the next empty
-    word in the output buffer.  If the buffer is full, then
-    it is flushed, and nextOut jumps back to the beginning. */
-
-    output = (MYFLT*) csound->Calloc(csound, (size_t) OBUF * sizeof(MYFLT));
-    nextOut = output;
-
- /* initialization: */
-
-    nread = csound->getsndin(csound, inf, input, IBUF2, p);
-    for(i=0; i < nread; i++)
-       input[i] *= 1.0/csound->Get0dBFS(csound);
-    nMax = (long)(input_dur * p->sr);
-    nextIn = input + nread;
-    for (i = nread; i < IBUF2; i++)
-      *(nextIn++) = FL(0.0);
-    jMin = -(wLen + 1) * L;
-    mMax = IBUF2;
-    o = n = m = 0;
-    fo = FL(0.0);
-
- /* main loop:   If nMax is not specified it is assumed to be very large
-    and then readjusted when read detects the end of input. */
-
-    while (n < nMax) {
-
-      time = n * invRin;
-
-      /* case 1:  (Rin / Rout) * 120 = integer  */
-
-      if ((tvflg == 0) && (idel == fdel)) {
-        /* apply window (window is sampled at L * Rin) */
-
-        for (chan = 0; chan < Chans; chan++) {
-          *nextOut = FL(0.0);
-          k = Chans * (m - wLen) + chan - Chans;
-          if (k < 0)
-            k += IBUF;
-          wj = window + jMin - o;
-          for (i = -wLen; i <= wLen+1; i++){
-            wj += L;
-            k += Chans;
-            if (k >= IBUF)
-              k -= IBUF;
-            *nextOut += (MYFLT) *wj * *(input + k);
-          }
-          nextOut++;
-          if (nextOut >= (output + OBUF)) {
-            nextOut = output;
-            writebuffer(csound, output, &block, outfd, OBUF, &O);
-          }
-        }
-
-        /* move window (window advances by del samples at L*Rin sample rate) */
-
-        o += del;
-        while (o >= L) {
-          o -= L;
-          n++;
-          m++;
-          if ((Chans * (m + wLen + 1)) >= mMax) {
-            if (!csound->CheckEvents(csound))
-              csound->LongJmp(csound, 1);
-            mMax += IBUF2;
-            if (nextIn >= (input + IBUF))
-              nextIn = input;
-            nread = csound->getsndin(csound, inf, nextIn, IBUF2, p);
-            for(i=0; i < nread; i++)
-               input[i] *= 1.0/csound->Get0dBFS(csound);
-            nextIn += nread;
-            if (nread < IBUF2)
-              nMax = n + wLen + (nread / Chans) + 1;
-            for (i = nread; i < IBUF2; i++)
-              *(nextIn++) = FL(0.0);
-          }
-          if ((Chans * m) >= IBUF) {
-            m = 0;
-            mMax = IBUF2;
-          }
-        }
-      }
-
-      /* case 2: (Rin / Rout) * 120 = non-integer constant */
-
-      else {
-
-        /* apply window (window values are linearly interpolated) */
-
-        for (chan = 0; chan < Chans; chan++) {
-          *nextOut = FL(0.0);
-          o = (int)fo;
-          of = fo - o;
-          wj = window + jMin - o;
-          wj1 = wj + 1;
-          k = Chans * (m - wLen) + chan - Chans;
-          if (k < 0)
-            k += IBUF;
-          for (i = -wLen; i <= wLen+1; i++) {
-            wj += L;
-            wj1 += L;
-            k += Chans;
-            if (k >= IBUF)
-              k -= IBUF;
-            iw = (MYFLT) *wj + of * ((MYFLT) *wj1 - (MYFLT) *wj);
-            *nextOut += iw * *(input + k);
-          }
-          nextOut++;
-          if (nextOut >= (output + OBUF)) {
-            nextOut = output;
-            writebuffer(csound, output, &block, outfd, OBUF, &O);
-          }
-        }
-
-        /* move window */
-
-        fo += fdel;
-        while (fo >= fL) {
-          fo -= fL;
-          n++;
-          m++;
-          if ((Chans * (m + wLen + 1)) >= mMax) {
-            if (!csound->CheckEvents(csound))
-              csound->LongJmp(csound, 1);
-            mMax += IBUF2;
-            if (nextIn >= (input + IBUF))
-              nextIn = input;
-            nread = csound->getsndin(csound, inf, nextIn, IBUF2, p);
-            for(i=0; i < nread; i++)
-               input[i] *= 1.0/csound->Get0dBFS(csound);
-            nextIn += nread;
-            if (nread < IBUF2)
-              nMax = n + wLen + (nread / Chans) + 1;
-            for (i = nread; i < IBUF2; i++)
-              *(nextIn++) = FL(0.0);
-          }
-          if ((Chans * m) >= IBUF) {
-            m = 0;
-            mMax = IBUF2;
-          }
-        }
-
-        if (tvflg && (time > FL(0.0))) {
-          while (tvflg && (time >= tvx1)) {
-            if (++tvnxt >= tvlen)
-              tvflg = 0;
-            else {
-              tvx0 = tvx1;
-              tvx1 = fxval[tvnxt];
-              tvy0 = tvy1;
-              tvy1 = fyval[tvnxt];
-              tvdx = tvx1 - tvx0;
-              if (tvdx <= FL(0.0)) {
-                strncpy(err_msg, Str("srconv: invalid x values "
-                                     "in time-vary function"), 256);
-                goto err_rtn_msg;
-              }
-              tvdy = tvy1 - tvy0;
-              tvslope = tvdy / tvdx;
-            }
-          }
-          P = tvy0 + tvslope * (time - tvx0);
-          fdel = (MYFLT) L * P;
-        }
-      }
-
-    }
-    nread = nextOut - output;
-    writebuffer(csound, output, &block, outfd, nread, &O);
+    srcfilter_make(csound, &f, Rin, Rout, Q, &tv);
+    if (srconv_stream(csound, &f, &tv, inf, p, outfd, &O, &stop, 1) != 0)
+      csound->LongJmp(csound, 1);
+    csound->Free(csound, f.bank);
+    csound->Free(csound, infiles);
     csound->Message(csound, "\n\n");
     if (O.ringbell)
       csound->MessageS(csound, CSOUNDMSG_REALTIME, "\a");
@@ -753,22 +1002,17 @@ static int srconv(CSOUND *csound, int argc, char **argv)
     csound->ErrorMsg(csound, err_msg);
     return -1;
 }
-#else
-static int srconv(CSOUND *csound, int argc, char **argv)
-{
-    csound->Message(csound, Str("Do not use srconv but the src_conv program\n"));
-    return execv("src_conv", argv);
-}
-#endif
 
 static const char *usage_txt[] = {
-  Str_noop("usage: srconv [flags] infile\n\nflags:"),
+  Str_noop("usage: srconv [flags] infile [infile ...]\n\nflags:"),
   Str_noop("-P num\tpitch transposition ratio (srate/r) [do not specify "
            "both P and r]"),
   Str_noop("-Q num\tquality factor (1 to 8: default = 2)"),
   Str_noop("-i filnam\tbreak file"),
+  Str_noop("-j num\tnumber of files to convert at once (several infiles)"),
   Str_noop("-r num\toutput sample rate (must be specified)"),
-  Str_noop("-o fnam\tsound output filename\n"),
+  Str_noop("-o fnam\tsound output filename (output directory if several "
+           "infiles)\n"),
   Str_noop("-A\tcreate an AIFF format output soundfile"),
   Str_noop("-J\tcreate an IRCAM format output soundfile"),
   Str_noop("-W\tcreate a WAV format output soundfile"),